@@ -55,7 +55,7 @@ from .database import Database
 from .directory import Directory
 from .filenames import Filenames
 from .message import Message
-from .messages import Messages
+from .messages import Messages, MessageInfo
 from .query import Query
 from .tag import Tags
 from .thread import Thread
@@ -17,7 +17,7 @@ along with notmuch.  If not, see <http://www.gnu.org/licenses/>.
 Copyright 2010 Sebastian Spaeth <Sebastian@SSpaeth.de>
 """
 
-from ctypes import CDLL, Structure, POINTER
+from ctypes import CDLL, Structure, POINTER, c_char_p, c_long, c_uint
 from version import SOVERSION
 
 #-----------------------------------------------------------------------------
@@ -83,3 +83,13 @@ NotmuchDirectoryP = POINTER(NotmuchDirectoryS)
 class NotmuchFilenamesS(Structure):
     pass
 NotmuchFilenamesP = POINTER(NotmuchFilenamesS)
+
+
+class NotmuchMessageInfoS(Structure):
+    _fields_ = [('message_id', c_char_p),
+                ('thread_id', c_char_p),
+                ('date', c_long),
+                ('flags', c_uint),
+                ('num_tags', c_uint),
+                ('tags', POINTER(c_char_p))]
+NotmuchMessageInfoP = POINTER(NotmuchMessageInfoS)
@@ -18,19 +18,34 @@ Copyright 2010 Sebastian Spaeth <Sebastian@SSpaeth.de>
                Jesse Rosenthal <jrosenthal@jhu.edu>
 """
 
+from collections import namedtuple
+from ctypes import byref, c_uint, POINTER
 from .globals import (
     nmlib,
     NotmuchTagsP,
     NotmuchMessageP,
     NotmuchMessagesP,
+    NotmuchMessageInfoS,
+    NotmuchMessageInfoP,
 )
 from .errors import (
+    STATUS,
+    NotmuchError,
     NullPointerError,
     NotInitializedError,
 )
 from .tag import Tags
 from .message import Message
 
+class MessageInfo(namedtuple('MessageInfo', ['message_id', 'thread_id',
+                                             'date', 'flags', 'tags'])):
+    """The properties of one message, as returned by :meth:`Messages.get_info`
+
+    *flags* has bit ``1 << flag`` set for each :attr:`Message.FLAG`
+    that is set on the message, and *tags* is a list of strings.
+    """
+    __slots__ = ()
+
 class Messages(object):
     """Represents a list of notmuch messages
 
@@ -144,6 +159,66 @@ class Messages(object):
             raise NullPointerError()
         return Tags(tags_p, self)
 
+    _get_info = nmlib.notmuch_messages_get_info
+    _get_info.argtypes = [NotmuchMessagesP, NotmuchMessageInfoP, c_uint,
+                          POINTER(c_uint)]
+    _get_info.restype = c_uint
+
+    def get_info(self, count=256):
+        """Return the properties of up to *count* of the next messages
+
+        This gives the same results as iterating over the messages and
+        calling :meth:`Message.get_message_id`,
+        :meth:`Message.get_thread_id`, :meth:`Message.get_date`,
+        :meth:`Message.get_flag` and :meth:`Message.get_tags` on each,
+        but retrieves all of them with a single call into the library,
+        which is much faster for large results.
+
+        The messages are consumed like with the iterator: a later call
+        or iteration continues with the message after the last one
+        returned.
+
+        :param count: The maximum number of messages to return.
+        :returns: A list of :class:`MessageInfo`, which is shorter than
+                  *count* (and empty) only once the messages are
+                  exhausted.
+        :raises: :exc:`NotInitializedError` if the messages were
+                 already exhausted, :exc:`NotmuchError` on errors.
+        """
+        if not self._msgs:
+            raise NotInitializedError()
+
+        info = (NotmuchMessageInfoS * count)()
+        filled = c_uint(0)
+        status = Messages._get_info(self._msgs, info, count, byref(filled))
+
+        result = []
+        for i in range(filled.value):
+            item = info[i]
+            result.append(MessageInfo(
+                item.message_id.decode('utf-8', 'ignore'),
+                item.thread_id.decode('utf-8', 'ignore'),
+                item.date,
+                item.flags,
+                [item.tags[j].decode('UTF-8') for j in range(item.num_tags)]))
+
+        if status != STATUS.SUCCESS:
+            raise NotmuchError(status)
+
+        if filled.value < count:
+            self._msgs = None
+        return result
+
+    def iter_info(self, batch=256):
+        """Iterate over the remaining messages as :class:`MessageInfo`
+
+        The messages are retrieved *batch* at a time with
+        :meth:`get_info`.
+        """
+        while self._msgs:
+            for info in self.get_info(batch):
+                yield info
+
     def __iter__(self):
         """ Make Messages an iterator """
         return self
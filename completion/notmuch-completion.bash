@@ -259,7 +259,7 @@ _notmuch_reply()
     $split &&
     case "${prev}" in
 	--format)
-	    COMPREPLY=( $( compgen -W "default json sexp headers-only" -- "${cur}" ) )
+	    COMPREPLY=( $( compgen -W "default json sexp cbor headers-only" -- "${cur}" ) )
 	    return
 	    ;;
 	--reply-to)
@@ -308,6 +308,29 @@ _notmuch_restore()
     esac
 }
 
+_notmuch_serve()
+{
+    local cur prev words cword split
+    _init_completion -s || return
+
+    $split &&
+    case "${prev}" in
+	--socket)
+	    _filedir
+	    return
+	    ;;
+    esac
+
+    ! $split &&
+    case "${cur}" in
+	-*)
+	    local options="--socket="
+	    compopt -o nospace
+	    COMPREPLY=( $(compgen -W "$options" -- ${cur}) )
+	    ;;
+    esac
+}
+
 _notmuch_search()
 {
     local cur prev words cword split
@@ -316,7 +339,7 @@ _notmuch_search()
     $split &&
     case "${prev}" in
 	--format)
-	    COMPREPLY=( $( compgen -W "json sexp text text0" -- "${cur}" ) )
+	    COMPREPLY=( $( compgen -W "json sexp cbor text text0" -- "${cur}" ) )
 	    return
 	    ;;
 	--output)
@@ -336,7 +359,7 @@ _notmuch_search()
     ! $split &&
     case "${cur}" in
 	-*)
-	    local options="--format= --output= --sort= --offset= --limit= --exclude= --duplicate="
+	    local options="--format= --output= --sort= --offset= --limit= --exclude= --duplicate= --jobs="
 	    compopt -o nospace
 	    COMPREPLY=( $(compgen -W "$options" -- ${cur}) )
 	    ;;
@@ -354,7 +377,7 @@ _notmuch_address()
     $split &&
     case "${prev}" in
 	--format)
-	    COMPREPLY=( $( compgen -W "json sexp text text0" -- "${cur}" ) )
+	    COMPREPLY=( $( compgen -W "json sexp cbor text text0" -- "${cur}" ) )
 	    return
 	    ;;
 	--output)
@@ -396,7 +419,7 @@ _notmuch_show()
 	    return
 	    ;;
 	--format)
-	    COMPREPLY=( $( compgen -W "text json sexp mbox raw" -- "${cur}" ) )
+	    COMPREPLY=( $( compgen -W "text json sexp cbor mbox raw" -- "${cur}" ) )
 	    return
 	    ;;
 	--exclude|--body)
@@ -435,7 +458,7 @@ _notmuch_tag()
     ! $split &&
     case "${cur}" in
 	--*)
-	    local options="--batch --input= --remove-all"
+	    local options="--batch --input= --remove-all --transaction-size="
 	    compopt -o nospace
 	    COMPREPLY=( $(compgen -W "$options" -- ${cur}) )
 	    return
@@ -457,7 +480,7 @@ _notmuch_tag()
 
 _notmuch()
 {
-    local _notmuch_commands="compact config count dump help insert new reply restore search address setup show tag"
+    local _notmuch_commands="compact config count dump help insert new reply restore search address serve setup show tag"
     local arg cur prev words cword split
 
     # require bash-completion with _init_completion
@@ -110,6 +110,10 @@ man_pages = [
         u'syntax for notmuch queries',
         [u'Carl Worth and many others'], 7),
 
+('man1/notmuch-serve','notmuch-serve',
+        u'run notmuch commands from a long-running server',
+        [u'Carl Worth and many others'], 1),
+
 ('man1/notmuch-show','notmuch-show',
         u'show messages matching the given search terms',
         [u'Carl Worth and many others'], 1),
@@ -174,6 +178,9 @@ texinfo_documents = [
 ('man7/notmuch-search-terms','notmuch-search-terms',u'notmuch Documentation',
       u'Carl Worth and many others', 'notmuch-search-terms',
       'syntax for notmuch queries','Miscellaneous'),
+('man1/notmuch-serve','notmuch-serve',u'notmuch Documentation',
+      u'Carl Worth and many others', 'notmuch-serve',
+      'run notmuch commands from a long-running server','Miscellaneous'),
 ('man1/notmuch-show','notmuch-show',u'notmuch Documentation',
       u'Carl Worth and many others', 'notmuch-show',
       'show messages matching the given search terms','Miscellaneous'),
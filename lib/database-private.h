@@ -100,6 +100,21 @@ enum _notmuch_features {
      *
      * Introduced: version 3. */
     NOTMUCH_FEATURE_INDEXED_MIMETYPES = 1 << 5,
+
+    /* If set, a summary record of each thread is kept in database
+     * metadata and updated whenever one of its messages is written.
+     * If unset, thread summaries are computed from the messages.
+     *
+     * Introduced: version 3. */
+    NOTMUCH_FEATURE_THREAD_SUMMARIES = 1 << 6,
+
+    /* If set, the author shown in thread summaries is stored in a
+     * message document value.  If unset, message documents *may*
+     * have this value, but if the value is empty, it must be
+     * computed from the From header.
+     *
+     * Introduced: version 3. */
+    NOTMUCH_FEATURE_AUTHOR_VALUES = 1 << 7,
 };
 
 /* In C++, a named enum is its own type, so define bitwise operators
@@ -162,6 +177,17 @@ struct _notmuch_database {
     Xapian::TermGenerator *term_gen;
     Xapian::ValueRangeProcessor *value_range_processor;
     Xapian::ValueRangeProcessor *date_range_processor;
+
+    /* Metadata read from the term lists of message documents, keyed
+     * by document ID and dropped when a document is written (see
+     * message.cc).  May be NULL. */
+    GHashTable *message_cache;
+
+    /* Directory paths keyed by document ID, and directory document
+     * IDs keyed by path, filled as directories are looked up (see
+     * database.cc).  Either may be NULL. */
+    GHashTable *directory_paths;
+    GHashTable *directory_ids;
 };
 
 /* Prior to database version 3, features were implied by the database
@@ -173,13 +199,15 @@ struct _notmuch_database {
 
 /* Current database features.  If any of these are missing from a
  * database, request an upgrade.
- * NOTMUCH_FEATURE_FROM_SUBJECT_ID_VALUES and
- * NOTMUCH_FEATURE_INDEXED_MIMETYPES are not included because upgrade
+ * NOTMUCH_FEATURE_FROM_SUBJECT_ID_VALUES,
+ * NOTMUCH_FEATURE_INDEXED_MIMETYPES and
+ * NOTMUCH_FEATURE_AUTHOR_VALUES are not included because upgrade
  * doesn't currently introduce the features (though brand new databases
  * will have it). */
 #define NOTMUCH_FEATURES_CURRENT \
     (NOTMUCH_FEATURE_FILE_TERMS | NOTMUCH_FEATURE_DIRECTORY_DOCS | \
-     NOTMUCH_FEATURE_BOOL_FOLDER | NOTMUCH_FEATURE_GHOSTS)
+     NOTMUCH_FEATURE_BOOL_FOLDER | NOTMUCH_FEATURE_GHOSTS | \
+     NOTMUCH_FEATURE_THREAD_SUMMARIES)
 
 /* Return the list of terms from the given iterator matching a prefix.
  * The prefix will be stripped from the strings in the returned list.
@@ -192,6 +220,23 @@ _notmuch_database_get_terms_with_prefix (void *ctx, Xapian::TermIterator &i,
 					 Xapian::TermIterator &end,
 					 const char *prefix);
 
+/* Return the query string stored under 'name' (without the "query:"
+ * prefix), or NULL if there is none.
+ *
+ * Xapian exceptions are not caught.
+ */
+char *
+_notmuch_database_get_named_query (void *ctx,
+				   notmuch_database_t *notmuch,
+				   const char *name);
+
+/* thread-summary.cc */
+
+notmuch_thread_summary_entry_t *
+_notmuch_thread_summary_entry_create (void *ctx,
+				      notmuch_database_t *notmuch,
+				      const Xapian::Document &doc);
+
 #pragma GCC visibility pop
 
 #endif
@@ -28,6 +28,7 @@
 #include <sys/stat.h>
 #include <signal.h>
 #include <ftw.h>
+#include <pthread.h>
 
 #include <glib.h> /* g_free, GPtrArray, GHashTable */
 #include <glib-object.h> /* g_type_init */
@@ -181,6 +182,19 @@ typedef struct {
  *			generated is 1 and the value will be
  *			incremented for each thread ID.
  *
+ *	thread_summary.*
+ *			The summary of a thread: its message count,
+ *			oldest subject, authors and tags. The thread
+ *			ID follows the "thread_summary." prefix.
+ *			Present only if
+ *			NOTMUCH_FEATURE_THREAD_SUMMARIES. See
+ *			thread-summary.cc for the format.
+ *
+ *	named_query.*	A query string saved by the user. The name of
+ *			the query follows the "named_query." prefix, and
+ *			query strings may refer to it with the
+ *			"query:" prefix.
+ *
  * Obsolete metadata
  * -----------------
  *
@@ -310,6 +324,14 @@ static const struct {
      * them. */
     { NOTMUCH_FEATURE_INDEXED_MIMETYPES,
       "indexed MIME types", "w"},
+    /* Readers can always fall back to loading the messages of a
+     * thread, but writers must keep the summaries up to date. */
+    { NOTMUCH_FEATURE_THREAD_SUMMARIES,
+      "thread summaries", "w"},
+    /* Author values are not required for reading a database because
+     * a reader can just parse the From header. */
+    { NOTMUCH_FEATURE_AUTHOR_VALUES,
+      "author in database", "w"},
 };
 
 const char *
@@ -342,6 +364,8 @@ notmuch_status_to_string (notmuch_status_t status)
 	return "Unsupported operation";
     case NOTMUCH_STATUS_UPGRADE_REQUIRED:
 	return "Operation requires a database upgrade";
+    case NOTMUCH_STATUS_ILLEGAL_ARGUMENT:
+	return "Illegal argument for function";
     default:
     case NOTMUCH_STATUS_LAST_STATUS:
 	return "Unknown error status value";
@@ -694,6 +718,8 @@ notmuch_database_create_verbose (const char *path,
      * new databases have them. */
     notmuch->features |= NOTMUCH_FEATURE_FROM_SUBJECT_ID_VALUES;
     notmuch->features |= NOTMUCH_FEATURE_INDEXED_MIMETYPES;
+    notmuch->features |= NOTMUCH_FEATURE_THREAD_SUMMARIES;
+    notmuch->features |= NOTMUCH_FEATURE_AUTHOR_VALUES;
 
     status = notmuch_database_upgrade (notmuch, NULL, NULL);
     if (status) {
@@ -825,6 +851,57 @@ notmuch_database_open (const char *path,
     return status;
 }
 
+static pthread_once_t _notmuch_init_once = PTHREAD_ONCE_INIT;
+
+static void
+_notmuch_init_libraries (void)
+{
+    /* Initialize the GLib type system and threads */
+#if !GLIB_CHECK_VERSION(2, 35, 1)
+    g_type_init ();
+#endif
+
+    g_mime_init (GMIME_ENABLE_RFC2047_WORKAROUNDS);
+}
+
+void
+_notmuch_init (void)
+{
+    pthread_once (&_notmuch_init_once, _notmuch_init_libraries);
+}
+
+/* Create the query parser and term generator of a newly opened
+ * database.  Xapian exceptions are not caught. */
+static void
+_notmuch_database_setup_parsers (notmuch_database_t *notmuch)
+{
+    unsigned int i;
+
+    notmuch->query_parser = new Xapian::QueryParser;
+    notmuch->term_gen = new Xapian::TermGenerator;
+    notmuch->term_gen->set_stemmer (Xapian::Stem ("english"));
+    notmuch->value_range_processor = new Xapian::NumberValueRangeProcessor (NOTMUCH_VALUE_TIMESTAMP);
+    notmuch->date_range_processor = new ParseTimeValueRangeProcessor (NOTMUCH_VALUE_TIMESTAMP);
+
+    notmuch->query_parser->set_default_op (Xapian::Query::OP_AND);
+    notmuch->query_parser->set_database (*notmuch->xapian_db);
+    notmuch->query_parser->set_stemmer (Xapian::Stem ("english"));
+    notmuch->query_parser->set_stemming_strategy (Xapian::QueryParser::STEM_SOME);
+    notmuch->query_parser->add_valuerangeprocessor (notmuch->value_range_processor);
+    notmuch->query_parser->add_valuerangeprocessor (notmuch->date_range_processor);
+
+    for (i = 0; i < ARRAY_SIZE (BOOLEAN_PREFIX_EXTERNAL); i++) {
+	prefix_t *prefix = &BOOLEAN_PREFIX_EXTERNAL[i];
+	notmuch->query_parser->add_boolean_prefix (prefix->name,
+						   prefix->prefix);
+    }
+
+    for (i = 0; i < ARRAY_SIZE (PROBABILISTIC_PREFIX); i++) {
+	prefix_t *prefix = &PROBABILISTIC_PREFIX[i];
+	notmuch->query_parser->add_prefix (prefix->name, prefix->prefix);
+    }
+}
+
 notmuch_status_t
 notmuch_database_open_verbose (const char *path,
 			       notmuch_database_mode_t mode,
@@ -838,8 +915,7 @@ notmuch_database_open_verbose (const char *path,
     char *message = NULL;
     struct stat st;
     int err;
-    unsigned int i, version;
-    static int initialized = 0;
+    unsigned int version;
 
     if (path == NULL) {
 	message = strdup ("Error: Cannot open a database for a NULL path.\n");
@@ -867,16 +943,11 @@ notmuch_database_open_verbose (const char *path,
 	goto DONE;
     }
 
-    /* Initialize the GLib type system and threads */
-#if !GLIB_CHECK_VERSION(2, 35, 1)
-    g_type_init ();
-#endif
+    _notmuch_init ();
 
-    /* Initialize gmime */
-    if (! initialized) {
-	g_mime_init (GMIME_ENABLE_RFC2047_WORKAROUNDS);
-	initialized = 1;
-    }
+    /* Start the profile clock, so that every process opening a
+     * database writes a report when NOTMUCH_PROFILE is set. */
+    (void) _notmuch_profile_enabled ();
 
     notmuch = talloc_zero (NULL, notmuch_database_t);
     notmuch->exception_reported = FALSE;
@@ -948,29 +1019,7 @@ notmuch_database_open_verbose (const char *path,
 		INTERNAL_ERROR ("Malformed database last_thread_id: %s", str);
 	}
 
-	notmuch->query_parser = new Xapian::QueryParser;
-	notmuch->term_gen = new Xapian::TermGenerator;
-	notmuch->term_gen->set_stemmer (Xapian::Stem ("english"));
-	notmuch->value_range_processor = new Xapian::NumberValueRangeProcessor (NOTMUCH_VALUE_TIMESTAMP);
-	notmuch->date_range_processor = new ParseTimeValueRangeProcessor (NOTMUCH_VALUE_TIMESTAMP);
-
-	notmuch->query_parser->set_default_op (Xapian::Query::OP_AND);
-	notmuch->query_parser->set_database (*notmuch->xapian_db);
-	notmuch->query_parser->set_stemmer (Xapian::Stem ("english"));
-	notmuch->query_parser->set_stemming_strategy (Xapian::QueryParser::STEM_SOME);
-	notmuch->query_parser->add_valuerangeprocessor (notmuch->value_range_processor);
-	notmuch->query_parser->add_valuerangeprocessor (notmuch->date_range_processor);
-
-	for (i = 0; i < ARRAY_SIZE (BOOLEAN_PREFIX_EXTERNAL); i++) {
-	    prefix_t *prefix = &BOOLEAN_PREFIX_EXTERNAL[i];
-	    notmuch->query_parser->add_boolean_prefix (prefix->name,
-						       prefix->prefix);
-	}
-
-	for (i = 0; i < ARRAY_SIZE (PROBABILISTIC_PREFIX); i++) {
-	    prefix_t *prefix = &PROBABILISTIC_PREFIX[i];
-	    notmuch->query_parser->add_prefix (prefix->name, prefix->prefix);
-	}
+	_notmuch_database_setup_parsers (notmuch);
     } catch (const Xapian::Error &error) {
 	IGNORE_RESULT (asprintf (&message, "A Xapian exception occurred opening database: %s\n",
 				 error.get_msg().c_str()));
@@ -996,6 +1045,82 @@ notmuch_database_open_verbose (const char *path,
     return status;
 }
 
+notmuch_status_t
+notmuch_database_clone_reader (notmuch_database_t *notmuch,
+			       notmuch_database_t **clone)
+{
+    notmuch_database_t *reader;
+    char *xapian_path;
+
+    if (clone == NULL)
+	return NOTMUCH_STATUS_NULL_POINTER;
+    *clone = NULL;
+
+    if (notmuch->xapian_db == NULL) {
+	_notmuch_database_log (notmuch, "Cannot clone a closed database.\n");
+	return NOTMUCH_STATUS_XAPIAN_EXCEPTION;
+    }
+
+    reader = talloc_zero (NULL, notmuch_database_t);
+    if (unlikely (reader == NULL))
+	return NOTMUCH_STATUS_OUT_OF_MEMORY;
+
+    reader->path = talloc_strdup (reader, notmuch->path);
+    xapian_path = talloc_asprintf (reader, "%s/.notmuch/xapian", notmuch->path);
+    if (unlikely (reader->path == NULL || xapian_path == NULL)) {
+	talloc_free (reader);
+	return NOTMUCH_STATUS_OUT_OF_MEMORY;
+    }
+
+    /* The version and features were checked when 'notmuch' was
+     * opened, and cannot change under a reader. */
+    reader->mode = NOTMUCH_DATABASE_MODE_READ_ONLY;
+    reader->features = notmuch->features;
+    reader->last_doc_id = notmuch->last_doc_id;
+    reader->last_thread_id = notmuch->last_thread_id;
+
+    try {
+	reader->xapian_db = new Xapian::Database (xapian_path);
+	_notmuch_database_setup_parsers (reader);
+    } catch (const Xapian::Error &error) {
+	_notmuch_database_log (notmuch,
+		 "A Xapian exception occurred cloning the database: %s\n",
+		 error.get_msg().c_str());
+	notmuch->exception_reported = TRUE;
+	notmuch_database_destroy (reader);
+	return NOTMUCH_STATUS_XAPIAN_EXCEPTION;
+    }
+
+    *clone = reader;
+
+    return NOTMUCH_STATUS_SUCCESS;
+}
+
+notmuch_status_t
+notmuch_database_reopen (notmuch_database_t *notmuch)
+{
+    if (notmuch->mode != NOTMUCH_DATABASE_MODE_READ_ONLY)
+	return NOTMUCH_STATUS_SUCCESS;
+
+    try {
+	notmuch->xapian_db->reopen ();
+    } catch (const Xapian::Error &error) {
+	_notmuch_database_log (notmuch,
+		 "A Xapian exception occurred reopening the database: %s.\n",
+		 error.get_msg().c_str());
+	notmuch->exception_reported = TRUE;
+	return NOTMUCH_STATUS_XAPIAN_EXCEPTION;
+    }
+
+    /* Whatever was cached on the handle may describe an older
+     * revision. */
+    if (notmuch->message_cache)
+	g_hash_table_remove_all (notmuch->message_cache);
+    _notmuch_database_flush_directory_cache (notmuch);
+
+    return NOTMUCH_STATUS_SUCCESS;
+}
+
 notmuch_status_t
 notmuch_database_close (notmuch_database_t *notmuch)
 {
@@ -1018,8 +1143,11 @@ notmuch_database_close (notmuch_database_t *notmuch)
 
 	    /* Close the database.  This implicitly flushes
 	     * outstanding changes. */
+	    _notmuch_profile_begin (NOTMUCH_PROFILE_XAPIAN_COMMIT);
 	    notmuch->xapian_db->close();
+	    _notmuch_profile_end (NOTMUCH_PROFILE_XAPIAN_COMMIT);
 	} catch (const Xapian::Error &error) {
+	    _notmuch_profile_end (NOTMUCH_PROFILE_XAPIAN_COMMIT);
 	    status = NOTMUCH_STATUS_XAPIAN_EXCEPTION;
 	    if (! notmuch->exception_reported) {
 		_notmuch_database_log (notmuch, "Error: A Xapian exception occurred closing database: %s\n",
@@ -1039,6 +1167,13 @@ notmuch_database_close (notmuch_database_t *notmuch)
     delete notmuch->date_range_processor;
     notmuch->date_range_processor = NULL;
 
+    if (notmuch->message_cache) {
+	g_hash_table_unref (notmuch->message_cache);
+	notmuch->message_cache = NULL;
+    }
+
+    _notmuch_database_flush_directory_cache (notmuch);
+
     return status;
 }
 
@@ -1372,6 +1507,15 @@ notmuch_database_upgrade (notmuch_database_t *notmuch,
 	for (t = db->metadata_keys_begin ("thread_id_"); t != t_end; ++t)
 	    ++total;
     }
+    if (new_features & NOTMUCH_FEATURE_THREAD_SUMMARIES) {
+	/* The thread summary upgrade builds a record for each
+	 * thread. */
+	const char *thread_prefix = _find_prefix ("thread");
+
+	t_end = db->allterms_end (thread_prefix);
+	for (t = db->allterms_begin (thread_prefix); t != t_end; t++)
+	    ++total;
+    }
 
     /* Perform the upgrade in a transaction. */
     db->begin_transaction (true);
@@ -1380,6 +1524,11 @@ notmuch_database_upgrade (notmuch_database_t *notmuch,
      * format. */
     notmuch->features = target_features;
 
+    /* Thread summaries are built once all messages are upgraded,
+     * rather than kept up to date through the upgrades below. */
+    if (new_features & NOTMUCH_FEATURE_THREAD_SUMMARIES)
+	notmuch->features &= ~NOTMUCH_FEATURE_THREAD_SUMMARIES;
+
     /* Perform per-message upgrades. */
     if (new_features &
 	(NOTMUCH_FEATURE_FILE_TERMS | NOTMUCH_FEATURE_BOOL_FOLDER)) {
@@ -1469,6 +1618,7 @@ notmuch_database_upgrade (notmuch_database_t *notmuch,
 		notmuch_directory_destroy (directory);
 
 		db->delete_document (*p);
+		_notmuch_database_flush_directory_cache (notmuch);
 	    }
 
 	    ++count;
@@ -1524,6 +1674,29 @@ notmuch_database_upgrade (notmuch_database_t *notmuch,
 	}
     }
 
+    /* Before NOTMUCH_FEATURE_THREAD_SUMMARIES, thread summaries were
+     * always computed from the messages of each thread.  Build the
+     * summary record of each thread.
+     */
+    if (new_features & NOTMUCH_FEATURE_THREAD_SUMMARIES) {
+	const char *thread_prefix = _find_prefix ("thread");
+
+	t_end = db->allterms_end (thread_prefix);
+	for (t = db->allterms_begin (thread_prefix); t != t_end; t++) {
+	    if (do_progress_notify) {
+		progress_notify (closure, (double) count / total);
+		do_progress_notify = 0;
+	    }
+
+	    _notmuch_thread_summary_rebuild (
+		notmuch, (*t).c_str () + strlen (thread_prefix));
+
+	    ++count;
+	}
+
+	notmuch->features |= NOTMUCH_FEATURE_THREAD_SUMMARIES;
+    }
+
     status = NOTMUCH_STATUS_SUCCESS;
     db->set_metadata ("features", _print_features (local, notmuch->features));
     db->set_metadata ("version", STRINGIFY (NOTMUCH_DATABASE_VERSION));
@@ -1585,6 +1758,7 @@ notmuch_database_end_atomic (notmuch_database_t *notmuch)
 	goto DONE;
 
     db = static_cast <Xapian::WritableDatabase *> (notmuch->xapian_db);
+    _notmuch_profile_begin (NOTMUCH_PROFILE_XAPIAN_COMMIT);
     try {
 	db->commit_transaction ();
 
@@ -1594,7 +1768,9 @@ notmuch_database_end_atomic (notmuch_database_t *notmuch)
 	const char *thresh = getenv ("XAPIAN_FLUSH_THRESHOLD");
 	if (thresh && atoi (thresh) == 1)
 	    db->flush ();
+	_notmuch_profile_end (NOTMUCH_PROFILE_XAPIAN_COMMIT);
     } catch (const Xapian::Error &error) {
+	_notmuch_profile_end (NOTMUCH_PROFILE_XAPIAN_COMMIT);
 	_notmuch_database_log (notmuch, "A Xapian exception occurred committing transaction: %s.\n",
 		 error.get_msg().c_str());
 	notmuch->exception_reported = TRUE;
@@ -1706,6 +1882,28 @@ _notmuch_database_split_path (void *ctx,
     return NOTMUCH_STATUS_SUCCESS;
 }
 
+/* Every file name of a message is stored as the document ID of its
+ * directory, so listing files looks up the same few directory
+ * documents over and over.  Remember the path of each directory
+ * document, and the document of each path, once read.
+ *
+ * The documents of directories never change path, so the cache only
+ * has to be dropped when a directory document is deleted. */
+void
+_notmuch_database_flush_directory_cache (notmuch_database_t *notmuch)
+{
+    if (notmuch->directory_paths) {
+	g_hash_table_unref (notmuch->directory_paths);
+	notmuch->directory_paths = NULL;
+    }
+
+    if (notmuch->directory_ids) {
+	g_hash_table_unref (notmuch->directory_ids);
+	notmuch->directory_ids = NULL;
+    }
+}
+
+
 /* Find the document ID of the specified directory.
  *
  * If (flags & NOTMUCH_FIND_CREATE), a new directory document will be
@@ -1722,11 +1920,21 @@ _notmuch_database_find_directory_id (notmuch_database_t *notmuch,
     notmuch_directory_t *directory;
     notmuch_status_t status;
 
+    gpointer cached;
+
     if (path == NULL) {
 	*directory_id = 0;
 	return NOTMUCH_STATUS_SUCCESS;
     }
 
+    /* Directories that do not exist yet are not cached, since they
+     * may be created later. */
+    if (notmuch->directory_ids &&
+	(cached = g_hash_table_lookup (notmuch->directory_ids, path))) {
+	*directory_id = GPOINTER_TO_UINT (cached);
+	return NOTMUCH_STATUS_SUCCESS;
+    }
+
     directory = _notmuch_directory_create (notmuch, path, flags, &status);
     if (status || !directory) {
 	*directory_id = -1;
@@ -1737,6 +1945,12 @@ _notmuch_database_find_directory_id (notmuch_database_t *notmuch,
 
     notmuch_directory_destroy (directory);
 
+    if (notmuch->directory_ids == NULL)
+	notmuch->directory_ids =
+	    g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    g_hash_table_insert (notmuch->directory_ids, g_strdup (path),
+			 GUINT_TO_POINTER (*directory_id));
+
     return NOTMUCH_STATUS_SUCCESS;
 }
 
@@ -1746,10 +1960,25 @@ _notmuch_database_get_directory_path (void *ctx,
 				      unsigned int doc_id)
 {
     Xapian::Document document;
+    const char *path;
+
+    if (notmuch->directory_paths) {
+	path = (const char *) g_hash_table_lookup (notmuch->directory_paths,
+						   GUINT_TO_POINTER (doc_id));
+	if (path)
+	    return talloc_strdup (ctx, path);
+    }
 
     document = find_document_for_doc_id (notmuch, doc_id);
 
-    return talloc_strdup (ctx, document.get_data ().c_str ());
+    if (notmuch->directory_paths == NULL)
+	notmuch->directory_paths =
+	    g_hash_table_new_full (NULL, NULL, NULL, g_free);
+    path = g_strdup (document.get_data ().c_str ());
+    g_hash_table_insert (notmuch->directory_paths,
+			 GUINT_TO_POINTER (doc_id), (gpointer) path);
+
+    return talloc_strdup (ctx, path);
 }
 
 /* Given a legal 'filename' for the database, (either relative to
@@ -1874,19 +2103,22 @@ _notmuch_database_generate_doc_id (notmuch_database_t *notmuch)
     return notmuch->last_doc_id;
 }
 
-static const char *
-_notmuch_database_generate_thread_id (notmuch_database_t *notmuch)
+/* Generate a new thread ID, allocated with 'ctx' as the talloc
+ * owner. */
+static char *
+_notmuch_database_generate_thread_id (void *ctx, notmuch_database_t *notmuch)
 {
-    /* 16 bytes (+ terminator) for hexadecimal representation of
-     * a 64-bit integer. */
-    static char thread_id[17];
     Xapian::WritableDatabase *db;
+    char *thread_id;
 
     db = static_cast <Xapian::WritableDatabase *> (notmuch->xapian_db);
 
     notmuch->last_thread_id++;
 
-    sprintf (thread_id, "%016" PRIx64, notmuch->last_thread_id);
+    /* 16 hexadecimal digits of a 64-bit integer. */
+    thread_id = talloc_asprintf (ctx, "%016" PRIx64, notmuch->last_thread_id);
+    if (unlikely (thread_id == NULL))
+	return NULL;
 
     db->set_metadata ("last_thread_id", thread_id);
 
@@ -1944,8 +2176,7 @@ _resolve_message_id_to_thread_id (notmuch_database_t *notmuch,
     } else if (status == NOTMUCH_PRIVATE_STATUS_NO_DOCUMENT_FOUND) {
 	/* Message did not exist.  Give it a fresh thread ID and
 	 * populate this message as a ghost message. */
-	*thread_id_ret = talloc_strdup (
-	    ctx, _notmuch_database_generate_thread_id (notmuch));
+	*thread_id_ret = _notmuch_database_generate_thread_id (ctx, notmuch);
 	if (! *thread_id_ret) {
 	    status = NOTMUCH_PRIVATE_STATUS_OUT_OF_MEMORY;
 	} else {
@@ -2001,8 +2232,11 @@ _resolve_message_id_to_thread_id_old (notmuch_database_t *notmuch,
     thread_id_string = notmuch->xapian_db->get_metadata (metadata_key);
 
     if (thread_id_string.empty()) {
-	*thread_id_ret = talloc_strdup (ctx,
-					_notmuch_database_generate_thread_id (notmuch));
+	*thread_id_ret = _notmuch_database_generate_thread_id (ctx, notmuch);
+	if (*thread_id_ret == NULL) {
+	    talloc_free (metadata_key);
+	    return NOTMUCH_STATUS_OUT_OF_MEMORY;
+	}
 	db->set_metadata (metadata_key, *thread_id_ret);
     } else {
 	*thread_id_ret = talloc_strdup (ctx, thread_id_string.c_str());
@@ -2281,7 +2515,11 @@ _notmuch_database_link_message (notmuch_database_t *notmuch,
 
     /* If not part of any existing thread, generate a new thread ID. */
     if (thread_id == NULL) {
-	thread_id = _notmuch_database_generate_thread_id (notmuch);
+	thread_id = _notmuch_database_generate_thread_id (local, notmuch);
+	if (thread_id == NULL) {
+	    status = NOTMUCH_STATUS_OUT_OF_MEMORY;
+	    goto DONE;
+	}
 
 	_notmuch_message_add_term (message, "thread", thread_id);
     }
@@ -2413,6 +2651,12 @@ notmuch_database_add_message (notmuch_database_t *notmuch,
 
 	    date = _notmuch_message_file_get_header (message_file, "date");
 	    _notmuch_message_set_header_values (message, date, from, subject);
+	    _notmuch_message_set_header_block (
+		message, _notmuch_message_file_get_header_block (message_file,
+								 message_file));
+	    _notmuch_message_set_mailboxes (
+		message, _notmuch_message_file_get_mailboxes (message_file,
+							      message_file));
 
 	    ret = _notmuch_message_index_file (message, message_file);
 	    if (ret)
@@ -2575,6 +2819,116 @@ notmuch_database_get_all_tags (notmuch_database_t *db)
     }
 }
 
+static notmuch_bool_t
+_named_query_name_valid (const char *name)
+{
+    const char *s;
+
+    if (*name == '\0')
+	return FALSE;
+
+    if (strlen (NOTMUCH_METADATA_NAMED_QUERY_PREFIX) + strlen (name) >
+	NOTMUCH_TERM_MAX)
+	return FALSE;
+
+    for (s = name; *s; s++) {
+	if (isspace (*s) || *s == '"' || *s == '(' || *s == ')')
+	    return FALSE;
+    }
+
+    return TRUE;
+}
+
+notmuch_status_t
+notmuch_database_set_named_query (notmuch_database_t *notmuch,
+				  const char *name,
+				  const char *query_string)
+{
+    Xapian::WritableDatabase *db;
+    notmuch_status_t status;
+    char *key;
+
+    if (name == NULL)
+	return NOTMUCH_STATUS_NULL_POINTER;
+
+    if (! _named_query_name_valid (name))
+	return NOTMUCH_STATUS_ILLEGAL_ARGUMENT;
+
+    status = _notmuch_database_ensure_writable (notmuch);
+    if (status)
+	return status;
+
+    if (query_string == NULL)
+	query_string = "";
+
+    key = talloc_asprintf (notmuch, "%s%s",
+			   NOTMUCH_METADATA_NAMED_QUERY_PREFIX, name);
+
+    try {
+	db = static_cast <Xapian::WritableDatabase *> (notmuch->xapian_db);
+	/* Xapian removes metadata entries set to an empty value. */
+	db->set_metadata (key, query_string);
+    } catch (const Xapian::Error &error) {
+	_notmuch_database_log (notmuch, "A Xapian exception occurred setting named query: %s.\n",
+		 error.get_msg().c_str());
+	notmuch->exception_reported = TRUE;
+	status = NOTMUCH_STATUS_XAPIAN_EXCEPTION;
+    }
+
+    talloc_free (key);
+    return status;
+}
+
+/* Return the query string stored under 'name', allocated with 'ctx'
+ * as the talloc owner, or NULL if there is none.  Xapian exceptions
+ * are left for the caller to handle. */
+char *
+_notmuch_database_get_named_query (void *ctx,
+				   notmuch_database_t *notmuch,
+				   const char *name)
+{
+    string key = NOTMUCH_METADATA_NAMED_QUERY_PREFIX;
+    string value;
+
+    key += name;
+    value = notmuch->xapian_db->get_metadata (key);
+    if (value.empty ())
+	return NULL;
+
+    return talloc_strdup (ctx, value.c_str ());
+}
+
+notmuch_status_t
+notmuch_database_get_named_query (notmuch_database_t *notmuch,
+				  const char *name,
+				  char **query_string)
+{
+    char *value;
+
+    if (name == NULL || query_string == NULL)
+	return NOTMUCH_STATUS_NULL_POINTER;
+
+    *query_string = NULL;
+
+    try {
+	value = _notmuch_database_get_named_query (notmuch, notmuch, name);
+    } catch (const Xapian::Error &error) {
+	_notmuch_database_log (notmuch, "A Xapian exception occurred getting named query: %s.\n",
+		 error.get_msg().c_str());
+	notmuch->exception_reported = TRUE;
+	return NOTMUCH_STATUS_XAPIAN_EXCEPTION;
+    }
+
+    if (value) {
+	*query_string = strdup (value);
+	talloc_free (value);
+	if (*query_string == NULL)
+	    return NOTMUCH_STATUS_OUT_OF_MEMORY;
+    }
+
+    return NOTMUCH_STATUS_SUCCESS;
+}
+
 const char *
 notmuch_database_status_string (notmuch_database_t *notmuch)
 {
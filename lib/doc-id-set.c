@@ -0,0 +1,396 @@
+/* doc-id-set.c - Compressed sets of Xapian document IDs
+ *
+ * Copyright © 2026 agent
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ * Author: agent <agent@local>
+ */
+
+#include "notmuch-private.h"
+
+#include <stdint.h>
+
+/* A doc id set is split into containers, one for each run of 2^16 doc
+ * ids sharing the same high 16 bits (the container's "key").  A
+ * container holds the low 16 bits of its members either as a sorted
+ * array, while it is sparse, or as a 2^16 bit bitmap once it holds
+ * more than ARRAY_MAX members.  (This is the scheme used by "roaring"
+ * bitmaps.)  Memory use is thus proportional to the number of members
+ * rather than to the largest doc id, and the containers are kept
+ * sorted by key so that members can be visited in order. */
+
+#define CONTAINER_BITS 16
+#define CONTAINER_KEY(doc_id) ((doc_id) >> CONTAINER_BITS)
+#define CONTAINER_LOW(doc_id) ((doc_id) & 0xffff)
+
+/* Beyond this many members, a bitmap is no larger than an array. */
+#define ARRAY_MAX 4096
+#define BITMAP_WORDS (65536 / 64)
+
+#define BITMAP_TEST(bitmap, low) ((bitmap)[(low) / 64] & (UINT64_C(1) << ((low) % 64)))
+
+typedef struct _notmuch_doc_id_container {
+    unsigned int key;
+    /* Number of members. */
+    unsigned int cardinality;
+    /* Exactly one of these is non-NULL. */
+    uint16_t *array;
+    uint64_t *bitmap;
+    /* Allocated length of array. */
+    unsigned int array_size;
+} notmuch_doc_id_container_t;
+
+struct _notmuch_doc_id_set {
+    notmuch_doc_id_container_t *containers;
+    unsigned int length;
+    unsigned int size;
+};
+
+/* Create a new, empty doc id set with 'ctx' as its talloc owner.
+ *
+ * Returns NULL if out of memory.
+ */
+notmuch_doc_id_set_t *
+_notmuch_doc_id_set_create (const void *ctx)
+{
+    notmuch_doc_id_set_t *doc_ids;
+
+    doc_ids = talloc (ctx, notmuch_doc_id_set_t);
+    if (unlikely (doc_ids == NULL))
+	return NULL;
+
+    doc_ids->containers = NULL;
+    doc_ids->length = 0;
+    doc_ids->size = 0;
+
+    return doc_ids;
+}
+
+/* Return the index of the first container with a key not less than
+ * 'key' (possibly doc_ids->length). */
+static unsigned int
+_find_container (notmuch_doc_id_set_t *doc_ids, unsigned int key)
+{
+    unsigned int lo = 0, hi = doc_ids->length;
+
+    /* Doc ids are mostly added in ascending order. */
+    if (hi > 0 && doc_ids->containers[hi - 1].key < key)
+	return hi;
+
+    while (lo < hi) {
+	unsigned int mid = lo + (hi - lo) / 2;
+	if (doc_ids->containers[mid].key < key)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    return lo;
+}
+
+/* Return the index in the array container 'c' of the first member not
+ * less than 'low' (possibly c->cardinality). */
+static unsigned int
+_find_in_array (notmuch_doc_id_container_t *c, unsigned int low)
+{
+    unsigned int lo = 0, hi = c->cardinality;
+
+    if (hi > 0 && c->array[hi - 1] < low)
+	return hi;
+
+    while (lo < hi) {
+	unsigned int mid = lo + (hi - lo) / 2;
+	if (c->array[mid] < low)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    return lo;
+}
+
+static notmuch_bool_t
+_container_contains (notmuch_doc_id_container_t *c, unsigned int low)
+{
+    unsigned int pos;
+
+    if (c->bitmap)
+	return BITMAP_TEST (c->bitmap, low) != 0;
+
+    pos = _find_in_array (c, low);
+    return pos < c->cardinality && c->array[pos] == low;
+}
+
+static notmuch_bool_t
+_container_to_bitmap (notmuch_doc_id_set_t *doc_ids,
+		      notmuch_doc_id_container_t *c)
+{
+    uint64_t *bitmap;
+    unsigned int i;
+
+    bitmap = talloc_zero_array (doc_ids, uint64_t, BITMAP_WORDS);
+    if (unlikely (bitmap == NULL))
+	return FALSE;
+
+    for (i = 0; i < c->cardinality; i++)
+	bitmap[c->array[i] / 64] |= UINT64_C(1) << (c->array[i] % 64);
+
+    talloc_free (c->array);
+    c->array = NULL;
+    c->array_size = 0;
+    c->bitmap = bitmap;
+
+    return TRUE;
+}
+
+/* Add 'doc_id' to 'doc_ids'.
+ *
+ * Returns FALSE if out of memory.
+ */
+notmuch_bool_t
+_notmuch_doc_id_set_add (notmuch_doc_id_set_t *doc_ids,
+			 unsigned int doc_id)
+{
+    unsigned int key = CONTAINER_KEY (doc_id), low = CONTAINER_LOW (doc_id);
+    unsigned int i, pos;
+    notmuch_doc_id_container_t *c;
+
+    i = _find_container (doc_ids, key);
+    if (i == doc_ids->length || doc_ids->containers[i].key != key) {
+	if (doc_ids->length == doc_ids->size) {
+	    unsigned int size = doc_ids->size ? 2 * doc_ids->size : 4;
+	    notmuch_doc_id_container_t *containers;
+
+	    containers = talloc_realloc (doc_ids, doc_ids->containers,
+					 notmuch_doc_id_container_t, size);
+	    if (unlikely (containers == NULL))
+		return FALSE;
+	    doc_ids->containers = containers;
+	    doc_ids->size = size;
+	}
+	memmove (&doc_ids->containers[i + 1], &doc_ids->containers[i],
+		 (doc_ids->length - i) * sizeof (notmuch_doc_id_container_t));
+	doc_ids->length++;
+
+	c = &doc_ids->containers[i];
+	c->key = key;
+	c->cardinality = 0;
+	c->array = NULL;
+	c->bitmap = NULL;
+	c->array_size = 0;
+    }
+    c = &doc_ids->containers[i];
+
+    if (c->bitmap) {
+	if (! BITMAP_TEST (c->bitmap, low)) {
+	    c->bitmap[low / 64] |= UINT64_C(1) << (low % 64);
+	    c->cardinality++;
+	}
+	return TRUE;
+    }
+
+    pos = _find_in_array (c, low);
+    if (pos < c->cardinality && c->array[pos] == low)
+	return TRUE;
+
+    if (c->cardinality == ARRAY_MAX) {
+	if (! _container_to_bitmap (doc_ids, c))
+	    return FALSE;
+	c->bitmap[low / 64] |= UINT64_C(1) << (low % 64);
+	c->cardinality++;
+	return TRUE;
+    }
+
+    if (c->cardinality == c->array_size) {
+	unsigned int size = c->array_size ? 2 * c->array_size : 8;
+	uint16_t *array;
+
+	array = talloc_realloc (doc_ids, c->array, uint16_t, size);
+	if (unlikely (array == NULL))
+	    return FALSE;
+	c->array = array;
+	c->array_size = size;
+    }
+
+    memmove (&c->array[pos + 1], &c->array[pos],
+	     (c->cardinality - pos) * sizeof (uint16_t));
+    c->array[pos] = low;
+    c->cardinality++;
+
+    return TRUE;
+}
+
+notmuch_bool_t
+_notmuch_doc_id_set_contains (notmuch_doc_id_set_t *doc_ids,
+			      unsigned int doc_id)
+{
+    unsigned int key = CONTAINER_KEY (doc_id);
+    unsigned int i;
+
+    i = _find_container (doc_ids, key);
+    if (i == doc_ids->length || doc_ids->containers[i].key != key)
+	return FALSE;
+
+    return _container_contains (&doc_ids->containers[i],
+				CONTAINER_LOW (doc_id));
+}
+
+static void
+_remove_container (notmuch_doc_id_set_t *doc_ids, unsigned int i)
+{
+    notmuch_doc_id_container_t *c = &doc_ids->containers[i];
+
+    talloc_free (c->array);
+    talloc_free (c->bitmap);
+    memmove (c, c + 1,
+	     (doc_ids->length - i - 1) * sizeof (notmuch_doc_id_container_t));
+    doc_ids->length--;
+}
+
+void
+_notmuch_doc_id_set_remove (notmuch_doc_id_set_t *doc_ids,
+			    unsigned int doc_id)
+{
+    unsigned int key = CONTAINER_KEY (doc_id), low = CONTAINER_LOW (doc_id);
+    unsigned int i, pos;
+    notmuch_doc_id_container_t *c;
+
+    i = _find_container (doc_ids, key);
+    if (i == doc_ids->length || doc_ids->containers[i].key != key)
+	return;
+    c = &doc_ids->containers[i];
+
+    if (c->bitmap) {
+	if (! BITMAP_TEST (c->bitmap, low))
+	    return;
+	c->bitmap[low / 64] &= ~(UINT64_C(1) << (low % 64));
+    } else {
+	pos = _find_in_array (c, low);
+	if (pos == c->cardinality || c->array[pos] != low)
+	    return;
+	memmove (&c->array[pos], &c->array[pos + 1],
+		 (c->cardinality - pos - 1) * sizeof (uint16_t));
+    }
+
+    if (--c->cardinality == 0)
+	_remove_container (doc_ids, i);
+}
+
+/* Return the number of members of 'doc_ids'. */
+unsigned int
+_notmuch_doc_id_set_count (notmuch_doc_id_set_t *doc_ids)
+{
+    unsigned int i, count = 0;
+
+    for (i = 0; i < doc_ids->length; i++)
+	count += doc_ids->containers[i].cardinality;
+
+    return count;
+}
+
+/* Find the smallest member of 'doc_ids' not less than 'doc_id' and
+ * store it in *next.
+ *
+ * Returns FALSE if there is no such member.  To visit every member in
+ * ascending order, start from 0 and continue from each result plus
+ * one.
+ */
+notmuch_bool_t
+_notmuch_doc_id_set_next (notmuch_doc_id_set_t *doc_ids,
+			  unsigned int doc_id,
+			  unsigned int *next)
+{
+    unsigned int key = CONTAINER_KEY (doc_id), low = CONTAINER_LOW (doc_id);
+    unsigned int i;
+
+    for (i = _find_container (doc_ids, key); i < doc_ids->length; i++) {
+	notmuch_doc_id_container_t *c = &doc_ids->containers[i];
+
+	/* Containers past the first need searching from their start. */
+	if (c->key != key)
+	    low = 0;
+
+	if (c->bitmap) {
+	    unsigned int word = low / 64;
+	    uint64_t bits = c->bitmap[word] & (~UINT64_C(0) << (low % 64));
+
+	    while (bits == 0 && ++word < BITMAP_WORDS)
+		bits = c->bitmap[word];
+	    if (bits) {
+		*next = (c->key << CONTAINER_BITS) | (word * 64 +
+						      __builtin_ctzll (bits));
+		return TRUE;
+	    }
+	} else {
+	    unsigned int pos = _find_in_array (c, low);
+	    if (pos < c->cardinality) {
+		*next = (c->key << CONTAINER_BITS) | c->array[pos];
+		return TRUE;
+	    }
+	}
+    }
+
+    return FALSE;
+}
+
+/* Remove from 'doc_ids' every doc id that is not also a member of
+ * 'other'. */
+void
+_notmuch_doc_id_set_intersect (notmuch_doc_id_set_t *doc_ids,
+			       notmuch_doc_id_set_t *other)
+{
+    unsigned int i = 0, j = 0;
+
+    while (i < doc_ids->length) {
+	notmuch_doc_id_container_t *c = &doc_ids->containers[i];
+	notmuch_doc_id_container_t *o;
+	unsigned int k, low, kept = 0;
+
+	while (j < other->length && other->containers[j].key < c->key)
+	    j++;
+	if (j == other->length || other->containers[j].key != c->key) {
+	    _remove_container (doc_ids, i);
+	    continue;
+	}
+	o = &other->containers[j];
+
+	if (c->bitmap) {
+	    for (k = 0; k < BITMAP_WORDS; k++) {
+		uint64_t bits = c->bitmap[k], keep = 0;
+		while (bits) {
+		    low = k * 64 + __builtin_ctzll (bits);
+		    bits &= bits - 1;
+		    if (_container_contains (o, low)) {
+			keep |= UINT64_C(1) << (low % 64);
+			kept++;
+		    }
+		}
+		c->bitmap[k] = keep;
+	    }
+	} else {
+	    for (k = 0; k < c->cardinality; k++) {
+		low = c->array[k];
+		if (_container_contains (o, low))
+		    c->array[kept++] = low;
+	    }
+	}
+
+	c->cardinality = kept;
+	if (kept == 0)
+	    _remove_container (doc_ids, i);
+	else
+	    i++;
+    }
+}
@@ -446,6 +446,8 @@ _notmuch_message_index_file (notmuch_message_t *message,
     if (status)
 	return status;
 
+    _notmuch_profile_begin (NOTMUCH_PROFILE_TERM_GENERATION);
+
     from = g_mime_message_get_sender (mime_message);
 
     addresses = internet_address_list_parse_string (from);
@@ -465,5 +467,7 @@ _notmuch_message_index_file (notmuch_message_t *message,
 
     _index_mime_part (message, g_mime_message_get_mime_part (mime_message));
 
+    _notmuch_profile_end (NOTMUCH_PROFILE_TERM_GENERATION);
+
     return NOTMUCH_STATUS_SUCCESS;
 }
@@ -0,0 +1,131 @@
+/* mailboxes.c - Iterator for the stored mailboxes of a message
+ *
+ * Copyright © 2026 agent
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ * Author: agent <agent@local>
+ */
+
+#include "notmuch-private.h"
+
+struct _notmuch_mailboxes {
+    /* The header whose mailboxes are iterated over. */
+    char *header;
+
+    /* The rest of the list, split into fields as it is read. */
+    char *pos;
+
+    /* The current mailbox, or NULL address at the end. */
+    const char *name;
+    const char *address;
+};
+
+/* Move to the next mailbox of the header, if any. */
+static void
+_notmuch_mailboxes_advance (notmuch_mailboxes_t *mailboxes)
+{
+    size_t header_len = strlen (mailboxes->header);
+
+    mailboxes->name = NULL;
+    mailboxes->address = NULL;
+
+    while (*mailboxes->pos && *mailboxes->pos != '\n') {
+	char *line = mailboxes->pos;
+	char *end = strchr (line, '\n');
+	char *tab;
+
+	if (end == NULL)
+	    end = line + strlen (line);
+
+	mailboxes->pos = *end ? end + 1 : end;
+	*end = '\0';
+
+	if (strncmp (line, mailboxes->header, header_len) != 0 ||
+	    line[header_len] != '\t')
+	    continue;
+
+	mailboxes->address = line + header_len + 1;
+	tab = strchr (mailboxes->address, '\t');
+	if (tab) {
+	    *tab = '\0';
+	    mailboxes->name = tab + 1;
+	}
+	return;
+    }
+}
+
+notmuch_mailboxes_t *
+_notmuch_mailboxes_create (const void *ctx, const char *list,
+			   const char *header)
+{
+    notmuch_mailboxes_t *mailboxes;
+
+    mailboxes = talloc (ctx, notmuch_mailboxes_t);
+    if (unlikely (mailboxes == NULL))
+	return NULL;
+
+    mailboxes->header = talloc_strdup (mailboxes, header);
+    mailboxes->pos = talloc_strdup (mailboxes, list);
+    if (unlikely (mailboxes->header == NULL || mailboxes->pos == NULL)) {
+	talloc_free (mailboxes);
+	return NULL;
+    }
+
+    _notmuch_mailboxes_advance (mailboxes);
+
+    return mailboxes;
+}
+
+notmuch_bool_t
+notmuch_mailboxes_valid (notmuch_mailboxes_t *mailboxes)
+{
+    if (mailboxes == NULL)
+	return FALSE;
+
+    return (mailboxes->address != NULL);
+}
+
+const char *
+notmuch_mailboxes_get_name (notmuch_mailboxes_t *mailboxes)
+{
+    if (! notmuch_mailboxes_valid (mailboxes))
+	return NULL;
+
+    return mailboxes->name;
+}
+
+const char *
+notmuch_mailboxes_get_address (notmuch_mailboxes_t *mailboxes)
+{
+    if (! notmuch_mailboxes_valid (mailboxes))
+	return NULL;
+
+    return mailboxes->address;
+}
+
+void
+notmuch_mailboxes_move_to_next (notmuch_mailboxes_t *mailboxes)
+{
+    if (! notmuch_mailboxes_valid (mailboxes))
+	return;
+
+    _notmuch_mailboxes_advance (mailboxes);
+}
+
+void
+notmuch_mailboxes_destroy (notmuch_mailboxes_t *mailboxes)
+{
+    talloc_free (mailboxes);
+}
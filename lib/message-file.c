@@ -26,6 +26,8 @@
 
 #include <glib.h> /* GHashTable */
 
+#define ARRAY_SIZE(arr) (sizeof (arr) / sizeof (arr[0]))
+
 struct _notmuch_message_file {
     /* File object */
     FILE *file;
@@ -92,7 +94,9 @@ _notmuch_message_file_open_ctx (notmuch_database_t *notmuch,
 
     talloc_set_destructor (message, _notmuch_message_file_destructor);
 
+    _notmuch_profile_begin (NOTMUCH_PROFILE_FILE_OPEN);
     message->file = fopen (filename, "r");
+    _notmuch_profile_end (NOTMUCH_PROFILE_FILE_OPEN);
     if (message->file == NULL)
 	goto FAIL;
 
@@ -141,7 +145,6 @@ _notmuch_message_file_parse (notmuch_message_file_t *message)
     GMimeStream *stream;
     GMimeParser *parser;
     notmuch_status_t status = NOTMUCH_STATUS_SUCCESS;
-    static int initialized = 0;
     notmuch_bool_t is_mbox;
 
     if (message->message)
@@ -149,10 +152,7 @@ _notmuch_message_file_parse (notmuch_message_file_t *message)
 
     is_mbox = _is_mbox (message->file);
 
-    if (! initialized) {
-	g_mime_init (GMIME_ENABLE_RFC2047_WORKAROUNDS);
-	initialized = 1;
-    }
+    _notmuch_init ();
 
     message->headers = g_hash_table_new_full (strcase_hash, strcase_equal,
 					      free, g_free);
@@ -167,7 +167,9 @@ _notmuch_message_file_parse (notmuch_message_file_t *message)
     parser = g_mime_parser_new_with_stream (stream);
     g_mime_parser_set_scan_from (parser, is_mbox);
 
+    _notmuch_profile_begin (NOTMUCH_PROFILE_MIME_PARSE);
     message->message = g_mime_parser_construct_message (parser);
+    _notmuch_profile_end (NOTMUCH_PROFILE_MIME_PARSE);
     if (! message->message) {
 	status = NOTMUCH_STATUS_FILE_NOT_EMAIL;
 	goto DONE;
@@ -325,3 +327,150 @@ _notmuch_message_file_get_header (notmuch_message_file_t *message,
 
     return decoded;
 }
+
+/* The headers kept in the header block, see
+ * _notmuch_message_file_get_header_block. */
+static const char *stored_headers[] = {
+    "Subject", "From", "To", "Cc", "Bcc", "Reply-To", "Date", "In-Reply-To",
+};
+
+char *
+_notmuch_message_file_get_header_block (void *ctx,
+					notmuch_message_file_t *message)
+{
+    GMimeHeaderList *headers;
+    GMimeHeaderIter *iter;
+    char *block;
+    unsigned int i;
+
+    if (_notmuch_message_file_parse (message))
+	return NULL;
+
+    headers = g_mime_object_get_header_list (GMIME_OBJECT (message->message));
+    if (! headers)
+	return NULL;
+
+    iter = g_mime_header_iter_new ();
+    if (! iter)
+	return NULL;
+
+    block = talloc_strdup (ctx, "");
+
+    if (g_mime_header_list_get_iter (headers, iter)) {
+	do {
+	    const char *name = g_mime_header_iter_get_name (iter);
+	    const char *value = g_mime_header_iter_get_value (iter);
+
+	    for (i = 0; i < ARRAY_SIZE (stored_headers); i++)
+		if (strcasecmp (name, stored_headers[i]) == 0)
+		    break;
+	    if (i == ARRAY_SIZE (stored_headers) || value == NULL)
+		continue;
+
+	    /* Keep the raw value, folding and encoded words included,
+	     * so that it decodes just as it does from the file. */
+	    block = talloc_asprintf_append (block, "%s: %s\n",
+					    stored_headers[i], value);
+	} while (block && g_mime_header_iter_next (iter));
+    }
+
+    /* The empty line ending the headers also keeps the block from
+     * being empty when none of the headers is present. */
+    if (block)
+	block = talloc_strdup_append (block, "\n");
+
+    g_mime_header_iter_free (iter);
+
+    return block;
+}
+
+/* Append 'string' to 'list' with tabs and newlines, which separate
+ * the fields and lines of the list, replaced by spaces. */
+static char *
+_append_mailbox_field (char *list, const char *string)
+{
+    size_t start = talloc_get_size (list) - 1;
+    char *p;
+
+    list = talloc_strdup_append_buffer (list, string);
+    if (list == NULL)
+	return NULL;
+
+    for (p = list + start; *p; p++)
+	if (*p == '\t' || *p == '\n')
+	    *p = ' ';
+
+    return list;
+}
+
+static char *
+_append_mailboxes (char *list, const char *header, InternetAddressList *addresses)
+{
+    int i;
+
+    for (i = 0; list && i < internet_address_list_length (addresses); i++) {
+	InternetAddress *address = internet_address_list_get_address (addresses, i);
+
+	if (INTERNET_ADDRESS_IS_GROUP (address)) {
+	    InternetAddressList *members = internet_address_group_get_members (
+		INTERNET_ADDRESS_GROUP (address));
+
+	    if (members)
+		list = _append_mailboxes (list, header, members);
+	} else {
+	    const char *name = internet_address_get_name (address);
+	    const char *addr = internet_address_mailbox_get_addr (
+		INTERNET_ADDRESS_MAILBOX (address));
+
+	    list = talloc_asprintf_append_buffer (list, "%s\t", header);
+	    if (list)
+		list = _append_mailbox_field (list, addr ? addr : "");
+	    if (list && name) {
+		list = talloc_strdup_append_buffer (list, "\t");
+		if (list)
+		    list = _append_mailbox_field (list, name);
+	    }
+	    if (list)
+		list = talloc_strdup_append_buffer (list, "\n");
+	}
+    }
+
+    return list;
+}
+
+char *
+_notmuch_message_file_get_mailboxes (void *ctx,
+				     notmuch_message_file_t *message)
+{
+    const char *headers[] = { "from", "to", "cc", "bcc" };
+    char *list;
+    unsigned int i;
+
+    list = talloc_strdup (ctx, "");
+
+    for (i = 0; list && i < ARRAY_SIZE (headers); i++) {
+	const char *value = _notmuch_message_file_get_header (message,
+							      headers[i]);
+	InternetAddressList *addresses;
+
+	if (value == NULL) {
+	    talloc_free (list);
+	    return NULL;
+	}
+
+	if (*value == '\0')
+	    continue;
+
+	addresses = internet_address_list_parse_string (value);
+	if (addresses == NULL)
+	    continue;
+
+	list = _append_mailboxes (list, headers[i], addresses);
+	g_object_unref (addresses);
+    }
+
+    if (list)
+	list = talloc_strdup_append_buffer (list, "\n");
+
+    return list;
+}
@@ -29,6 +29,9 @@ struct visible _notmuch_message {
     notmuch_database_t *notmuch;
     Xapian::docid doc_id;
     int frozen;
+    /* True if message->doc has changes not yet written by
+     * _notmuch_message_sync. */
+    notmuch_bool_t modified;
     char *message_id;
     char *thread_id;
     char *in_reply_to;
@@ -101,6 +104,7 @@ _notmuch_message_create_for_document (const void *talloc_owner,
     message->doc_id = doc_id;
 
     message->frozen = 0;
+    message->modified = FALSE;
     message->flags = 0;
     message->lazy_flags = 0;
 
@@ -264,8 +268,10 @@ _notmuch_message_create_for_message_id (notmuch_database_t *notmuch,
 
     /* We want to inform the caller that we had to create a new
      * document. */
-    if (*status_ret == NOTMUCH_PRIVATE_STATUS_SUCCESS)
+    if (*status_ret == NOTMUCH_PRIVATE_STATUS_SUCCESS) {
+	message->modified = TRUE;
 	*status_ret = NOTMUCH_PRIVATE_STATUS_NO_DOCUMENT_FOUND;
+    }
 
     return message;
 }
@@ -302,10 +308,137 @@ _notmuch_message_get_term (notmuch_message_t *message,
     return value;
 }
 
+/* The number of documents whose metadata a database handle keeps in
+ * its message_cache before the cache is flushed. */
+#define MESSAGE_CACHE_MAX 16384
+
+#pragma GCC visibility push(hidden)
+
+/* The metadata _notmuch_message_ensure_metadata reads from the term
+ * list of a document, as kept in notmuch->message_cache so that
+ * message objects created for the same document by later queries
+ * need not decompress the term list again. */
+typedef struct _notmuch_message_metadata {
+    char *message_id;
+    char *thread_id;
+    char *in_reply_to;
+    notmuch_string_list_t *tag_list;
+    notmuch_string_list_t *filename_term_list;
+    notmuch_bool_t is_ghost;
+} notmuch_message_metadata_t;
+
+#pragma GCC visibility pop
+
+static void
+_notmuch_message_metadata_free (gpointer data)
+{
+    talloc_free (data);
+}
+
+static notmuch_string_list_t *
+_copy_string_list (const void *ctx, notmuch_string_list_t *list)
+{
+    notmuch_string_list_t *copy = _notmuch_string_list_create (ctx);
+    notmuch_string_node_t *node;
+
+    if (unlikely (copy == NULL))
+	return NULL;
+
+    for (node = list->head; node; node = node->next)
+	_notmuch_string_list_append (copy, node->string);
+
+    return copy;
+}
+
+/* Forget the cached metadata of document 'doc_id', which is about to
+ * change. */
+static void
+_notmuch_message_cache_remove (notmuch_database_t *notmuch,
+			       unsigned int doc_id)
+{
+    if (notmuch->message_cache)
+	g_hash_table_remove (notmuch->message_cache,
+			     GUINT_TO_POINTER (doc_id));
+}
+
+/* Fill in the metadata of 'message', none of which has been read
+ * yet, from the database's message_cache.  Returns FALSE if the
+ * document is not in the cache. */
+static notmuch_bool_t
+_notmuch_message_cache_load (notmuch_message_t *message)
+{
+    notmuch_message_metadata_t *metadata;
+
+    if (message->notmuch->message_cache == NULL)
+	return FALSE;
+
+    metadata = (notmuch_message_metadata_t *)
+	g_hash_table_lookup (message->notmuch->message_cache,
+			     GUINT_TO_POINTER (message->doc_id));
+    if (metadata == NULL)
+	return FALSE;
+
+    message->message_id = talloc_strdup (message, metadata->message_id);
+    message->thread_id = talloc_strdup (message, metadata->thread_id);
+    message->in_reply_to = talloc_strdup (message, metadata->in_reply_to);
+    message->tag_list = _copy_string_list (message, metadata->tag_list);
+    message->filename_term_list =
+	_copy_string_list (message, metadata->filename_term_list);
+    if (metadata->is_ghost)
+	NOTMUCH_SET_BIT (&message->flags, NOTMUCH_MESSAGE_FLAG_GHOST);
+    else
+	NOTMUCH_CLEAR_BIT (&message->flags, NOTMUCH_MESSAGE_FLAG_GHOST);
+    NOTMUCH_SET_BIT (&message->lazy_flags, NOTMUCH_MESSAGE_FLAG_GHOST);
+
+    return TRUE;
+}
+
+/* Remember the metadata just read from the (unmodified) document of
+ * 'message' in the database's message_cache. */
+static void
+_notmuch_message_cache_store (notmuch_message_t *message)
+{
+    notmuch_database_t *notmuch = message->notmuch;
+    notmuch_message_metadata_t *metadata;
+
+    if (notmuch->message_cache == NULL)
+	notmuch->message_cache =
+	    g_hash_table_new_full (NULL, NULL, NULL,
+				   _notmuch_message_metadata_free);
+    else if (g_hash_table_size (notmuch->message_cache) >= MESSAGE_CACHE_MAX)
+	g_hash_table_remove_all (notmuch->message_cache);
+
+    metadata = talloc (notmuch, notmuch_message_metadata_t);
+    if (unlikely (metadata == NULL))
+	return;
+
+    metadata->message_id = talloc_strdup (metadata, message->message_id);
+    metadata->thread_id = talloc_strdup (metadata, message->thread_id);
+    metadata->in_reply_to = talloc_strdup (metadata, message->in_reply_to);
+    metadata->tag_list = _copy_string_list (metadata, message->tag_list);
+    metadata->filename_term_list =
+	_copy_string_list (metadata, message->filename_term_list);
+    metadata->is_ghost = NOTMUCH_TEST_BIT (message->flags,
+					   NOTMUCH_MESSAGE_FLAG_GHOST);
+
+    if (unlikely (metadata->message_id == NULL ||
+		  metadata->thread_id == NULL ||
+		  metadata->in_reply_to == NULL ||
+		  metadata->tag_list == NULL ||
+		  metadata->filename_term_list == NULL)) {
+	talloc_free (metadata);
+	return;
+    }
+
+    g_hash_table_replace (notmuch->message_cache,
+			  GUINT_TO_POINTER (message->doc_id), metadata);
+}
+
 void
 _notmuch_message_ensure_metadata (notmuch_message_t *message)
 {
     Xapian::TermIterator i, end;
+    notmuch_bool_t fresh;
     const char *thread_prefix = _find_prefix ("thread"),
 	*tag_prefix = _find_prefix ("tag"),
 	*id_prefix = _find_prefix ("id"),
@@ -317,7 +450,19 @@ _notmuch_message_ensure_metadata (notmuch_message_t *message)
      * term list every time you iterate over it.  Thus, while this is
      * slightly more costly than looking up individual fields if only
      * one field of the message object is actually used, it's a huge
-     * win as more fields are used. */
+     * win as more fields are used.
+     *
+     * If nothing has been read yet, another message object for the
+     * same document may already have done this walk for us. */
+
+    fresh = (! message->modified &&
+	     ! message->message_id && ! message->thread_id &&
+	     ! message->in_reply_to && ! message->tag_list &&
+	     ! message->filename_term_list && ! message->filename_list &&
+	     ! NOTMUCH_TEST_BIT (message->lazy_flags,
+				 NOTMUCH_MESSAGE_FLAG_GHOST));
+    if (fresh && _notmuch_message_cache_load (message))
+	return;
 
     i = message->doc.termlist_begin ();
     end = message->doc.termlist_end ();
@@ -375,6 +520,9 @@ _notmuch_message_ensure_metadata (notmuch_message_t *message)
      * header. For these cases, we return an empty string. */
     if (!message->in_reply_to)
 	message->in_reply_to = talloc_strdup (message, "");
+
+    if (fresh && message->message_id && message->thread_id)
+	_notmuch_message_cache_store (message);
 }
 
 static void
@@ -441,10 +589,107 @@ _notmuch_message_ensure_message_file (notmuch_message_t *message)
 	_notmuch_message_database (message), message, filename);
 }
 
+/* The headers kept in NOTMUCH_VALUE_HEADERS, apart from those with
+ * a value slot of their own. */
+static const char *block_headers[] = {
+    "to", "cc", "bcc", "reply-to", "date", "in-reply-to",
+};
+
+/* Find the first 'header' in a header block, as stored by
+ * _notmuch_message_set_header_block, and return its decoded value,
+ * talloc'ed on 'ctx', or "" if there is none. */
+static char *
+_notmuch_header_block_get (const void *ctx, const char *block,
+			   const char *header)
+{
+    size_t header_len = strlen (header);
+    const char *line, *end;
+    char *raw, *decoded, *ret;
+
+    for (line = block; *line && *line != '\n'; line = end + 1) {
+	/* A line ends at a newline not followed by a folded
+	 * continuation. */
+	end = line;
+	while ((end = strchr (end, '\n')) && (end[1] == ' ' || end[1] == '\t'))
+	    end++;
+	if (end == NULL)
+	    break;
+
+	if (strncasecmp (line, header, header_len) != 0 ||
+	    line[header_len] != ':')
+	    continue;
+
+	line += header_len + 1;
+	if (*line == ' ')
+	    line++;
+
+	raw = talloc_strndup (ctx, line, end - line);
+	if (raw == NULL)
+	    return NULL;
+	decoded = g_mime_utils_header_decode_text (raw);
+	talloc_free (raw);
+	if (decoded == NULL)
+	    return NULL;
+	ret = talloc_strdup (ctx, decoded);
+	g_free (decoded);
+	return ret;
+    }
+
+    return talloc_strdup (ctx, "");
+}
+
+const char *
+notmuch_message_get_stored_headers (notmuch_message_t *message)
+{
+    try {
+	std::string block = message->doc.get_value (NOTMUCH_VALUE_HEADERS);
+
+	if (block.empty ())
+	    return NULL;
+
+	return talloc_strdup (message, block.c_str ());
+    } catch (Xapian::Error &error) {
+	_notmuch_database_log (_notmuch_message_database (message),
+			       "A Xapian exception occurred when reading headers: %s\n",
+			       error.get_msg().c_str());
+	message->notmuch->exception_reported = TRUE;
+	return NULL;
+    }
+}
+
+notmuch_mailboxes_t *
+notmuch_message_get_mailboxes (notmuch_message_t *message, const char *header)
+{
+    const char *headers[] = { "from", "to", "cc", "bcc" };
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE (headers); i++)
+	if (strcasecmp (header, headers[i]) == 0)
+	    break;
+    if (i == ARRAY_SIZE (headers))
+	return NULL;
+
+    try {
+	std::string list = message->doc.get_value (NOTMUCH_VALUE_MAILBOXES);
+
+	if (list.empty ())
+	    return NULL;
+
+	return _notmuch_mailboxes_create (message, list.c_str (), headers[i]);
+    } catch (Xapian::Error &error) {
+	_notmuch_database_log (_notmuch_message_database (message),
+			       "A Xapian exception occurred when reading mailboxes: %s\n",
+			       error.get_msg().c_str());
+	message->notmuch->exception_reported = TRUE;
+	return NULL;
+    }
+}
+
 const char *
 notmuch_message_get_header (notmuch_message_t *message, const char *header)
 {
     Xapian::valueno slot = Xapian::BAD_VALUENO;
+    unsigned int i;
 
     /* Fetch header from the appropriate xapian value field if
      * available */
@@ -475,12 +720,38 @@ notmuch_message_get_header (notmuch_message_t *message, const char *header)
 	}
     }
 
+    /* Messages indexed with a header block answer for the headers
+     * it holds without opening the file. */
+    for (i = 0; i < ARRAY_SIZE (block_headers); i++) {
+	if (strcasecmp (header, block_headers[i]) == 0) {
+	    try {
+		std::string block = message->doc.get_value (NOTMUCH_VALUE_HEADERS);
+
+		if (! block.empty ())
+		    return _notmuch_header_block_get (message, block.c_str (),
+						      block_headers[i]);
+	    } catch (Xapian::Error &error) {
+		_notmuch_database_log (_notmuch_message_database (message),
+				       "A Xapian exception occurred when reading header: %s\n",
+				       error.get_msg().c_str());
+		message->notmuch->exception_reported = TRUE;
+		return NULL;
+	    }
+	    break;
+	}
+    }
+
     /* Otherwise fall back to parsing the file */
+    const char *value = NULL;
+
+    _notmuch_profile_begin (NOTMUCH_PROFILE_HEADER_FALLBACK);
     _notmuch_message_ensure_message_file (message);
-    if (message->message_file == NULL)
-	return NULL;
+    if (message->message_file)
+	value = _notmuch_message_file_get_header (message->message_file,
+						  header);
+    _notmuch_profile_end (NOTMUCH_PROFILE_HEADER_FALLBACK);
 
-    return _notmuch_message_file_get_header (message->message_file, header);
+    return value;
 }
 
 /* Return the message ID from the In-Reply-To header of 'message'.
@@ -539,6 +810,7 @@ _notmuch_message_remove_terms (notmuch_message_t *message, const char *prefix)
 
 	try {
 	    message->doc.remove_term ((*i));
+	    message->modified = TRUE;
 	} catch (const Xapian::InvalidArgumentError) {
 	    /* Ignore failure to remove non-existent term. */
 	}
@@ -958,6 +1230,28 @@ notmuch_message_get_tags (notmuch_message_t *message)
 const char *
 _notmuch_message_get_author (notmuch_message_t *message)
 {
+    std::string value;
+
+    if (message->author)
+	return message->author;
+
+    try {
+	value = message->doc.get_value (NOTMUCH_VALUE_AUTHOR);
+    } catch (Xapian::Error &error) {
+	_notmuch_database_log(_notmuch_message_database (message), "A Xapian exception occurred when reading author: %s\n",
+		 error.get_msg().c_str());
+	message->notmuch->exception_reported = TRUE;
+	return NULL;
+    }
+
+    /* As for the header values, an empty value only means "no
+     * author" if the database promises to record it. */
+    if (! value.empty ())
+	message->author = talloc_strdup (message, value.c_str ());
+    else if (! (message->notmuch->features & NOTMUCH_FEATURE_AUTHOR_VALUES))
+	message->author = _notmuch_thread_summary_author (
+	    message, notmuch_message_get_header (message, "from"));
+
     return message->author;
 }
 
@@ -990,6 +1284,48 @@ _notmuch_message_set_header_values (notmuch_message_t *message,
 			    Xapian::sortable_serialise (time_value));
     message->doc.add_value (NOTMUCH_VALUE_FROM, from);
     message->doc.add_value (NOTMUCH_VALUE_SUBJECT, subject);
+
+    if (message->notmuch->features & NOTMUCH_FEATURE_AUTHOR_VALUES) {
+	char *author = _notmuch_thread_summary_author (message, from);
+
+	message->doc.add_value (NOTMUCH_VALUE_AUTHOR, author ? author : "");
+	talloc_free (author);
+    }
+}
+
+void
+_notmuch_message_set_header_block (notmuch_message_t *message,
+				   const char *block)
+{
+    if (block)
+	message->doc.add_value (NOTMUCH_VALUE_HEADERS, block);
+}
+
+void
+_notmuch_message_set_mailboxes (notmuch_message_t *message,
+				const char *mailboxes)
+{
+    if (mailboxes)
+	message->doc.add_value (NOTMUCH_VALUE_MAILBOXES, mailboxes);
+}
+
+/* Describe the document of 'message' as it is stored in the database
+ * for the summary of its thread (see thread-summary.cc), or return
+ * NULL if it is not stored yet or is not part of a thread summary. */
+static notmuch_thread_summary_entry_t *
+_notmuch_message_stored_summary_entry (notmuch_message_t *message)
+{
+    Xapian::Database *db = message->notmuch->xapian_db;
+
+    if (message->doc_id > db->get_lastdocid ())
+	return NULL;
+
+    try {
+	return _notmuch_thread_summary_entry_create (
+	    message, message->notmuch, db->get_document (message->doc_id));
+    } catch (const Xapian::DocNotFoundError &) {
+	return NULL;
+    }
 }
 
 /* Synchronize changes made to message->doc out into the database. */
@@ -997,12 +1333,42 @@ void
 _notmuch_message_sync (notmuch_message_t *message)
 {
     Xapian::WritableDatabase *db;
+    notmuch_profile_phase_t phase = NOTMUCH_PROFILE_XAPIAN_REPLACE;
+    notmuch_thread_summary_entry_t *old_entry = NULL, *new_entry;
 
     if (message->notmuch->mode == NOTMUCH_DATABASE_MODE_READ_ONLY)
 	return;
 
     db = static_cast <Xapian::WritableDatabase *> (message->notmuch->xapian_db);
-    db->replace_document (message->doc_id, message->doc);
+
+    if (message->notmuch->features & NOTMUCH_FEATURE_THREAD_SUMMARIES)
+	old_entry = _notmuch_message_stored_summary_entry (message);
+
+    /* New documents get IDs beyond the last one Xapian knows. */
+    if (_notmuch_profile_enabled () && message->doc_id > db->get_lastdocid ())
+	phase = NOTMUCH_PROFILE_XAPIAN_ADD;
+
+    _notmuch_profile_begin (phase);
+    try {
+	db->replace_document (message->doc_id, message->doc);
+    } catch (...) {
+	_notmuch_profile_end (phase);
+	throw;
+    }
+    _notmuch_profile_end (phase);
+    message->modified = FALSE;
+    _notmuch_message_cache_remove (message->notmuch, message->doc_id);
+
+    /* Bring the summaries of the threads the message was and is in up
+     * to date. */
+    if (message->notmuch->features & NOTMUCH_FEATURE_THREAD_SUMMARIES) {
+	new_entry = _notmuch_thread_summary_entry_create (message,
+							  message->notmuch,
+							  message->doc);
+	_notmuch_thread_summary_change (message->notmuch, old_entry, new_entry);
+	talloc_free (old_entry);
+	talloc_free (new_entry);
+    }
 }
 
 /* Delete a message document from the database. */
@@ -1011,16 +1377,110 @@ _notmuch_message_delete (notmuch_message_t *message)
 {
     notmuch_status_t status;
     Xapian::WritableDatabase *db;
+    notmuch_thread_summary_entry_t *old_entry = NULL;
 
     status = _notmuch_database_ensure_writable (message->notmuch);
     if (status)
 	return status;
 
+    if (message->notmuch->features & NOTMUCH_FEATURE_THREAD_SUMMARIES)
+	old_entry = _notmuch_message_stored_summary_entry (message);
+
     db = static_cast <Xapian::WritableDatabase *> (message->notmuch->xapian_db);
     db->delete_document (message->doc_id);
+    _notmuch_message_cache_remove (message->notmuch, message->doc_id);
+
+    if (old_entry) {
+	_notmuch_thread_summary_change (message->notmuch, old_entry, NULL);
+	talloc_free (old_entry);
+    }
     return NOTMUCH_STATUS_SUCCESS;
 }
 
+/* Apply the 'count' tag changes in 'ops' to the document 'doc_id'
+ * without creating a message object for it (see
+ * notmuch_query_apply_tag_ops).  The document is only rewritten if
+ * its tags change, in which case *changed is set to TRUE.  The caller
+ * must have validated the tags and ensured that the database is
+ * writable.
+ */
+notmuch_status_t
+_notmuch_message_apply_tag_ops_by_doc_id (notmuch_database_t *notmuch,
+					  unsigned int doc_id,
+					  const notmuch_tag_op_t *ops,
+					  unsigned int count,
+					  notmuch_bool_t *changed)
+{
+    Xapian::WritableDatabase *db =
+	static_cast <Xapian::WritableDatabase *> (notmuch->xapian_db);
+    const char *tag_prefix = _find_prefix ("tag");
+    size_t tag_prefix_len = strlen (tag_prefix);
+    void *local = talloc_new (NULL);
+    notmuch_thread_summary_entry_t *old_entry = NULL;
+    GHashTable *tags;
+    notmuch_status_t status = NOTMUCH_STATUS_SUCCESS;
+    unsigned int n;
+
+    *changed = FALSE;
+    tags = g_hash_table_new (g_str_hash, g_str_equal);
+
+    try {
+	Xapian::Document doc = db->get_document (doc_id);
+	Xapian::TermIterator i, end;
+
+	if (notmuch->features & NOTMUCH_FEATURE_THREAD_SUMMARIES)
+	    old_entry = _notmuch_thread_summary_entry_create (local, notmuch,
+							      doc);
+
+	i = doc.termlist_begin ();
+	end = doc.termlist_end ();
+
+	for (i.skip_to (tag_prefix); i != end; i++) {
+	    const std::string &term = *i;
+	    char *tag;
+
+	    if (strncmp (term.c_str (), tag_prefix, tag_prefix_len))
+		break;
+	    tag = talloc_strdup (local, term.c_str () + tag_prefix_len);
+	    g_hash_table_insert (tags, tag, tag);
+	}
+
+	for (n = 0; n < count; n++) {
+	    const char *tag = ops[n].tag;
+	    std::string term = std::string (tag_prefix) + tag;
+
+	    if (ops[n].remove && g_hash_table_remove (tags, tag)) {
+		doc.remove_term (term);
+		*changed = TRUE;
+	    } else if (! ops[n].remove && ! g_hash_table_lookup (tags, tag)) {
+		g_hash_table_insert (tags, (gpointer) tag, (gpointer) tag);
+		doc.add_term (term, 0);
+		*changed = TRUE;
+	    }
+	}
+
+	if (*changed) {
+	    db->replace_document (doc_id, doc);
+	    _notmuch_message_cache_remove (notmuch, doc_id);
+
+	    if (old_entry)
+		_notmuch_thread_summary_change (
+		    notmuch, old_entry,
+		    _notmuch_thread_summary_entry_create (local, notmuch, doc));
+	}
+    } catch (const Xapian::Error &error) {
+	_notmuch_database_log (notmuch, "A Xapian exception occurred changing tags: %s\n",
+			       error.get_msg().c_str());
+	notmuch->exception_reported = TRUE;
+	status = NOTMUCH_STATUS_XAPIAN_EXCEPTION;
+    }
+
+    g_hash_table_unref (tags);
+    talloc_free (local);
+
+    return status;
+}
+
 /* Transform a blank message into a ghost message.  The caller must
  * _notmuch_message_sync the message. */
 notmuch_private_status_t
@@ -1077,6 +1537,7 @@ _notmuch_message_add_term (notmuch_message_t *message,
 	return NOTMUCH_PRIVATE_STATUS_TERM_TOO_LONG;
 
     message->doc.add_term (term, 0);
+    message->modified = TRUE;
 
     talloc_free (term);
 
@@ -1145,6 +1606,7 @@ _notmuch_message_remove_term (notmuch_message_t *message,
 
     try {
 	message->doc.remove_term (term);
+	message->modified = TRUE;
     } catch (const Xapian::InvalidArgumentError) {
 	/* We'll let the philosopher's try to wrestle with the
 	 * question of whether failing to remove that which was not
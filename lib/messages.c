@@ -70,6 +70,7 @@ _notmuch_messages_create (notmuch_message_list_t *list)
 
     messages->is_of_list_type = TRUE;
     messages->iterator = list->head;
+    messages->info_ctx = NULL;
 
     return messages;
 }
@@ -133,6 +134,83 @@ notmuch_messages_destroy (notmuch_messages_t *messages)
     talloc_free (messages);
 }
 
+/* Store the properties of message into info, with the allocated
+ * parts owned by ctx. */
+static notmuch_status_t
+_notmuch_message_get_info (void *ctx, notmuch_message_t *message,
+			   notmuch_message_info_t *info)
+{
+    notmuch_tags_t *tags;
+    unsigned int flag;
+
+    info->message_id = notmuch_message_get_message_id (message);
+    info->thread_id = notmuch_message_get_thread_id (message);
+    info->date = notmuch_message_get_date (message);
+
+    info->flags = 0;
+    for (flag = NOTMUCH_MESSAGE_FLAG_MATCH;
+	 flag <= NOTMUCH_MESSAGE_FLAG_GHOST; flag++) {
+	if (notmuch_message_get_flag (message, flag))
+	    info->flags |= (1u << flag);
+    }
+
+    info->num_tags = 0;
+    info->tags = NULL;
+    for (tags = notmuch_message_get_tags (message);
+	 notmuch_tags_valid (tags);
+	 notmuch_tags_move_to_next (tags))
+    {
+	info->tags = talloc_realloc (ctx, info->tags, const char *,
+				     info->num_tags + 1);
+	if (unlikely (info->tags == NULL))
+	    return NOTMUCH_STATUS_OUT_OF_MEMORY;
+	info->tags[info->num_tags++] = notmuch_tags_get (tags);
+    }
+    notmuch_tags_destroy (tags);
+
+    return NOTMUCH_STATUS_SUCCESS;
+}
+
+notmuch_status_t
+notmuch_messages_get_info (notmuch_messages_t *messages,
+			   notmuch_message_info_t *info,
+			   unsigned int count,
+			   unsigned int *filled)
+{
+    notmuch_message_t *message;
+    notmuch_status_t status;
+
+    if (info == NULL || filled == NULL)
+	return NOTMUCH_STATUS_NULL_POINTER;
+
+    *filled = 0;
+
+    if (messages == NULL)
+	return NOTMUCH_STATUS_SUCCESS;
+
+    talloc_free (messages->info_ctx);
+    messages->info_ctx = talloc_new (messages);
+    if (unlikely (messages->info_ctx == NULL))
+	return NOTMUCH_STATUS_OUT_OF_MEMORY;
+
+    while (*filled < count && (message = notmuch_messages_get (messages))) {
+	/* Messages of a list belong to the list and stay around, but
+	 * those of a query result are created by notmuch_messages_get,
+	 * so keep them only as long as their info. */
+	if (! messages->is_of_list_type)
+	    talloc_steal (messages->info_ctx, message);
+
+	status = _notmuch_message_get_info (messages->info_ctx, message,
+					    &info[*filled]);
+	if (status)
+	    return status;
+
+	(*filled)++;
+	notmuch_messages_move_to_next (messages);
+    }
+
+    return NOTMUCH_STATUS_SUCCESS;
+}
 
 notmuch_tags_t *
 notmuch_messages_collect_tags (notmuch_messages_t *messages)
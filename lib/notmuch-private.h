@@ -50,6 +50,7 @@ NOTMUCH_BEGIN_DECLS
 
 #include "xutil.h"
 #include "error_util.h"
+#include "profile-private.h"
 
 #pragma GCC visibility push(hidden)
 
@@ -107,7 +108,10 @@ typedef enum {
     NOTMUCH_VALUE_TIMESTAMP = 0,
     NOTMUCH_VALUE_MESSAGE_ID,
     NOTMUCH_VALUE_FROM,
-    NOTMUCH_VALUE_SUBJECT
+    NOTMUCH_VALUE_SUBJECT,
+    NOTMUCH_VALUE_AUTHOR,
+    NOTMUCH_VALUE_HEADERS,
+    NOTMUCH_VALUE_MAILBOXES
 } notmuch_value_t;
 
 /* Xapian (with flint backend) complains if we provide a term longer
@@ -117,6 +121,10 @@ typedef enum {
 
 #define NOTMUCH_METADATA_THREAD_ID_PREFIX "thread_id_"
 
+#define NOTMUCH_METADATA_NAMED_QUERY_PREFIX "named_query."
+
+#define NOTMUCH_METADATA_THREAD_SUMMARY_PREFIX "thread_summary."
+
 /* For message IDs we have to be even more restrictive. Beyond fitting
  * into the term limit, we also use message IDs to construct
  * metadata-key values. And the documentation says that these should
@@ -190,6 +198,11 @@ _notmuch_message_id_compressed (void *ctx, const char *message_id);
 notmuch_status_t
 _notmuch_database_ensure_writable (notmuch_database_t *notmuch);
 
+/* Initialize the libraries notmuch depends on, once per process,
+ * whichever thread gets here first. */
+void
+_notmuch_init (void);
+
 void
 _notmuch_database_log (notmuch_database_t *notmuch,
 		       const char *format, ...);
@@ -222,6 +235,9 @@ _notmuch_database_find_directory_id (notmuch_database_t *database,
 				     notmuch_find_flags_t flags,
 				     unsigned int *directory_id);
 
+void
+_notmuch_database_flush_directory_cache (notmuch_database_t *notmuch);
+
 const char *
 _notmuch_database_get_directory_path (void *ctx,
 				      notmuch_database_t *notmuch,
@@ -297,6 +313,9 @@ notmuch_status_t
 _notmuch_message_rename (notmuch_message_t *message,
 			 const char *new_filename);
 
+void
+_notmuch_message_ensure_metadata (notmuch_message_t *message);
+
 void
 _notmuch_message_ensure_thread_id (notmuch_message_t *message);
 
@@ -305,12 +324,33 @@ _notmuch_message_set_header_values (notmuch_message_t *message,
 				    const char *date,
 				    const char *from,
 				    const char *subject);
+
+/* Store the header block of 'message' (see
+ * _notmuch_message_file_get_header_block), from which its headers
+ * can be read without opening the message file. */
+void
+_notmuch_message_set_header_block (notmuch_message_t *message,
+				   const char *block);
+
+/* Store the mailboxes of 'message' (see
+ * _notmuch_message_file_get_mailboxes). */
+void
+_notmuch_message_set_mailboxes (notmuch_message_t *message,
+				const char *mailboxes);
+
 void
 _notmuch_message_sync (notmuch_message_t *message);
 
 notmuch_status_t
 _notmuch_message_delete (notmuch_message_t *message);
 
+notmuch_status_t
+_notmuch_message_apply_tag_ops_by_doc_id (notmuch_database_t *notmuch,
+					  unsigned int doc_id,
+					  const notmuch_tag_op_t *ops,
+					  unsigned int count,
+					  notmuch_bool_t *changed);
+
 notmuch_private_status_t
 _notmuch_message_initialize_ghost (notmuch_message_t *message,
 				   const char *thread_id);
@@ -339,7 +379,11 @@ _notmuch_message_clear_data (notmuch_message_t *message);
 void
 _notmuch_message_set_author (notmuch_message_t *message, const char *author);
 
-/* Get the author member of 'message' */
+/* Get the author member of 'message', which defaults to the cleaned-up
+ * sender name stored at index time (or, for documents indexed without
+ * one, the name parsed from the From header).
+ *
+ * Returns NULL if the message has no sender. */
 const char *
 _notmuch_message_get_author (notmuch_message_t *message);
 
@@ -411,12 +455,48 @@ const char *
 _notmuch_message_file_get_header (notmuch_message_file_t *message,
 				 const char *header);
 
+/* Get the headers of the message that are needed to show it without
+ * its body (Subject, From, To, Cc, Bcc, Reply-To, Date and
+ * In-Reply-To), as a block of raw header lines in the order of the
+ * file, ended by an empty line.
+ *
+ * The result is talloc'ed on 'ctx'.  Returns NULL on errors.
+ */
+char *
+_notmuch_message_file_get_header_block (void *ctx,
+					notmuch_message_file_t *message);
+
+/* Get the mailboxes of the From, To, Cc and Bcc headers of the
+ * message, parsed as by internet_address_list_parse_string, with
+ * groups flattened.  Each mailbox is a line
+ *
+ *	<header>\t<address>[\t<name>]\n
+ *
+ * where <header> is "from", "to", "cc" or "bcc", and the name is left
+ * out if the mailbox has none.  Tabs and newlines in addresses and
+ * names are replaced by spaces.  The list is ended by an empty line.
+ *
+ * The result is talloc'ed on 'ctx'.  Returns NULL on errors.
+ */
+char *
+_notmuch_message_file_get_mailboxes (void *ctx,
+				     notmuch_message_file_t *message);
+
 /* index.cc */
 
 notmuch_status_t
 _notmuch_message_index_file (notmuch_message_t *message,
 			     notmuch_message_file_t *message_file);
 
+/* mailboxes.c */
+
+/* Create an iterator over the mailboxes of 'header' in 'list', in the
+ * format of _notmuch_message_file_get_mailboxes.  The list is copied.
+ */
+notmuch_mailboxes_t *
+_notmuch_mailboxes_create (const void *ctx, const char *list,
+			   const char *header);
+
 /* messages.c */
 
 typedef struct _notmuch_message_node {
@@ -437,6 +517,8 @@ struct visible _notmuch_messages {
     notmuch_bool_t is_of_list_type;
     notmuch_doc_id_set_t *excluded_doc_ids;
     notmuch_message_node_t *iterator;
+    /* Owner of what notmuch_messages_get_info last returned. */
+    void *info_ctx;
 };
 
 notmuch_message_list_t *
@@ -460,13 +542,43 @@ _notmuch_mset_messages_get (notmuch_messages_t *messages);
 void
 _notmuch_mset_messages_move_to_next (notmuch_messages_t *messages);
 
+notmuch_database_t *
+_notmuch_query_database (notmuch_query_t *query);
+
+notmuch_status_t
+_notmuch_query_search_doc_ids (notmuch_query_t *query,
+			       const void *ctx,
+			       unsigned int **doc_ids,
+			       unsigned int *count);
+
+/* doc-id-set.c */
+
+notmuch_doc_id_set_t *
+_notmuch_doc_id_set_create (const void *ctx);
+
+notmuch_bool_t
+_notmuch_doc_id_set_add (notmuch_doc_id_set_t *doc_ids,
+			 unsigned int doc_id);
+
 notmuch_bool_t
 _notmuch_doc_id_set_contains (notmuch_doc_id_set_t *doc_ids,
-                              unsigned int doc_id);
+			      unsigned int doc_id);
 
 void
 _notmuch_doc_id_set_remove (notmuch_doc_id_set_t *doc_ids,
-                            unsigned int doc_id);
+			    unsigned int doc_id);
+
+unsigned int
+_notmuch_doc_id_set_count (notmuch_doc_id_set_t *doc_ids);
+
+notmuch_bool_t
+_notmuch_doc_id_set_next (notmuch_doc_id_set_t *doc_ids,
+			  unsigned int doc_id,
+			  unsigned int *next);
+
+void
+_notmuch_doc_id_set_intersect (notmuch_doc_id_set_t *doc_ids,
+			       notmuch_doc_id_set_t *other);
 
 /* message.cc */
 
@@ -524,6 +636,54 @@ notmuch_filenames_t *
 _notmuch_filenames_create (const void *ctx,
 			   notmuch_string_list_t *list);
 
+/* thread-summary.cc */
+
+/* What the summary of a thread records about one of its messages. */
+typedef struct _notmuch_thread_summary_entry {
+    char *thread_id;
+    time_t date;
+    /* Empty if the message has no usable From header. */
+    char *author;
+    char *subject;
+    /* Sorted. */
+    notmuch_string_list_t *tags;
+} notmuch_thread_summary_entry_t;
+
+typedef struct _notmuch_thread_summary {
+    /* The number of messages of the thread. */
+    unsigned int count;
+    /* The subject of the oldest message. */
+    char *subject;
+    /* In the order of the oldest message of each author. */
+    notmuch_string_list_t *authors;
+    /* The union of the tags of the messages, sorted. */
+    notmuch_string_list_t *tags;
+} notmuch_thread_summary_t;
+
+char *
+_notmuch_thread_summary_author (void *ctx, const char *from);
+
+void
+_notmuch_thread_summary_rebuild (notmuch_database_t *notmuch,
+				 const char *thread_id);
+
+void
+_notmuch_thread_summary_change (notmuch_database_t *notmuch,
+				const notmuch_thread_summary_entry_t *old_entry,
+				const notmuch_thread_summary_entry_t *new_entry);
+
+notmuch_thread_summary_t *
+_notmuch_thread_summary_get (void *ctx,
+			     notmuch_database_t *notmuch,
+			     const char *thread_id);
+
+/* profile.c */
+
+/* Whether NOTMUCH_PROFILE enabled profiling, for work that is only
+ * needed to profile. */
+notmuch_bool_t
+_notmuch_profile_enabled (void);
+
 /* thread.cc */
 
 notmuch_thread_t *
@@ -56,7 +56,7 @@ NOTMUCH_BEGIN_DECLS
  * version in Makefile.local.
  */
 #define LIBNOTMUCH_MAJOR_VERSION	4
-#define LIBNOTMUCH_MINOR_VERSION	2
+#define LIBNOTMUCH_MINOR_VERSION	3
 #define LIBNOTMUCH_MICRO_VERSION	0
 
 #endif /* __DOXYGEN__ */
@@ -163,6 +163,10 @@ typedef enum _notmuch_status {
      * The operation requires a database upgrade.
      */
     NOTMUCH_STATUS_UPGRADE_REQUIRED,
+    /**
+     * An argument passed to a function has an invalid value.
+     */
+    NOTMUCH_STATUS_ILLEGAL_ARGUMENT,
     /**
      * Not an actual status value. Just a way to find out how many
      * valid status values there are.
@@ -190,6 +194,8 @@ typedef struct _notmuch_message notmuch_message_t;
 typedef struct _notmuch_tags notmuch_tags_t;
 typedef struct _notmuch_directory notmuch_directory_t;
 typedef struct _notmuch_filenames notmuch_filenames_t;
+typedef struct _notmuch_mailboxes notmuch_mailboxes_t;
+typedef struct _notmuch_tag_dump notmuch_tag_dump_t;
 #endif /* __DOXYGEN__ */
 
 /**
@@ -301,6 +307,46 @@ notmuch_database_open_verbose (const char *path,
 			       notmuch_database_t **database,
 			       char **error_message);
 
+/**
+ * Open another read-only handle on the database of 'database'.
+ *
+ * Threads: a database, and every object obtained from it (queries,
+ * messages, threads, tags, directories and so on), may only be used
+ * by one thread at a time.  Different databases may be used from
+ * different threads at the same time, including databases opened on
+ * the same path.  Process-wide initialization (of GMime and GLib) is
+ * done once, by whichever thread first opens a database.  Memory
+ * returned by the library is allocated with talloc, so it must not
+ * be shared between threads either.
+ *
+ * A clone is cheaper to get than a database of notmuch_database_open:
+ * the checks of the database version and features made when
+ * 'database' was opened are not repeated.  Give each worker thread
+ * its own clone.  A clone sees the latest revision committed to disk
+ * when it was made (see notmuch_database_reopen), and is independent
+ * of 'database' afterwards: either may be destroyed first.
+ *
+ * 'database' itself must not be in use by another thread during the
+ * call.
+ *
+ * The caller should call notmuch_database_destroy when finished with
+ * the clone.
+ *
+ * Return value:
+ *
+ * NOTMUCH_STATUS_SUCCESS: The clone was stored in *clone.
+ *
+ * NOTMUCH_STATUS_NULL_POINTER: 'clone' is NULL.
+ *
+ * NOTMUCH_STATUS_OUT_OF_MEMORY: Out of memory.
+ *
+ * NOTMUCH_STATUS_XAPIAN_EXCEPTION: 'database' is closed, or a Xapian
+ *	exception occurred.
+ */
+notmuch_status_t
+notmuch_database_clone_reader (notmuch_database_t *database,
+			       notmuch_database_t **clone);
+
 /**
  * Retrieve last status string for given database.
  *
@@ -308,6 +354,25 @@ notmuch_database_open_verbose (const char *path,
 const char *
 notmuch_database_status_string (notmuch_database_t *notmuch);
 
+/**
+ * Bring a read-only database up to date with the latest changes
+ * committed to disk, by this or any other process.
+ *
+ * A read-only database otherwise keeps seeing the revision that was
+ * current when it was opened.  Reopening is cheap when nothing has
+ * changed.  Objects derived from the database before it was reopened
+ * should not be used afterwards.  Writable databases always see their
+ * own changes, so for them this has no effect.
+ *
+ * Return value:
+ *
+ * NOTMUCH_STATUS_SUCCESS: The database was reopened.
+ *
+ * NOTMUCH_STATUS_XAPIAN_EXCEPTION: A Xapian exception occurred.
+ */
+notmuch_status_t
+notmuch_database_reopen (notmuch_database_t *database);
+
 /**
  * Commit changes and close the given notmuch database.
  *
@@ -648,6 +713,60 @@ notmuch_database_find_message_by_filename (notmuch_database_t *notmuch,
 notmuch_tags_t *
 notmuch_database_get_all_tags (notmuch_database_t *db);
 
+/**
+ * Store 'query_string' in the database under 'name', so that later
+ * queries can refer to it as "query:<name>".
+ *
+ * A name may not be empty and may not contain whitespace, quotes or
+ * parentheses.  Passing NULL or "" for 'query_string' removes any
+ * query previously stored under 'name'.
+ *
+ * Named queries may refer to other named queries.  They are expanded
+ * into the query string each time a query is run, so using one costs
+ * the same as writing out the stored query.
+ *
+ * Return value:
+ *
+ * NOTMUCH_STATUS_SUCCESS: Query successfully stored or removed.
+ *
+ * NOTMUCH_STATUS_NULL_POINTER: The given 'name' is NULL.
+ *
+ * NOTMUCH_STATUS_ILLEGAL_ARGUMENT: The given 'name' is not a valid
+ * 	name for a query.
+ *
+ * NOTMUCH_STATUS_READ_ONLY_DATABASE: Database was opened in
+ * 	read-only mode so the query cannot be stored.
+ *
+ * NOTMUCH_STATUS_XAPIAN_EXCEPTION: A Xapian exception occurred
+ */
+notmuch_status_t
+notmuch_database_set_named_query (notmuch_database_t *notmuch,
+				  const char *name,
+				  const char *query_string);
+
+/**
+ * Retrieve the query string stored under 'name'.
+ *
+ * On success, *query_string is set to a newly allocated string that
+ * the caller must free with free(), or to NULL if no query is stored
+ * under 'name'.
+ *
+ * Return value:
+ *
+ * NOTMUCH_STATUS_SUCCESS: Lookup completed (even if nothing was found).
+ *
+ * NOTMUCH_STATUS_NULL_POINTER: The given 'name' or 'query_string' is
+ * 	NULL.
+ *
+ * NOTMUCH_STATUS_OUT_OF_MEMORY: Out of memory.
+ *
+ * NOTMUCH_STATUS_XAPIAN_EXCEPTION: A Xapian exception occurred
+ */
+notmuch_status_t
+notmuch_database_get_named_query (notmuch_database_t *notmuch,
+				  const char *name,
+				  char **query_string);
+
 /**
  * Create a new query for 'database'.
  *
@@ -963,6 +1082,201 @@ notmuch_query_count_messages (notmuch_query_t *query);
 unsigned
 notmuch_query_count_threads (notmuch_query_t *query);
 
+/**
+ * Count the messages matching each of 'num_queries' queries, storing
+ * the count of queries[i] in counts[i].
+ *
+ * The counts are those of notmuch_query_count_messages.  Each
+ * distinct query is still evaluated on its own; what is shared is
+ * that identical queries are only evaluated once, and that for a
+ * batch of several queries the messages carrying the exclude tags
+ * are read once rather than for each query.  All the queries must
+ * belong to the same database.
+ *
+ * Return value:
+ *
+ * NOTMUCH_STATUS_SUCCESS: All the counts were stored.
+ *
+ * NOTMUCH_STATUS_NULL_POINTER: One of the queries is NULL.
+ *
+ * NOTMUCH_STATUS_ILLEGAL_ARGUMENT: The queries belong to different
+ *	databases.
+ *
+ * NOTMUCH_STATUS_OUT_OF_MEMORY: Memory allocation failed.
+ *
+ * NOTMUCH_STATUS_XAPIAN_EXCEPTION: A Xapian exception occurred.
+ */
+notmuch_status_t
+notmuch_query_count_messages_batch (notmuch_query_t **queries,
+				    unsigned int num_queries,
+				    unsigned int *counts);
+
+/**
+ * Count the threads matching each of 'num_queries' queries, storing
+ * the count of queries[i] in counts[i].
+ *
+ * The counts are those of notmuch_query_count_threads.  Besides what
+ * notmuch_query_count_messages_batch shares, once the queries
+ * have matched enough messages the thread of every message is read
+ * once for the whole batch, from the thread terms, so that no further
+ * message document needs to be loaded.
+ *
+ * The return values are those of notmuch_query_count_messages_batch.
+ */
+notmuch_status_t
+notmuch_query_count_threads_batch (notmuch_query_t **queries,
+				   unsigned int num_queries,
+				   unsigned int *counts);
+
+/**
+ * A change to the tags of a message, for notmuch_query_apply_tag_ops.
+ */
+typedef struct _notmuch_tag_op {
+    /** The tag to add or remove. */
+    const char *tag;
+    /** TRUE to remove 'tag', FALSE to add it. */
+    notmuch_bool_t remove;
+} notmuch_tag_op_t;
+
+/**
+ * Apply the 'count' tag changes in 'ops', in order, to every message
+ * matching 'query'.
+ *
+ * This has the same effect as calling notmuch_message_add_tag and
+ * notmuch_message_remove_tag on each matching message, but works on
+ * the documents directly, without creating message objects, rewrites
+ * only documents whose tags actually change and commits the changes
+ * in large batches.  Because it never looks at message files, it does
+ * not synchronize maildir flags; callers that want
+ * notmuch_message_tags_to_maildir_flags must tag message by message.
+ *
+ * If an error occurs part way through, changes already committed are
+ * kept (unless the caller wrapped the call in an atomic section).
+ *
+ * Within an atomic section of the caller (see
+ * notmuch_database_begin_atomic), nothing is committed before that
+ * section ends, however many messages change.  If 'changed' is not
+ * NULL, the number of messages whose tags changed is stored in it
+ * (also on error or interruption), so that such a caller can decide
+ * when to end its section.
+ *
+ * The optional 'interrupted' callback is called with 'closure' before
+ * each message is changed.  If it returns TRUE, the changes made so
+ * far are committed and the function returns NOTMUCH_STATUS_SUCCESS
+ * without changing the remaining messages.  This lets a caller stop a
+ * large change, for example on SIGINT.
+ *
+ * Return value:
+ *
+ * NOTMUCH_STATUS_SUCCESS: Tags successfully changed (or the change
+ *	was interrupted).
+ *
+ * NOTMUCH_STATUS_NULL_POINTER: One of the tags is NULL.
+ *
+ * NOTMUCH_STATUS_TAG_TOO_LONG: One of the tags is too long (exceeds
+ *	NOTMUCH_TAG_MAX).  No message was changed.
+ *
+ * NOTMUCH_STATUS_READ_ONLY_DATABASE: Database was opened in read-only
+ *	mode so messages cannot be modified.
+ *
+ * NOTMUCH_STATUS_OUT_OF_MEMORY: Memory allocation failed.
+ *
+ * NOTMUCH_STATUS_XAPIAN_EXCEPTION: A Xapian exception occurred.
+ */
+notmuch_status_t
+notmuch_query_apply_tag_ops (notmuch_query_t *query,
+			     const notmuch_tag_op_t *ops,
+			     unsigned int count,
+			     unsigned int *changed,
+			     notmuch_bool_t (*interrupted) (void *closure),
+			     void *closure);
+
+/**
+ * Collect the message IDs and tags of all messages matching 'query',
+ * for example to dump them.
+ *
+ * When many messages match, rather than reading each message, this
+ * reads the list of messages carrying each tag in the database, so it
+ * is much faster than notmuch_query_search_messages followed by
+ * notmuch_message_get_tags.  When few messages match, it reads the
+ * tags of each message instead.  The messages are returned in an
+ * unspecified order, and the sort order of 'query' is ignored.
+ *
+ * Typical usage might be:
+ *
+ *     notmuch_tag_dump_t *dump;
+ *
+ *     if (notmuch_query_search_tag_dump (query, &dump))
+ *         return;
+ *
+ *     for (; notmuch_tag_dump_valid (dump);
+ *          notmuch_tag_dump_move_to_next (dump))
+ *     {
+ *         message_id = notmuch_tag_dump_get_message_id (dump);
+ *         tags = notmuch_tag_dump_get_tags (dump);
+ *         ....
+ *     }
+ *
+ *     notmuch_tag_dump_destroy (dump);
+ *
+ * The returned object belongs to 'query' and is destroyed with it.
+ *
+ * Return value:
+ *
+ * NOTMUCH_STATUS_SUCCESS: Search successful.
+ *
+ * NOTMUCH_STATUS_OUT_OF_MEMORY: Memory allocation failed.
+ *
+ * NOTMUCH_STATUS_XAPIAN_EXCEPTION: A Xapian exception occurred.
+ */
+notmuch_status_t
+notmuch_query_search_tag_dump (notmuch_query_t *query,
+			       notmuch_tag_dump_t **out);
+
+/**
+ * Is the given 'dump' pointing at a valid message?
+ *
+ * When this function returns TRUE, the message ID and tags of the
+ * current message are available from notmuch_tag_dump_get_message_id
+ * and notmuch_tag_dump_get_tags.
+ */
+notmuch_bool_t
+notmuch_tag_dump_valid (notmuch_tag_dump_t *dump);
+
+/**
+ * Get the message ID of the current message in 'dump'.
+ *
+ * The returned string belongs to 'dump' and is only valid until the
+ * next call to notmuch_tag_dump_move_to_next.
+ *
+ * Returns NULL if 'dump' is not valid or if an error occurred.
+ */
+const char *
+notmuch_tag_dump_get_message_id (notmuch_tag_dump_t *dump);
+
+/**
+ * Get the tags of the current message in 'dump', in sorted order.
+ *
+ * The returned list belongs to 'dump', and may be destroyed with
+ * notmuch_tags_destroy once the caller is done with it.
+ *
+ * Returns NULL if 'dump' is not valid or if an error occurred.
+ */
+notmuch_tags_t *
+notmuch_tag_dump_get_tags (notmuch_tag_dump_t *dump);
+
+/**
+ * Move 'dump' to the next message.
+ */
+void
+notmuch_tag_dump_move_to_next (notmuch_tag_dump_t *dump);
+
+/**
+ * Destroy a notmuch_tag_dump_t object.
+ */
+void
+notmuch_tag_dump_destroy (notmuch_tag_dump_t *dump);
+
 /**
  * Get the thread ID of 'thread'.
  *
@@ -1177,6 +1491,65 @@ notmuch_messages_destroy (notmuch_messages_t *messages);
 notmuch_tags_t *
 notmuch_messages_collect_tags (notmuch_messages_t *messages);
 
+/**
+ * The commonly needed properties of one message, as stored by
+ * notmuch_messages_get_info.
+ */
+typedef struct _notmuch_message_info {
+    /* As returned by notmuch_message_get_message_id. */
+    const char *message_id;
+
+    /* As returned by notmuch_message_get_thread_id. */
+    const char *thread_id;
+
+    /* As returned by notmuch_message_get_date. */
+    time_t date;
+
+    /* The flags of the message that are set, with bit (1 << flag)
+     * for each notmuch_message_flag_t flag. */
+    unsigned int flags;
+
+    /* The tags of the message, in the order notmuch_message_get_tags
+     * returns them. */
+    unsigned int num_tags;
+    const char **tags;
+} notmuch_message_info_t;
+
+/**
+ * Retrieve the properties of up to 'count' messages at once.
+ *
+ * Starting with the current message of the 'messages' iterator, store
+ * the properties of each message into the next element of 'info' and
+ * move the iterator to the next message, until 'count' messages have
+ * been stored or the iterator is exhausted.  The number of messages
+ * stored is returned in *filled; it is only less than 'count' at the
+ * end of the iterator.
+ *
+ * This gives the same results as calling notmuch_messages_get and the
+ * notmuch_message_get_* functions for each message in turn, with one
+ * call for many messages.  It is meant for language bindings, for
+ * which each call into the library has a cost.
+ *
+ * The strings and arrays stored in 'info' are owned by 'messages'.
+ * They remain valid until the next call to this function with
+ * 'messages', until 'messages' is destroyed, or until the tags of the
+ * message are changed, whichever comes first.
+ *
+ * Return value:
+ *
+ * NOTMUCH_STATUS_SUCCESS: *filled messages were stored.
+ *
+ * NOTMUCH_STATUS_NULL_POINTER: 'info' or 'filled' is NULL.
+ *
+ * NOTMUCH_STATUS_OUT_OF_MEMORY: Out of memory. The messages stored
+ *	before the error are counted in *filled.
+ */
+notmuch_status_t
+notmuch_messages_get_info (notmuch_messages_t *messages,
+			   notmuch_message_info_t *info,
+			   unsigned int count,
+			   unsigned int *filled);
+
 /**
  * Get the message ID of 'message'.
  *
@@ -1318,6 +1691,91 @@ notmuch_message_get_date  (notmuch_message_t *message);
 const char *
 notmuch_message_get_header (notmuch_message_t *message, const char *header);
 
+/**
+ * Get the headers of 'message' that were stored in the database when
+ * it was indexed, as a block of raw (undecoded) RFC 5322 header lines
+ * ended by an empty line.
+ *
+ * The block holds every Subject, From, To, Cc, Bcc, Reply-To, Date
+ * and In-Reply-To header of the message, in the order of the file,
+ * which is enough to show the message without its body.
+ *
+ * The returned string belongs to the message so should not be
+ * modified or freed by the caller (nor should it be referenced after
+ * the message is destroyed).
+ *
+ * Returns NULL if the message was indexed without the block (by an
+ * older version of notmuch), or if any error occurs.
+ */
+const char *
+notmuch_message_get_stored_headers (notmuch_message_t *message);
+
+/**
+ * Get the mailboxes of the given address header of 'message', as
+ * stored in the database when the message was indexed.
+ *
+ * 'header' is one of "from", "to", "cc" or "bcc" (case insensitive).
+ * The mailboxes are those found by parsing the value returned by
+ * notmuch_message_get_header with internet_address_list_parse_string,
+ * with the members of groups listed in place of the groups, so that
+ * callers after all the addresses of a message do not need to parse
+ * its headers.
+ *
+ * The returned iterator belongs to the message; it may be destroyed
+ * with notmuch_mailboxes_destroy when no longer needed.
+ *
+ * Returns NULL if 'header' is not an address header, if the message
+ * was indexed without its mailboxes (by an older version of notmuch),
+ * or if any error occurs.  Callers should then fall back to parsing
+ * the header.
+ */
+notmuch_mailboxes_t *
+notmuch_message_get_mailboxes (notmuch_message_t *message, const char *header);
+
+/**
+ * Is the given 'mailboxes' iterator pointing at a valid mailbox.
+ *
+ * When this function returns TRUE, notmuch_mailboxes_get_address
+ * will return a valid string.
+ *
+ * It is acceptable to pass NULL for 'mailboxes', in which case this
+ * function will always return FALSE.
+ */
+notmuch_bool_t
+notmuch_mailboxes_valid (notmuch_mailboxes_t *mailboxes);
+
+/**
+ * Get the display name of the current mailbox, or NULL if it has
+ * none.
+ *
+ * The returned string belongs to the iterator and is valid only until
+ * it is moved or destroyed.
+ */
+const char *
+notmuch_mailboxes_get_name (notmuch_mailboxes_t *mailboxes);
+
+/**
+ * Get the address of the current mailbox, or NULL if the iterator is
+ * not valid.
+ *
+ * The returned string belongs to the iterator and is valid only until
+ * it is moved or destroyed.
+ */
+const char *
+notmuch_mailboxes_get_address (notmuch_mailboxes_t *mailboxes);
+
+/**
+ * Move the 'mailboxes' iterator to the next mailbox.
+ */
+void
+notmuch_mailboxes_move_to_next (notmuch_mailboxes_t *mailboxes);
+
+/**
+ * Destroy a notmuch_mailboxes_t object.
+ */
+void
+notmuch_mailboxes_destroy (notmuch_mailboxes_t *mailboxes);
+
 /**
  * Get the tags for 'message', returning a notmuch_tags_t object which
  * can be used to iterate over all tags.
@@ -0,0 +1,90 @@
+/* profile-private.h - Phase timers enabled with NOTMUCH_PROFILE
+ *
+ * Copyright © 2026 agent
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ * Author: agent <agent@local>
+ */
+
+#ifndef NOTMUCH_PROFILE_PRIVATE_H
+#define NOTMUCH_PROFILE_PRIVATE_H
+
+/* This is not part of the library interface.  The functions below
+ * are exported from libnotmuch only so that the notmuch client can
+ * time its own phases in the same report; see gen-version-script.sh.
+ *
+ * Profiling is enabled by setting the NOTMUCH_PROFILE environment
+ * variable before the first call into the library.  When the process
+ * exits, a JSON object is then written on one line, giving for each
+ * phase the number of times it ran and the total time it took in
+ * microseconds.  It goes to standard error if the variable is "1" or
+ * "stderr", and is otherwise appended to the file it names.
+ *
+ * Phases may run within other phases (a file is parsed while its
+ * terms are generated, for example), so the times overlap rather than
+ * adding up to the total.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum _notmuch_profile_phase {
+    /* Listing the files of a directory (by the client). */
+    NOTMUCH_PROFILE_DIRECTORY_SCAN,
+    /* Opening message files. */
+    NOTMUCH_PROFILE_FILE_OPEN,
+    /* Parsing the MIME structure of messages. */
+    NOTMUCH_PROFILE_MIME_PARSE,
+    /* Generating the terms of a message being indexed. */
+    NOTMUCH_PROFILE_TERM_GENERATION,
+    /* Writing new documents to the Xapian database. */
+    NOTMUCH_PROFILE_XAPIAN_ADD,
+    /* Rewriting existing documents, such as after tag changes. */
+    NOTMUCH_PROFILE_XAPIAN_REPLACE,
+    /* Committing transactions and closing a writable database. */
+    NOTMUCH_PROFILE_XAPIAN_COMMIT,
+    /* Building each thread of notmuch_query_search_threads. */
+    NOTMUCH_PROFILE_THREAD_BUILD,
+    /* Reading a header from the message file because the database
+     * does not have it. */
+    NOTMUCH_PROFILE_HEADER_FALLBACK,
+    /* Formatting output (by the client). */
+    NOTMUCH_PROFILE_OUTPUT,
+
+    NOTMUCH_PROFILE_NUM_PHASES
+} notmuch_profile_phase_t;
+
+/* Start timing 'phase', if profiling is enabled.  Every call must be
+ * matched by a call to _notmuch_profile_end in the same thread.
+ * Nested calls for the same phase are timed as one. */
+void
+_notmuch_profile_begin (notmuch_profile_phase_t phase);
+
+/* Stop timing 'phase', as started by _notmuch_profile_begin. */
+void
+_notmuch_profile_end (notmuch_profile_phase_t phase);
+
+/* Stop profiling this process and write no report when it exits.  A
+ * forked child calls this so that the report of its parent is not
+ * written again, with the totals the child inherited. */
+void
+_notmuch_profile_disable (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
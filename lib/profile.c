@@ -0,0 +1,164 @@
+/* profile.c - Phase timers enabled with NOTMUCH_PROFILE
+ *
+ * Copyright © 2026 agent
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ * Author: agent <agent@local>
+ */
+
+#include "notmuch-private.h"
+
+#include <pthread.h>
+#include <time.h>
+
+/* Names of the phases in the report, in the order of
+ * notmuch_profile_phase_t. */
+static const char *phase_names[NOTMUCH_PROFILE_NUM_PHASES] = {
+    "directory_scan",
+    "file_open",
+    "mime_parse",
+    "term_generation",
+    "xapian_add",
+    "xapian_replace",
+    "xapian_commit",
+    "thread_build",
+    "header_fallback",
+    "output",
+};
+
+typedef struct {
+    unsigned long count;
+    double seconds;
+} phase_total_t;
+
+static pthread_once_t profile_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t profile_mutex = PTHREAD_MUTEX_INITIALIZER;
+static notmuch_bool_t profile_enabled;
+static char *profile_target;
+static double profile_start;
+static phase_total_t profile_totals[NOTMUCH_PROFILE_NUM_PHASES];
+
+/* Phases nest only within one thread, so the running phases are kept
+ * per thread, and only the totals are shared. */
+static __thread unsigned int phase_depth[NOTMUCH_PROFILE_NUM_PHASES];
+static __thread double phase_start[NOTMUCH_PROFILE_NUM_PHASES];
+
+static double
+_profile_now (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+_profile_report (void)
+{
+    FILE *out = stderr;
+    unsigned int i;
+
+    if (! profile_enabled)
+	return;
+
+    if (strcmp (profile_target, "1") != 0 &&
+	strcmp (profile_target, "stderr") != 0) {
+	out = fopen (profile_target, "a");
+	if (out == NULL) {
+	    fprintf (stderr, "Error: cannot write profile to %s: %s\n",
+		     profile_target, strerror (errno));
+	    return;
+	}
+    }
+
+    pthread_mutex_lock (&profile_mutex);
+
+    fprintf (out, "{\"pid\": %ld, \"wall_usec\": %.0f, \"phases\": {",
+	     (long) getpid (), (_profile_now () - profile_start) * 1e6);
+    for (i = 0; i < NOTMUCH_PROFILE_NUM_PHASES; i++) {
+	fprintf (out, "%s\"%s\": {\"count\": %lu, \"usec\": %.0f}",
+		 i ? ", " : "", phase_names[i],
+		 profile_totals[i].count, profile_totals[i].seconds * 1e6);
+    }
+    fprintf (out, "}}\n");
+
+    pthread_mutex_unlock (&profile_mutex);
+
+    if (out != stderr)
+	fclose (out);
+}
+
+static void
+_profile_init (void)
+{
+    const char *env = getenv ("NOTMUCH_PROFILE");
+
+    if (env == NULL || *env == '\0' || strcmp (env, "0") == 0)
+	return;
+
+    profile_target = strdup (env);
+    if (profile_target == NULL)
+	return;
+
+    profile_start = _profile_now ();
+    profile_enabled = TRUE;
+    atexit (_profile_report);
+}
+
+notmuch_bool_t
+_notmuch_profile_enabled (void)
+{
+    pthread_once (&profile_once, _profile_init);
+    return profile_enabled;
+}
+
+void
+_notmuch_profile_disable (void)
+{
+    pthread_once (&profile_once, _profile_init);
+    profile_enabled = FALSE;
+}
+
+void
+_notmuch_profile_begin (notmuch_profile_phase_t phase)
+{
+    if (! _notmuch_profile_enabled () ||
+	(unsigned int) phase >= NOTMUCH_PROFILE_NUM_PHASES)
+	return;
+
+    if (phase_depth[phase]++ == 0)
+	phase_start[phase] = _profile_now ();
+}
+
+void
+_notmuch_profile_end (notmuch_profile_phase_t phase)
+{
+    double elapsed;
+
+    if (! _notmuch_profile_enabled () ||
+	(unsigned int) phase >= NOTMUCH_PROFILE_NUM_PHASES ||
+	phase_depth[phase] == 0)
+	return;
+
+    if (--phase_depth[phase] > 0)
+	return;
+
+    elapsed = _profile_now () - phase_start[phase];
+
+    pthread_mutex_lock (&profile_mutex);
+    profile_totals[phase].count++;
+    profile_totals[phase].seconds += elapsed;
+    pthread_mutex_unlock (&profile_mutex);
+}
@@ -22,6 +22,7 @@
 #include "database-private.h"
 
 #include <glib.h> /* GHashTable, GPtrArray */
+#include <limits.h>
 
 struct _notmuch_query {
     notmuch_database_t *notmuch;
@@ -34,35 +35,82 @@ struct _notmuch_query {
 typedef struct _notmuch_mset_messages {
     notmuch_messages_t base;
     notmuch_database_t *notmuch;
+    Xapian::MSetIterator iterator_begin;
     Xapian::MSetIterator iterator;
     Xapian::MSetIterator iterator_end;
 } notmuch_mset_messages_t;
 
-struct _notmuch_doc_id_set {
-    unsigned char *bitmap;
-    unsigned int bound;
-};
-
-#define DOCIDSET_WORD(bit) ((bit) / CHAR_BIT)
-#define DOCIDSET_BIT(bit) ((bit) % CHAR_BIT)
-
 struct visible _notmuch_threads {
     notmuch_query_t *query;
 
-    /* The ordered list of doc ids matched by the query. */
-    GArray *doc_ids;
-    /* Our iterator's current position in doc_ids. */
-    unsigned int doc_id_pos;
+    /* The messages matched by the query, in order.  The current
+     * message is the seed of the next thread. */
+    notmuch_messages_t *messages;
     /* The set of matched docid's that have not been assigned to a
-     * thread. Initially, this contains every docid in doc_ids. */
-    notmuch_doc_id_set_t match_set;
+     * thread. Initially, this contains every docid in messages. */
+    notmuch_doc_id_set_t *match_set;
 };
 
-/* We need this in the message functions so forward declare. */
-static notmuch_bool_t
-_notmuch_doc_id_set_init (void *ctx,
-			  notmuch_doc_id_set_t *doc_ids,
-			  GArray *arr);
+/* Named queries may refer to other named queries, but only this many
+ * levels deep.  This also stops a query that refers to itself. */
+#define NAMED_QUERY_MAX_DEPTH 8
+
+/* The longest query string that named queries may expand to.  A
+ * query that refers twice to another doubles in length with each
+ * level, long before NAMED_QUERY_MAX_DEPTH is reached. */
+#define NAMED_QUERY_MAX_LENGTH (64 * 1024)
+
+/* The number of documents notmuch_query_apply_tag_ops changes in
+ * each of its atomic sections. */
+#define TAG_OPS_BATCH_SIZE 10000
+
+#pragma GCC visibility push(hidden)
+
+/* A posting source over a doc id set, used to replay a set of doc
+ * ids that was already read without evaluating a query again. */
+class DocIdSetSource : public Xapian::PostingSource {
+    notmuch_doc_id_set_t *doc_ids;
+    Xapian::doccount count;
+    Xapian::docid current;
+    bool done;
+
+public:
+    DocIdSetSource (notmuch_doc_id_set_t *doc_ids_, Xapian::doccount count_) :
+	doc_ids (doc_ids_), count (count_), current (0), done (false) { }
+
+    Xapian::doccount get_termfreq_min () const { return count; }
+    Xapian::doccount get_termfreq_est () const { return count; }
+    Xapian::doccount get_termfreq_max () const { return count; }
+
+    void init (unused (const Xapian::Database &db))
+    {
+	current = 0;
+	done = false;
+    }
+
+    void next (unused (Xapian::weight min_wt))
+    {
+	skip_to (current + 1, 0);
+    }
+
+    void skip_to (Xapian::docid did, unused (Xapian::weight min_wt))
+    {
+	unsigned int doc_id;
+
+	if (done || did <= current)
+	    return;
+	if (_notmuch_doc_id_set_next (doc_ids, did, &doc_id))
+	    current = doc_id;
+	else
+	    done = true;
+    }
+
+    bool at_end () const { return done; }
+
+    Xapian::docid get_docid () const { return current; }
+};
+
+#pragma GCC visibility pop
 
 static notmuch_bool_t
 _debug_query (void)
@@ -138,6 +186,7 @@ notmuch_query_add_tag_exclude (notmuch_query_t *query, const char *tag)
 static int
 _notmuch_messages_destructor (notmuch_mset_messages_t *messages)
 {
+    messages->iterator_begin.~MSetIterator ();
     messages->iterator.~MSetIterator ();
     messages->iterator_end.~MSetIterator ();
 
@@ -171,6 +220,215 @@ _notmuch_exclude_tags (notmuch_query_t *query, Xapian::Query xquery)
     return exclude_query;
 }
 
+/* Return the document IDs of all messages carrying one of the
+ * excluded tags registered with query, read directly from the posting
+ * lists of the tag terms.  This must be called after
+ * _notmuch_exclude_tags, so that tags appearing explicitly in the
+ * query have already been dropped from the list.
+ *
+ * The result is not restricted to messages matching the query, but
+ * since it is only ever consulted for messages that do match, this
+ * saves us from evaluating the query a second time.  The set is
+ * allocated with 'ctx' as its talloc owner; NULL is returned if out
+ * of memory. */
+static notmuch_doc_id_set_t *
+_notmuch_exclude_doc_ids (void *ctx, notmuch_query_t *query)
+{
+    Xapian::Database *db = query->notmuch->xapian_db;
+    notmuch_doc_id_set_t *doc_ids = _notmuch_doc_id_set_create (ctx);
+
+    if (unlikely (doc_ids == NULL))
+	return NULL;
+
+    for (notmuch_string_node_t *term = query->exclude_terms->head; term;
+	 term = term->next) {
+	/* Skip tags blanked out by _notmuch_exclude_tags. */
+	if (*term->string == '\0')
+	    continue;
+
+	Xapian::PostingIterator i = db->postlist_begin (term->string);
+	Xapian::PostingIterator end = db->postlist_end (term->string);
+	for (; i != end; i++) {
+	    if (unlikely (! _notmuch_doc_id_set_add (doc_ids, *i))) {
+		talloc_free (doc_ids);
+		return NULL;
+	    }
+	}
+    }
+
+    return doc_ids;
+}
+
+static int
+_compare_doc_ids (const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *) a, y = *(const unsigned int *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Return the document IDs of the messages in 'mset' that carry one of
+ * the excluded tags registered with query.  As for
+ * _notmuch_exclude_doc_ids, this must be called after
+ * _notmuch_exclude_tags.
+ *
+ * The posting list of each excluded tag is only skipped to the
+ * matched documents, in doc id order, so the cost follows the number
+ * of matches rather than the number of excluded messages.  The set
+ * is allocated with 'ctx' as its talloc owner; NULL is returned if
+ * out of memory.  Xapian exceptions are not caught. */
+static notmuch_doc_id_set_t *
+_notmuch_exclude_matched_doc_ids (void *ctx, notmuch_query_t *query,
+				  Xapian::MSet &mset)
+{
+    Xapian::Database *db = query->notmuch->xapian_db;
+    notmuch_doc_id_set_t *doc_ids = _notmuch_doc_id_set_create (ctx);
+    unsigned int *matched, count = 0, i;
+
+    if (unlikely (doc_ids == NULL))
+	return NULL;
+
+    matched = talloc_array (doc_ids, unsigned int, mset.size ());
+    if (unlikely (matched == NULL && mset.size ())) {
+	talloc_free (doc_ids);
+	return NULL;
+    }
+
+    for (Xapian::MSetIterator m = mset.begin (); m != mset.end (); m++)
+	matched[count++] = *m;
+    qsort (matched, count, sizeof (*matched), _compare_doc_ids);
+
+    for (notmuch_string_node_t *term = query->exclude_terms->head; term;
+	 term = term->next) {
+	/* Skip tags blanked out by _notmuch_exclude_tags. */
+	if (*term->string == '\0')
+	    continue;
+
+	Xapian::PostingIterator p = db->postlist_begin (term->string);
+	Xapian::PostingIterator end = db->postlist_end (term->string);
+	for (i = 0; i < count && p != end; i++) {
+	    p.skip_to (matched[i]);
+	    if (p != end && *p == matched[i] &&
+		unlikely (! _notmuch_doc_id_set_add (doc_ids, matched[i]))) {
+		talloc_free (doc_ids);
+		return NULL;
+	    }
+	}
+    }
+
+    talloc_free (matched);
+
+    return doc_ids;
+}
+
+/* Append to 'result' a copy of 'query_string' in which every
+ * "query:<name>" term outside quotes is replaced by the parenthesized
+ * query stored under <name>, and set *expanded to TRUE if any such
+ * replacement was made.  References to unknown names are left for the
+ * query parser.
+ *
+ * Throws Xapian::QueryParserError if named queries are nested more
+ * than NAMED_QUERY_MAX_DEPTH deep or the expansion grows longer than
+ * NAMED_QUERY_MAX_LENGTH. */
+static char *
+_notmuch_query_expand_named (notmuch_query_t *query,
+			     char *result,
+			     const char *query_string,
+			     int depth,
+			     notmuch_bool_t *expanded)
+{
+    const char *prefix = "query:";
+    size_t prefix_len = strlen (prefix);
+    const char *start = query_string, *s;
+    notmuch_bool_t quoted = FALSE;
+
+    for (s = query_string; *s; s++) {
+	const char *name, *end;
+	char *name_copy, *stored;
+
+	if (*s == '"') {
+	    quoted = ! quoted;
+	    continue;
+	}
+
+	/* Only consider "query:" at the beginning of a term, and not
+	 * within a quoted phrase. */
+	if (quoted || strncmp (s, prefix, prefix_len) != 0 ||
+	    (s > query_string && ! isspace ((unsigned char) s[-1]) &&
+	     s[-1] != '(' && s[-1] != '+' && s[-1] != '-'))
+	    continue;
+
+	name = end = s + prefix_len;
+	while (*end && ! isspace ((unsigned char) *end) && *end != ')')
+	    end++;
+
+	name_copy = talloc_strndup (query, name, end - name);
+	stored = _notmuch_database_get_named_query (query, query->notmuch,
+						    name_copy);
+	talloc_free (name_copy);
+	if (stored == NULL) {
+	    s = end - 1;
+	    continue;
+	}
+
+	if (depth >= NAMED_QUERY_MAX_DEPTH)
+	    throw Xapian::QueryParserError (
+		"Named queries are nested too deeply at " +
+		std::string (s, end - s));
+
+	result = talloc_asprintf_append_buffer (result, "%.*s( ",
+						(int) (s - start), start);
+	result = _notmuch_query_expand_named (query, result, stored,
+					      depth + 1, expanded);
+	result = talloc_strdup_append_buffer (result, " )");
+	if (talloc_get_size (result) > NAMED_QUERY_MAX_LENGTH)
+	    throw Xapian::QueryParserError (
+		"Named queries expand to a query string that is too long at " +
+		std::string (s, end - s));
+
+	*expanded = TRUE;
+	start = end;
+	s = end - 1;
+    }
+
+    return talloc_strdup_append_buffer (result, start);
+}
+
+/* Parse the query string of 'query' into a Xapian query matching mail
+ * documents, expanding any named queries it refers to. */
+static Xapian::Query
+_notmuch_query_parse (notmuch_query_t *query)
+{
+    notmuch_database_t *notmuch = query->notmuch;
+    const char *query_string;
+    Xapian::Query mail_query (talloc_asprintf (query, "%s%s",
+					       _find_prefix ("type"),
+					       "mail"));
+    Xapian::Query string_query;
+    unsigned int flags = (Xapian::QueryParser::FLAG_BOOLEAN |
+			  Xapian::QueryParser::FLAG_PHRASE |
+			  Xapian::QueryParser::FLAG_LOVEHATE |
+			  Xapian::QueryParser::FLAG_BOOLEAN_ANY_CASE |
+			  Xapian::QueryParser::FLAG_WILDCARD |
+			  Xapian::QueryParser::FLAG_PURE_NOT);
+    notmuch_bool_t expanded = FALSE;
+
+    query_string = _notmuch_query_expand_named (query,
+						talloc_strdup (query, ""),
+						query->query_string,
+						0, &expanded);
+
+    if (_debug_query () && expanded)
+	fprintf (stderr, "Expanded query string is:\n%s\n", query_string);
+
+    if (strcmp (query_string, "") == 0 ||
+	strcmp (query_string, "*") == 0)
+	return mail_query;
+
+    string_query = notmuch->query_parser->parse_query (query_string, flags);
+    return Xapian::Query (Xapian::Query::OP_AND, mail_query, string_query);
+}
+
 notmuch_messages_t *
 notmuch_query_search_messages (notmuch_query_t *query)
 {
@@ -188,7 +446,6 @@ notmuch_query_search_messages_st (notmuch_query_t *query,
 				  notmuch_messages_t **out)
 {
     notmuch_database_t *notmuch = query->notmuch;
-    const char *query_string = query->query_string;
     notmuch_mset_messages_t *messages;
 
     messages = talloc (query, notmuch_mset_messages_t);
@@ -199,36 +456,19 @@ notmuch_query_search_messages_st (notmuch_query_t *query,
 
 	messages->base.is_of_list_type = FALSE;
 	messages->base.iterator = NULL;
+	messages->base.info_ctx = NULL;
 	messages->notmuch = notmuch;
+	new (&messages->iterator_begin) Xapian::MSetIterator ();
 	new (&messages->iterator) Xapian::MSetIterator ();
 	new (&messages->iterator_end) Xapian::MSetIterator ();
 
 	talloc_set_destructor (messages, _notmuch_messages_destructor);
 
 	Xapian::Enquire enquire (*notmuch->xapian_db);
-	Xapian::Query mail_query (talloc_asprintf (query, "%s%s",
-						   _find_prefix ("type"),
-						   "mail"));
-	Xapian::Query string_query, final_query, exclude_query;
+	Xapian::Query final_query, exclude_query;
 	Xapian::MSet mset;
-	Xapian::MSetIterator iterator;
-	unsigned int flags = (Xapian::QueryParser::FLAG_BOOLEAN |
-			      Xapian::QueryParser::FLAG_PHRASE |
-			      Xapian::QueryParser::FLAG_LOVEHATE |
-			      Xapian::QueryParser::FLAG_BOOLEAN_ANY_CASE |
-			      Xapian::QueryParser::FLAG_WILDCARD |
-			      Xapian::QueryParser::FLAG_PURE_NOT);
-
-	if (strcmp (query_string, "") == 0 ||
-	    strcmp (query_string, "*") == 0)
-	{
-	    final_query = mail_query;
-	} else {
-	    string_query = notmuch->query_parser->
-		parse_query (query_string, flags);
-	    final_query = Xapian::Query (Xapian::Query::OP_AND,
-					 mail_query, string_query);
-	}
+
+	final_query = _notmuch_query_parse (query);
 	messages->base.excluded_doc_ids = NULL;
 
 	if ((query->omit_excluded != NOTMUCH_EXCLUDE_FALSE) && (query->exclude_terms)) {
@@ -239,29 +479,9 @@ notmuch_query_search_messages_st (notmuch_query_t *query,
 	    {
 		final_query = Xapian::Query (Xapian::Query::OP_AND_NOT,
 					     final_query, exclude_query);
-	    } else { /* NOTMUCH_EXCLUDE_FLAG */
-		exclude_query = Xapian::Query (Xapian::Query::OP_AND,
-					   exclude_query, final_query);
-
-		enquire.set_weighting_scheme (Xapian::BoolWeight());
-		enquire.set_query (exclude_query);
-
-		mset = enquire.get_mset (0, notmuch->xapian_db->get_doccount ());
-
-		GArray *excluded_doc_ids = g_array_new (FALSE, FALSE, sizeof (unsigned int));
-
-		for (iterator = mset.begin (); iterator != mset.end (); iterator++) {
-		    unsigned int doc_id = *iterator;
-		    g_array_append_val (excluded_doc_ids, doc_id);
-		}
-		messages->base.excluded_doc_ids = talloc (messages, _notmuch_doc_id_set);
-		_notmuch_doc_id_set_init (query, messages->base.excluded_doc_ids,
-					  excluded_doc_ids);
-		g_array_unref (excluded_doc_ids);
 	    }
 	}
 
-
 	enquire.set_weighting_scheme (Xapian::BoolWeight());
 
 	switch (query->sort) {
@@ -289,7 +509,20 @@ notmuch_query_search_messages_st (notmuch_query_t *query,
 
 	mset = enquire.get_mset (0, notmuch->xapian_db->get_doccount ());
 
-	messages->iterator = mset.begin ();
+	/* With NOTMUCH_EXCLUDE_FLAG, find which of the matches are
+	 * excluded, so that they can be flagged. */
+	if (query->omit_excluded == NOTMUCH_EXCLUDE_FLAG &&
+	    query->exclude_terms) {
+	    messages->base.excluded_doc_ids =
+		_notmuch_exclude_matched_doc_ids (messages, query, mset);
+	    if (unlikely (messages->base.excluded_doc_ids == NULL)) {
+		talloc_free (messages);
+		return NOTMUCH_STATUS_OUT_OF_MEMORY;
+	    }
+	}
+
+	messages->iterator_begin = mset.begin ();
+	messages->iterator = messages->iterator_begin;
 	messages->iterator_end = mset.end ();
 
 	*out = &messages->base;
@@ -373,63 +606,17 @@ _notmuch_mset_messages_move_to_next (notmuch_messages_t *messages)
     mset_messages->iterator++;
 }
 
-static notmuch_bool_t
-_notmuch_doc_id_set_init (void *ctx,
-			  notmuch_doc_id_set_t *doc_ids,
-			  GArray *arr)
+/* Move 'messages' back to its first message. */
+static void
+_notmuch_mset_messages_rewind (notmuch_messages_t *messages)
 {
-    unsigned int max = 0;
-    unsigned char *bitmap;
-
-    for (unsigned int i = 0; i < arr->len; i++)
-	max = MAX(max, g_array_index (arr, unsigned int, i));
-    bitmap = talloc_zero_array (ctx, unsigned char, DOCIDSET_WORD(max) + 1);
-
-    if (bitmap == NULL)
-	return FALSE;
-
-    doc_ids->bitmap = bitmap;
-    doc_ids->bound = max + 1;
-
-    for (unsigned int i = 0; i < arr->len; i++) {
-	unsigned int doc_id = g_array_index (arr, unsigned int, i);
-	bitmap[DOCIDSET_WORD(doc_id)] |= 1 << DOCIDSET_BIT(doc_id);
-    }
-
-    return TRUE;
-}
-
-notmuch_bool_t
-_notmuch_doc_id_set_contains (notmuch_doc_id_set_t *doc_ids,
-			      unsigned int doc_id)
-{
-    if (doc_id >= doc_ids->bound)
-	return FALSE;
-    return doc_ids->bitmap[DOCIDSET_WORD(doc_id)] & (1 << DOCIDSET_BIT(doc_id));
-}
-
-void
-_notmuch_doc_id_set_remove (notmuch_doc_id_set_t *doc_ids,
-                            unsigned int doc_id)
-{
-    if (doc_id < doc_ids->bound)
-	doc_ids->bitmap[DOCIDSET_WORD(doc_id)] &= ~(1 << DOCIDSET_BIT(doc_id));
-}
+    notmuch_mset_messages_t *mset_messages;
 
-/* Glib objects force use to use a talloc destructor as well, (but not
- * nearly as ugly as the for messages due to C++ objects). At
- * this point, I'd really like to have some talloc-friendly
- * equivalents for the few pieces of glib that I'm using. */
-static int
-_notmuch_threads_destructor (notmuch_threads_t *threads)
-{
-    if (threads->doc_ids)
-	g_array_unref (threads->doc_ids);
+    mset_messages = (notmuch_mset_messages_t *) messages;
 
-    return 0;
+    mset_messages->iterator = mset_messages->iterator_begin;
 }
 
-
 notmuch_threads_t *
 notmuch_query_search_threads (notmuch_query_t *query)
 {
@@ -453,32 +640,33 @@ notmuch_query_search_threads_st (notmuch_query_t *query,
     threads = talloc (query, notmuch_threads_t);
     if (threads == NULL)
 	return NOTMUCH_STATUS_OUT_OF_MEMORY;
-    threads->doc_ids = NULL;
-    talloc_set_destructor (threads, _notmuch_threads_destructor);
 
     threads->query = query;
 
+    threads->match_set = _notmuch_doc_id_set_create (threads);
+    if (threads->match_set == NULL) {
+	talloc_free (threads);
+	return NOTMUCH_STATUS_OUT_OF_MEMORY;
+    }
+
     status = notmuch_query_search_messages_st (query, &messages);
     if (status) {
 	talloc_free (threads);
 	return status;
     }
+    threads->messages = talloc_steal (threads, messages);
 
-    threads->doc_ids = g_array_new (FALSE, FALSE, sizeof (unsigned int));
-    while (notmuch_messages_valid (messages)) {
+    /* Walk the matches once to fill in the match set, then rewind to
+     * iterate over them again in order. */
+    for (; notmuch_messages_valid (messages);
+	 notmuch_messages_move_to_next (messages)) {
 	unsigned int doc_id = _notmuch_mset_messages_get_doc_id (messages);
-	g_array_append_val (threads->doc_ids, doc_id);
-	notmuch_messages_move_to_next (messages);
-    }
-    threads->doc_id_pos = 0;
-
-    talloc_free (messages);
-
-    if (! _notmuch_doc_id_set_init (threads, &threads->match_set,
-				    threads->doc_ids)) {
-	talloc_free (threads);
-	return NOTMUCH_STATUS_OUT_OF_MEMORY;
+	if (! _notmuch_doc_id_set_add (threads->match_set, doc_id)) {
+	    talloc_free (threads);
+	    return NOTMUCH_STATUS_OUT_OF_MEMORY;
+	}
     }
+    _notmuch_mset_messages_rewind (messages);
 
     *out = threads;
     return NOTMUCH_STATUS_SUCCESS;
@@ -498,41 +686,45 @@ notmuch_threads_valid (notmuch_threads_t *threads)
     if (! threads)
 	return FALSE;
 
-    while (threads->doc_id_pos < threads->doc_ids->len) {
-	doc_id = g_array_index (threads->doc_ids, unsigned int,
-				threads->doc_id_pos);
-	if (_notmuch_doc_id_set_contains (&threads->match_set, doc_id))
-	    break;
+    while (notmuch_messages_valid (threads->messages)) {
+	doc_id = _notmuch_mset_messages_get_doc_id (threads->messages);
+	if (_notmuch_doc_id_set_contains (threads->match_set, doc_id))
+	    return TRUE;
 
-	threads->doc_id_pos++;
+	notmuch_messages_move_to_next (threads->messages);
     }
 
-    return threads->doc_id_pos < threads->doc_ids->len;
+    return FALSE;
 }
 
 notmuch_thread_t *
 notmuch_threads_get (notmuch_threads_t *threads)
 {
+    notmuch_thread_t *thread;
     unsigned int doc_id;
 
     if (! notmuch_threads_valid (threads))
 	return NULL;
 
-    doc_id = g_array_index (threads->doc_ids, unsigned int,
-			    threads->doc_id_pos);
-    return _notmuch_thread_create (threads->query,
-				   threads->query->notmuch,
-				   doc_id,
-				   &threads->match_set,
-				   threads->query->exclude_terms,
-				   threads->query->omit_excluded,
-				   threads->query->sort);
+    doc_id = _notmuch_mset_messages_get_doc_id (threads->messages);
+
+    _notmuch_profile_begin (NOTMUCH_PROFILE_THREAD_BUILD);
+    thread = _notmuch_thread_create (threads->query,
+				     threads->query->notmuch,
+				     doc_id,
+				     threads->match_set,
+				     threads->query->exclude_terms,
+				     threads->query->omit_excluded,
+				     threads->query->sort);
+    _notmuch_profile_end (NOTMUCH_PROFILE_THREAD_BUILD);
+
+    return thread;
 }
 
 void
 notmuch_threads_move_to_next (notmuch_threads_t *threads)
 {
-    threads->doc_id_pos++;
+    notmuch_messages_move_to_next (threads->messages);
 }
 
 void
@@ -545,33 +737,14 @@ unsigned
 notmuch_query_count_messages (notmuch_query_t *query)
 {
     notmuch_database_t *notmuch = query->notmuch;
-    const char *query_string = query->query_string;
     Xapian::doccount count = 0;
 
     try {
 	Xapian::Enquire enquire (*notmuch->xapian_db);
-	Xapian::Query mail_query (talloc_asprintf (query, "%s%s",
-						   _find_prefix ("type"),
-						   "mail"));
-	Xapian::Query string_query, final_query, exclude_query;
+	Xapian::Query final_query, exclude_query;
 	Xapian::MSet mset;
-	unsigned int flags = (Xapian::QueryParser::FLAG_BOOLEAN |
-			      Xapian::QueryParser::FLAG_PHRASE |
-			      Xapian::QueryParser::FLAG_LOVEHATE |
-			      Xapian::QueryParser::FLAG_BOOLEAN_ANY_CASE |
-			      Xapian::QueryParser::FLAG_WILDCARD |
-			      Xapian::QueryParser::FLAG_PURE_NOT);
-
-	if (strcmp (query_string, "") == 0 ||
-	    strcmp (query_string, "*") == 0)
-	{
-	    final_query = mail_query;
-	} else {
-	    string_query = notmuch->query_parser->
-		parse_query (query_string, flags);
-	    final_query = Xapian::Query (Xapian::Query::OP_AND,
-					 mail_query, string_query);
-	}
+
+	final_query = _notmuch_query_parse (query);
 
 	exclude_query = _notmuch_exclude_tags (query, final_query);
 
@@ -654,3 +827,455 @@ notmuch_query_count_threads (notmuch_query_t *query)
 
     return count;
 }
+
+/* Work shared between the queries of one count batch. */
+typedef struct {
+    notmuch_database_t *notmuch;
+    void *ctx;
+    unsigned int num_queries;
+
+    /* For batches of more than one query: the union of the posting
+     * lists of each distinct set of exclude terms, keyed by the terms
+     * joined with newlines. */
+    GHashTable *exclude_sets;
+
+    /* Counts of the queries already done, keyed by the final query
+     * and its exclude key. */
+    GHashTable *results;
+
+    /* For thread counts, until the thread map below is built: the
+     * thread terms seen by the current query, and the number of
+     * documents whose thread has been looked up so far. */
+    GHashTable *thread_terms;
+    unsigned long long thread_lookups;
+
+    /* For thread counts: the thread number of each doc id (or
+     * UINT_MAX for documents without a thread), and a bitmap of the
+     * threads seen by the current query. */
+    unsigned int *thread_of;
+    unsigned int num_doc_ids;
+    unsigned int num_threads;
+    unsigned char *threads_seen;
+} notmuch_count_batch_t;
+
+/* Looking up the thread of one matching document costs roughly as
+ * much as reading this many postings of the thread terms. */
+#define COUNT_BATCH_LOOKUP_COST 32
+
+/* Return the doc ids excluded from 'query' (after
+ * _notmuch_exclude_tags), or NULL with an empty *key if nothing is
+ * excluded.
+ *
+ * Reading all the postings of the exclude tags only pays when they
+ * are replayed for several queries, so a batch of a single query
+ * gets NULL with a non-empty *key, and should exclude with the tag
+ * query instead.  Xapian exceptions are not caught. */
+static notmuch_doc_id_set_t *
+_count_batch_exclude_set (notmuch_count_batch_t *batch,
+			  notmuch_query_t *query, char **key)
+{
+    notmuch_doc_id_set_t *doc_ids;
+
+    *key = talloc_strdup (batch->ctx, "");
+    for (notmuch_string_node_t *term = query->exclude_terms->head; term;
+	 term = term->next) {
+	if (*term->string != '\0')
+	    *key = talloc_asprintf_append (*key, "%s\n", term->string);
+    }
+
+    if (**key == '\0' || batch->num_queries == 1)
+	return NULL;
+
+    doc_ids = (notmuch_doc_id_set_t *) g_hash_table_lookup (batch->exclude_sets,
+							    *key);
+    if (doc_ids)
+	return doc_ids;
+
+    doc_ids = _notmuch_exclude_doc_ids (batch->ctx, query);
+    if (doc_ids)
+	g_hash_table_insert (batch->exclude_sets, g_strdup (*key), doc_ids);
+
+    return doc_ids;
+}
+
+/* Number every thread and record the thread of each message, from
+ * the posting lists of the thread terms.  Xapian exceptions are not
+ * caught. */
+static notmuch_status_t
+_count_batch_map_threads (notmuch_count_batch_t *batch)
+{
+    Xapian::Database *db = batch->notmuch->xapian_db;
+    const char *prefix = _find_prefix ("thread");
+    Xapian::TermIterator t, t_end;
+    unsigned int i;
+
+    batch->num_doc_ids = db->get_lastdocid () + 1;
+    batch->thread_of = talloc_array (batch->ctx, unsigned int,
+				     batch->num_doc_ids);
+    if (unlikely (batch->thread_of == NULL))
+	return NOTMUCH_STATUS_OUT_OF_MEMORY;
+
+    for (i = 0; i < batch->num_doc_ids; i++)
+	batch->thread_of[i] = UINT_MAX;
+
+    t_end = db->allterms_end (prefix);
+    for (t = db->allterms_begin (prefix); t != t_end; t++) {
+	Xapian::PostingIterator p, p_end = db->postlist_end (*t);
+
+	for (p = db->postlist_begin (*t); p != p_end; p++)
+	    if (*p < batch->num_doc_ids)
+		batch->thread_of[*p] = batch->num_threads;
+	batch->num_threads++;
+    }
+
+    batch->threads_seen = talloc_array (batch->ctx, unsigned char,
+					batch->num_threads / 8 + 1);
+    if (unlikely (batch->threads_seen == NULL))
+	return NOTMUCH_STATUS_OUT_OF_MEMORY;
+
+    return NOTMUCH_STATUS_SUCCESS;
+}
+
+/* Count the threads of the documents in 'mset' by looking up the
+ * thread term of each.  Xapian exceptions are not caught. */
+static unsigned int
+_count_batch_lookup_threads (notmuch_count_batch_t *batch, Xapian::MSet &mset)
+{
+    Xapian::Database *db = batch->notmuch->xapian_db;
+    const char *prefix = _find_prefix ("thread");
+    size_t prefix_len = strlen (prefix);
+
+    g_hash_table_remove_all (batch->thread_terms);
+
+    for (Xapian::MSetIterator i = mset.begin (); i != mset.end (); i++) {
+	Xapian::TermIterator t = db->termlist_begin (*i);
+	Xapian::TermIterator t_end = db->termlist_end (*i);
+
+	t.skip_to (prefix);
+	if (t == t_end || (*t).compare (0, prefix_len, prefix) != 0)
+	    continue;
+
+	g_hash_table_insert (batch->thread_terms, g_strdup ((*t).c_str ()),
+			     NULL);
+    }
+
+    batch->thread_lookups += mset.size ();
+
+    return g_hash_table_size (batch->thread_terms);
+}
+
+/* Count the messages or threads matching 'query'.  Xapian exceptions
+ * are not caught. */
+static notmuch_status_t
+_count_batch_query (notmuch_count_batch_t *batch, notmuch_query_t *query,
+		    notmuch_bool_t threads, unsigned int *count)
+{
+    Xapian::Database *db = batch->notmuch->xapian_db;
+    Xapian::Enquire enquire (*db);
+    Xapian::Query final_query, exclude_query;
+    Xapian::MSet mset;
+    notmuch_doc_id_set_t *excluded = NULL;
+    gpointer cached;
+    std::string result_key;
+    char *exclude_key = NULL;
+
+    final_query = _notmuch_query_parse (query);
+    exclude_query = _notmuch_exclude_tags (query, final_query);
+
+    /* Like notmuch_query_count_messages, message counts always leave
+     * out excluded messages; like notmuch_query_count_threads, thread
+     * counts follow the exclude setting of the query. */
+    if (! threads || query->omit_excluded == NOTMUCH_EXCLUDE_TRUE ||
+	query->omit_excluded == NOTMUCH_EXCLUDE_ALL) {
+	excluded = _count_batch_exclude_set (batch, query, &exclude_key);
+	if (exclude_key == NULL ||
+	    (*exclude_key && batch->num_queries > 1 && excluded == NULL))
+	    return NOTMUCH_STATUS_OUT_OF_MEMORY;
+    }
+
+    result_key = final_query.get_description ();
+    if (exclude_key)
+	result_key += std::string ("\n") + exclude_key;
+
+    if (g_hash_table_lookup_extended (batch->results, result_key.c_str (),
+				      NULL, &cached)) {
+	*count = GPOINTER_TO_UINT (cached);
+	return NOTMUCH_STATUS_SUCCESS;
+    }
+
+    /* The excluded doc ids were read once for the whole batch;
+     * replay them rather than reading the posting lists of the
+     * exclude tags again.  A single query skips through those posting
+     * lists to its matches, as notmuch_query_count_messages does. */
+    DocIdSetSource exclude_source (excluded,
+				   excluded ? _notmuch_doc_id_set_count (excluded) : 0);
+    if (excluded)
+	final_query = Xapian::Query (Xapian::Query::OP_AND_NOT, final_query,
+				     Xapian::Query (&exclude_source));
+    else if (exclude_key && *exclude_key)
+	final_query = Xapian::Query (Xapian::Query::OP_AND_NOT, final_query,
+				     exclude_query);
+
+    enquire.set_weighting_scheme (Xapian::BoolWeight ());
+    enquire.set_docid_order (Xapian::Enquire::ASCENDING);
+    enquire.set_query (final_query);
+
+    if (! threads) {
+	mset = enquire.get_mset (0, db->get_doccount (), db->get_doccount ());
+	*count = mset.get_matches_estimated ();
+    } else {
+	mset = enquire.get_mset (0, db->get_doccount ());
+
+	/* Mapping every document to its thread walks all the postings
+	 * of the thread terms, which only pays once the queries of the
+	 * batch have matched enough documents.  Until then, look up
+	 * the thread of each match, as notmuch_query_count_threads
+	 * does. */
+	if (batch->thread_of == NULL &&
+	    (batch->thread_lookups + mset.size ()) * COUNT_BATCH_LOOKUP_COST <
+	    db->get_doccount ()) {
+	    *count = _count_batch_lookup_threads (batch, mset);
+	} else {
+	    if (batch->thread_of == NULL) {
+		notmuch_status_t status = _count_batch_map_threads (batch);
+		if (status)
+		    return status;
+	    }
+
+	    memset (batch->threads_seen, 0, batch->num_threads / 8 + 1);
+	    *count = 0;
+
+	    for (Xapian::MSetIterator i = mset.begin (); i != mset.end (); i++) {
+		Xapian::docid doc_id = *i;
+		unsigned int thread;
+
+		if (doc_id >= batch->num_doc_ids ||
+		    (thread = batch->thread_of[doc_id]) == UINT_MAX)
+		    continue;
+
+		if (! (batch->threads_seen[thread / 8] & (1 << (thread % 8)))) {
+		    batch->threads_seen[thread / 8] |= 1 << (thread % 8);
+		    (*count)++;
+		}
+	    }
+	}
+    }
+
+    g_hash_table_insert (batch->results, g_strdup (result_key.c_str ()),
+			 GUINT_TO_POINTER (*count));
+
+    return NOTMUCH_STATUS_SUCCESS;
+}
+
+static notmuch_status_t
+_notmuch_query_count_batch (notmuch_query_t **queries, unsigned int num_queries,
+			    notmuch_bool_t threads, unsigned int *counts)
+{
+    notmuch_count_batch_t batch;
+    notmuch_status_t status = NOTMUCH_STATUS_SUCCESS;
+    unsigned int i;
+
+    if (num_queries == 0)
+	return NOTMUCH_STATUS_SUCCESS;
+
+    for (i = 0; i < num_queries; i++) {
+	if (queries[i] == NULL)
+	    return NOTMUCH_STATUS_NULL_POINTER;
+	if (queries[i]->notmuch != queries[0]->notmuch)
+	    return NOTMUCH_STATUS_ILLEGAL_ARGUMENT;
+    }
+
+    memset (&batch, 0, sizeof (batch));
+    batch.notmuch = queries[0]->notmuch;
+    batch.num_queries = num_queries;
+    batch.ctx = talloc_new (NULL);
+    if (unlikely (batch.ctx == NULL))
+	return NOTMUCH_STATUS_OUT_OF_MEMORY;
+    batch.exclude_sets = g_hash_table_new_full (g_str_hash, g_str_equal,
+						g_free, NULL);
+    batch.results = g_hash_table_new_full (g_str_hash, g_str_equal,
+					   g_free, NULL);
+    batch.thread_terms = g_hash_table_new_full (g_str_hash, g_str_equal,
+						g_free, NULL);
+
+    try {
+	for (i = 0; i < num_queries && ! status; i++)
+	    status = _count_batch_query (&batch, queries[i], threads, &counts[i]);
+    } catch (const Xapian::Error &error) {
+	_notmuch_database_log (batch.notmuch,
+			       "A Xapian exception occurred counting queries: %s\n"
+			       "Query string was: %s\n",
+			       error.get_msg().c_str(),
+			       queries[i]->query_string);
+	batch.notmuch->exception_reported = TRUE;
+	status = NOTMUCH_STATUS_XAPIAN_EXCEPTION;
+    }
+
+    g_hash_table_unref (batch.thread_terms);
+    g_hash_table_unref (batch.results);
+    g_hash_table_unref (batch.exclude_sets);
+    talloc_free (batch.ctx);
+
+    return status;
+}
+
+notmuch_status_t
+notmuch_query_count_messages_batch (notmuch_query_t **queries,
+				    unsigned int num_queries,
+				    unsigned int *counts)
+{
+    return _notmuch_query_count_batch (queries, num_queries, FALSE, counts);
+}
+
+notmuch_status_t
+notmuch_query_count_threads_batch (notmuch_query_t **queries,
+				   unsigned int num_queries,
+				   unsigned int *counts)
+{
+    return _notmuch_query_count_batch (queries, num_queries, TRUE, counts);
+}
+
+notmuch_status_t
+notmuch_query_apply_tag_ops (notmuch_query_t *query,
+			     const notmuch_tag_op_t *ops,
+			     unsigned int count,
+			     unsigned int *changed,
+			     notmuch_bool_t (*interrupted) (void *closure),
+			     void *closure)
+{
+    notmuch_database_t *notmuch = query->notmuch;
+    notmuch_messages_t *messages;
+    notmuch_status_t status, end_status;
+    notmuch_sort_t sort;
+    notmuch_bool_t doc_changed;
+    unsigned int i, batched = 0;
+
+    if (changed)
+	*changed = 0;
+
+    status = _notmuch_database_ensure_writable (notmuch);
+    if (status)
+	return status;
+
+    for (i = 0; i < count; i++) {
+	if (ops[i].tag == NULL)
+	    return NOTMUCH_STATUS_NULL_POINTER;
+	if (strlen (ops[i].tag) > NOTMUCH_TAG_MAX)
+	    return NOTMUCH_STATUS_TAG_TOO_LONG;
+    }
+
+    /* Visit the documents in doc id order, which is also the order
+     * they are stored in. */
+    sort = query->sort;
+    query->sort = NOTMUCH_SORT_UNSORTED;
+    status = notmuch_query_search_messages_st (query, &messages);
+    query->sort = sort;
+    if (status)
+	return status;
+
+    status = notmuch_database_begin_atomic (notmuch);
+    if (status)
+	goto DONE;
+
+    for (; notmuch_messages_valid (messages);
+	 notmuch_messages_move_to_next (messages)) {
+	if (interrupted && interrupted (closure))
+	    break;
+
+	status = _notmuch_message_apply_tag_ops_by_doc_id (
+	    notmuch, _notmuch_mset_messages_get_doc_id (messages), ops, count,
+	    &doc_changed);
+	if (status)
+	    break;
+	if (! doc_changed)
+	    continue;
+	if (changed)
+	    (*changed)++;
+
+	/* Commit every TAG_OPS_BATCH_SIZE changed documents so that
+	 * the pending changes don't grow with the size of the query.
+	 * Within an atomic section of the caller, this only commits
+	 * when that section ends. */
+	if (++batched == TAG_OPS_BATCH_SIZE) {
+	    batched = 0;
+	    status = notmuch_database_end_atomic (notmuch);
+	    if (! status)
+		status = notmuch_database_begin_atomic (notmuch);
+	    if (status)
+		goto DONE;
+	}
+    }
+
+    end_status = notmuch_database_end_atomic (notmuch);
+    if (! status)
+	status = end_status;
+
+  DONE:
+    talloc_free (messages);
+
+    return status;
+}
+
+notmuch_database_t *
+_notmuch_query_database (notmuch_query_t *query)
+{
+    return query->notmuch;
+}
+
+/* Store the doc ids of the messages matching 'query', in increasing
+ * order, in a new array owned by 'ctx', and their number in *count.
+ * The sort order of 'query' is ignored. */
+notmuch_status_t
+_notmuch_query_search_doc_ids (notmuch_query_t *query,
+			       const void *ctx,
+			       unsigned int **doc_ids,
+			       unsigned int *count)
+{
+    notmuch_messages_t *messages;
+    notmuch_status_t status;
+    notmuch_sort_t sort;
+    unsigned int n = 0, size = 1024;
+    unsigned int *ids;
+    notmuch_bool_t sorted = TRUE;
+
+    sort = query->sort;
+    query->sort = NOTMUCH_SORT_UNSORTED;
+    status = notmuch_query_search_messages_st (query, &messages);
+    query->sort = sort;
+    if (status)
+	return status;
+
+    ids = talloc_array (ctx, unsigned int, size);
+    for (; ids && notmuch_messages_valid (messages);
+	 notmuch_messages_move_to_next (messages)) {
+	if (n == size) {
+	    unsigned int *grown;
+
+	    size *= 2;
+	    grown = talloc_realloc (ctx, ids, unsigned int, size);
+	    if (unlikely (grown == NULL)) {
+		talloc_free (ids);
+		ids = NULL;
+		break;
+	    }
+	    ids = grown;
+	}
+	ids[n] = _notmuch_mset_messages_get_doc_id (messages);
+	if (n && ids[n] < ids[n - 1])
+	    sorted = FALSE;
+	n++;
+    }
+
+    talloc_free (messages);
+
+    if (unlikely (ids == NULL))
+	return NOTMUCH_STATUS_OUT_OF_MEMORY;
+
+    /* Unsorted boolean matches come in doc id order anyway. */
+    if (! sorted)
+	qsort (ids, n, sizeof (*ids), _compare_doc_ids);
+
+    *doc_ids = ids;
+    *count = n;
+    return NOTMUCH_STATUS_SUCCESS;
+}
@@ -0,0 +1,372 @@
+/* tag-dump.cc - Message IDs and tags of many messages at once
+ *
+ * Copyright © 2026 agent
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ * Author: agent <agent@local>
+ */
+
+#include "notmuch-private.h"
+#include "database-private.h"
+
+/* Reading the tags of every message means decompressing the term
+ * list of every document.  Tags are few, so instead we walk the
+ * posting list of each tag term once and invert it into a map from
+ * document to tags.  That walk costs the same however few documents
+ * match, so when the query matches only a small part of the database
+ * the tags are read from the term list of each matching document
+ * instead.  Message IDs are read in doc id order from the value
+ * stream of NOTMUCH_VALUE_MESSAGE_ID. */
+
+/* Reading the term list of one document costs roughly as much as
+ * walking this many postings of the tag terms. */
+#define TAG_DUMP_DOCUMENT_COST 32
+
+struct visible _notmuch_tag_dump {
+    notmuch_database_t *notmuch;
+
+    /* The matching documents, in increasing order. */
+    unsigned int *doc_ids;
+    unsigned int count;
+
+    /* All tags in the database, sorted. */
+    char **tag_names;
+
+    /* The tags of doc_ids[i] are tag_names[tags[j]] for offsets[i] <=
+     * j < offsets[i + 1], in sorted order.  All three are NULL if the
+     * tags are read from each document instead. */
+    unsigned int *offsets;
+    unsigned int *tags;
+
+    /* The current document, as an index into doc_ids. */
+    unsigned int position;
+
+    /* Message ID of the current document, once read. */
+    char *message_id;
+
+    Xapian::ValueIterator ids;
+    Xapian::ValueIterator ids_end;
+};
+
+/* A tag carried by a matching document, during the inversion. */
+typedef struct {
+    unsigned int index;
+    unsigned int tag;
+} _tag_posting_t;
+
+static int
+_notmuch_tag_dump_destructor (notmuch_tag_dump_t *dump)
+{
+    dump->ids.~ValueIterator ();
+    dump->ids_end.~ValueIterator ();
+
+    return 0;
+}
+
+/* Return the index of 'doc_id' in the sorted array 'doc_ids', or -1
+ * if it is not there. */
+static long
+_find_doc_id (const unsigned int *doc_ids, unsigned int count,
+	      unsigned int doc_id)
+{
+    unsigned int low = 0, high = count;
+
+    while (low < high) {
+	unsigned int mid = low + (high - low) / 2;
+
+	if (doc_ids[mid] < doc_id)
+	    low = mid + 1;
+	else
+	    high = mid;
+    }
+
+    if (low < count && doc_ids[low] == doc_id)
+	return low;
+
+    return -1;
+}
+
+/* Would inverting the tag posting lists cost less than reading the
+ * term list of each matching document?
+ *
+ * Xapian exceptions are not caught. */
+static notmuch_bool_t
+_notmuch_tag_dump_should_invert (notmuch_tag_dump_t *dump)
+{
+    Xapian::Database *db = dump->notmuch->xapian_db;
+    const char *prefix = _find_prefix ("tag");
+    Xapian::TermIterator t, t_end;
+    unsigned long long postings = 0;
+
+    t_end = db->allterms_end (prefix);
+    for (t = db->allterms_begin (prefix); t != t_end; t++)
+	postings += t.get_termfreq ();
+
+    return (unsigned long long) dump->count * TAG_DUMP_DOCUMENT_COST >= postings;
+}
+
+/* Fill in dump->tag_names, dump->offsets and dump->tags.
+ *
+ * Xapian exceptions are not caught. */
+static notmuch_status_t
+_notmuch_tag_dump_invert (notmuch_tag_dump_t *dump)
+{
+    Xapian::Database *db = dump->notmuch->xapian_db;
+    const char *prefix = _find_prefix ("tag");
+    size_t prefix_len = strlen (prefix);
+    Xapian::TermIterator t, t_end;
+    _tag_posting_t *postings;
+    unsigned int num_postings = 0, postings_size = 1024;
+    unsigned int num_tags = 0, tags_size = 64;
+    unsigned int *next;
+    unsigned int i;
+
+    postings = talloc_array (dump, _tag_posting_t, postings_size);
+    dump->tag_names = talloc_array (dump, char *, tags_size);
+    if (unlikely (postings == NULL || dump->tag_names == NULL))
+	return NOTMUCH_STATUS_OUT_OF_MEMORY;
+
+    /* Terms come in sorted order, so each document collects its tags
+     * in sorted order too. */
+    t_end = db->allterms_end (prefix);
+    for (t = db->allterms_begin (prefix); t != t_end; t++) {
+	const std::string &term = *t;
+	Xapian::PostingIterator p, p_end;
+
+	if (num_tags == tags_size) {
+	    tags_size *= 2;
+	    dump->tag_names = talloc_realloc (dump, dump->tag_names,
+					      char *, tags_size);
+	    if (unlikely (dump->tag_names == NULL))
+		return NOTMUCH_STATUS_OUT_OF_MEMORY;
+	}
+	dump->tag_names[num_tags] = talloc_strdup (dump->tag_names,
+						   term.c_str () + prefix_len);
+	if (unlikely (dump->tag_names[num_tags] == NULL))
+	    return NOTMUCH_STATUS_OUT_OF_MEMORY;
+
+	p_end = db->postlist_end (term);
+	for (p = db->postlist_begin (term); p != p_end; p++) {
+	    long index = _find_doc_id (dump->doc_ids, dump->count, *p);
+
+	    if (index < 0)
+		continue;
+
+	    if (num_postings == postings_size) {
+		postings_size *= 2;
+		postings = talloc_realloc (dump, postings, _tag_posting_t,
+					   postings_size);
+		if (unlikely (postings == NULL))
+		    return NOTMUCH_STATUS_OUT_OF_MEMORY;
+	    }
+	    postings[num_postings].index = index;
+	    postings[num_postings].tag = num_tags;
+	    num_postings++;
+	}
+
+	num_tags++;
+    }
+
+    /* Group the postings by document with a counting sort, which
+     * keeps the tags of each document in order. */
+    dump->offsets = talloc_zero_array (dump, unsigned int, dump->count + 1);
+    dump->tags = talloc_array (dump, unsigned int, num_postings + 1);
+    next = talloc_array (dump, unsigned int, dump->count + 1);
+    if (unlikely (dump->offsets == NULL || dump->tags == NULL || next == NULL))
+	return NOTMUCH_STATUS_OUT_OF_MEMORY;
+
+    for (i = 0; i < num_postings; i++)
+	dump->offsets[postings[i].index + 1]++;
+    for (i = 0; i < dump->count; i++)
+	dump->offsets[i + 1] += dump->offsets[i];
+
+    memcpy (next, dump->offsets, (dump->count + 1) * sizeof (*next));
+    for (i = 0; i < num_postings; i++)
+	dump->tags[next[postings[i].index]++] = postings[i].tag;
+
+    talloc_free (next);
+    talloc_free (postings);
+
+    return NOTMUCH_STATUS_SUCCESS;
+}
+
+notmuch_status_t
+notmuch_query_search_tag_dump (notmuch_query_t *query,
+			       notmuch_tag_dump_t **out)
+{
+    notmuch_database_t *notmuch = _notmuch_query_database (query);
+    notmuch_tag_dump_t *dump;
+    notmuch_status_t status;
+
+    dump = talloc (query, notmuch_tag_dump_t);
+    if (unlikely (dump == NULL))
+	return NOTMUCH_STATUS_OUT_OF_MEMORY;
+
+    dump->notmuch = notmuch;
+    dump->doc_ids = NULL;
+    dump->count = 0;
+    dump->tag_names = NULL;
+    dump->offsets = NULL;
+    dump->tags = NULL;
+    dump->position = 0;
+    dump->message_id = NULL;
+
+    new (&dump->ids) Xapian::ValueIterator ();
+    new (&dump->ids_end) Xapian::ValueIterator ();
+    talloc_set_destructor (dump, _notmuch_tag_dump_destructor);
+
+    status = _notmuch_query_search_doc_ids (query, dump,
+					    &dump->doc_ids, &dump->count);
+    if (status)
+	goto FAIL;
+
+    try {
+	if (_notmuch_tag_dump_should_invert (dump)) {
+	    status = _notmuch_tag_dump_invert (dump);
+	    if (status)
+		goto FAIL;
+	}
+
+	dump->ids = notmuch->xapian_db->valuestream_begin (
+	    NOTMUCH_VALUE_MESSAGE_ID);
+	dump->ids_end = notmuch->xapian_db->valuestream_end (
+	    NOTMUCH_VALUE_MESSAGE_ID);
+    } catch (const Xapian::Error &error) {
+	_notmuch_database_log (notmuch,
+			       "A Xapian exception occurred reading tags: %s\n",
+			       error.get_msg().c_str());
+	notmuch->exception_reported = TRUE;
+	status = NOTMUCH_STATUS_XAPIAN_EXCEPTION;
+	goto FAIL;
+    }
+
+    *out = dump;
+    return NOTMUCH_STATUS_SUCCESS;
+
+  FAIL:
+    talloc_free (dump);
+    return status;
+}
+
+notmuch_bool_t
+notmuch_tag_dump_valid (notmuch_tag_dump_t *dump)
+{
+    return dump->position < dump->count;
+}
+
+const char *
+notmuch_tag_dump_get_message_id (notmuch_tag_dump_t *dump)
+{
+    unsigned int doc_id;
+
+    if (dump->message_id)
+	return dump->message_id;
+
+    if (! notmuch_tag_dump_valid (dump))
+	return NULL;
+
+    doc_id = dump->doc_ids[dump->position];
+
+    try {
+	/* Documents come in doc id order, so the value stream only
+	 * ever moves forward. */
+	if (dump->ids != dump->ids_end) {
+	    dump->ids.skip_to (doc_id);
+	    if (dump->ids != dump->ids_end && dump->ids.get_docid () == doc_id)
+		dump->message_id = talloc_strdup (dump, (*dump->ids).c_str ());
+	}
+
+	/* Databases without NOTMUCH_FEATURE_FROM_SUBJECT_ID_VALUES
+	 * may lack the value; the id term is always there. */
+	if (dump->message_id == NULL) {
+	    Xapian::Document doc = dump->notmuch->xapian_db->get_document (doc_id);
+	    const char *prefix = _find_prefix ("id");
+	    Xapian::TermIterator i = doc.termlist_begin ();
+
+	    i.skip_to (prefix);
+	    if (i != doc.termlist_end () &&
+		strncmp ((*i).c_str (), prefix, strlen (prefix)) == 0)
+		dump->message_id = talloc_strdup (dump,
+						  (*i).c_str () + strlen (prefix));
+	}
+    } catch (const Xapian::Error &error) {
+	_notmuch_database_log (dump->notmuch,
+			       "A Xapian exception occurred reading message id: %s\n",
+			       error.get_msg().c_str());
+	dump->notmuch->exception_reported = TRUE;
+	return NULL;
+    }
+
+    return dump->message_id;
+}
+
+notmuch_tags_t *
+notmuch_tag_dump_get_tags (notmuch_tag_dump_t *dump)
+{
+    notmuch_string_list_t *list;
+    unsigned int i;
+
+    if (! notmuch_tag_dump_valid (dump))
+	return NULL;
+
+    if (dump->offsets == NULL) {
+	try {
+	    Xapian::Document doc = dump->notmuch->xapian_db->get_document (
+		dump->doc_ids[dump->position]);
+	    Xapian::TermIterator t = doc.termlist_begin ();
+	    Xapian::TermIterator t_end = doc.termlist_end ();
+
+	    list = _notmuch_database_get_terms_with_prefix (
+		dump, t, t_end, _find_prefix ("tag"));
+	} catch (const Xapian::Error &error) {
+	    _notmuch_database_log (dump->notmuch,
+				   "A Xapian exception occurred reading tags: %s\n",
+				   error.get_msg().c_str());
+	    dump->notmuch->exception_reported = TRUE;
+	    return NULL;
+	}
+	if (unlikely (list == NULL))
+	    return NULL;
+
+	return _notmuch_tags_create (dump, list);
+    }
+
+    list = _notmuch_string_list_create (dump);
+    if (unlikely (list == NULL))
+	return NULL;
+
+    for (i = dump->offsets[dump->position];
+	 i < dump->offsets[dump->position + 1]; i++)
+	_notmuch_string_list_append (list, dump->tag_names[dump->tags[i]]);
+
+    return _notmuch_tags_create (dump, list);
+}
+
+void
+notmuch_tag_dump_move_to_next (notmuch_tag_dump_t *dump)
+{
+    if (! notmuch_tag_dump_valid (dump))
+	return;
+
+    talloc_free (dump->message_id);
+    dump->message_id = NULL;
+    dump->position++;
+}
+
+void
+notmuch_tag_dump_destroy (notmuch_tag_dump_t *dump)
+{
+    talloc_free (dump);
+}
@@ -0,0 +1,732 @@
+/* thread-summary.cc - Precomputed per-thread summary records
+ *
+ * Copyright © 2026 agent
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ * Author: agent <agent@local>
+ */
+
+#include "notmuch-private.h"
+#include "database-private.h"
+
+#include <gmime/gmime.h>
+
+#include <map>
+#include <vector>
+#include <algorithm>
+
+/* If NOTMUCH_FEATURE_THREAD_SUMMARIES is set, the database holds one
+ * summary record for each thread, stored as database metadata under
+ * "thread_summary.<thread-id>".  A record is made of lines, the first
+ * of which is of the form:
+ *
+ *	<count> TAB <oldest> TAB <newest> TAB <subject>
+ *
+ * giving the number of mail documents of the thread, the dates of
+ * the oldest and newest of them, and the subject of the oldest.  It
+ * is followed by a line for each author of the thread, in the order
+ * of the oldest message of each:
+ *
+ *	A TAB <date> TAB <count> TAB <author>
+ *
+ * where <author> is the cleaned-up name of the sender as shown in
+ * thread summaries, <date> the date of the oldest message from that
+ * author and <count> the number of messages from that author.  Then
+ * comes a line for each tag carried by a message of the thread:
+ *
+ *	T TAB <count> TAB <tag>
+ *
+ * where <count> is the number of messages carrying the tag.  Backslash,
+ * tab and newline within fields are escaped as "\\", "\t" and "\n".
+ *
+ * The counts are what lets a change to one message update the record
+ * without looking at the other messages of the thread: the record is
+ * only rebuilt from the messages when the change removes the oldest or
+ * newest message of the thread or of one of its authors.  Writing a
+ * message that leaves its date, author, subject, tags and thread alone
+ * (adding a file name, say) does not touch the record at all.
+ */
+
+/* A thread summary record, as read from the database. */
+struct _summary_author {
+    std::string name;
+    time_t first;
+    unsigned int count;
+};
+
+struct _summary {
+    unsigned int count;
+    time_t oldest;
+    time_t newest;
+    std::string subject;
+    /* In the order of their first message. */
+    std::vector<_summary_author> authors;
+    std::map<std::string, unsigned int> tags;
+
+    _summary () : count (0), oldest (0), newest (0) {}
+};
+
+static std::string
+_summary_key (const char *thread_id)
+{
+    std::string key = NOTMUCH_METADATA_THREAD_SUMMARY_PREFIX;
+
+    return key + thread_id;
+}
+
+static void
+_append_escaped (std::string &s, const std::string &str)
+{
+    for (size_t i = 0; i < str.size (); i++) {
+	switch (str[i]) {
+	case '\\':
+	    s += "\\\\";
+	    break;
+	case '\t':
+	    s += "\\t";
+	    break;
+	case '\n':
+	    s += "\\n";
+	    break;
+	default:
+	    s += str[i];
+	}
+    }
+}
+
+/* Read the field of 's' starting at 'pos', unescaping it, and move
+ * 'pos' past the tab or newline that ends it.  That character is
+ * stored in *sep, or a NUL if the field ends 's'. */
+static std::string
+_read_field (const std::string &s, size_t &pos, char *sep)
+{
+    std::string field;
+
+    *sep = '\0';
+    while (pos < s.size ()) {
+	char c = s[pos++];
+
+	if (c == '\t' || c == '\n') {
+	    *sep = c;
+	    break;
+	}
+	if (c == '\\' && pos < s.size ()) {
+	    c = s[pos++];
+	    if (c == 't')
+		c = '\t';
+	    else if (c == 'n')
+		c = '\n';
+	}
+	field += c;
+    }
+
+    return field;
+}
+
+/* Read a number field of 's', which must be followed by another
+ * field of the same line. */
+static notmuch_bool_t
+_read_number (const std::string &s, size_t &pos, long long *value)
+{
+    std::string field;
+    char *end, sep;
+
+    field = _read_field (s, pos, &sep);
+    *value = strtoll (field.c_str (), &end, 10);
+
+    return sep == '\t' && ! field.empty () && *end == '\0';
+}
+
+/* Read the last field of a line of 's'. */
+static std::string
+_read_last_field (const std::string &s, size_t &pos, notmuch_bool_t *valid)
+{
+    std::string field;
+    char sep;
+
+    field = _read_field (s, pos, &sep);
+    if (sep == '\t')
+	*valid = FALSE;
+
+    return field;
+}
+
+/* Parse the record 'value' into 'summary'.  Returns FALSE if the
+ * record is empty or corrupt. */
+static notmuch_bool_t
+_summary_parse (const std::string &value, _summary &summary)
+{
+    notmuch_bool_t valid = TRUE;
+    long long count, oldest, newest;
+    size_t pos = 0;
+
+    if (! _read_number (value, pos, &count) ||
+	! _read_number (value, pos, &oldest) ||
+	! _read_number (value, pos, &newest))
+	return FALSE;
+
+    summary.count = count;
+    summary.oldest = oldest;
+    summary.newest = newest;
+    summary.subject = _read_last_field (value, pos, &valid);
+
+    while (valid && pos < value.size ()) {
+	std::string kind;
+	char sep;
+
+	kind = _read_field (value, pos, &sep);
+	if (sep != '\t')
+	    return FALSE;
+
+	if (kind == "A") {
+	    _summary_author author;
+	    long long first;
+
+	    if (! _read_number (value, pos, &first) ||
+		! _read_number (value, pos, &count))
+		return FALSE;
+	    author.first = first;
+	    author.count = count;
+	    author.name = _read_last_field (value, pos, &valid);
+	    summary.authors.push_back (author);
+	} else if (kind == "T") {
+	    std::string tag;
+
+	    if (! _read_number (value, pos, &count))
+		return FALSE;
+	    tag = _read_last_field (value, pos, &valid);
+	    summary.tags[tag] = count;
+	} else {
+	    return FALSE;
+	}
+    }
+
+    return valid && summary.count > 0;
+}
+
+static std::string
+_summary_serialize (const _summary &summary)
+{
+    std::map<std::string, unsigned int>::const_iterator tag;
+    std::string value;
+    char buf[64];
+    size_t i;
+
+    snprintf (buf, sizeof (buf), "%u\t%ld\t%ld\t", summary.count,
+	      (long) summary.oldest, (long) summary.newest);
+    value = buf;
+    _append_escaped (value, summary.subject);
+    value += '\n';
+
+    for (i = 0; i < summary.authors.size (); i++) {
+	snprintf (buf, sizeof (buf), "A\t%ld\t%u\t",
+		  (long) summary.authors[i].first, summary.authors[i].count);
+	value += buf;
+	_append_escaped (value, summary.authors[i].name);
+	value += '\n';
+    }
+
+    for (tag = summary.tags.begin (); tag != summary.tags.end (); tag++) {
+	snprintf (buf, sizeof (buf), "T\t%u\t", tag->second);
+	value += buf;
+	_append_escaped (value, tag->first);
+	value += '\n';
+    }
+
+    return value;
+}
+
+/* Read the record of the thread 'thread_id' into 'summary'.  Returns
+ * FALSE if there is none or it is corrupt.
+ *
+ * Xapian exceptions are not caught.
+ */
+static notmuch_bool_t
+_summary_load (notmuch_database_t *notmuch, const char *thread_id,
+	       _summary &summary)
+{
+    return _summary_parse (
+	notmuch->xapian_db->get_metadata (_summary_key (thread_id)), summary);
+}
+
+/* Write 'summary' as the record of the thread 'thread_id', removing
+ * the record if the thread has no messages left.
+ *
+ * Xapian exceptions are not caught.
+ */
+static void
+_summary_store (notmuch_database_t *notmuch, const char *thread_id,
+		const _summary &summary)
+{
+    Xapian::WritableDatabase *db =
+	static_cast <Xapian::WritableDatabase *> (notmuch->xapian_db);
+
+    /* Xapian removes metadata entries set to an empty value. */
+    db->set_metadata (_summary_key (thread_id),
+		      summary.count ? _summary_serialize (summary) : "");
+}
+
+static bool
+_author_is_older (const _summary_author &a, const _summary_author &b)
+{
+    return a.first < b.first;
+}
+
+static void
+_summary_add_tags (_summary &summary, notmuch_string_list_t *tags)
+{
+    notmuch_string_node_t *tag;
+
+    for (tag = tags->head; tag; tag = tag->next)
+	summary.tags[tag->string]++;
+}
+
+static void
+_summary_add (_summary &summary, const notmuch_thread_summary_entry_t *entry)
+{
+    size_t i;
+
+    if (summary.count == 0 || entry->date < summary.oldest) {
+	summary.oldest = entry->date;
+	summary.subject = entry->subject;
+    }
+    if (summary.count == 0 || entry->date > summary.newest)
+	summary.newest = entry->date;
+    summary.count++;
+
+    if (*entry->author) {
+	for (i = 0; i < summary.authors.size (); i++) {
+	    if (summary.authors[i].name == entry->author)
+		break;
+	}
+
+	if (i < summary.authors.size ()) {
+	    summary.authors[i].count++;
+	    if (entry->date < summary.authors[i].first)
+		summary.authors[i].first = entry->date;
+	} else {
+	    _summary_author author;
+
+	    author.name = entry->author;
+	    author.first = entry->date;
+	    author.count = 1;
+	    summary.authors.push_back (author);
+	}
+
+	std::stable_sort (summary.authors.begin (), summary.authors.end (),
+			  _author_is_older);
+    }
+
+    _summary_add_tags (summary, entry->tags);
+}
+
+/* Remove one message with the tags 'tags' from the tag counts of
+ * 'summary'.  Returns FALSE if the record did not count such a
+ * message. */
+static notmuch_bool_t
+_summary_remove_tags (_summary &summary, notmuch_string_list_t *tags)
+{
+    std::map<std::string, unsigned int>::iterator count;
+    notmuch_string_node_t *tag;
+
+    for (tag = tags->head; tag; tag = tag->next) {
+	count = summary.tags.find (tag->string);
+	if (count == summary.tags.end ())
+	    return FALSE;
+	if (--count->second == 0)
+	    summary.tags.erase (count);
+    }
+
+    return TRUE;
+}
+
+/* Remove 'entry' from 'summary'.  Returns FALSE if the record cannot
+ * be updated without looking at the other messages of the thread, or
+ * did not count this message. */
+static notmuch_bool_t
+_summary_remove (_summary &summary, const notmuch_thread_summary_entry_t *entry)
+{
+    size_t i;
+
+    if (summary.count == 0)
+	return FALSE;
+    summary.count--;
+
+    /* The oldest subject or the dates would need the other
+     * messages. */
+    if (summary.count &&
+	(entry->date <= summary.oldest || entry->date >= summary.newest))
+	return FALSE;
+
+    if (*entry->author) {
+	for (i = 0; i < summary.authors.size (); i++) {
+	    if (summary.authors[i].name == entry->author)
+		break;
+	}
+	if (i == summary.authors.size ())
+	    return FALSE;
+
+	if (--summary.authors[i].count == 0)
+	    summary.authors.erase (summary.authors.begin () + i);
+	else if (entry->date <= summary.authors[i].first)
+	    return FALSE;
+    }
+
+    return _summary_remove_tags (summary, entry->tags);
+}
+
+static notmuch_bool_t
+_tag_lists_equal (notmuch_string_list_t *a, notmuch_string_list_t *b)
+{
+    notmuch_string_node_t *ta, *tb;
+
+    for (ta = a->head, tb = b->head; ta && tb; ta = ta->next, tb = tb->next) {
+	if (strcmp (ta->string, tb->string) != 0)
+	    return FALSE;
+    }
+
+    return ta == NULL && tb == NULL;
+}
+
+/* clean up the ugly "Lastname, Firstname" format that some mail systems
+ * (most notably, Exchange) are creating to be "Firstname Lastname"
+ * To make sure that we don't change other potential situations where a
+ * comma is in the name, we check that we match one of these patterns
+ * "Last, First" <first.last@company.com>
+ * "Last, First MI" <first.mi.last@company.com>
+ */
+static char *
+_cleanup_author (void *ctx, const char *author, const char *from)
+{
+    char *clean_author,*test_author;
+    const char *comma;
+    char *blank;
+    int fname,lname;
+
+    if (author == NULL)
+	return NULL;
+    clean_author = talloc_strdup(ctx, author);
+    if (clean_author == NULL)
+	return NULL;
+    /* check if there's a comma in the name and that there's a
+     * component of the name behind it (so the name doesn't end with
+     * the comma - in which case the string that strchr finds is just
+     * one character long ",\0").
+     * Otherwise just return the copy of the original author name that
+     * we just made*/
+    comma = strchr(author,',');
+    if (comma && strlen(comma) > 1) {
+	/* let's assemble what we think is the correct name */
+	lname = comma - author;
+
+	/* Skip all the spaces after the comma */
+	fname = strlen(author) - lname - 1;
+	comma += 1;
+	while (*comma == ' ') {
+	    fname -= 1;
+	    comma += 1;
+	}
+	strncpy(clean_author, comma, fname);
+
+	*(clean_author+fname) = ' ';
+	strncpy(clean_author + fname + 1, author, lname);
+	*(clean_author+fname+1+lname) = '\0';
+	/* make a temporary copy and see if it matches the email */
+	test_author = talloc_strdup(ctx,clean_author);
+
+	blank=strchr(test_author,' ');
+	while (blank != NULL) {
+	    *blank = '.';
+	    blank=strchr(test_author,' ');
+	}
+	if (strcasestr(from, test_author) == NULL)
+	    /* we didn't identify this as part of the email address
+	    * so let's punt and return the original author */
+	    strcpy (clean_author, author);
+    }
+    return clean_author;
+}
+
+/* Return the author to show in thread summaries for a message with
+ * the given From header: the name of the first sender (or the
+ * address, if there is no name), cleaned up as described above.
+ *
+ * Returns NULL if 'from' contains no address.
+ */
+char *
+_notmuch_thread_summary_author (void *ctx, const char *from)
+{
+    InternetAddressList *list;
+    InternetAddress *address;
+    const char *author;
+    char *clean_author = NULL;
+
+    if (from == NULL)
+	return NULL;
+
+    list = internet_address_list_parse_string (from);
+    if (list == NULL)
+	return NULL;
+
+    address = internet_address_list_get_address (list, 0);
+    if (address) {
+	author = internet_address_get_name (address);
+	/* We treat quoted empty names as if they were empty. */
+	if (author == NULL || author[0] == '\0') {
+	    InternetAddressMailbox *mailbox;
+	    mailbox = INTERNET_ADDRESS_MAILBOX (address);
+	    author = internet_address_mailbox_get_addr (mailbox);
+	}
+	clean_author = _cleanup_author (ctx, author, from);
+    }
+    g_object_unref (G_OBJECT (list));
+
+    return clean_author;
+}
+
+/* Describe the mail document 'doc' as an entry of the summary of its
+ * thread, with strings owned by the returned entry.
+ *
+ * Returns NULL for documents which are not part of a thread summary,
+ * such as ghost messages.
+ *
+ * Xapian exceptions are not caught.
+ */
+notmuch_thread_summary_entry_t *
+_notmuch_thread_summary_entry_create (void *ctx,
+				      notmuch_database_t *notmuch,
+				      const Xapian::Document &doc)
+{
+    const char *thread_prefix = _find_prefix ("thread"),
+	*tag_prefix = _find_prefix ("tag");
+    std::string mail_term = std::string (_find_prefix ("type")) + "mail";
+    size_t tag_prefix_len = strlen (tag_prefix);
+    notmuch_thread_summary_entry_t *entry;
+    Xapian::TermIterator i, end;
+    std::string from, subject, author;
+
+    entry = talloc (ctx, notmuch_thread_summary_entry_t);
+    if (unlikely (entry == NULL))
+	return NULL;
+
+    /* The thread, tag and type prefixes sort in this order, so a
+     * single pass over the term list finds all three. */
+    i = doc.termlist_begin ();
+    end = doc.termlist_end ();
+
+    i.skip_to (thread_prefix);
+    if (i == end || strncmp ((*i).c_str (), thread_prefix,
+			     strlen (thread_prefix)) != 0)
+	goto FAIL;
+    entry->thread_id = talloc_strdup (entry,
+				      (*i).c_str () + strlen (thread_prefix));
+
+    entry->tags = _notmuch_string_list_create (entry);
+    for (i.skip_to (tag_prefix); i != end; i++) {
+	const std::string &term = *i;
+
+	if (strncmp (term.c_str (), tag_prefix, tag_prefix_len))
+	    break;
+	_notmuch_string_list_append (entry->tags,
+				     term.c_str () + tag_prefix_len);
+    }
+
+    i.skip_to (mail_term);
+    if (i == end || *i != mail_term)
+	goto FAIL;
+
+    entry->date = Xapian::sortable_unserialise (
+	doc.get_value (NOTMUCH_VALUE_TIMESTAMP));
+    from = doc.get_value (NOTMUCH_VALUE_FROM);
+    subject = doc.get_value (NOTMUCH_VALUE_SUBJECT);
+    author = doc.get_value (NOTMUCH_VALUE_AUTHOR);
+
+    /* Older databases may lack the header values, which are then
+     * read from the message file. */
+    if ((from.empty () || subject.empty ()) &&
+	! (notmuch->features & NOTMUCH_FEATURE_FROM_SUBJECT_ID_VALUES)) {
+	notmuch_message_t *message;
+	const char *header;
+
+	message = _notmuch_message_create (entry, notmuch,
+					   doc.get_docid (), NULL);
+	if (message) {
+	    header = notmuch_message_get_header (message, "from");
+	    if (from.empty () && header)
+		from = header;
+	    header = notmuch_message_get_header (message, "subject");
+	    if (subject.empty () && header)
+		subject = header;
+	    notmuch_message_destroy (message);
+	}
+    }
+
+    if (author.empty () &&
+	! (notmuch->features & NOTMUCH_FEATURE_AUTHOR_VALUES)) {
+	char *parsed = _notmuch_thread_summary_author (entry, from.c_str ());
+
+	if (parsed)
+	    author = parsed;
+	talloc_free (parsed);
+    }
+
+    entry->author = talloc_strdup (entry, author.c_str ());
+    entry->subject = talloc_strdup (entry, subject.c_str ());
+
+    return entry;
+
+  FAIL:
+    talloc_free (entry);
+    return NULL;
+}
+
+/* Rebuild the summary record of the thread 'thread_id' from the
+ * messages of the thread.
+ *
+ * Xapian exceptions are not caught.
+ */
+void
+_notmuch_thread_summary_rebuild (notmuch_database_t *notmuch,
+				 const char *thread_id)
+{
+    std::string term = std::string (_find_prefix ("thread")) + thread_id;
+    Xapian::PostingIterator i, end;
+    void *local = talloc_new (NULL);
+    _summary summary;
+
+    end = notmuch->xapian_db->postlist_end (term);
+    for (i = notmuch->xapian_db->postlist_begin (term); i != end; i++) {
+	notmuch_thread_summary_entry_t *entry;
+
+	entry = _notmuch_thread_summary_entry_create (
+	    local, notmuch, notmuch->xapian_db->get_document (*i));
+	if (entry && strcmp (entry->thread_id, thread_id) == 0)
+	    _summary_add (summary, entry);
+	talloc_free (entry);
+    }
+
+    _summary_store (notmuch, thread_id, summary);
+
+    talloc_free (local);
+}
+
+/* Update the summary records after a mail document, described by
+ * 'old_entry' as it was stored before and by 'new_entry' as it is
+ * stored now, was written to the database.  Either entry is NULL if
+ * the document was not part of a thread summary, such as when it was
+ * added or deleted.
+ *
+ * Xapian exceptions are not caught.
+ */
+void
+_notmuch_thread_summary_change (notmuch_database_t *notmuch,
+				const notmuch_thread_summary_entry_t *old_entry,
+				const notmuch_thread_summary_entry_t *new_entry)
+{
+    _summary summary;
+
+    if (old_entry && new_entry &&
+	strcmp (old_entry->thread_id, new_entry->thread_id) == 0 &&
+	old_entry->date == new_entry->date &&
+	strcmp (old_entry->author, new_entry->author) == 0 &&
+	strcmp (old_entry->subject, new_entry->subject) == 0) {
+	/* Only the tags may have changed, which is the common case
+	 * and needs no other message of the thread. */
+	if (_tag_lists_equal (old_entry->tags, new_entry->tags))
+	    return;
+
+	if (_summary_load (notmuch, new_entry->thread_id, summary) &&
+	    _summary_remove_tags (summary, old_entry->tags)) {
+	    _summary_add_tags (summary, new_entry->tags);
+	    _summary_store (notmuch, new_entry->thread_id, summary);
+	} else {
+	    _notmuch_thread_summary_rebuild (notmuch, new_entry->thread_id);
+	}
+	return;
+    }
+
+    if (old_entry) {
+	if (_summary_load (notmuch, old_entry->thread_id, summary) &&
+	    _summary_remove (summary, old_entry)) {
+	    _summary_store (notmuch, old_entry->thread_id, summary);
+	} else {
+	    _notmuch_thread_summary_rebuild (notmuch, old_entry->thread_id);
+	    /* The rebuilt record already counts the new entry. */
+	    if (new_entry &&
+		strcmp (old_entry->thread_id, new_entry->thread_id) == 0)
+		return;
+	}
+    }
+
+    if (new_entry) {
+	summary = _summary ();
+	if (_summary_load (notmuch, new_entry->thread_id, summary)) {
+	    _summary_add (summary, new_entry);
+	    _summary_store (notmuch, new_entry->thread_id, summary);
+	} else {
+	    /* A new thread, or one whose record was lost. */
+	    _notmuch_thread_summary_rebuild (notmuch, new_entry->thread_id);
+	}
+    }
+}
+
+/* Read the summary record of the thread 'thread_id' (owned by 'ctx').
+ *
+ * Returns NULL if the database holds no summary for this thread or
+ * if an error occurred, in which case the caller should examine the
+ * messages of the thread instead.
+ */
+notmuch_thread_summary_t *
+_notmuch_thread_summary_get (void *ctx,
+			     notmuch_database_t *notmuch,
+			     const char *thread_id)
+{
+    std::map<std::string, unsigned int>::const_iterator tag;
+    notmuch_thread_summary_t *result;
+    _summary summary;
+    size_t i;
+
+    if (! (notmuch->features & NOTMUCH_FEATURE_THREAD_SUMMARIES))
+	return NULL;
+
+    try {
+	if (! _summary_load (notmuch, thread_id, summary))
+	    return NULL;
+    } catch (const Xapian::Error &) {
+	return NULL;
+    }
+
+    result = talloc (ctx, notmuch_thread_summary_t);
+    if (unlikely (result == NULL))
+	return NULL;
+
+    result->count = summary.count;
+    result->subject = talloc_strdup (result, summary.subject.c_str ());
+    result->authors = _notmuch_string_list_create (result);
+    result->tags = _notmuch_string_list_create (result);
+    if (unlikely (result->subject == NULL || result->authors == NULL ||
+		  result->tags == NULL)) {
+	talloc_free (result);
+	return NULL;
+    }
+
+    for (i = 0; i < summary.authors.size (); i++)
+	_notmuch_string_list_append (result->authors,
+				     summary.authors[i].name.c_str ());
+    for (tag = summary.tags.begin (); tag != summary.tags.end (); tag++)
+	_notmuch_string_list_append (result->tags, tag->first.c_str ());
+
+    return result;
+}
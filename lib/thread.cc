@@ -47,6 +47,12 @@ struct visible _notmuch_thread {
     int matched_messages;
     time_t oldest;
     time_t newest;
+
+    /* For a thread built from its summary record, the messages above
+     * are only loaded when asked for, using these. */
+    notmuch_string_list_t *exclude_terms;
+    notmuch_exclude_t omit_excluded;
+    notmuch_doc_id_set_t *matched_doc_ids;
 };
 
 static int
@@ -55,7 +61,8 @@ _notmuch_thread_destructor (notmuch_thread_t *thread)
     g_hash_table_unref (thread->authors_hash);
     g_hash_table_unref (thread->matched_authors_hash);
     g_hash_table_unref (thread->tags);
-    g_hash_table_unref (thread->message_hash);
+    if (thread->message_hash)
+	g_hash_table_unref (thread->message_hash);
 
     if (thread->authors_array) {
 	g_ptr_array_free (thread->authors_array, TRUE);
@@ -161,64 +168,20 @@ _resolve_thread_authors_string (notmuch_thread_t *thread)
     thread->matched_authors_array = NULL;
 }
 
-/* clean up the ugly "Lastname, Firstname" format that some mail systems
- * (most notably, Exchange) are creating to be "Firstname Lastname"
- * To make sure that we don't change other potential situations where a
- * comma is in the name, we check that we match one of these patterns
- * "Last, First" <first.last@company.com>
- * "Last, First MI" <first.mi.last@company.com>
- */
-static char *
-_thread_cleanup_author (notmuch_thread_t *thread,
-			const char *author, const char *from)
+/* Does 'tag' make a message excluded, according to 'exclude_terms'? */
+static notmuch_bool_t
+_thread_tag_excluded (const char *tag, notmuch_string_list_t *exclude_terms)
 {
-    char *clean_author,*test_author;
-    const char *comma;
-    char *blank;
-    int fname,lname;
-
-    if (author == NULL)
-	return NULL;
-    clean_author = talloc_strdup(thread, author);
-    if (clean_author == NULL)
-	return NULL;
-    /* check if there's a comma in the name and that there's a
-     * component of the name behind it (so the name doesn't end with
-     * the comma - in which case the string that strchr finds is just
-     * one character long ",\0").
-     * Otherwise just return the copy of the original author name that
-     * we just made*/
-    comma = strchr(author,',');
-    if (comma && strlen(comma) > 1) {
-	/* let's assemble what we think is the correct name */
-	lname = comma - author;
-
-	/* Skip all the spaces after the comma */
-	fname = strlen(author) - lname - 1;
-	comma += 1;
-	while (*comma == ' ') {
-	    fname -= 1;
-	    comma += 1;
-	}
-	strncpy(clean_author, comma, fname);
-
-	*(clean_author+fname) = ' ';
-	strncpy(clean_author + fname + 1, author, lname);
-	*(clean_author+fname+1+lname) = '\0';
-	/* make a temporary copy and see if it matches the email */
-	test_author = talloc_strdup(thread,clean_author);
-
-	blank=strchr(test_author,' ');
-	while (blank != NULL) {
-	    *blank = '.';
-	    blank=strchr(test_author,' ');
-	}
-	if (strcasestr(from, test_author) == NULL)
-	    /* we didn't identify this as part of the email address
-	    * so let's punt and return the original author */
-	    strcpy (clean_author, author);
+    for (notmuch_string_node_t *term = exclude_terms->head;
+	 term != NULL;
+	 term = term->next)
+    {
+	/* Check for an empty string, and then ignore initial 'K'. */
+	if (*(term->string) && strcmp(tag, (term->string + 1)) == 0)
+	    return TRUE;
     }
-    return clean_author;
+
+    return FALSE;
 }
 
 /* Add 'message' as a message that belongs to 'thread'.
@@ -234,29 +197,17 @@ _thread_add_message (notmuch_thread_t *thread,
 {
     notmuch_tags_t *tags;
     const char *tag;
-    InternetAddressList *list = NULL;
-    InternetAddress *address;
-    const char *from, *author;
-    char *clean_author;
+    const char *author;
     notmuch_bool_t message_excluded = FALSE;
 
     if (omit_exclude != NOTMUCH_EXCLUDE_FALSE) {
 	for (tags = notmuch_message_get_tags (message);
-	     notmuch_tags_valid (tags);
+	     notmuch_tags_valid (tags) && ! message_excluded;
 	     notmuch_tags_move_to_next (tags))
 	{
 	    tag = notmuch_tags_get (tags);
 	    /* Is message excluded? */
-	    for (notmuch_string_node_t *term = exclude_terms->head;
-		 term != NULL;
-		 term = term->next)
-	    {
-		/* Check for an empty string, and then ignore initial 'K'. */
-		if (*(term->string) && strcmp(tag, (term->string + 1)) == 0) {
-		    message_excluded = TRUE;
-		    break;
-		}
-	    }
+	    message_excluded = _thread_tag_excluded (tag, exclude_terms);
 	}
     }
 
@@ -271,26 +222,9 @@ _thread_add_message (notmuch_thread_t *thread,
 			 xstrdup (notmuch_message_get_message_id (message)),
 			 message);
 
-    from = notmuch_message_get_header (message, "from");
-    if (from)
-	list = internet_address_list_parse_string (from);
-
-    if (list) {
-	address = internet_address_list_get_address (list, 0);
-	if (address) {
-	    author = internet_address_get_name (address);
-	    /* We treat quoted empty names as if they were empty. */
-	    if (author == NULL || author[0] == '\0') {
-		InternetAddressMailbox *mailbox;
-		mailbox = INTERNET_ADDRESS_MAILBOX (address);
-		author = internet_address_mailbox_get_addr (mailbox);
-	    }
-	    clean_author = _thread_cleanup_author (thread, author, from);
-	    _thread_add_author (thread, clean_author);
-	    _notmuch_message_set_author (message, clean_author);
-	}
-	g_object_unref (G_OBJECT (list));
-    }
+    author = _notmuch_message_get_author (message);
+    if (author)
+	_thread_add_author (thread, author);
 
     if (! thread->subject) {
 	const char *subject;
@@ -312,13 +246,10 @@ _thread_add_message (notmuch_thread_t *thread,
 }
 
 static void
-_thread_set_subject_from_message (notmuch_thread_t *thread,
-				  notmuch_message_t *message)
+_thread_set_subject (notmuch_thread_t *thread, const char *subject)
 {
-    const char *subject;
     const char *cleaned_subject;
 
-    subject = notmuch_message_get_header (message, "subject");
     if (! subject)
 	return;
 
@@ -342,36 +273,46 @@ _thread_set_subject_from_message (notmuch_thread_t *thread,
     }
 }
 
-/* Add a message to this thread which is known to match the original
- * search specification. The 'sort' parameter controls whether the
- * oldest or newest matching subject is applied to the thread as a
- * whole. */
+/* Account for a message in this thread which is known to match the
+ * original search specification. The 'sort' parameter controls
+ * whether the oldest or newest matching subject is applied to the
+ * thread as a whole. */
 static void
-_thread_add_matched_message (notmuch_thread_t *thread,
-			     notmuch_message_t *message,
-			     notmuch_sort_t sort)
+_thread_add_match (notmuch_thread_t *thread,
+		   time_t date,
+		   const char *subject,
+		   const char *author,
+		   notmuch_bool_t excluded,
+		   notmuch_sort_t sort)
 {
-    time_t date;
-    notmuch_message_t *hashed_message;
-
-    date = notmuch_message_get_date (message);
-
     if (date < thread->oldest || ! thread->matched_messages) {
 	thread->oldest = date;
 	if (sort == NOTMUCH_SORT_OLDEST_FIRST)
-	    _thread_set_subject_from_message (thread, message);
+	    _thread_set_subject (thread, subject);
     }
 
     if (date > thread->newest || ! thread->matched_messages) {
 	thread->newest = date;
 	const char *cur_subject = notmuch_thread_get_subject(thread);
 	if (sort != NOTMUCH_SORT_OLDEST_FIRST || EMPTY_STRING(cur_subject))
-	    _thread_set_subject_from_message (thread, message);
+	    _thread_set_subject (thread, subject);
     }
 
-    if (!notmuch_message_get_flag (message, NOTMUCH_MESSAGE_FLAG_EXCLUDED))
+    if (! excluded)
 	thread->matched_messages++;
 
+    _thread_add_matched_author (thread, author);
+}
+
+/* Add a message to this thread which is known to match the original
+ * search specification. */
+static void
+_thread_add_matched_message (notmuch_thread_t *thread,
+			     notmuch_message_t *message,
+			     notmuch_sort_t sort)
+{
+    notmuch_message_t *hashed_message;
+
     if (g_hash_table_lookup_extended (thread->message_hash,
 			    notmuch_message_get_message_id (message), NULL,
 			    (void **) &hashed_message)) {
@@ -379,7 +320,133 @@ _thread_add_matched_message (notmuch_thread_t *thread,
 				  NOTMUCH_MESSAGE_FLAG_MATCH, 1);
     }
 
-    _thread_add_matched_author (thread, _notmuch_message_get_author (hashed_message));
+    _thread_add_match (thread,
+		       notmuch_message_get_date (message),
+		       notmuch_message_get_header (message, "subject"),
+		       _notmuch_message_get_author (hashed_message),
+		       notmuch_message_get_flag (message,
+						 NOTMUCH_MESSAGE_FLAG_EXCLUDED),
+		       sort);
+}
+
+/* Whether the thread summary record 'summary' can stand for the
+ * messages of the thread, which it cannot if some of them are
+ * excluded: the record does not say which. */
+static notmuch_bool_t
+_thread_summary_usable (notmuch_thread_t *thread,
+			notmuch_thread_summary_t *summary)
+{
+    notmuch_string_node_t *tag;
+
+    if (thread->omit_excluded == NOTMUCH_EXCLUDE_FALSE)
+	return TRUE;
+
+    for (tag = summary->tags->head; tag; tag = tag->next) {
+	if (_thread_tag_excluded (tag->string, thread->exclude_terms))
+	    return FALSE;
+    }
+
+    return TRUE;
+}
+
+typedef struct _notmuch_thread_match {
+    unsigned int doc_id;
+    time_t date;
+    notmuch_message_t *message;
+} notmuch_thread_match_t;
+
+static int
+_compare_matches (const void *a, const void *b)
+{
+    const notmuch_thread_match_t *ma = (const notmuch_thread_match_t *) a;
+    const notmuch_thread_match_t *mb = (const notmuch_thread_match_t *) b;
+
+    if (ma->date != mb->date)
+	return ma->date < mb->date ? -1 : 1;
+    if (ma->doc_id != mb->doc_id)
+	return ma->doc_id < mb->doc_id ? -1 : 1;
+    return 0;
+}
+
+/* Account for the messages of a thread built from its summary record
+ * which are in 'match_set', removing them from 'match_set'.  Only
+ * these messages are read, oldest first, as _notmuch_thread_create
+ * would have.  Returns FALSE on error. */
+static notmuch_bool_t
+_thread_add_summary_matches (void *ctx,
+			     notmuch_thread_t *thread,
+			     notmuch_doc_id_set_t *match_set,
+			     notmuch_sort_t sort)
+{
+    std::string term = std::string (_find_prefix ("thread")) +
+	thread->thread_id;
+    notmuch_thread_match_t *matches = NULL;
+    unsigned int n = 0, size = 0, i;
+    Xapian::PostingIterator p, end;
+
+    try {
+	end = thread->notmuch->xapian_db->postlist_end (term);
+	for (p = thread->notmuch->xapian_db->postlist_begin (term);
+	     p != end; p++) {
+	    unsigned int doc_id = *p;
+
+	    if (! _notmuch_doc_id_set_contains (match_set, doc_id))
+		continue;
+
+	    if (n == size) {
+		size = size ? 2 * size : 16;
+		matches = talloc_realloc (ctx, matches,
+					  notmuch_thread_match_t, size);
+		if (unlikely (matches == NULL))
+		    return FALSE;
+	    }
+
+	    matches[n].doc_id = doc_id;
+	    matches[n].message = _notmuch_message_create (ctx, thread->notmuch,
+							  doc_id, NULL);
+	    if (unlikely (matches[n].message == NULL))
+		return FALSE;
+	    matches[n].date = notmuch_message_get_date (matches[n].message);
+	    n++;
+	}
+    } catch (const Xapian::Error &error) {
+	_notmuch_database_log (thread->notmuch,
+			       "A Xapian exception occurred building a thread: %s\n",
+			       error.get_msg().c_str());
+	thread->notmuch->exception_reported = TRUE;
+	return FALSE;
+    }
+
+    qsort (matches, n, sizeof (notmuch_thread_match_t), _compare_matches);
+
+    for (i = 0; i < n; i++) {
+	notmuch_message_t *message = matches[i].message;
+
+	_notmuch_doc_id_set_remove (match_set, matches[i].doc_id);
+	_notmuch_doc_id_set_add (thread->matched_doc_ids, matches[i].doc_id);
+	_thread_add_match (thread, matches[i].date,
+			   notmuch_message_get_header (message, "subject"),
+			   _notmuch_message_get_author (message),
+			   FALSE, sort);
+	_notmuch_message_close (message);
+    }
+
+    return TRUE;
+}
+
+static notmuch_bool_t
+_thread_create_message_lists (notmuch_thread_t *thread)
+{
+    thread->message_list = _notmuch_message_list_create (thread);
+    thread->toplevel_list = _notmuch_message_list_create (thread);
+    if (unlikely (thread->message_list == NULL ||
+		  thread->toplevel_list == NULL))
+	return FALSE;
+
+    thread->message_hash = g_hash_table_new_full (g_str_hash, g_str_equal,
+						  free, NULL);
+
+    return TRUE;
 }
 
 static void
@@ -444,6 +511,8 @@ _notmuch_thread_create (void *ctx,
     const char *thread_id;
     char *thread_id_query_string;
     notmuch_query_t *thread_id_query;
+    notmuch_thread_summary_t *summary;
+    notmuch_string_node_t *node;
 
     notmuch_messages_t *messages;
     notmuch_message_t *message;
@@ -453,14 +522,6 @@ _notmuch_thread_create (void *ctx,
 	INTERNAL_ERROR ("Thread seed message %u does not exist", seed_doc_id);
 
     thread_id = notmuch_message_get_thread_id (seed_message);
-    thread_id_query_string = talloc_asprintf (local, "thread:%s", thread_id);
-    if (unlikely (thread_id_query_string == NULL))
-	goto DONE;
-
-    thread_id_query = talloc_steal (
-	local, notmuch_query_create (notmuch, thread_id_query_string));
-    if (unlikely (thread_id_query == NULL))
-	goto DONE;
 
     thread = talloc (local, notmuch_thread_t);
     if (unlikely (thread == NULL))
@@ -482,22 +543,66 @@ _notmuch_thread_create (void *ctx,
     thread->tags = g_hash_table_new_full (g_str_hash, g_str_equal,
 					  free, NULL);
 
-    thread->message_list = _notmuch_message_list_create (thread);
-    thread->toplevel_list = _notmuch_message_list_create (thread);
-    if (unlikely (thread->message_list == NULL ||
-		  thread->toplevel_list == NULL)) {
-	thread = NULL;
-	goto DONE;
-    }
-
-    thread->message_hash = g_hash_table_new_full (g_str_hash, g_str_equal,
-						  free, NULL);
+    thread->message_list = NULL;
+    thread->toplevel_list = NULL;
+    thread->message_hash = NULL;
 
     thread->total_messages = 0;
     thread->matched_messages = 0;
     thread->oldest = 0;
     thread->newest = 0;
 
+    thread->exclude_terms = exclude_terms;
+    thread->omit_excluded = omit_excluded;
+    thread->matched_doc_ids = NULL;
+
+    /* If the database keeps a summary of this thread, build the
+     * thread from that and its matched messages alone, and load the
+     * other messages only if asked. */
+    summary = _notmuch_thread_summary_get (local, notmuch, thread_id);
+    if (summary && _thread_summary_usable (thread, summary)) {
+	thread->matched_doc_ids = _notmuch_doc_id_set_create (thread);
+	if (unlikely (thread->matched_doc_ids == NULL)) {
+	    thread = NULL;
+	    goto DONE;
+	}
+
+	thread->total_messages = summary->count;
+	thread->subject = talloc_strdup (thread, summary->subject);
+	for (node = summary->authors->head; node; node = node->next)
+	    _thread_add_author (thread, node->string);
+	for (node = summary->tags->head; node; node = node->next)
+	    g_hash_table_insert (thread->tags, xstrdup (node->string), NULL);
+
+	if (! _thread_add_summary_matches (local, thread, match_set, sort)) {
+	    thread = NULL;
+	    goto DONE;
+	}
+
+	_resolve_thread_authors_string (thread);
+
+	(void) talloc_steal (ctx, thread);
+	goto DONE;
+    }
+
+    if (unlikely (! _thread_create_message_lists (thread))) {
+	thread = NULL;
+	goto DONE;
+    }
+
+    thread_id_query_string = talloc_asprintf (local, "thread:%s", thread_id);
+    if (unlikely (thread_id_query_string == NULL)) {
+	thread = NULL;
+	goto DONE;
+    }
+
+    thread_id_query = talloc_steal (
+	local, notmuch_query_create (notmuch, thread_id_query_string));
+    if (unlikely (thread_id_query == NULL)) {
+	thread = NULL;
+	goto DONE;
+    }
+
     /* We use oldest-first order unconditionally here to obtain the
      * proper author ordering for the thread. The 'sort' parameter
      * passed to this function is used only to indicate whether the
@@ -537,15 +642,88 @@ _notmuch_thread_create (void *ctx,
     return thread;
 }
 
+/* Load the messages of a thread that was built from its summary
+ * record, flagging them as _notmuch_thread_create would have. */
+static void
+_thread_ensure_messages (notmuch_thread_t *thread)
+{
+    notmuch_query_t *query;
+    notmuch_messages_t *messages;
+    notmuch_message_t *message;
+    notmuch_tags_t *tags;
+    char *query_string;
+
+    if (thread->message_list)
+	return;
+
+    if (unlikely (! _thread_create_message_lists (thread)))
+	return;
+
+    query_string = talloc_asprintf (thread, "thread:%s", thread->thread_id);
+    if (unlikely (query_string == NULL))
+	return;
+
+    query = notmuch_query_create (thread->notmuch, query_string);
+    talloc_free (query_string);
+    if (unlikely (query == NULL))
+	return;
+
+    notmuch_query_set_sort (query, NOTMUCH_SORT_OLDEST_FIRST);
+
+    for (messages = notmuch_query_search_messages (query);
+	 notmuch_messages_valid (messages);
+	 notmuch_messages_move_to_next (messages))
+    {
+	notmuch_bool_t excluded = FALSE;
+
+	message = notmuch_messages_get (messages);
+
+	if (thread->omit_excluded != NOTMUCH_EXCLUDE_FALSE) {
+	    for (tags = notmuch_message_get_tags (message);
+		 notmuch_tags_valid (tags) && ! excluded;
+		 notmuch_tags_move_to_next (tags))
+		excluded = _thread_tag_excluded (notmuch_tags_get (tags),
+						 thread->exclude_terms);
+	}
+
+	if (excluded && thread->omit_excluded == NOTMUCH_EXCLUDE_ALL) {
+	    notmuch_message_destroy (message);
+	    continue;
+	}
+
+	_notmuch_message_list_add_message (thread->message_list,
+					   talloc_steal (thread, message));
+	g_hash_table_insert (thread->message_hash,
+			     xstrdup (notmuch_message_get_message_id (message)),
+			     message);
+
+	if (excluded)
+	    notmuch_message_set_flag (message, NOTMUCH_MESSAGE_FLAG_EXCLUDED,
+				      TRUE);
+	if (_notmuch_doc_id_set_contains (thread->matched_doc_ids,
+					  _notmuch_message_get_doc_id (message)))
+	    notmuch_message_set_flag (message, NOTMUCH_MESSAGE_FLAG_MATCH,
+				      TRUE);
+
+	_notmuch_message_close (message);
+    }
+
+    notmuch_query_destroy (query);
+
+    _resolve_thread_relationships (thread);
+}
+
 notmuch_messages_t *
 notmuch_thread_get_toplevel_messages (notmuch_thread_t *thread)
 {
+    _thread_ensure_messages (thread);
     return _notmuch_messages_create (thread->toplevel_list);
 }
 
 notmuch_messages_t *
 notmuch_thread_get_messages (notmuch_thread_t *thread)
 {
+    _thread_ensure_messages (thread);
     return _notmuch_messages_create (thread->message_list);
 }
 
@@ -0,0 +1,517 @@
+/* notmuch - Not much of an email program, (just index and search)
+ *
+ * Copyright © 2026 agent
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ * Author: agent <agent@local>
+ */
+
+#include "notmuch-client.h"
+
+#include <fcntl.h>
+
+/* The MIME structure of a message file, kept on disk so that showing
+ * the message again does not have to parse the whole file.
+ *
+ * For each part, the cache holds its headers and, for leaf parts,
+ * the offsets of its (encoded) content in the file.  The message is
+ * rebuilt by parsing only the headers, and the content of each leaf
+ * part is read straight from the file when it is output, so parts
+ * that are not shown are never read.
+ *
+ * A cache file is a version line followed by entries, each a line
+ *
+ *	<kind> <a> <b> <length>
+ *
+ * followed by <length> bytes of payload and a newline.  The first
+ * entry is "file", with the size and modification time (in seconds)
+ * of the message file in a and b and its name as payload.  The second
+ * is "stat", with the inode number of the file and the nanoseconds of
+ * its modification time in a and b, so that a file replaced by another
+ * of the same size within a second is not taken for the cached one.
+ * The others hold the headers of a part as payload, in depth-first
+ * order:
+ *
+ *	message		a message; its MIME part follows
+ *	message-part	a message/rfc822 part; its message follows
+ *	multipart	a multipart with a children, which follow
+ *	part		a leaf part with content from offset a to b
+ *
+ * The modification time of a cache file is that of its last use.
+ * Every MIME_CACHE_PRUNE_INTERVAL stores, counted in the file
+ * MIME_CACHE_STORES_FILE of the directory, the files are counted, and
+ * if there are more than MIME_CACHE_MAX_ENTRIES, the least recently
+ * used are removed until MIME_CACHE_KEPT_ENTRIES remain.  The
+ * directory may thus briefly hold up to MIME_CACHE_PRUNE_INTERVAL
+ * files more than MIME_CACHE_MAX_ENTRIES.
+ */
+
+#define MIME_CACHE_VERSION "notmuch-mime-cache 2"
+#define MIME_CACHE_KIND_SIZE 16
+#define MIME_CACHE_MAX_ENTRIES 4096
+#define MIME_CACHE_KEPT_ENTRIES 3072
+#define MIME_CACHE_PRUNE_INTERVAL 64
+#define MIME_CACHE_STORES_FILE ".stores"
+
+typedef struct {
+    const char *pos;
+    const char *end;
+} mime_cache_cursor_t;
+
+static char *
+_mime_cache_path (const void *ctx, const char *cache_dir, const char *filename)
+{
+    gchar *digest;
+    char *path;
+
+    digest = g_compute_checksum_for_string (G_CHECKSUM_SHA1, filename, -1);
+    path = talloc_asprintf (ctx, "%s/%s", cache_dir, digest);
+    g_free (digest);
+
+    return path;
+}
+
+static void
+_mime_cache_write_entry (FILE *file, const char *kind,
+			 long long a, long long b, const char *payload)
+{
+    size_t len = payload ? strlen (payload) : 0;
+
+    fprintf (file, "%s %lld %lld %zu\n", kind, a, b, len);
+    if (len)
+	fwrite (payload, 1, len, file);
+    fputc ('\n', file);
+}
+
+static notmuch_bool_t
+_mime_cache_write_object (FILE *file, GMimeObject *object)
+{
+    char *headers = g_mime_object_get_headers (object);
+    notmuch_bool_t ret = FALSE;
+
+    if (GMIME_IS_MESSAGE (object)) {
+	GMimeObject *part = g_mime_message_get_mime_part (GMIME_MESSAGE (object));
+
+	if (part) {
+	    _mime_cache_write_entry (file, "message", 0, 0, headers);
+	    ret = _mime_cache_write_object (file, part);
+	}
+    } else if (GMIME_IS_MESSAGE_PART (object)) {
+	GMimeMessage *message = g_mime_message_part_get_message (
+	    GMIME_MESSAGE_PART (object));
+
+	if (message) {
+	    _mime_cache_write_entry (file, "message-part", 0, 0, headers);
+	    ret = _mime_cache_write_object (file, GMIME_OBJECT (message));
+	}
+    } else if (GMIME_IS_MULTIPART (object)) {
+	GMimeMultipart *multipart = GMIME_MULTIPART (object);
+	int count = g_mime_multipart_get_count (multipart);
+	int i;
+
+	_mime_cache_write_entry (file, "multipart", count, 0, headers);
+	ret = TRUE;
+	for (i = 0; ret && i < count; i++)
+	    ret = _mime_cache_write_object (
+		file, g_mime_multipart_get_part (multipart, i));
+    } else if (GMIME_IS_PART (object)) {
+	GMimeDataWrapper *wrapper = g_mime_part_get_content_object (
+	    GMIME_PART (object));
+	GMimeStream *stream = wrapper ?
+	    g_mime_data_wrapper_get_stream (wrapper) : NULL;
+
+	/* Only content that the parser left in the file can be
+	 * found again. */
+	if (stream && GMIME_IS_STREAM_FILE (stream) &&
+	    stream->bound_start >= 0 && stream->bound_end >= stream->bound_start) {
+	    _mime_cache_write_entry (file, "part", stream->bound_start,
+				     stream->bound_end, headers);
+	    ret = TRUE;
+	}
+    }
+
+    g_free (headers);
+
+    return ret;
+}
+
+typedef struct {
+    char *name;
+    time_t mtime;
+} mime_cache_entry_t;
+
+static int
+_mime_cache_compare_entries (const void *a, const void *b)
+{
+    const mime_cache_entry_t *ea = a, *eb = b;
+
+    if (ea->mtime != eb->mtime)
+	return ea->mtime < eb->mtime ? -1 : 1;
+
+    return strcmp (ea->name, eb->name);
+}
+
+/* Count a store in MIME_CACHE_STORES_FILE, and return TRUE once every
+ * MIME_CACHE_PRUNE_INTERVAL stores.  Concurrent stores may be counted
+ * once, which only delays pruning. */
+static notmuch_bool_t
+_mime_cache_prune_due (const void *ctx, const char *cache_dir)
+{
+    char *path;
+    char buf[32];
+    ssize_t len;
+    unsigned long stores = 0;
+    int fd;
+
+    path = talloc_asprintf (ctx, "%s/%s", cache_dir, MIME_CACHE_STORES_FILE);
+    if (path == NULL)
+	return FALSE;
+
+    fd = open (path, O_RDWR | O_CREAT, 0644);
+    talloc_free (path);
+    if (fd < 0)
+	return FALSE;
+
+    len = read (fd, buf, sizeof (buf) - 1);
+    if (len > 0) {
+	buf[len] = '\0';
+	stores = strtoul (buf, NULL, 10);
+    }
+
+    if (++stores >= MIME_CACHE_PRUNE_INTERVAL)
+	stores = 0;
+
+    len = snprintf (buf, sizeof (buf), "%lu\n", stores);
+    if (lseek (fd, 0, SEEK_SET) == 0 && ftruncate (fd, 0) == 0)
+	IGNORE_RESULT (write (fd, buf, len));
+    close (fd);
+
+    return stores == 0;
+}
+
+/* Remove the least recently used files of the cache if it has grown
+ * past MIME_CACHE_MAX_ENTRIES.  Counting the files is a read of the
+ * directory; the files are only examined when some must go. */
+static void
+_mime_cache_prune (const void *ctx, const char *cache_dir)
+{
+    void *local = talloc_new (ctx);
+    mime_cache_entry_t *entries;
+    struct dirent *ent;
+    struct stat st;
+    unsigned int count = 0, i;
+    DIR *dir = NULL;
+
+    if (! _mime_cache_prune_due (local, cache_dir))
+	goto DONE;
+
+    dir = opendir (cache_dir);
+    if (dir == NULL)
+	goto DONE;
+
+    while ((ent = readdir (dir)))
+	if (ent->d_name[0] != '.')
+	    count++;
+
+    if (count <= MIME_CACHE_MAX_ENTRIES)
+	goto DONE;
+
+    entries = talloc_array (local, mime_cache_entry_t, count);
+    if (entries == NULL)
+	goto DONE;
+
+    rewinddir (dir);
+    count = 0;
+    while ((ent = readdir (dir))) {
+	char *path;
+
+	if (ent->d_name[0] == '.')
+	    continue;
+
+	path = talloc_asprintf (local, "%s/%s", cache_dir, ent->d_name);
+	if (path == NULL)
+	    goto DONE;
+	if (stat (path, &st))
+	    continue;
+
+	/* The directory may have grown since it was counted. */
+	if (count == talloc_array_length (entries)) {
+	    entries = talloc_realloc (local, entries, mime_cache_entry_t,
+				      2 * count);
+	    if (entries == NULL)
+		goto DONE;
+	}
+	entries[count].name = path;
+	entries[count].mtime = st.st_mtime;
+	count++;
+    }
+
+    qsort (entries, count, sizeof (*entries), _mime_cache_compare_entries);
+
+    for (i = 0; i + MIME_CACHE_KEPT_ENTRIES < count; i++)
+	unlink (entries[i].name);
+
+  DONE:
+    if (dir)
+	closedir (dir);
+    talloc_free (local);
+}
+
+void
+mime_cache_store (const void *ctx, const char *cache_dir,
+		  const char *filename, const struct stat *st,
+		  GMimeMessage *message)
+{
+    void *local = talloc_new (ctx);
+    char *path, *tempname;
+    FILE *file;
+    notmuch_bool_t ok;
+    int fd;
+
+    path = _mime_cache_path (local, cache_dir, filename);
+    tempname = talloc_asprintf (local, "%s.XXXXXX", path);
+    if (path == NULL || tempname == NULL)
+	goto DONE;
+
+    /* The cache is only an optimization, so failing to write it is
+     * not an error. */
+    if (mkdir (cache_dir, 0755) && errno != EEXIST)
+	goto DONE;
+
+    fd = mkstemp (tempname);
+    if (fd < 0)
+	goto DONE;
+
+    file = fdopen (fd, "w");
+    if (file == NULL) {
+	close (fd);
+	unlink (tempname);
+	goto DONE;
+    }
+
+    fprintf (file, "%s\n", MIME_CACHE_VERSION);
+    _mime_cache_write_entry (file, "file", (long long) st->st_size,
+			     (long long) st->st_mtime, filename);
+    _mime_cache_write_entry (file, "stat", (long long) st->st_ino,
+			     (long long) st->st_mtim.tv_nsec, NULL);
+    ok = _mime_cache_write_object (file, GMIME_OBJECT (message));
+
+    if (fclose (file) || ! ok || rename (tempname, path))
+	unlink (tempname);
+    else
+	_mime_cache_prune (local, cache_dir);
+
+  DONE:
+    talloc_free (local);
+}
+
+/* Read the next entry into 'kind' (of MIME_CACHE_KIND_SIZE bytes),
+ * 'a', 'b' and 'payload'.  Returns FALSE if the cache is malformed. */
+static notmuch_bool_t
+_mime_cache_read_entry (mime_cache_cursor_t *cursor, char *kind,
+			long long *a, long long *b,
+			const char **payload, size_t *len)
+{
+    char line[128];
+    const char *newline;
+    size_t line_len;
+
+    newline = memchr (cursor->pos, '\n', cursor->end - cursor->pos);
+    if (newline == NULL)
+	return FALSE;
+
+    line_len = newline - cursor->pos;
+    if (line_len >= sizeof (line))
+	return FALSE;
+
+    memcpy (line, cursor->pos, line_len);
+    line[line_len] = '\0';
+
+    if (sscanf (line, "%15s %lld %lld %zu", kind, a, b, len) != 4)
+	return FALSE;
+
+    *payload = newline + 1;
+    if (*len >= (size_t) (cursor->end - *payload) || (*payload)[*len] != '\n')
+	return FALSE;
+
+    cursor->pos = *payload + *len + 1;
+
+    return TRUE;
+}
+
+/* Build a MIME object, or a message if 'is_message', from headers
+ * alone. */
+static GMimeObject *
+_mime_cache_parse_headers (const char *headers, size_t len,
+			   notmuch_bool_t is_message)
+{
+    GMimeStream *stream;
+    GMimeParser *parser;
+    GMimeObject *object;
+
+    stream = g_mime_stream_mem_new ();
+    g_mime_stream_write (stream, headers, len);
+    g_mime_stream_write (stream, "\n", 1);
+    g_mime_stream_reset (stream);
+
+    parser = g_mime_parser_new_with_stream (stream);
+    _notmuch_profile_begin (NOTMUCH_PROFILE_MIME_PARSE);
+    if (is_message)
+	object = GMIME_OBJECT (g_mime_parser_construct_message (parser));
+    else
+	object = g_mime_parser_construct_part (parser);
+    _notmuch_profile_end (NOTMUCH_PROFILE_MIME_PARSE);
+
+    g_object_unref (parser);
+    g_object_unref (stream);
+
+    return object;
+}
+
+static GMimeObject *
+_mime_cache_read_object (mime_cache_cursor_t *cursor, GMimeStream *file_stream,
+			 notmuch_bool_t is_message)
+{
+    char kind[MIME_CACHE_KIND_SIZE];
+    const char *headers;
+    long long a, b;
+    size_t len;
+    GMimeObject *object, *child;
+
+    if (! _mime_cache_read_entry (cursor, kind, &a, &b, &headers, &len))
+	return NULL;
+
+    if (is_message != (strcmp (kind, "message") == 0))
+	return NULL;
+
+    object = _mime_cache_parse_headers (headers, len, is_message);
+    if (object == NULL)
+	return NULL;
+
+    if (strcmp (kind, "message") == 0) {
+	child = _mime_cache_read_object (cursor, file_stream, FALSE);
+	if (child == NULL)
+	    goto FAIL;
+	g_mime_message_set_mime_part (GMIME_MESSAGE (object), child);
+	g_object_unref (child);
+    } else if (strcmp (kind, "message-part") == 0) {
+	if (! GMIME_IS_MESSAGE_PART (object))
+	    goto FAIL;
+	child = _mime_cache_read_object (cursor, file_stream, TRUE);
+	if (child == NULL)
+	    goto FAIL;
+	g_mime_message_part_set_message (GMIME_MESSAGE_PART (object),
+					 GMIME_MESSAGE (child));
+	g_object_unref (child);
+    } else if (strcmp (kind, "multipart") == 0) {
+	long long i;
+
+	if (! GMIME_IS_MULTIPART (object) ||
+	    g_mime_multipart_get_count (GMIME_MULTIPART (object)) != 0)
+	    goto FAIL;
+	for (i = 0; i < a; i++) {
+	    child = _mime_cache_read_object (cursor, file_stream, FALSE);
+	    if (child == NULL)
+		goto FAIL;
+	    g_mime_multipart_add (GMIME_MULTIPART (object), child);
+	    g_object_unref (child);
+	}
+    } else if (strcmp (kind, "part") == 0) {
+	GMimePart *part;
+	GMimeStream *content;
+	GMimeDataWrapper *wrapper;
+
+	if (! GMIME_IS_PART (object) || a < 0 || b < a)
+	    goto FAIL;
+
+	/* As the parser does, leave the content in the file, to be
+	 * decoded when it is written out. */
+	part = GMIME_PART (object);
+	content = g_mime_stream_substream (file_stream, a, b);
+	wrapper = g_mime_data_wrapper_new_with_stream (
+	    content, g_mime_part_get_content_encoding (part));
+	g_mime_part_set_content_object (part, wrapper);
+	g_object_unref (wrapper);
+	g_object_unref (content);
+    } else {
+	goto FAIL;
+    }
+
+    return object;
+
+  FAIL:
+    g_object_unref (object);
+    return NULL;
+}
+
+GMimeMessage *
+mime_cache_load (const void *ctx, const char *cache_dir,
+		 const char *filename, const struct stat *st,
+		 GMimeStream *stream)
+{
+    char *path;
+    gchar *contents = NULL;
+    gsize length;
+    mime_cache_cursor_t cursor;
+    char kind[MIME_CACHE_KIND_SIZE];
+    const char *name, *unused;
+    long long size, mtime, ino, mtime_nsec;
+    size_t name_len, unused_len;
+    GMimeObject *message = NULL;
+
+    path = _mime_cache_path (ctx, cache_dir, filename);
+    if (path == NULL || ! g_file_get_contents (path, &contents, &length, NULL))
+	goto DONE;
+
+    cursor.pos = contents;
+    cursor.end = contents + length;
+
+    if (length <= strlen (MIME_CACHE_VERSION) ||
+	strncmp (contents, MIME_CACHE_VERSION "\n",
+		 strlen (MIME_CACHE_VERSION) + 1) != 0)
+	goto DONE;
+    cursor.pos += strlen (MIME_CACHE_VERSION) + 1;
+
+    /* Check that the entry is for this very file. */
+    if (! _mime_cache_read_entry (&cursor, kind, &size, &mtime,
+				  &name, &name_len) ||
+	strcmp (kind, "file") != 0 ||
+	size != (long long) st->st_size || mtime != (long long) st->st_mtime ||
+	name_len != strlen (filename) || memcmp (name, filename, name_len) != 0)
+	goto DONE;
+
+    if (! _mime_cache_read_entry (&cursor, kind, &ino, &mtime_nsec,
+				  &unused, &unused_len) ||
+	strcmp (kind, "stat") != 0 ||
+	ino != (long long) st->st_ino ||
+	mtime_nsec != (long long) st->st_mtim.tv_nsec)
+	goto DONE;
+
+    message = _mime_cache_read_object (&cursor, stream, TRUE);
+    if (message && cursor.pos != cursor.end) {
+	g_object_unref (message);
+	message = NULL;
+    }
+
+    /* Mark the entry as recently used, so that pruning keeps it. */
+    if (message)
+	utimes (path, NULL);
+
+  DONE:
+    g_free (contents);
+    talloc_free (path);
+
+    return message ? GMIME_MESSAGE (message) : NULL;
+}
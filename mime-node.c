@@ -57,11 +57,20 @@ _mime_node_context_free (mime_node_context_t *res)
 notmuch_status_t
 mime_node_open (const void *ctx, notmuch_message_t *message,
 		notmuch_crypto_t *crypto, mime_node_t **root_out)
+{
+    return mime_node_open_cached (ctx, message, crypto, NULL, root_out);
+}
+
+notmuch_status_t
+mime_node_open_cached (const void *ctx, notmuch_message_t *message,
+		       notmuch_crypto_t *crypto, const char *cache_dir,
+		       mime_node_t **root_out)
 {
     const char *filename = notmuch_message_get_filename (message);
     mime_node_context_t *mctx;
     mime_node_t *root;
     notmuch_status_t status;
+    struct stat st;
 
     root = talloc_zero (ctx, mime_node_t);
     if (root == NULL) {
@@ -79,7 +88,9 @@ mime_node_open (const void *ctx, notmuch_message_t *message,
     }
     talloc_set_destructor (mctx, _mime_node_context_free);
 
+    _notmuch_profile_begin (NOTMUCH_PROFILE_FILE_OPEN);
     mctx->file = fopen (filename, "r");
+    _notmuch_profile_end (NOTMUCH_PROFILE_FILE_OPEN);
     if (! mctx->file) {
 	fprintf (stderr, "Error opening %s: %s\n", filename, strerror (errno));
 	status = NOTMUCH_STATUS_FILE_ERROR;
@@ -94,6 +105,99 @@ mime_node_open (const void *ctx, notmuch_message_t *message,
     }
     g_mime_stream_file_set_owner (GMIME_STREAM_FILE (mctx->stream), FALSE);
 
+    /* Signed and encrypted parts must be checked against the exact
+     * bytes of the message, so those are always parsed. */
+    if (cache_dir && (crypto->verify || crypto->decrypt ||
+		      fstat (fileno (mctx->file), &st)))
+	cache_dir = NULL;
+
+    if (cache_dir)
+	mctx->mime_message = mime_cache_load (mctx, cache_dir, filename,
+					      &st, mctx->stream);
+
+    if (! mctx->mime_message) {
+	mctx->parser = g_mime_parser_new_with_stream (mctx->stream);
+	if (!mctx->parser) {
+	    fprintf (stderr, "Out of memory.\n");
+	    status = NOTMUCH_STATUS_OUT_OF_MEMORY;
+	    goto DONE;
+	}
+
+	_notmuch_profile_begin (NOTMUCH_PROFILE_MIME_PARSE);
+	mctx->mime_message = g_mime_parser_construct_message (mctx->parser);
+	_notmuch_profile_end (NOTMUCH_PROFILE_MIME_PARSE);
+	if (!mctx->mime_message) {
+	    fprintf (stderr, "Failed to parse %s\n", filename);
+	    status = NOTMUCH_STATUS_FILE_ERROR;
+	    goto DONE;
+	}
+
+	if (cache_dir)
+	    mime_cache_store (mctx, cache_dir, filename, &st,
+			      mctx->mime_message);
+    }
+
+    mctx->crypto = crypto;
+
+    /* Create the root node */
+    root->part = GMIME_OBJECT (mctx->mime_message);
+    root->envelope_file = message;
+    root->nchildren = 1;
+    root->ctx = mctx;
+
+    root->parent = NULL;
+    root->part_num = 0;
+    root->next_child = 0;
+    root->next_part_num = 1;
+
+    *root_out = root;
+    return NOTMUCH_STATUS_SUCCESS;
+
+DONE:
+    talloc_free (root);
+    return status;
+}
+
+notmuch_status_t
+mime_node_open_headers (const void *ctx, notmuch_message_t *message,
+			notmuch_crypto_t *crypto, const char *cache_dir,
+			mime_node_t **root_out)
+{
+    const char *headers = notmuch_message_get_stored_headers (message);
+    mime_node_context_t *mctx;
+    mime_node_t *root;
+    notmuch_status_t status;
+
+    if (headers == NULL)
+	return mime_node_open_cached (ctx, message, crypto, cache_dir,
+				      root_out);
+
+    root = talloc_zero (ctx, mime_node_t);
+    if (root == NULL) {
+	fprintf (stderr, "Out of memory.\n");
+	status = NOTMUCH_STATUS_OUT_OF_MEMORY;
+	goto DONE;
+    }
+
+    mctx = talloc_zero (root, mime_node_context_t);
+    if (mctx == NULL) {
+	fprintf (stderr, "Out of memory.\n");
+	status = NOTMUCH_STATUS_OUT_OF_MEMORY;
+	goto DONE;
+    }
+    talloc_set_destructor (mctx, _mime_node_context_free);
+
+    /* The stored headers end with an empty line, so they parse as a
+     * message with an empty body. */
+    mctx->stream = g_mime_stream_mem_new ();
+    if (!mctx->stream) {
+	fprintf (stderr, "Out of memory.\n");
+	status = NOTMUCH_STATUS_OUT_OF_MEMORY;
+	goto DONE;
+    }
+    g_mime_stream_write (mctx->stream, headers, strlen (headers));
+    g_mime_stream_reset (mctx->stream);
+
     mctx->parser = g_mime_parser_new_with_stream (mctx->stream);
     if (!mctx->parser) {
 	fprintf (stderr, "Out of memory.\n");
@@ -101,19 +205,22 @@ mime_node_open (const void *ctx, notmuch_message_t *message,
 	goto DONE;
     }
 
+    _notmuch_profile_begin (NOTMUCH_PROFILE_MIME_PARSE);
     mctx->mime_message = g_mime_parser_construct_message (mctx->parser);
+    _notmuch_profile_end (NOTMUCH_PROFILE_MIME_PARSE);
     if (!mctx->mime_message) {
-	fprintf (stderr, "Failed to parse %s\n", filename);
+	fprintf (stderr, "Failed to parse the stored headers of %s\n",
+		 notmuch_message_get_message_id (message));
 	status = NOTMUCH_STATUS_FILE_ERROR;
 	goto DONE;
     }
 
     mctx->crypto = crypto;
 
-    /* Create the root node */
+    /* Create the root node, without the body. */
     root->part = GMIME_OBJECT (mctx->mime_message);
     root->envelope_file = message;
-    root->nchildren = 1;
+    root->nchildren = 0;
     root->ctx = mctx;
 
     root->parent = NULL;
@@ -49,6 +49,9 @@ typedef GMimeCipherContext notmuch_crypto_context_t;
  */
 #include "xutil.h"
 
+/* Not part of the library interface either, but exported for us. */
+#include "profile-private.h"
+
 #include <stddef.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -91,6 +94,8 @@ typedef struct notmuch_show_params {
     int part;
     notmuch_crypto_t crypto;
     notmuch_bool_t include_html;
+    /* Where to cache the MIME structure of shown messages, or NULL. */
+    const char *mime_cache_dir;
 } notmuch_show_params_t;
 
 /* There's no point in continuing when we've detected that we've done
@@ -217,6 +222,9 @@ notmuch_config_command (notmuch_config_t *config, int argc, char *argv[]);
 int
 notmuch_compact_command (notmuch_config_t *config, int argc, char *argv[]);
 
+int
+notmuch_serve_command (notmuch_config_t *config, int argc, char *argv[]);
+
 const char *
 notmuch_time_relative_date (const void *ctx, time_t then);
 
@@ -255,6 +263,25 @@ json_quote_chararray (const void *ctx, const char *str, const size_t len);
 char *
 json_quote_str (const void *ctx, const char *str);
 
+/* notmuch-serve.c */
+
+/* Open the database of 'config' like notmuch_database_open, reporting
+ * errors on stderr.  Commands run by "notmuch serve" are given the
+ * read-only database the server keeps open. */
+notmuch_status_t
+notmuch_client_database_open (notmuch_config_t *config,
+			      notmuch_database_mode_t mode,
+			      notmuch_database_t **notmuch);
+
+/* Have the server listening on 'socket_path' run the command in
+ * 'argv' (starting with the command name) on the standard streams of
+ * this process.  Return FALSE, without running anything, if the
+ * command is not one the server runs or there is no server;
+ * otherwise store the exit status of the command in *ret. */
+notmuch_bool_t
+notmuch_serve_forward (const char *socket_path, int argc, char *argv[],
+		       int *ret);
+
 /* notmuch-config.c */
 
 notmuch_config_t *
@@ -332,6 +359,13 @@ void
 notmuch_config_set_maildir_synchronize_flags (notmuch_config_t *config,
 					      notmuch_bool_t synchronize_flags);
 
+notmuch_bool_t
+notmuch_config_get_show_mime_cache (notmuch_config_t *config);
+
+void
+notmuch_config_set_show_mime_cache (notmuch_config_t *config,
+				    notmuch_bool_t mime_cache);
+
 const char **
 notmuch_config_get_search_exclude_tags (notmuch_config_t *config, size_t *length);
 
@@ -437,6 +471,28 @@ notmuch_status_t
 mime_node_open (const void *ctx, notmuch_message_t *message,
 		notmuch_crypto_t *crypto, mime_node_t **node_out);
 
+/* Like mime_node_open, but keep the MIME structure of the message in
+ * the cache in 'cache_dir', and build the tree from there if the
+ * message file has not changed since.  The cache is not used when
+ * crypto->verify or crypto->decrypt is set.  If cache_dir is NULL,
+ * this is just mime_node_open.
+ */
+notmuch_status_t
+mime_node_open_cached (const void *ctx, notmuch_message_t *message,
+		       notmuch_crypto_t *crypto, const char *cache_dir,
+		       mime_node_t **node_out);
+
+/* Like mime_node_open_cached, for callers that only need the headers
+ * of the message.  If the message has headers stored in the database
+ * (see notmuch_message_get_stored_headers), the root node is built
+ * from those alone, without opening the message file, and has no
+ * children.
+ */
+notmuch_status_t
+mime_node_open_headers (const void *ctx, notmuch_message_t *message,
+			notmuch_crypto_t *crypto, const char *cache_dir,
+			mime_node_t **node_out);
+
 /* Return a new MIME node for the requested child part of parent.
  * parent will be used as the talloc context for the returned child
  * node.
@@ -452,6 +508,28 @@ mime_node_child (mime_node_t *parent, int child);
 mime_node_t *
 mime_node_seek_dfs (mime_node_t *node, int n);
 
+/* mime-cache.c */
+
+/* Build the message in the file 'filename' from its MIME structure
+ * in the cache in 'cache_dir', with the content of its parts read
+ * from 'stream', a stream on the whole file.  Returns NULL unless the
+ * cache has an entry for the file with the size and modification
+ * time in 'st'.
+ */
+GMimeMessage *
+mime_cache_load (const void *ctx, const char *cache_dir,
+		 const char *filename, const struct stat *st,
+		 GMimeStream *stream);
+
+/* Record the MIME structure of 'message', parsed from the file
+ * 'filename' with status 'st', in the cache in 'cache_dir'.  Failures
+ * are silently ignored.
+ */
+void
+mime_cache_store (const void *ctx, const char *cache_dir,
+		  const char *filename, const struct stat *st,
+		  GMimeMessage *message);
+
 typedef enum dump_formats {
     DUMP_FORMAT_AUTO,
     DUMP_FORMAT_BATCH_TAG,
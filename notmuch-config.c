@@ -125,6 +125,7 @@ struct _notmuch_config {
     const char **new_ignore;
     size_t new_ignore_length;
     notmuch_bool_t maildir_synchronize_flags;
+    notmuch_bool_t show_mime_cache;
     const char **search_exclude_tags;
     size_t search_exclude_tags_length;
 };
@@ -285,6 +286,7 @@ notmuch_config_open (void *ctx,
     config->new_ignore = NULL;
     config->new_ignore_length = 0;
     config->maildir_synchronize_flags = TRUE;
+    config->show_mime_cache = FALSE;
     config->search_exclude_tags = NULL;
     config->search_exclude_tags_length = 0;
     config->crypto_gpg_path = NULL;
@@ -417,6 +419,17 @@ notmuch_config_open (void *ctx,
 	g_error_free (error);
     }
 
+    /* The MIME cache is off unless asked for, so it is not written
+     * to configuration files that don't mention it. */
+    error = NULL;
+    config->show_mime_cache =
+	g_key_file_get_boolean (config->key_file,
+				"show", "mime_cache", &error);
+    if (error) {
+	config->show_mime_cache = FALSE;
+	g_error_free (error);
+    }
+
     if (notmuch_config_get_crypto_gpg_path (config) == NULL) {
 	notmuch_config_set_crypto_gpg_path (config, "gpg");
     }
@@ -920,3 +933,18 @@ notmuch_config_set_maildir_synchronize_flags (notmuch_config_t *config,
 			    "maildir", "synchronize_flags", synchronize_flags);
     config->maildir_synchronize_flags = synchronize_flags;
 }
+
+notmuch_bool_t
+notmuch_config_get_show_mime_cache (notmuch_config_t *config)
+{
+    return config->show_mime_cache;
+}
+
+void
+notmuch_config_set_show_mime_cache (notmuch_config_t *config,
+				    notmuch_bool_t mime_cache)
+{
+    g_key_file_set_boolean (config->key_file,
+			    "show", "mime_cache", mime_cache);
+    config->show_mime_cache = mime_cache;
+}
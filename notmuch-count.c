@@ -70,7 +70,10 @@ print_count (notmuch_database_t *notmuch, const char *query_str,
 	     const char **exclude_tags, size_t exclude_tags_length, int output)
 {
     notmuch_query_t *query;
+    notmuch_status_t status = NOTMUCH_STATUS_SUCCESS;
+    unsigned int count = 0;
     size_t i;
+    int ret = 0;
 
     query = notmuch_query_create (notmuch, query_str);
     if (query == NULL) {
@@ -81,21 +84,36 @@ print_count (notmuch_database_t *notmuch, const char *query_str,
     for (i = 0; i < exclude_tags_length; i++)
 	notmuch_query_add_tag_exclude (query, exclude_tags[i]);
 
+    /* Unlike notmuch_query_count_messages and
+     * notmuch_query_count_threads, the batch functions report
+     * errors. */
     switch (output) {
     case OUTPUT_MESSAGES:
-	printf ("%u\n", notmuch_query_count_messages (query));
+	status = notmuch_query_count_messages_batch (&query, 1, &count);
 	break;
     case OUTPUT_THREADS:
-	printf ("%u\n", notmuch_query_count_threads (query));
+	status = notmuch_query_count_threads_batch (&query, 1, &count);
 	break;
     case OUTPUT_FILES:
-	printf ("%u\n", count_files (query));
+	count = count_files (query);
 	break;
     }
 
+    if (status) {
+	const char *reason = notmuch_database_status_string (notmuch);
+
+	fprintf (stderr, "Error counting \"%s\": %s\n", query_str,
+		 notmuch_status_to_string (status));
+	if (reason)
+	    fputs (reason, stderr);
+	ret = 1;
+    } else {
+	printf ("%u\n", count);
+    }
+
     notmuch_query_destroy (query);
 
-    return 0;
+    return ret;
 }
 
 static int
@@ -168,8 +186,8 @@ notmuch_count_command (notmuch_config_t *config, int argc, char *argv[])
 	return EXIT_FAILURE;
     }
 
-    if (notmuch_database_open (notmuch_config_get_database_path (config),
-			       NOTMUCH_DATABASE_MODE_READ_ONLY, &notmuch))
+    if (notmuch_client_database_open (config, NOTMUCH_DATABASE_MODE_READ_ONLY,
+				      &notmuch))
 	return EXIT_FAILURE;
 
     query_str = query_string_from_args (config, argc-opt_index, argv+opt_index);
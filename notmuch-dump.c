@@ -21,16 +21,28 @@
 #include "notmuch-client.h"
 #include "hex-escape.h"
 #include "string-util.h"
-#include <zlib.h>
+#include "zlib-extra.h"
 
 
+/* Report a failure to read 'what', with the reason recorded by the
+ * library if there is one. */
+static void
+dump_read_error (notmuch_database_t *notmuch, const char *what)
+{
+    const char *reason = notmuch_database_status_string (notmuch);
+
+    if (reason)
+	fprintf (stderr, "Error: failed to read %s: %s", what, reason);
+    else
+	fprintf (stderr, "Error: failed to read %s.\n", what);
+}
+
 static int
-database_dump_file (notmuch_database_t *notmuch, gzFile output,
+database_dump_file (notmuch_database_t *notmuch, gz_writer_t *output,
 		    const char *query_str, int output_format)
 {
     notmuch_query_t *query;
-    notmuch_messages_t *messages;
-    notmuch_message_t *message;
+    notmuch_tag_dump_t *dump;
     notmuch_tags_t *tags;
 
     if (! query_str)
@@ -41,22 +53,29 @@ database_dump_file (notmuch_database_t *notmuch, gzFile output,
 	fprintf (stderr, "Out of memory\n");
 	return EXIT_FAILURE;
     }
-    /* Don't ask xapian to sort by Message-ID. Xapian optimizes returning the
-     * first results quickly at the expense of total time.
-     */
-    notmuch_query_set_sort (query, NOTMUCH_SORT_UNSORTED);
 
     char *buffer = NULL;
     size_t buffer_size = 0;
 
-    for (messages = notmuch_query_search_messages (query);
-	 notmuch_messages_valid (messages);
-	 notmuch_messages_move_to_next (messages)) {
+    /* Collect the tags of all matching messages at once rather than
+     * reading each message. */
+    if (notmuch_query_search_tag_dump (query, &dump)) {
+	dump_read_error (notmuch, "the tags to dump");
+	notmuch_query_destroy (query);
+	return EXIT_FAILURE;
+    }
+
+    for (; notmuch_tag_dump_valid (dump);
+	 notmuch_tag_dump_move_to_next (dump)) {
 	int first = 1;
 	const char *message_id;
 
-	message = notmuch_messages_get (messages);
-	message_id = notmuch_message_get_message_id (message);
+	message_id = notmuch_tag_dump_get_message_id (dump);
+	if (message_id == NULL) {
+	    dump_read_error (notmuch, "the message ID of a message to dump");
+	    notmuch_query_destroy (query);
+	    return EXIT_FAILURE;
+	}
 
 	if (output_format == DUMP_FORMAT_BATCH_TAG &&
 	    strchr (message_id, '\n')) {
@@ -66,26 +85,32 @@ database_dump_file (notmuch_database_t *notmuch, gzFile output,
 	     * break in a message ID because of unfolding, so we can
 	     * safely disallow it. */
 	    fprintf (stderr, "Warning: skipping message id containing line break: \"%s\"\n", message_id);
-	    notmuch_message_destroy (message);
 	    continue;
 	}
 
 	if (output_format == DUMP_FORMAT_SUP) {
-	    gzprintf (output, "%s (", message_id);
+	    gz_writer_puts (output, message_id);
+	    gz_writer_puts (output, " (");
+	}
+
+	tags = notmuch_tag_dump_get_tags (dump);
+	if (tags == NULL) {
+	    dump_read_error (notmuch, "the tags of a message to dump");
+	    notmuch_query_destroy (query);
+	    return EXIT_FAILURE;
 	}
 
-	for (tags = notmuch_message_get_tags (message);
-	     notmuch_tags_valid (tags);
+	for (; notmuch_tags_valid (tags);
 	     notmuch_tags_move_to_next (tags)) {
 	    const char *tag_str = notmuch_tags_get (tags);
 
 	    if (! first)
-		gzputs (output, " ");
+		gz_writer_puts (output, " ");
 
 	    first = 0;
 
 	    if (output_format == DUMP_FORMAT_SUP) {
-		gzputs (output, tag_str);
+		gz_writer_puts (output, tag_str);
 	    } else {
 		if (hex_encode (notmuch, tag_str,
 				&buffer, &buffer_size) != HEX_SUCCESS) {
@@ -93,12 +118,13 @@ database_dump_file (notmuch_database_t *notmuch, gzFile output,
 			     tag_str);
 		    return EXIT_FAILURE;
 		}
-		gzprintf (output, "+%s", buffer);
+		gz_writer_puts (output, "+");
+		gz_writer_puts (output, buffer);
 	    }
 	}
 
 	if (output_format == DUMP_FORMAT_SUP) {
-	    gzputs (output, ")\n");
+	    gz_writer_puts (output, ")\n");
 	} else {
 	    if (make_boolean_term (notmuch, "id", message_id,
 				   &buffer, &buffer_size)) {
@@ -106,10 +132,12 @@ database_dump_file (notmuch_database_t *notmuch, gzFile output,
 			     message_id, strerror (errno));
 		    return EXIT_FAILURE;
 	    }
-	    gzprintf (output, " -- %s\n", buffer);
+	    gz_writer_puts (output, " -- ");
+	    gz_writer_puts (output, buffer);
+	    gz_writer_puts (output, "\n");
 	}
 
-	notmuch_message_destroy (message);
+	notmuch_tags_destroy (tags);
     }
 
     notmuch_query_destroy (query);
@@ -127,8 +155,7 @@ notmuch_database_dump (notmuch_database_t *notmuch,
 		       dump_format_t output_format,
 		       notmuch_bool_t gzip_output)
 {
-    gzFile output = NULL;
-    const char *mode = gzip_output ? "w9" : "wT";
+    gz_writer_t *output = NULL;
     const char *name_for_error = output_file_name ? output_file_name : "stdout";
 
     char *tempname = NULL;
@@ -148,23 +175,23 @@ notmuch_database_dump (notmuch_database_t *notmuch,
 	goto DONE;
     }
 
-    output = gzdopen (outfd, mode);
+    /* Compression is most of the cost of a gzipped dump, so it is
+     * spread over several threads. */
+    output = gz_writer_create (notmuch, outfd, gzip_output);
 
     if (output == NULL) {
 	fprintf (stderr, "Error opening %s for (gzip) writing: %s\n",
 		 name_for_error, strerror (errno));
-	if (close (outfd))
-	    fprintf (stderr, "Error closing %s during shutdown: %s\n",
-		 name_for_error, strerror (errno));
 	goto DONE;
     }
 
     ret = database_dump_file (notmuch, output, query_str, output_format);
     if (ret) goto DONE;
 
-    ret = gzflush (output, Z_FINISH);
+    ret = gz_writer_finish (output);
     if (ret) {
-	fprintf (stderr, "Error flushing output: %s\n", gzerror (output, NULL));
+	fprintf (stderr, "Error writing %s: %s\n", name_for_error,
+		 util_error_string (ret));
 	goto DONE;
     }
 
@@ -177,11 +204,15 @@ notmuch_database_dump (notmuch_database_t *notmuch,
 	}
     }
 
-    if (gzclose_w (output) != Z_OK) {
+    talloc_free (output);
+    output = NULL;
+
+    ret = close (outfd);
+    outfd = -1;
+    if (ret) {
 	fprintf (stderr, "Error closing %s: %s\n", name_for_error,
-		 gzerror (output, NULL));
+		 strerror (errno));
 	ret = EXIT_FAILURE;
-	output = NULL;
 	goto DONE;
     }
 
@@ -195,8 +226,11 @@ notmuch_database_dump (notmuch_database_t *notmuch,
 
     }
  DONE:
-    if (ret != EXIT_SUCCESS && output)
-	(void) gzclose_w (output);
+    if (output)
+	talloc_free (output);
+
+    if (outfd >= 0)
+	(void) close (outfd);
 
     if (ret != EXIT_SUCCESS && output_file_name)
 	(void) unlink (tempname);
@@ -414,9 +414,11 @@ add_files (notmuch_database_t *notmuch,
     /* If the database knows about this directory, then we sort based
      * on strcmp to match the database sorting. Otherwise, we can do
      * inode-based sorting for faster filesystem operation. */
+    _notmuch_profile_begin (NOTMUCH_PROFILE_DIRECTORY_SCAN);
     num_fs_entries = scandir (path, &fs_entries, 0,
 			      directory ?
 			      dirent_sort_strcmp_name : dirent_sort_inode);
+    _notmuch_profile_end (NOTMUCH_PROFILE_DIRECTORY_SCAN);
 
     if (num_fs_entries == -1) {
 	fprintf (stderr, "Error opening directory %s: %s\n",
@@ -708,9 +710,13 @@ count_files (const char *path, int *count, add_files_state_t *state)
     struct dirent *entry = NULL;
     char *next;
     struct dirent **fs_entries = NULL;
-    int num_fs_entries = scandir (path, &fs_entries, 0, dirent_sort_inode);
+    int num_fs_entries;
     int entry_type, i;
 
+    _notmuch_profile_begin (NOTMUCH_PROFILE_DIRECTORY_SCAN);
+    num_fs_entries = scandir (path, &fs_entries, 0, dirent_sort_inode);
+    _notmuch_profile_end (NOTMUCH_PROFILE_DIRECTORY_SCAN);
+
     if (num_fs_entries == -1) {
 	fprintf (stderr, "Warning: failed to open directory %s: %s\n",
 		 path, strerror (errno));
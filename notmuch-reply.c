@@ -749,6 +749,7 @@ enum {
     FORMAT_DEFAULT,
     FORMAT_JSON,
     FORMAT_SEXP,
+    FORMAT_CBOR,
     FORMAT_HEADERS_ONLY,
 };
 
@@ -782,6 +783,7 @@ notmuch_reply_command (notmuch_config_t *config, int argc, char *argv[])
 	  (notmuch_keyword_t []){ { "default", FORMAT_DEFAULT },
 				  { "json", FORMAT_JSON },
 				  { "sexp", FORMAT_SEXP },
+				  { "cbor", FORMAT_CBOR },
 				  { "headers-only", FORMAT_HEADERS_ONLY },
 				  { 0, 0 } } },
 	{ NOTMUCH_OPT_INT, &notmuch_format_version, "format-version", 0, 0 },
@@ -805,6 +807,9 @@ notmuch_reply_command (notmuch_config_t *config, int argc, char *argv[])
     } else if (format == FORMAT_SEXP) {
 	reply_format_func = notmuch_reply_format_sprinter;
 	sp = sprinter_sexp_create (config, stdout);
+    } else if (format == FORMAT_CBOR) {
+	reply_format_func = notmuch_reply_format_sprinter;
+	sp = sprinter_cbor_create (config, stdout);
     } else {
 	reply_format_func = notmuch_reply_format_default;
     }
@@ -824,8 +829,8 @@ notmuch_reply_command (notmuch_config_t *config, int argc, char *argv[])
 
     params.crypto.gpgpath = notmuch_config_get_crypto_gpg_path (config);
 
-    if (notmuch_database_open (notmuch_config_get_database_path (config),
-			       NOTMUCH_DATABASE_MODE_READ_ONLY, &notmuch))
+    if (notmuch_client_database_open (config, NOTMUCH_DATABASE_MODE_READ_ONLY,
+				      &notmuch))
 	return EXIT_FAILURE;
 
     query = notmuch_query_create (notmuch, query_string);
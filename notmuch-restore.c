@@ -64,6 +64,256 @@ tag_message (unused (void *ctx),
     return ret;
 }
 
+/* Restoring works on the whole input at once: the lines are sorted by
+ * message ID, so that looking up their messages walks the database in
+ * order, and lines that would not change the tags of their message
+ * are dropped before any message is looked up. */
+
+/* The number of changed messages written in each transaction. */
+#define RESTORE_TRANSACTION_SIZE 10000
+
+typedef struct {
+    char *message_id;
+    notmuch_tag_op_t *ops;
+    size_t count;
+    /* Position in the input, to keep lines for the same message in
+     * order. */
+    size_t line;
+    notmuch_bool_t unchanged;
+} restore_line_t;
+
+typedef struct {
+    restore_line_t *lines;
+    size_t count;
+    size_t size;
+} restore_lines_t;
+
+static int
+restore_lines_append (restore_lines_t *lines, const char *message_id,
+		      tag_op_list_t *tag_ops)
+{
+    restore_line_t *line;
+    size_t i;
+
+    if (lines->count == lines->size) {
+	lines->size = lines->size ? 2 * lines->size : 1024;
+	lines->lines = talloc_realloc (lines, lines->lines, restore_line_t,
+				       lines->size);
+	if (lines->lines == NULL)
+	    return -1;
+    }
+
+    line = &lines->lines[lines->count];
+    line->message_id = talloc_strdup (lines->lines, message_id);
+    line->count = tag_op_list_size (tag_ops);
+    line->ops = talloc_array (lines->lines, notmuch_tag_op_t, line->count);
+    line->line = lines->count;
+    line->unchanged = FALSE;
+    if (line->message_id == NULL || (line->count && line->ops == NULL))
+	return -1;
+
+    for (i = 0; i < line->count; i++) {
+	line->ops[i].tag = talloc_strdup (line->ops,
+					  tag_op_list_tag (tag_ops, i));
+	line->ops[i].remove = tag_op_list_isremove (tag_ops, i);
+	if (line->ops[i].tag == NULL)
+	    return -1;
+    }
+
+    lines->count++;
+    return 0;
+}
+
+static int
+compare_restore_lines (const void *a, const void *b)
+{
+    const restore_line_t *x = a, *y = b;
+    int cmp = strcmp (x->message_id, y->message_id);
+
+    if (cmp)
+	return cmp;
+
+    return x->line < y->line ? -1 : x->line > y->line;
+}
+
+/* Would applying 'line' to a message with the (sorted) tags 'tags'
+ * leave its tags as they are? */
+static notmuch_bool_t
+line_keeps_tags (restore_line_t *line, notmuch_tags_t *tags,
+		 tag_op_flag_t flags)
+{
+    GHashTable *current, *result;
+    GHashTableIter iter;
+    gpointer key;
+    notmuch_bool_t same;
+    size_t i;
+
+    current = g_hash_table_new (g_str_hash, g_str_equal);
+    result = g_hash_table_new (g_str_hash, g_str_equal);
+
+    for (; notmuch_tags_valid (tags); notmuch_tags_move_to_next (tags)) {
+	const char *tag = notmuch_tags_get (tags);
+
+	g_hash_table_insert (current, (gpointer) tag, (gpointer) tag);
+	if (! (flags & TAG_FLAG_REMOVE_ALL))
+	    g_hash_table_insert (result, (gpointer) tag, (gpointer) tag);
+    }
+
+    for (i = 0; i < line->count; i++) {
+	const char *tag = line->ops[i].tag;
+
+	if (line->ops[i].remove)
+	    g_hash_table_remove (result, tag);
+	else
+	    g_hash_table_insert (result, (gpointer) tag, (gpointer) tag);
+    }
+
+    same = (g_hash_table_size (current) == g_hash_table_size (result));
+    g_hash_table_iter_init (&iter, result);
+    while (same && g_hash_table_iter_next (&iter, &key, NULL))
+	same = g_hash_table_lookup (current, key) != NULL;
+
+    g_hash_table_unref (current);
+    g_hash_table_unref (result);
+
+    return same;
+}
+
+/* Mark the lines that would not change the tags of their message as
+ * unchanged, reading the current tags of all messages at once.  Only
+ * the first line for each message can be judged against the
+ * database. */
+static int
+mark_unchanged_lines (notmuch_database_t *notmuch, restore_lines_t *lines,
+		      tag_op_flag_t flags)
+{
+    notmuch_query_t *query;
+    notmuch_tag_dump_t *dump;
+    GHashTable *first_lines;
+    size_t i;
+    int ret = 0;
+
+    query = notmuch_query_create (notmuch, "");
+    if (query == NULL) {
+	fprintf (stderr, "Out of memory.\n");
+	return 1;
+    }
+
+    /* Reading every message only pays off if the input covers a fair
+     * share of the database. */
+    if (lines->count * 16 < notmuch_query_count_messages (query))
+	goto DONE;
+
+    if (notmuch_query_search_tag_dump (query, &dump)) {
+	ret = 1;
+	goto DONE;
+    }
+
+    first_lines = g_hash_table_new (g_str_hash, g_str_equal);
+    for (i = 0; i < lines->count; i++) {
+	if (i == 0 || strcmp (lines->lines[i].message_id,
+			      lines->lines[i - 1].message_id))
+	    g_hash_table_insert (first_lines, lines->lines[i].message_id,
+				 &lines->lines[i]);
+    }
+
+    for (; notmuch_tag_dump_valid (dump);
+	 notmuch_tag_dump_move_to_next (dump)) {
+	const char *message_id = notmuch_tag_dump_get_message_id (dump);
+	restore_line_t *line;
+	notmuch_tags_t *tags;
+
+	if (message_id == NULL) {
+	    ret = 1;
+	    break;
+	}
+
+	line = g_hash_table_lookup (first_lines, message_id);
+	if (line == NULL)
+	    continue;
+
+	tags = notmuch_tag_dump_get_tags (dump);
+	if (tags == NULL) {
+	    fprintf (stderr, "Out of memory.\n");
+	    ret = 1;
+	    break;
+	}
+	line->unchanged = line_keeps_tags (line, tags, flags);
+	notmuch_tags_destroy (tags);
+    }
+
+    g_hash_table_unref (first_lines);
+
+  DONE:
+    notmuch_query_destroy (query);
+    return ret;
+}
+
+static int
+restore_all_lines (void *ctx, notmuch_database_t *notmuch,
+		   restore_lines_t *lines, tag_op_flag_t flags)
+{
+    tag_op_list_t *tag_ops;
+    size_t i, j, pending = 0;
+    int ret = 0;
+
+    tag_ops = tag_op_list_create (ctx);
+    if (tag_ops == NULL) {
+	fprintf (stderr, "Out of memory.\n");
+	return 1;
+    }
+
+    qsort (lines->lines, lines->count, sizeof (restore_line_t),
+	   compare_restore_lines);
+
+    ret = mark_unchanged_lines (notmuch, lines, flags);
+    if (ret)
+	return ret;
+
+    if (notmuch_database_begin_atomic (notmuch)) {
+	fprintf (stderr, "Error: failed to start a transaction.\n");
+	return 1;
+    }
+
+    for (i = 0; i < lines->count; i++) {
+	restore_line_t *line = &lines->lines[i];
+
+	if (line->unchanged)
+	    continue;
+
+	tag_op_list_reset (tag_ops);
+	for (j = 0; j < line->count; j++) {
+	    if (tag_op_list_append (tag_ops, line->ops[j].tag,
+				    line->ops[j].remove)) {
+		ret = 1;
+		break;
+	    }
+	}
+	if (ret)
+	    break;
+
+	ret = tag_message (ctx, notmuch, line->message_id, tag_ops, flags);
+	if (ret)
+	    break;
+
+	if (++pending == RESTORE_TRANSACTION_SIZE) {
+	    pending = 0;
+	    if (notmuch_database_end_atomic (notmuch) ||
+		notmuch_database_begin_atomic (notmuch)) {
+		fprintf (stderr, "Error: failed to commit restored tags.\n");
+		return 1;
+	    }
+	}
+    }
+
+    if (notmuch_database_end_atomic (notmuch)) {
+	fprintf (stderr, "Error: failed to commit restored tags.\n");
+	ret = 1;
+    }
+
+    return ret;
+}
+
 /* Sup dump output is one line per message. We match a sequence of
  * non-space characters for the message-id, then one or more
  * spaces, then a list of space-separated tags as a sequence of
@@ -127,10 +377,12 @@ notmuch_restore_command (notmuch_config_t *config, int argc, char *argv[])
     notmuch_bool_t accumulate = FALSE;
     tag_op_flag_t flags = 0;
     tag_op_list_t *tag_ops;
+    restore_lines_t *lines;
 
     char *input_file_name = NULL;
     const char *name_for_error = NULL;
     gzFile input = NULL;
+    gz_reader_t *reader = NULL;
     char *line = NULL;
     void *line_ctx = NULL;
     ssize_t line_len;
@@ -197,8 +449,11 @@ notmuch_restore_command (notmuch_config_t *config, int argc, char *argv[])
 	goto DONE;
     }
 
+    /* Decompress ahead of the parsing below. */
+    reader = gz_reader_create (config, input);
     tag_ops = tag_op_list_create (config);
-    if (tag_ops == NULL) {
+    lines = talloc_zero (config, restore_lines_t);
+    if (reader == NULL || tag_ops == NULL || lines == NULL) {
 	fprintf (stderr, "Out of memory.\n");
 	ret = EXIT_FAILURE;
 	goto DONE;
@@ -207,7 +462,7 @@ notmuch_restore_command (notmuch_config_t *config, int argc, char *argv[])
     do {
 	util_status_t status;
 
-	status = gz_getline (line_ctx, &line, &line_len, input);
+	status = gz_reader_getline (line_ctx, &line, &line_len, reader);
 
 	/* empty input file not considered an error */
 	if (status == UTIL_EOF) {
@@ -280,18 +535,19 @@ notmuch_restore_command (notmuch_config_t *config, int argc, char *argv[])
 	if (ret < 0)
 	    break;
 
-	ret = tag_message (line_ctx, notmuch, query_string,
-			   tag_ops, flags);
-	if (ret)
+	ret = restore_lines_append (lines, query_string, tag_ops);
+	if (ret) {
+	    fprintf (stderr, "Out of memory.\n");
 	    break;
+	}
 
-    }  while (! (ret = gz_getline (line_ctx, &line, &line_len, input)));
+    }  while (! (ret = gz_reader_getline (line_ctx, &line, &line_len, reader)));
     
 
     /* EOF is normal loop termination condition, UTIL_SUCCESS is
      * impossible here */
     if (ret == UTIL_EOF) {
-	ret = EXIT_SUCCESS;
+	ret = restore_all_lines (config, notmuch, lines, flags);
     } else {
 	fprintf (stderr, "Error reading (gzipped) input: %s\n",
 		 gz_error_string (ret, input));
@@ -312,6 +568,9 @@ notmuch_restore_command (notmuch_config_t *config, int argc, char *argv[])
     if (notmuch)
 	notmuch_database_destroy (notmuch);
 
+    if (reader)
+	talloc_free (reader);
+
     if (input && gzclose_r (input)) {
 	fprintf (stderr, "Error closing %s: %s\n",
 		 name_for_error, gzerror (input, NULL));
@@ -22,6 +22,8 @@
 #include "sprinter.h"
 #include "string-util.h"
 
+#include <pthread.h>
+
 typedef enum {
     /* Search command */
     OUTPUT_SUMMARY	= 1 << 0,
@@ -40,7 +42,8 @@ typedef enum {
     NOTMUCH_FORMAT_JSON,
     NOTMUCH_FORMAT_TEXT,
     NOTMUCH_FORMAT_TEXT0,
-    NOTMUCH_FORMAT_SEXP
+    NOTMUCH_FORMAT_SEXP,
+    NOTMUCH_FORMAT_CBOR
 } format_sel_t;
 
 typedef struct {
@@ -54,6 +57,9 @@ typedef struct {
     int offset;
     int limit;
     int dupe;
+    int jobs;
+    const char **exclude_tags;
+    size_t exclude_tags_length;
     GHashTable *addresses;
 } search_context_t;
 
@@ -102,14 +108,426 @@ get_thread_query (notmuch_thread_t *thread,
     return 0;
 }
 
+/* The summary of one thread, copied out of the thread so that it can
+ * be printed after the thread (and the database it came from) is
+ * gone. */
+typedef struct {
+    const char *thread_id;
+    time_t date;
+    int matched;
+    int total;
+    const char *authors;
+    const char *subject;
+    /* Only set for structured output of format version 2 and later. */
+    char *matched_query;
+    char *unmatched_query;
+    const char **tags;
+    size_t num_tags;
+} thread_summary_t;
+
+/* Summarize thread into a new thread_summary_t allocated from ctx.
+ * Returns NULL if out of memory. */
+static thread_summary_t *
+get_thread_summary (void *ctx, search_context_t *search,
+		    notmuch_thread_t *thread)
+{
+    thread_summary_t *summary;
+    notmuch_tags_t *tags;
+    size_t num_tags = 0;
+
+    summary = talloc_zero (ctx, thread_summary_t);
+    if (summary == NULL)
+	return NULL;
+
+    summary->thread_id = talloc_strdup (summary,
+					notmuch_thread_get_thread_id (thread));
+    summary->authors = talloc_strdup (summary,
+				      notmuch_thread_get_authors (thread));
+    summary->subject = talloc_strdup (summary,
+				      notmuch_thread_get_subject (thread));
+    summary->matched = notmuch_thread_get_matched_messages (thread);
+    summary->total = notmuch_thread_get_total_messages (thread);
+
+    if (search->sort == NOTMUCH_SORT_OLDEST_FIRST)
+	summary->date = notmuch_thread_get_oldest_date (thread);
+    else
+	summary->date = notmuch_thread_get_newest_date (thread);
+
+    if (! search->format->is_text_printer && notmuch_format_version >= 2) {
+	if (get_thread_query (thread, &summary->matched_query,
+			      &summary->unmatched_query) < 0)
+	    goto FAIL;
+	talloc_steal (summary, summary->matched_query);
+	talloc_steal (summary, summary->unmatched_query);
+    }
+
+    for (tags = notmuch_thread_get_tags (thread);
+	 notmuch_tags_valid (tags);
+	 notmuch_tags_move_to_next (tags))
+    {
+	summary->tags = talloc_realloc (summary, summary->tags,
+					const char *, num_tags + 1);
+	if (summary->tags == NULL)
+	    goto FAIL;
+	summary->tags[num_tags] = talloc_strdup (summary->tags,
+						 notmuch_tags_get (tags));
+	if (summary->tags[num_tags] == NULL)
+	    goto FAIL;
+	num_tags++;
+    }
+    summary->num_tags = num_tags;
+
+    if (summary->thread_id == NULL)
+	goto FAIL;
+
+    return summary;
+
+  FAIL:
+    talloc_free (summary);
+    return NULL;
+}
+
+static void
+print_thread_summary (search_context_t *ctx, thread_summary_t *summary)
+{
+    sprinter_t *format = ctx->format;
+    void *ctx_quote = talloc_new (summary);
+    const char *relative_date;
+    size_t i;
+
+    _notmuch_profile_begin (NOTMUCH_PROFILE_OUTPUT);
+
+    format->begin_map (format);
+
+    relative_date = notmuch_time_relative_date (ctx_quote, summary->date);
+
+    if (format->is_text_printer) {
+	/* Special case for the text formatter */
+	printf ("thread:%s %12s [%d/%d] %s; %s (",
+		summary->thread_id,
+		relative_date,
+		summary->matched,
+		summary->total,
+		sanitize_string (ctx_quote, summary->authors),
+		sanitize_string (ctx_quote, summary->subject));
+    } else { /* Structured Output */
+	format->map_key (format, "thread");
+	format->string (format, summary->thread_id);
+	format->map_key (format, "timestamp");
+	format->integer (format, summary->date);
+	format->map_key (format, "date_relative");
+	format->string (format, relative_date);
+	format->map_key (format, "matched");
+	format->integer (format, summary->matched);
+	format->map_key (format, "total");
+	format->integer (format, summary->total);
+	format->map_key (format, "authors");
+	format->string (format, summary->authors);
+	format->map_key (format, "subject");
+	format->string (format, summary->subject);
+	if (notmuch_format_version >= 2) {
+	    format->map_key (format, "query");
+	    format->begin_list (format);
+	    if (summary->matched_query)
+		format->string (format, summary->matched_query);
+	    else
+		format->null (format);
+	    if (summary->unmatched_query)
+		format->string (format, summary->unmatched_query);
+	    else
+		format->null (format);
+	    format->end (format);
+	}
+    }
+
+    talloc_free (ctx_quote);
+
+    format->map_key (format, "tags");
+    format->begin_list (format);
+
+    for (i = 0; i < summary->num_tags; i++) {
+	if (format->is_text_printer) {
+	    /* Special case for the text formatter */
+	    if (i > 0)
+		fputc (' ', stdout);
+	    fputs (summary->tags[i], stdout);
+	} else { /* Structured Output */
+	    format->string (format, summary->tags[i]);
+	}
+    }
+
+    if (format->is_text_printer)
+	printf (")");
+
+    format->end (format);
+    format->end (format);
+    format->separator (format);
+
+    _notmuch_profile_end (NOTMUCH_PROFILE_OUTPUT);
+}
+
+/* Thread summaries built by several workers, each searching its own
+ * read-only clone of the database.
+ *
+ * The main thread allocates everything the workers write into before
+ * starting them, and only looks at the results after joining them, so
+ * that talloc is never used concurrently on the same hierarchy. */
+typedef struct {
+    search_context_t *search;
+    const char *query_string;
+    char **thread_ids;
+    /* One talloc context per thread in the current page, to hold its
+     * summary. */
+    void **contexts;
+    thread_summary_t **summaries;
+    unsigned int first, last;
+
+    pthread_mutex_t mutex;
+    unsigned int next;
+    notmuch_bool_t failed;
+} search_jobs_t;
+
+typedef struct {
+    search_jobs_t *jobs;
+    notmuch_database_t *notmuch;
+    pthread_t thread;
+} search_worker_t;
+
+/* Number of threads summarized per worker before the results are
+ * printed and their memory released. */
+#define SEARCH_JOBS_PAGE 64
+
+/* Summarize the job'th thread using the worker's database.  The
+ * summary is NULL if the thread no longer matches. */
+static notmuch_bool_t
+summarize_thread (search_worker_t *worker, unsigned int job)
+{
+    search_jobs_t *jobs = worker->jobs;
+    search_context_t *search = jobs->search;
+    void *local = jobs->contexts[job - jobs->first];
+    const char *base = jobs->query_string;
+    notmuch_query_t *query;
+    notmuch_threads_t *threads;
+    char *query_string;
+    size_t i;
+
+    if (*base == '\0' || strcmp (base, "*") == 0)
+	query_string = talloc_asprintf (local, "thread:%s",
+					jobs->thread_ids[job]);
+    else
+	query_string = talloc_asprintf (local, "thread:%s and (%s)",
+					jobs->thread_ids[job], base);
+    if (query_string == NULL)
+	return FALSE;
+
+    query = notmuch_query_create (worker->notmuch, query_string);
+    if (query == NULL)
+	return FALSE;
+
+    notmuch_query_set_sort (query, search->sort);
+    if (search->exclude != NOTMUCH_EXCLUDE_FALSE) {
+	for (i = 0; i < search->exclude_tags_length; i++)
+	    notmuch_query_add_tag_exclude (query, search->exclude_tags[i]);
+	notmuch_query_set_omit_excluded (query, search->exclude);
+    }
+
+    threads = notmuch_query_search_threads (query);
+    if (threads == NULL) {
+	notmuch_query_destroy (query);
+	return FALSE;
+    }
+
+    if (notmuch_threads_valid (threads)) {
+	notmuch_thread_t *thread = notmuch_threads_get (threads);
+
+	jobs->summaries[job - jobs->first] =
+	    get_thread_summary (local, search, thread);
+	if (jobs->summaries[job - jobs->first] == NULL) {
+	    notmuch_query_destroy (query);
+	    return FALSE;
+	}
+    }
+
+    notmuch_query_destroy (query);
+    return TRUE;
+}
+
+static void *
+search_worker (void *closure)
+{
+    search_worker_t *worker = closure;
+    search_jobs_t *jobs = worker->jobs;
+    unsigned int job;
+
+    for (;;) {
+	pthread_mutex_lock (&jobs->mutex);
+	job = jobs->next++;
+	pthread_mutex_unlock (&jobs->mutex);
+
+	if (job >= jobs->last)
+	    break;
+
+	if (! summarize_thread (worker, job)) {
+	    pthread_mutex_lock (&jobs->mutex);
+	    jobs->failed = TRUE;
+	    pthread_mutex_unlock (&jobs->mutex);
+	}
+    }
+
+    return NULL;
+}
+
+/* Print the summaries of the matching threads, building them with
+ * ctx->jobs workers.  The threads are listed first, in order, from
+ * the matching messages, just as notmuch_query_search_threads
+ * would. */
+static int
+do_search_threads_parallel (search_context_t *ctx)
+{
+    sprinter_t *format = ctx->format;
+    search_jobs_t jobs;
+    search_worker_t *workers;
+    notmuch_messages_t *messages;
+    GHashTable *seen;
+    void *local;
+    unsigned int num_threads = 0, i, j;
+    int ret = 1;
+
+    local = talloc_new (ctx->notmuch);
+    if (local == NULL) {
+	fprintf (stderr, "Out of memory\n");
+	return 1;
+    }
+
+    memset (&jobs, 0, sizeof (jobs));
+    jobs.search = ctx;
+    jobs.query_string = notmuch_query_get_query_string (ctx->query);
+    pthread_mutex_init (&jobs.mutex, NULL);
+
+    workers = talloc_zero_array (local, search_worker_t, ctx->jobs);
+    if (workers == NULL)
+	goto DONE;
+
+    seen = g_hash_table_new (g_str_hash, g_str_equal);
+
+    messages = notmuch_query_search_messages (ctx->query);
+    if (messages == NULL) {
+	g_hash_table_unref (seen);
+	goto DONE;
+    }
+
+    for (;
+	 notmuch_messages_valid (messages) &&
+	     (ctx->limit < 0 || (int) num_threads < ctx->offset + ctx->limit);
+	 notmuch_messages_move_to_next (messages))
+    {
+	notmuch_message_t *message = notmuch_messages_get (messages);
+	const char *thread_id = notmuch_message_get_thread_id (message);
+
+	if (! g_hash_table_lookup_extended (seen, thread_id, NULL, NULL)) {
+	    char *id = talloc_strdup (local, thread_id);
+
+	    jobs.thread_ids = talloc_realloc (local, jobs.thread_ids,
+					      char *, num_threads + 1);
+	    if (id == NULL || jobs.thread_ids == NULL) {
+		g_hash_table_unref (seen);
+		fprintf (stderr, "Out of memory\n");
+		goto DONE;
+	    }
+	    jobs.thread_ids[num_threads++] = id;
+	    g_hash_table_insert (seen, id, NULL);
+	}
+
+	notmuch_message_destroy (message);
+    }
+
+    g_hash_table_unref (seen);
+    notmuch_messages_destroy (messages);
+
+    /* The main database stays idle while the workers run, so the
+     * first worker can use it. */
+    workers[0].notmuch = ctx->notmuch;
+    for (i = 1; i < (unsigned int) ctx->jobs; i++) {
+	if (notmuch_database_clone_reader (ctx->notmuch, &workers[i].notmuch)) {
+	    fprintf (stderr, "Error: Cannot open a reader for --jobs.\n");
+	    goto DONE;
+	}
+    }
+
+    format->begin_list (format);
+
+    for (jobs.first = ctx->offset; jobs.first < num_threads;
+	 jobs.first = jobs.last)
+    {
+	void *page = talloc_new (local);
+
+	jobs.last = jobs.first + SEARCH_JOBS_PAGE * ctx->jobs;
+	if (jobs.last > num_threads)
+	    jobs.last = num_threads;
+	jobs.next = jobs.first;
+
+	jobs.contexts = talloc_array (page, void *, jobs.last - jobs.first);
+	jobs.summaries = talloc_zero_array (page, thread_summary_t *,
+					    jobs.last - jobs.first);
+	if (jobs.contexts == NULL || jobs.summaries == NULL)
+	    jobs.failed = TRUE;
+	for (j = 0; ! jobs.failed && j < jobs.last - jobs.first; j++) {
+	    jobs.contexts[j] = talloc_new (page);
+	    if (jobs.contexts[j] == NULL)
+		jobs.failed = TRUE;
+	}
+	if (jobs.failed) {
+	    fprintf (stderr, "Out of memory\n");
+	    goto DONE;
+	}
+
+	for (i = 0; i < (unsigned int) ctx->jobs; i++) {
+	    workers[i].jobs = &jobs;
+	    if (pthread_create (&workers[i].thread, NULL,
+				search_worker, &workers[i])) {
+		/* Do the remaining work on the threads we have. */
+		break;
+	    }
+	}
+	if (i == 0)
+	    search_worker (&workers[0]);
+	while (i-- > 0)
+	    pthread_join (workers[i].thread, NULL);
+
+	if (jobs.failed) {
+	    fprintf (stderr, "Out of memory\n");
+	    goto DONE;
+	}
+
+	for (j = 0; j < jobs.last - jobs.first; j++) {
+	    if (jobs.summaries[j])
+		print_thread_summary (ctx, jobs.summaries[j]);
+	}
+
+	talloc_free (page);
+    }
+
+    format->end (format);
+    ret = 0;
+
+  DONE:
+    if (workers) {
+	for (i = 1; i < (unsigned int) ctx->jobs; i++) {
+	    if (workers[i].notmuch)
+		notmuch_database_destroy (workers[i].notmuch);
+	}
+    }
+    pthread_mutex_destroy (&jobs.mutex);
+    talloc_free (local);
+    return ret;
+}
+
 static int
 do_search_threads (search_context_t *ctx)
 {
     notmuch_thread_t *thread;
     notmuch_threads_t *threads;
-    notmuch_tags_t *tags;
     sprinter_t *format = ctx->format;
-    time_t date;
     int i;
 
     if (ctx->offset < 0) {
@@ -118,6 +536,9 @@ do_search_threads (search_context_t *ctx)
 	    ctx->offset = 0;
     }
 
+    if (ctx->output == OUTPUT_SUMMARY && ctx->jobs > 1)
+	return do_search_threads_parallel (ctx);
+
     threads = notmuch_query_search_threads (ctx->query);
     if (threads == NULL)
 	return 1;
@@ -141,98 +562,14 @@ do_search_threads (search_context_t *ctx)
 			    notmuch_thread_get_thread_id (thread));
 	    format->separator (format);
 	} else { /* output == OUTPUT_SUMMARY */
-	    void *ctx_quote = talloc_new (thread);
-	    const char *authors = notmuch_thread_get_authors (thread);
-	    const char *subject = notmuch_thread_get_subject (thread);
-	    const char *thread_id = notmuch_thread_get_thread_id (thread);
-	    int matched = notmuch_thread_get_matched_messages (thread);
-	    int total = notmuch_thread_get_total_messages (thread);
-	    const char *relative_date = NULL;
-	    notmuch_bool_t first_tag = TRUE;
-
-	    format->begin_map (format);
-
-	    if (ctx->sort == NOTMUCH_SORT_OLDEST_FIRST)
-		date = notmuch_thread_get_oldest_date (thread);
-	    else
-		date = notmuch_thread_get_newest_date (thread);
-
-	    relative_date = notmuch_time_relative_date (ctx_quote, date);
-
-	    if (format->is_text_printer) {
-                /* Special case for the text formatter */
-		printf ("thread:%s %12s [%d/%d] %s; %s (",
-			thread_id,
-			relative_date,
-			matched,
-			total,
-			sanitize_string (ctx_quote, authors),
-			sanitize_string (ctx_quote, subject));
-	    } else { /* Structured Output */
-		format->map_key (format, "thread");
-		format->string (format, thread_id);
-		format->map_key (format, "timestamp");
-		format->integer (format, date);
-		format->map_key (format, "date_relative");
-		format->string (format, relative_date);
-		format->map_key (format, "matched");
-		format->integer (format, matched);
-		format->map_key (format, "total");
-		format->integer (format, total);
-		format->map_key (format, "authors");
-		format->string (format, authors);
-		format->map_key (format, "subject");
-		format->string (format, subject);
-		if (notmuch_format_version >= 2) {
-		    char *matched_query, *unmatched_query;
-		    if (get_thread_query (thread, &matched_query,
-					  &unmatched_query) < 0) {
-			fprintf (stderr, "Out of memory\n");
-			return 1;
-		    }
-		    format->map_key (format, "query");
-		    format->begin_list (format);
-		    if (matched_query)
-			format->string (format, matched_query);
-		    else
-			format->null (format);
-		    if (unmatched_query)
-			format->string (format, unmatched_query);
-		    else
-			format->null (format);
-		    format->end (format);
-		}
-	    }
-
-	    talloc_free (ctx_quote);
-
-	    format->map_key (format, "tags");
-	    format->begin_list (format);
+	    thread_summary_t *summary = get_thread_summary (thread, ctx, thread);
 
-	    for (tags = notmuch_thread_get_tags (thread);
-		 notmuch_tags_valid (tags);
-		 notmuch_tags_move_to_next (tags))
-	    {
-		const char *tag = notmuch_tags_get (tags);
-
-		if (format->is_text_printer) {
-                  /* Special case for the text formatter */
-		    if (first_tag)
-			first_tag = FALSE;
-		    else
-			fputc (' ', stdout);
-		    fputs (tag, stdout);
-		} else { /* Structured Output */
-		    format->string (format, tag);
-		}
+	    if (summary == NULL) {
+		fprintf (stderr, "Out of memory\n");
+		return 1;
 	    }
 
-	    if (format->is_text_printer)
-		printf (")");
-
-	    format->end (format);
-	    format->end (format);
-	    format->separator (format);
+	    print_thread_summary (ctx, summary);
 	}
 
 	notmuch_thread_destroy (thread);
@@ -243,33 +580,59 @@ do_search_threads (search_context_t *ctx)
     return 0;
 }
 
+/* Hash and equality of mailboxes, by name and address, for the
+ * table of addresses seen so far.  A mailbox without a name differs
+ * from one with an empty name. */
+static guint
+mailbox_hash (gconstpointer key)
+{
+    const mailbox_t *mailbox = key;
+    guint hash = g_str_hash (mailbox->addr);
+
+    if (mailbox->name)
+	hash = hash * 33 + g_str_hash (mailbox->name);
+
+    return hash;
+}
+
+static gboolean
+mailbox_equal (gconstpointer a, gconstpointer b)
+{
+    const mailbox_t *mailbox_a = a, *mailbox_b = b;
+
+    if (strcmp (mailbox_a->addr, mailbox_b->addr) != 0)
+	return FALSE;
+
+    if (mailbox_a->name == NULL || mailbox_b->name == NULL)
+	return mailbox_a->name == mailbox_b->name;
+
+    return strcmp (mailbox_a->name, mailbox_b->name) == 0;
+}
+
 /* Returns TRUE iff name and addr is duplicate. If not, stores the
- * name/addr pair in order to detect subsequent duplicates. */
+ * name/addr pair in order to detect subsequent duplicates.  Only new
+ * mailboxes are copied; looking up a duplicate allocates nothing. */
 static notmuch_bool_t
 is_duplicate (const search_context_t *ctx, const char *name, const char *addr)
 {
-    notmuch_bool_t duplicate;
-    char *key;
+    mailbox_t key = { .name = name, .addr = addr ? addr : "" };
     mailbox_t *mailbox;
 
-    key = talloc_asprintf (ctx->format, "%s <%s>", name, addr);
-    if (! key)
-	return FALSE;
-
-    duplicate = g_hash_table_lookup_extended (ctx->addresses, key, NULL, (gpointer)&mailbox);
-
-    if (! duplicate) {
-	mailbox = talloc (ctx->format, mailbox_t);
-	mailbox->name = talloc_strdup (mailbox, name);
-	mailbox->addr = talloc_strdup (mailbox, addr);
-	mailbox->count = 1;
-	g_hash_table_insert (ctx->addresses, key, mailbox);
-    } else {
+    mailbox = g_hash_table_lookup (ctx->addresses, &key);
+    if (mailbox) {
 	mailbox->count++;
-	talloc_free (key);
+	return TRUE;
     }
 
-    return duplicate;
+    mailbox = talloc (ctx->format, mailbox_t);
+    if (! mailbox)
+	return FALSE;
+    mailbox->name = name ? talloc_strdup (mailbox, name) : NULL;
+    mailbox->addr = talloc_strdup (mailbox, key.addr);
+    mailbox->count = 1;
+    g_hash_table_insert (ctx->addresses, mailbox, mailbox);
+
+    return FALSE;
 }
 
 static void
@@ -313,6 +676,25 @@ print_mailbox (const search_context_t *ctx, const mailbox_t *mailbox)
     g_free (name_addr);
 }
 
+/* Print or prepare for printing a single mailbox. */
+static void
+process_mailbox (const search_context_t *ctx, const char *name, const char *addr)
+{
+    mailbox_t mbx = {
+	.name = name,
+	.addr = addr,
+	.count = 0,
+    };
+
+    if (is_duplicate (ctx, mbx.name, mbx.addr))
+	return;
+
+    if (ctx->output & OUTPUT_COUNT)
+	return;
+
+    print_mailbox (ctx, &mbx);
+}
+
 /* Print or prepare for printing addresses from InternetAddressList. */
 static void
 process_address_list (const search_context_t *ctx,
@@ -335,19 +717,9 @@ process_address_list (const search_context_t *ctx,
 	    process_address_list (ctx, group_list);
 	} else {
 	    InternetAddressMailbox *mailbox = INTERNET_ADDRESS_MAILBOX (address);
-	    mailbox_t mbx = {
-		.name = internet_address_get_name (address),
-		.addr = internet_address_mailbox_get_addr (mailbox),
-		.count = 0,
-	    };
-
-	    if (is_duplicate (ctx, mbx.name, mbx.addr))
-		continue;
 
-	    if (ctx->output & OUTPUT_COUNT)
-		continue;
-
-	    print_mailbox (ctx, &mbx);
+	    process_mailbox (ctx, internet_address_get_name (address),
+			     internet_address_mailbox_get_addr (mailbox));
 	}
     }
 }
@@ -370,6 +742,30 @@ process_address_header (const search_context_t *ctx, const char *value)
     g_object_unref (list);
 }
 
+/* Print or prepare for printing the addresses of a header of
+ * 'message', from the mailboxes stored in the database if it has
+ * them. */
+static void
+process_address_field (const search_context_t *ctx,
+		       notmuch_message_t *message, const char *header)
+{
+    notmuch_mailboxes_t *mailboxes;
+
+    mailboxes = notmuch_message_get_mailboxes (message, header);
+    if (mailboxes == NULL) {
+	process_address_header (ctx, notmuch_message_get_header (message,
+								 header));
+	return;
+    }
+
+    for (; notmuch_mailboxes_valid (mailboxes);
+	 notmuch_mailboxes_move_to_next (mailboxes))
+	process_mailbox (ctx, notmuch_mailboxes_get_name (mailboxes),
+			 notmuch_mailboxes_get_address (mailboxes));
+
+    notmuch_mailboxes_destroy (mailboxes);
+}
+
 /* Destructor for talloc-allocated GHashTable keys and values. */
 static void
 _talloc_free_for_g_hash (void *ptr)
@@ -459,22 +855,15 @@ do_search_messages (search_context_t *ctx)
                 format->separator (format);
             }
 	} else {
-	    if (ctx->output & OUTPUT_SENDER) {
-		const char *addrs;
-
-		addrs = notmuch_message_get_header (message, "from");
-		process_address_header (ctx, addrs);
-	    }
+	    if (ctx->output & OUTPUT_SENDER)
+		process_address_field (ctx, message, "from");
 
 	    if (ctx->output & OUTPUT_RECIPIENTS) {
 		const char *hdrs[] = { "to", "cc", "bcc" };
-		const char *addrs;
 		size_t j;
 
-		for (j = 0; j < ARRAY_SIZE (hdrs); j++) {
-		    addrs = notmuch_message_get_header (message, hdrs[j]);
-		    process_address_header (ctx, addrs);
-		}
+		for (j = 0; j < ARRAY_SIZE (hdrs); j++)
+		    process_address_field (ctx, message, hdrs[j]);
 	    }
 	}
 
@@ -545,7 +934,6 @@ _notmuch_search_prepare (search_context_t *ctx, notmuch_config_t *config, int ar
 {
     char *query_str;
     unsigned int i;
-    char *status_string = NULL;
 
     switch (ctx->format_sel) {
     case NOTMUCH_FORMAT_TEXT:
@@ -564,6 +952,9 @@ _notmuch_search_prepare (search_context_t *ctx, notmuch_config_t *config, int ar
     case NOTMUCH_FORMAT_SEXP:
 	ctx->format = sprinter_sexp_create (config, stdout);
 	break;
+    case NOTMUCH_FORMAT_CBOR:
+	ctx->format = sprinter_cbor_create (config, stdout);
+	break;
     default:
 	/* this should never happen */
 	INTERNAL_ERROR("no output format selected");
@@ -571,17 +962,9 @@ _notmuch_search_prepare (search_context_t *ctx, notmuch_config_t *config, int ar
 
     notmuch_exit_if_unsupported_format ();
 
-    if (notmuch_database_open_verbose (
-	    notmuch_config_get_database_path (config),
-	    NOTMUCH_DATABASE_MODE_READ_ONLY, &ctx->notmuch, &status_string)) {
-
-	if (status_string) {
-	    fputs (status_string, stderr);
-	    free (status_string);
-	}
-
+    if (notmuch_client_database_open (config, NOTMUCH_DATABASE_MODE_READ_ONLY,
+				      &ctx->notmuch))
 	return EXIT_FAILURE;
-    }
 
     query_str = query_string_from_args (ctx->notmuch, argc, argv);
     if (query_str == NULL) {
@@ -610,13 +993,10 @@ _notmuch_search_prepare (search_context_t *ctx, notmuch_config_t *config, int ar
     }
 
     if (ctx->exclude != NOTMUCH_EXCLUDE_FALSE) {
-	const char **search_exclude_tags;
-	size_t search_exclude_tags_length;
-
-	search_exclude_tags = notmuch_config_get_search_exclude_tags
-	    (config, &search_exclude_tags_length);
-	for (i = 0; i < search_exclude_tags_length; i++)
-	    notmuch_query_add_tag_exclude (ctx->query, search_exclude_tags[i]);
+	ctx->exclude_tags = notmuch_config_get_search_exclude_tags
+	    (config, &ctx->exclude_tags_length);
+	for (i = 0; i < ctx->exclude_tags_length; i++)
+	    notmuch_query_add_tag_exclude (ctx->query, ctx->exclude_tags[i]);
 	notmuch_query_set_omit_excluded (ctx->query, ctx->exclude);
     }
 
@@ -640,6 +1020,7 @@ static search_context_t search_context = {
     .offset = 0,
     .limit = -1, /* unlimited */
     .dupe = -1,
+    .jobs = 1,
 };
 
 static const notmuch_opt_desc_t common_options[] = {
@@ -650,6 +1031,7 @@ static const notmuch_opt_desc_t common_options[] = {
     { NOTMUCH_OPT_KEYWORD, &search_context.format_sel, "format", 'f',
       (notmuch_keyword_t []){ { "json", NOTMUCH_FORMAT_JSON },
 			      { "sexp", NOTMUCH_FORMAT_SEXP },
+			      { "cbor", NOTMUCH_FORMAT_CBOR },
 			      { "text", NOTMUCH_FORMAT_TEXT },
 			      { "text0", NOTMUCH_FORMAT_TEXT0 },
 			      { 0, 0 } } },
@@ -662,6 +1044,7 @@ notmuch_search_command (notmuch_config_t *config, int argc, char *argv[])
 {
     search_context_t *ctx = &search_context;
     int opt_index, ret;
+    long cpus;
 
     notmuch_opt_desc_t options[] = {
 	{ NOTMUCH_OPT_KEYWORD, &ctx->output, "output", 'o',
@@ -680,6 +1063,7 @@ notmuch_search_command (notmuch_config_t *config, int argc, char *argv[])
 	{ NOTMUCH_OPT_INT, &ctx->offset, "offset", 'O', 0 },
 	{ NOTMUCH_OPT_INT, &ctx->limit, "limit", 'L', 0  },
 	{ NOTMUCH_OPT_INT, &ctx->dupe, "duplicate", 'D', 0  },
+	{ NOTMUCH_OPT_INT, &ctx->jobs, "jobs", 'j', 0  },
 	{ NOTMUCH_OPT_INHERIT, (void *) &common_options, NULL, 0, 0 },
 	{ 0, 0, 0, 0, 0 }
     };
@@ -695,6 +1079,16 @@ notmuch_search_command (notmuch_config_t *config, int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
+    if (ctx->jobs < 1) {
+	fprintf (stderr, "Error: --jobs=N must be at least 1.\n");
+	return EXIT_FAILURE;
+    }
+
+    /* More workers than processors only add database handles. */
+    cpus = sysconf (_SC_NPROCESSORS_ONLN);
+    if (cpus >= 1 && ctx->jobs > cpus)
+	ctx->jobs = cpus;
+
     if (_notmuch_search_prepare (ctx, config,
 				 argc - opt_index, argv + opt_index))
 	return EXIT_FAILURE;
@@ -751,8 +1145,8 @@ notmuch_address_command (notmuch_config_t *config, int argc, char *argv[])
 				 argc - opt_index, argv + opt_index))
 	return EXIT_FAILURE;
 
-    ctx->addresses = g_hash_table_new_full (g_str_hash, g_str_equal,
-					    _talloc_free_for_g_hash, _talloc_free_for_g_hash);
+    ctx->addresses = g_hash_table_new_full (mailbox_hash, mailbox_equal,
+					    NULL, _talloc_free_for_g_hash);
 
     ret = do_search_messages (ctx);
 
@@ -0,0 +1,501 @@
+/* notmuch - Not much of an email program, (just index and search)
+ *
+ * Copyright © 2026 agent
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ * Author: agent <agent@local>
+ */
+
+#include "notmuch-client.h"
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* "notmuch serve" keeps the configuration and a read-only database
+ * open, and runs commands for clients connecting to a Unix socket.
+ *
+ * A client sends its standard input, output and error descriptors
+ * (as SCM_RIGHTS ancillary data) along with a request made of
+ * NUL-terminated strings: the number of arguments in decimal, the
+ * working directory of the client, then the arguments, starting with
+ * the command name.  The server forks a child that runs the command
+ * on the descriptors of the client, with the database it has open,
+ * and writes back a single byte holding the exit status.  A client
+ * seeing the connection close without that byte should consider the
+ * command failed.
+ *
+ * Forking keeps each command isolated from the others (and from the
+ * server), while the open database, the query parser and the page
+ * cache stay warm in the server. */
+
+typedef struct {
+    const char *name;
+    int (*function) (notmuch_config_t *config, int argc, char *argv[]);
+} served_command_t;
+
+static const served_command_t served_commands[] = {
+    { "search", notmuch_search_command },
+    { "address", notmuch_address_command },
+    { "show", notmuch_show_command },
+    { "count", notmuch_count_command },
+    { "reply", notmuch_reply_command },
+    { "tag", notmuch_tag_command },
+};
+
+/* Arguments, and bytes of them, accepted in a request. */
+#define MAX_REQUEST_ARGS 4096
+#define MAX_REQUEST_SIZE (1024 * 1024)
+
+/* The database held open by the server, handed to the commands it
+ * runs. */
+static notmuch_database_t *served_database;
+
+static volatile sig_atomic_t interrupted;
+
+static void
+handle_sigint (unused (int sig))
+{
+    interrupted = 1;
+}
+
+static const served_command_t *
+find_served_command (const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE (served_commands); i++)
+	if (strcmp (name, served_commands[i].name) == 0)
+	    return &served_commands[i];
+
+    return NULL;
+}
+
+notmuch_status_t
+notmuch_client_database_open (notmuch_config_t *config,
+			      notmuch_database_mode_t mode,
+			      notmuch_database_t **notmuch)
+{
+    if (served_database && mode == NOTMUCH_DATABASE_MODE_READ_ONLY) {
+	*notmuch = served_database;
+	return NOTMUCH_STATUS_SUCCESS;
+    }
+
+    return notmuch_database_open (notmuch_config_get_database_path (config),
+				  mode, notmuch);
+}
+
+static notmuch_bool_t
+socket_address (const char *path, struct sockaddr_un *addr)
+{
+    if (strlen (path) >= sizeof (addr->sun_path))
+	return FALSE;
+
+    memset (addr, 0, sizeof (*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy (addr->sun_path, path);
+
+    return TRUE;
+}
+
+static notmuch_bool_t
+write_all (int fd, const char *buf, size_t len)
+{
+    while (len) {
+	ssize_t written = write (fd, buf, len);
+
+	if (written < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return FALSE;
+	}
+	buf += written;
+	len -= written;
+    }
+
+    return TRUE;
+}
+
+/* Read the request of a client from 'conn', storing the descriptors
+ * it sent in 'fds' and its working directory in *cwd.  Return the
+ * arguments of the request, or NULL on error. */
+static char **
+read_request (void *ctx, int conn, int fds[3], char **cwd, int *argc_ret)
+{
+    char *buf = NULL;
+    size_t len = 0, size = 0, strings = 0, expected = 0;
+    char **argv;
+    char *s;
+    int argc = 0, i;
+
+    fds[0] = fds[1] = fds[2] = -1;
+
+    for (;;) {
+	char control[CMSG_SPACE (3 * sizeof (int))];
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	ssize_t received;
+
+	if (len == size) {
+	    size = size ? 2 * size : 4096;
+	    if (size > MAX_REQUEST_SIZE)
+		return NULL;
+	    buf = talloc_realloc (ctx, buf, char, size);
+	    if (buf == NULL)
+		return NULL;
+	}
+
+	iov.iov_base = buf + len;
+	iov.iov_len = size - len;
+	memset (&msg, 0, sizeof (msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof (control);
+
+	received = recvmsg (conn, &msg, 0);
+	if (received < 0 && errno == EINTR)
+	    continue;
+	if (received <= 0)
+	    return NULL;
+
+	for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+	    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+		cmsg->cmsg_len == CMSG_LEN (3 * sizeof (int)) && fds[0] == -1)
+		memcpy (fds, CMSG_DATA (cmsg), 3 * sizeof (int));
+	}
+
+	for (s = buf + len; s < buf + len + received; s++) {
+	    if (*s != '\0')
+		continue;
+	    if (strings++ == 0) {
+		argc = atoi (buf);
+		if (argc <= 0 || argc > MAX_REQUEST_ARGS)
+		    return NULL;
+		expected = argc + 2;
+	    }
+	}
+	len += received;
+
+	if (expected && strings >= expected)
+	    break;
+    }
+
+    if (fds[0] == -1)
+	return NULL;
+
+    argv = talloc_array (ctx, char *, argc + 1);
+    if (argv == NULL)
+	return NULL;
+
+    s = buf + strlen (buf) + 1;
+    *cwd = s;
+    for (i = 0; i < argc; i++) {
+	s += strlen (s) + 1;
+	argv[i] = s;
+    }
+    argv[argc] = NULL;
+
+    *argc_ret = argc;
+    return argv;
+}
+
+/* Run the request of the client connected on 'conn' and report its
+ * exit status.  This runs in a child of the server. */
+static int
+serve_request (notmuch_config_t *config, int conn)
+{
+    void *local = talloc_new (config);
+    const served_command_t *command;
+    char **argv, *cwd;
+    int fds[3], argc, i, ret;
+    unsigned char status;
+
+    signal (SIGCHLD, SIG_DFL);
+    signal (SIGINT, SIG_DFL);
+    signal (SIGTERM, SIG_DFL);
+
+    /* Connections closing without a request, as when checking for a
+     * running server, end up here too; the client alone can tell. */
+    argv = read_request (local, conn, fds, &cwd, &argc);
+    if (argv == NULL)
+	return EXIT_FAILURE;
+
+    for (i = 0; i < 3; i++) {
+	if (dup2 (fds[i], i) < 0) {
+	    fprintf (stderr, "Error: cannot use client descriptors: %s\n",
+		     strerror (errno));
+	    return EXIT_FAILURE;
+	}
+	if (fds[i] > 2)
+	    close (fds[i]);
+    }
+
+    if (! isatty (STDOUT_FILENO))
+	setvbuf (stdout, NULL, _IOFBF, 64 * 1024);
+
+    command = find_served_command (argv[0]);
+    if (command == NULL) {
+	fprintf (stderr, "Error: '%s' cannot be run by notmuch serve\n", argv[0]);
+	ret = EXIT_FAILURE;
+    } else if (chdir (cwd)) {
+	fprintf (stderr, "Error changing to %s: %s\n", cwd, strerror (errno));
+	ret = EXIT_FAILURE;
+    } else {
+	ret = command->function (config, argc, argv);
+    }
+
+    fflush (stdout);
+    fflush (stderr);
+
+    status = ret;
+    IGNORE_RESULT (write_all (conn, (char *) &status, 1));
+
+    talloc_free (local);
+
+    return ret;
+}
+
+notmuch_bool_t
+notmuch_serve_forward (const char *socket_path, int argc, char *argv[],
+		       int *ret)
+{
+    struct sockaddr_un addr;
+    char control[CMSG_SPACE (3 * sizeof (int))];
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    char *cwd, *request, *s;
+    size_t len;
+    ssize_t sent;
+    unsigned char status;
+    int conn, i;
+
+    if (argc < 1 || find_served_command (argv[0]) == NULL ||
+	! socket_address (socket_path, &addr))
+	return FALSE;
+
+    conn = socket (AF_UNIX, SOCK_STREAM, 0);
+    if (conn < 0)
+	return FALSE;
+
+    /* Without a server, run the command here. */
+    if (connect (conn, (struct sockaddr *) &addr, sizeof (addr))) {
+	close (conn);
+	return FALSE;
+    }
+
+    cwd = getcwd (NULL, 0);
+    if (cwd == NULL) {
+	close (conn);
+	return FALSE;
+    }
+
+    request = talloc_asprintf (NULL, "%d", argc);
+    len = strlen (request) + 1 + strlen (cwd) + 1;
+    for (i = 0; i < argc; i++)
+	len += strlen (argv[i]) + 1;
+    request = talloc_realloc (NULL, request, char, len);
+
+    s = request + strlen (request) + 1;
+    strcpy (s, cwd);
+    s += strlen (s) + 1;
+    for (i = 0; i < argc; i++) {
+	strcpy (s, argv[i]);
+	s += strlen (s) + 1;
+    }
+    free (cwd);
+
+    iov.iov_base = request;
+    iov.iov_len = len;
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof (control);
+    cmsg = CMSG_FIRSTHDR (&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN (sizeof (fds));
+    memcpy (CMSG_DATA (cmsg), fds, sizeof (fds));
+
+    /* Once the request is on its way, the command is the server's to
+     * run, so failures past this point are the command's failures. */
+    *ret = EXIT_FAILURE;
+
+    do
+	sent = sendmsg (conn, &msg, 0);
+    while (sent < 0 && errno == EINTR);
+
+    if (sent >= 0 &&
+	write_all (conn, request + sent, len - sent) &&
+	read (conn, &status, 1) == 1)
+	*ret = status;
+
+    talloc_free (request);
+    close (conn);
+
+    return TRUE;
+}
+
+/* Create the listening socket at 'path', refusing to take it over
+ * from a running server. */
+static int
+serve_listen (const char *path)
+{
+    struct sockaddr_un addr;
+    mode_t old_umask;
+    int fd;
+
+    if (! socket_address (path, &addr)) {
+	fprintf (stderr, "Error: socket path too long: %s\n", path);
+	return -1;
+    }
+
+    fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+	fprintf (stderr, "Error creating socket: %s\n", strerror (errno));
+	return -1;
+    }
+
+    if (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) == 0) {
+	fprintf (stderr, "Error: a server is already listening on %s\n", path);
+	close (fd);
+	return -1;
+    }
+
+    /* A socket left behind by a server that is gone. */
+    if (unlink (path) && errno != ENOENT) {
+	fprintf (stderr, "Error removing %s: %s\n", path, strerror (errno));
+	close (fd);
+	return -1;
+    }
+
+    close (fd);
+    fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+	fprintf (stderr, "Error creating socket: %s\n", strerror (errno));
+	return -1;
+    }
+
+    /* The server runs commands with the rights of its user, so no one
+     * else may connect. */
+    old_umask = umask (077);
+    if (bind (fd, (struct sockaddr *) &addr, sizeof (addr)) ||
+	listen (fd, SOMAXCONN)) {
+	fprintf (stderr, "Error listening on %s: %s\n", path, strerror (errno));
+	umask (old_umask);
+	close (fd);
+	return -1;
+    }
+    umask (old_umask);
+
+    return fd;
+}
+
+int
+notmuch_serve_command (notmuch_config_t *config, int argc, char *argv[])
+{
+    const char *socket_path = getenv ("NOTMUCH_SERVE_SOCKET");
+    struct sigaction action;
+    int opt_index, listen_fd;
+    int ret = EXIT_SUCCESS;
+
+    notmuch_opt_desc_t options[] = {
+	{ NOTMUCH_OPT_STRING, &socket_path, "socket", 's', 0 },
+	{ 0, 0, 0, 0, 0 }
+    };
+
+    opt_index = parse_arguments (argc, argv, options, 1);
+    if (opt_index < 0)
+	return EXIT_FAILURE;
+
+    if (opt_index < argc) {
+	fprintf (stderr, "Error: notmuch serve takes no arguments\n");
+	return EXIT_FAILURE;
+    }
+
+    if (socket_path == NULL || *socket_path == '\0') {
+	fprintf (stderr, "Error: no socket given (see --socket)\n");
+	return EXIT_FAILURE;
+    }
+
+    if (notmuch_database_open (notmuch_config_get_database_path (config),
+			       NOTMUCH_DATABASE_MODE_READ_ONLY,
+			       &served_database))
+	return EXIT_FAILURE;
+
+    listen_fd = serve_listen (socket_path);
+    if (listen_fd < 0) {
+	notmuch_database_destroy (served_database);
+	return EXIT_FAILURE;
+    }
+
+    /* Stop on SIGINT or SIGTERM, interrupting accept. */
+    memset (&action, 0, sizeof (struct sigaction));
+    action.sa_handler = handle_sigint;
+    sigemptyset (&action.sa_mask);
+    action.sa_flags = 0;
+    sigaction (SIGINT, &action, NULL);
+    sigaction (SIGTERM, &action, NULL);
+
+    /* Children are never waited for. */
+    signal (SIGCHLD, SIG_IGN);
+
+    while (! interrupted) {
+	pid_t pid;
+	int conn;
+
+	conn = accept (listen_fd, NULL, NULL);
+	if (conn < 0) {
+	    if (errno == EINTR || errno == ECONNABORTED)
+		continue;
+	    fprintf (stderr, "Error accepting connection: %s\n", strerror (errno));
+	    ret = EXIT_FAILURE;
+	    break;
+	}
+
+	/* Let the command see what other processes committed since
+	 * the last one ran. */
+	if (notmuch_database_reopen (served_database)) {
+	    close (conn);
+	    continue;
+	}
+
+	fflush (stdout);
+	fflush (stderr);
+
+	pid = fork ();
+	if (pid == 0) {
+	    /* Only the server reports its profile. */
+	    _notmuch_profile_disable ();
+	    close (listen_fd);
+	    exit (serve_request (config, conn));
+	}
+	if (pid < 0)
+	    fprintf (stderr, "Error forking: %s\n", strerror (errno));
+
+	close (conn);
+    }
+
+    close (listen_fd);
+    unlink (socket_path);
+    notmuch_database_destroy (served_database);
+    served_database = NULL;
+
+    return ret;
+}
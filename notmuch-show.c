@@ -45,6 +45,11 @@ static const notmuch_show_format_t format_sexp = {
     .part = format_part_sprinter_entry,
 };
 
+static const notmuch_show_format_t format_cbor = {
+    .new_sprinter = sprinter_cbor_create,
+    .part = format_part_sprinter_entry,
+};
+
 static notmuch_status_t
 format_part_mbox (const void *ctx, sprinter_t *sp, mime_node_t *node,
 		  int indent, const notmuch_show_params_t *params);
@@ -905,12 +910,24 @@ show_message (void *ctx,
     mime_node_t *root, *part;
     notmuch_status_t status;
 
-    status = mime_node_open (local, message, &(params->crypto), &root);
+    /* Without the body, the headers stored in the database are all
+     * that the structured formats show. */
+    if (! params->output_body && params->part <= 0 &&
+	(format == &format_json || format == &format_sexp ||
+	 format == &format_cbor))
+	status = mime_node_open_headers (local, message, &(params->crypto),
+					 params->mime_cache_dir, &root);
+    else
+	status = mime_node_open_cached (local, message, &(params->crypto),
+					params->mime_cache_dir, &root);
     if (status)
 	goto DONE;
     part = mime_node_seek_dfs (root, (params->part < 0 ? 0 : params->part));
-    if (part)
+    if (part) {
+	_notmuch_profile_begin (NOTMUCH_PROFILE_OUTPUT);
 	status = format->part (local, sp, part, indent, params);
+	_notmuch_profile_end (NOTMUCH_PROFILE_OUTPUT);
+    }
   DONE:
     talloc_free (local);
     return status;
@@ -1050,6 +1067,7 @@ enum {
     NOTMUCH_FORMAT_NOT_SPECIFIED,
     NOTMUCH_FORMAT_JSON,
     NOTMUCH_FORMAT_SEXP,
+    NOTMUCH_FORMAT_CBOR,
     NOTMUCH_FORMAT_TEXT,
     NOTMUCH_FORMAT_MBOX,
     NOTMUCH_FORMAT_RAW
@@ -1096,6 +1114,7 @@ notmuch_show_command (notmuch_config_t *config, int argc, char *argv[])
 	  (notmuch_keyword_t []){ { "json", NOTMUCH_FORMAT_JSON },
 				  { "text", NOTMUCH_FORMAT_TEXT },
 				  { "sexp", NOTMUCH_FORMAT_SEXP },
+				  { "cbor", NOTMUCH_FORMAT_CBOR },
 				  { "mbox", NOTMUCH_FORMAT_MBOX },
 				  { "raw", NOTMUCH_FORMAT_RAW },
 				  { 0, 0 } } },
@@ -1143,6 +1162,9 @@ notmuch_show_command (notmuch_config_t *config, int argc, char *argv[])
     case NOTMUCH_FORMAT_SEXP:
 	format = &format_sexp;
 	break;
+    case NOTMUCH_FORMAT_CBOR:
+	format = &format_cbor;
+	break;
     case NOTMUCH_FORMAT_MBOX:
 	if (params.part > 0) {
 	    fprintf (stderr, "Error: specifying parts is incompatible with mbox output format.\n");
@@ -1163,10 +1185,11 @@ notmuch_show_command (notmuch_config_t *config, int argc, char *argv[])
 
     notmuch_exit_if_unsupported_format ();
 
-    /* Default is entire-thread = FALSE except for format=json and
-     * format=sexp. */
+    /* Default is entire-thread = FALSE except for the structured
+     * formats. */
     if (entire_thread == ENTIRE_THREAD_DEFAULT) {
-	if (format == &format_json || format == &format_sexp)
+	if (format == &format_json || format == &format_sexp ||
+	    format == &format_cbor)
 	    entire_thread = ENTIRE_THREAD_TRUE;
 	else
 	    entire_thread = ENTIRE_THREAD_FALSE;
@@ -1177,15 +1200,17 @@ notmuch_show_command (notmuch_config_t *config, int argc, char *argv[])
 	    fprintf (stderr, "Warning: --body=false is incompatible with --part > 0. Disabling.\n");
 	    params.output_body = TRUE;
 	} else {
-	    if (format != &format_json && format != &format_sexp)
+	    if (format != &format_json && format != &format_sexp &&
+		format != &format_cbor)
 		fprintf (stderr,
-			 "Warning: --body=false only implemented for format=json and format=sexp\n");
+			 "Warning: --body=false only implemented for format=json, format=sexp and format=cbor\n");
 	}
     }
 
     if (params.include_html &&
-        (format_sel != NOTMUCH_FORMAT_JSON && format_sel != NOTMUCH_FORMAT_SEXP)) {
-	fprintf (stderr, "Warning: --include-html only implemented for format=json and format=sexp\n");
+        (format_sel != NOTMUCH_FORMAT_JSON && format_sel != NOTMUCH_FORMAT_SEXP &&
+	 format_sel != NOTMUCH_FORMAT_CBOR)) {
+	fprintf (stderr, "Warning: --include-html only implemented for format=json, format=sexp and format=cbor\n");
     }
 
     if (entire_thread == ENTIRE_THREAD_TRUE)
@@ -1206,8 +1231,8 @@ notmuch_show_command (notmuch_config_t *config, int argc, char *argv[])
 
     params.crypto.gpgpath = notmuch_config_get_crypto_gpg_path (config);
 
-    if (notmuch_database_open (notmuch_config_get_database_path (config),
-			       NOTMUCH_DATABASE_MODE_READ_ONLY, &notmuch))
+    if (notmuch_client_database_open (config, NOTMUCH_DATABASE_MODE_READ_ONLY,
+				      &notmuch))
 	return EXIT_FAILURE;
 
     query = notmuch_query_create (notmuch, query_string);
@@ -1216,6 +1241,15 @@ notmuch_show_command (notmuch_config_t *config, int argc, char *argv[])
 	return EXIT_FAILURE;
     }
 
+    /* Front ends show the same messages over and over, so keep their
+     * MIME structure around if asked to.  Raw and mbox output copy
+     * the file as is. */
+    if (notmuch_config_get_show_mime_cache (config) &&
+	(format == &format_json || format == &format_sexp ||
+	 format == &format_cbor || format == &format_text))
+	params.mime_cache_dir = talloc_asprintf (config, "%s/.notmuch/mime-cache",
+						 notmuch_database_get_path (notmuch));
+
     /* Create structure printer. */
     sprinter = format->new_sprinter(config, stdout);
 
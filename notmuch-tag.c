@@ -22,6 +22,8 @@
 #include "tag-util.h"
 #include "string-util.h"
 
+#include <ctype.h>
+
 static volatile sig_atomic_t interrupted;
 
 static void
@@ -88,20 +90,234 @@ _optimize_tag_query (void *ctx, const char *orig_query_string,
     return query_string;
 }
 
-/* Tag messages matching 'query_string' according to 'tag_ops'
- */
+/* The number of messages a --batch transaction keeps pending before
+ * it writes them out. */
+#define TAG_BATCH_MAX_MESSAGES 5000
+
+/* The number of changed messages after which a --batch transaction is
+ * committed, even before --transaction-size lines.  Xapian holds the
+ * changes of a transaction in memory until it is committed.  Lines
+ * are not split between transactions, so a single line changing more
+ * messages still holds all of them. */
+#define TAG_BATCH_MAX_CHANGES 10000
+
+/* State of the current --batch transaction, when maildir flags are
+ * synchronized.  (Without synchronization, each line is applied in
+ * bulk with notmuch_query_apply_tag_ops.) */
+typedef struct {
+    /* Messages changed by the lines of the transaction, keyed by
+     * message ID.  Each message is kept frozen, so all the changes the
+     * transaction makes to it are written with one document rewrite,
+     * and one rename of its files, when the messages are flushed. */
+    GHashTable *messages;
+    /* Tags changed on the messages above.  These changes are not yet
+     * visible to queries, so a line whose query refers to one of
+     * these tags flushes the messages first. */
+    GHashTable *tags;
+    tag_op_flag_t flags;
+} tag_batch_t;
+
+static int
+tag_batch_destructor (tag_batch_t *batch)
+{
+    g_hash_table_unref (batch->messages);
+    g_hash_table_unref (batch->tags);
+    return 0;
+}
+
+static tag_batch_t *
+tag_batch_create (void *ctx, tag_op_flag_t flags)
+{
+    tag_batch_t *batch;
+
+    batch = talloc (ctx, tag_batch_t);
+    if (batch == NULL)
+	return NULL;
+
+    batch->messages = g_hash_table_new (g_str_hash, g_str_equal);
+    batch->tags = g_hash_table_new_full (g_str_hash, g_str_equal,
+					 g_free, NULL);
+    batch->flags = flags;
+    talloc_set_destructor (batch, tag_batch_destructor);
+
+    return batch;
+}
+
+/* Write out the changes to the messages of 'batch', synchronizing
+ * maildir flags if requested, and forget the messages.  If 'changed'
+ * is not NULL, the number of messages written is added to it. */
+static int
+tag_batch_flush (tag_batch_t *batch, unsigned int *changed)
+{
+    GHashTableIter iter;
+    gpointer value;
+    int ret = 0;
+
+    g_hash_table_iter_init (&iter, batch->messages);
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+	notmuch_message_t *message = value;
+	notmuch_status_t status;
+
+	status = notmuch_message_thaw (message);
+	if (! status && (batch->flags & TAG_FLAG_MAILDIR_SYNC))
+	    status = notmuch_message_tags_to_maildir_flags (message);
+	if (status) {
+	    fprintf (stderr, "Error: failed to update message %s: %s\n",
+		     notmuch_message_get_message_id (message),
+		     notmuch_status_to_string (status));
+	    ret = 1;
+	}
+	g_hash_table_iter_remove (&iter);
+	notmuch_message_destroy (message);
+	if (changed)
+	    (*changed)++;
+    }
+
+    g_hash_table_remove_all (batch->tags);
+
+    return ret;
+}
+
+/* Is the term of 'query_string' starting at 's' one of the tags
+ * changed by the pending messages of 'batch'?  's' points just past a
+ * "tag:" or "is:" prefix. */
+static notmuch_bool_t
+tag_batch_term_is_pending (tag_batch_t *batch, const char *s)
+{
+    notmuch_bool_t pending;
+    char *tag, *out;
+
+    /* Grouped terms are not worth taking apart. */
+    if (*s == '(')
+	return TRUE;
+
+    tag = talloc_array (batch, char, strlen (s) + 1);
+    if (tag == NULL)
+	return TRUE;
+    out = tag;
+
+    if (*s == '"') {
+	/* Quotes are doubled within quoted terms (see
+	 * make_boolean_term). */
+	for (s++; *s; *out++ = *s++) {
+	    if (*s == '"' && *++s != '"')
+		break;
+	}
+    } else {
+	while (*s && ! isspace ((unsigned char) *s) && *s != ')')
+	    *out++ = *s++;
+    }
+    *out = '\0';
+
+    pending = g_hash_table_lookup_extended (batch->tags, tag, NULL, NULL);
+    talloc_free (tag);
+
+    return pending;
+}
+
+/* Could 'query_string' match differently once the pending changes of
+ * 'batch' are written?  That is the case if it has a "tag:" or "is:"
+ * term for one of the tags changed by the pending messages, or if it
+ * uses a named query, which may refer to any tag. */
+static notmuch_bool_t
+tag_batch_query_is_stale (tag_batch_t *batch, const char *query_string)
+{
+    const char *s;
+
+    if (g_hash_table_size (batch->tags) == 0)
+	return FALSE;
+
+    for (s = query_string; *s; s++) {
+	/* Only look at the beginning of terms. */
+	if (s > query_string && ! isspace ((unsigned char) s[-1]) &&
+	    s[-1] != '(' && s[-1] != '+' && s[-1] != '-')
+	    continue;
+
+	if (STRNCMP_LITERAL (s, "query:") == 0)
+	    return TRUE;
+	if (STRNCMP_LITERAL (s, "tag:") == 0 &&
+	    tag_batch_term_is_pending (batch, s + strlen ("tag:")))
+	    return TRUE;
+	if (STRNCMP_LITERAL (s, "is:") == 0 &&
+	    tag_batch_term_is_pending (batch, s + strlen ("is:")))
+	    return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* Does 'tag_ops' change one of the tags changed by the pending
+ * messages of 'batch'? */
+static notmuch_bool_t
+tag_batch_changes_pending_tag (tag_batch_t *batch, tag_op_list_t *tag_ops)
+{
+    size_t i;
+
+    for (i = 0; i < tag_op_list_size (tag_ops); i++) {
+	if (g_hash_table_lookup_extended (batch->tags,
+					  tag_op_list_tag (tag_ops, i),
+					  NULL, NULL))
+	    return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* Return the pending copy of 'message' in 'batch', adding 'message'
+ * to the batch if there is none yet. */
+static notmuch_message_t *
+tag_batch_get (tag_batch_t *batch, notmuch_message_t *message)
+{
+    const char *message_id = notmuch_message_get_message_id (message);
+    notmuch_message_t *pending;
+    notmuch_status_t status;
+
+    pending = g_hash_table_lookup (batch->messages, message_id);
+    if (pending) {
+	notmuch_message_destroy (message);
+	return pending;
+    }
+
+    status = notmuch_message_freeze (message);
+    if (status) {
+	fprintf (stderr, "Error: failed to freeze message %s: %s\n",
+		 message_id, notmuch_status_to_string (status));
+	notmuch_message_destroy (message);
+	return NULL;
+    }
+
+    talloc_steal (batch, message);
+    g_hash_table_insert (batch->messages, (gpointer) message_id, message);
+
+    return message;
+}
+
+/* Apply 'tag_ops' to the messages matching 'query_string'.  If
+ * 'batch' is not NULL, the changed messages are added to it rather
+ * than written out.  If 'changed' is not NULL, the number of messages
+ * written to the database is added to it. */
 static int
 tag_query (void *ctx, notmuch_database_t *notmuch, const char *query_string,
-	   tag_op_list_t *tag_ops, tag_op_flag_t flags)
+	   tag_op_list_t *tag_ops, tag_op_flag_t flags, tag_batch_t *batch,
+	   unsigned int *changed)
 {
     notmuch_query_t *query;
     notmuch_messages_t *messages;
     notmuch_message_t *message;
     int ret = NOTMUCH_STATUS_SUCCESS;
 
-    if (! (flags & TAG_FLAG_REMOVE_ALL)) {
-	/* Optimize the query so it excludes messages that already
-	 * have the specified set of tags. */
+    if (batch && tag_batch_query_is_stale (batch, query_string)) {
+	ret = tag_batch_flush (batch, changed);
+	if (ret)
+	    return ret;
+    }
+
+    /* Optimize the query so it excludes messages that already have
+     * the specified set of tags.  Whether a pending message has them
+     * is not yet visible to queries, so lines changing the tags of
+     * pending messages are not optimized. */
+    if (! (flags & TAG_FLAG_REMOVE_ALL) &&
+	! (batch && tag_batch_changes_pending_tag (batch, tag_ops))) {
 	query_string = _optimize_tag_query (ctx, query_string, tag_ops);
 	if (query_string == NULL) {
 	    fprintf (stderr, "Out of memory.\n");
@@ -119,24 +335,78 @@ tag_query (void *ctx, notmuch_database_t *notmuch, const char *query_string,
     /* tagging is not interested in any special sort order */
     notmuch_query_set_sort (query, NOTMUCH_SORT_UNSORTED);
 
+    /* Without maildir synchronization, nothing needs to look at the
+     * messages themselves, so let the library tag the documents in
+     * bulk. */
+    if (! (flags & (TAG_FLAG_MAILDIR_SYNC | TAG_FLAG_REMOVE_ALL))) {
+	ret = tag_op_list_apply_query (query, tag_ops, changed, &interrupted);
+	notmuch_query_destroy (query);
+	return ret || interrupted;
+    }
+
     for (messages = notmuch_query_search_messages (query);
 	 notmuch_messages_valid (messages) && ! interrupted;
 	 notmuch_messages_move_to_next (messages)) {
 	message = notmuch_messages_get (messages);
-	ret = tag_op_list_apply (message, tag_ops, flags);
-	notmuch_message_destroy (message);
+	if (batch) {
+	    message = tag_batch_get (batch, message);
+	    if (message == NULL) {
+		ret = 1;
+		break;
+	    }
+	    /* Maildir flags are synchronized when the batch is
+	     * flushed. */
+	    ret = tag_op_list_apply (message, tag_ops,
+				     flags & ~TAG_FLAG_MAILDIR_SYNC);
+	    if (! ret &&
+		g_hash_table_size (batch->messages) >= TAG_BATCH_MAX_MESSAGES)
+		ret = tag_batch_flush (batch, changed);
+	} else {
+	    ret = tag_op_list_apply (message, tag_ops, flags);
+	    notmuch_message_destroy (message);
+	    if (! ret && changed)
+		(*changed)++;
+	}
 	if (ret != NOTMUCH_STATUS_SUCCESS)
 	    break;
     }
 
+    if (batch) {
+	size_t i;
+
+	for (i = 0; i < tag_op_list_size (tag_ops); i++)
+	    g_hash_table_insert (batch->tags,
+				 g_strdup (tag_op_list_tag (tag_ops, i)), NULL);
+    }
+
     notmuch_query_destroy (query);
 
     return ret || interrupted;
 }
 
+/* Write out the messages of 'batch', if any, and commit the
+ * transaction they belong to, starting a new one if 'more' is TRUE. */
+static int
+tag_batch_commit (notmuch_database_t *notmuch, tag_batch_t *batch,
+		  notmuch_bool_t more)
+{
+    int ret = 0;
+
+    if (batch)
+	ret = tag_batch_flush (batch, NULL);
+
+    if (notmuch_database_end_atomic (notmuch) ||
+	(more && notmuch_database_begin_atomic (notmuch))) {
+	fprintf (stderr, "Error: failed to commit tag changes.\n");
+	ret = 1;
+    }
+
+    return ret;
+}
+
 static int
 tag_file (void *ctx, notmuch_database_t *notmuch, tag_op_flag_t flags,
-	  FILE *input)
+	  FILE *input, int transaction_size)
 {
     char *line = NULL;
     char *query_string = NULL;
@@ -144,7 +414,11 @@ tag_file (void *ctx, notmuch_database_t *notmuch, tag_op_flag_t flags,
     ssize_t line_len;
     int ret = 0;
     int warn = 0;
+    int line_number = 0;
+    int pending_lines = 0;
+    unsigned int pending_changes = 0;
     tag_op_list_t *tag_ops;
+    tag_batch_t *batch = NULL;
 
     tag_ops = tag_op_list_create (ctx);
     if (tag_ops == NULL) {
@@ -152,9 +426,29 @@ tag_file (void *ctx, notmuch_database_t *notmuch, tag_op_flag_t flags,
 	return 1;
     }
 
+    /* Only messages whose maildir flags are synchronized are kept in
+     * a batch; otherwise each line is applied in bulk. */
+    if (flags & TAG_FLAG_MAILDIR_SYNC) {
+	batch = tag_batch_create (ctx, flags);
+	if (batch == NULL) {
+	    fprintf (stderr, "Out of memory.\n");
+	    return 1;
+	}
+    }
+
+    /* Apply the lines in transactions of transaction_size lines, or
+     * fewer if they change many messages, so that the database is not
+     * committed after every change. */
+    if (notmuch_database_begin_atomic (notmuch)) {
+	fprintf (stderr, "Error: failed to start a transaction.\n");
+	return 1;
+    }
+
     while ((line_len = getline (&line, &line_size, input)) != -1 &&
 	   ! interrupted) {
 
+	line_number++;
+
 	ret = parse_tag_line (ctx, line, TAG_FLAG_NONE,
 			      &query_string, tag_ops);
 
@@ -169,11 +463,27 @@ tag_file (void *ctx, notmuch_database_t *notmuch, tag_op_flag_t flags,
 	if (ret < 0)
 	    break;
 
-	ret = tag_query (ctx, notmuch, query_string, tag_ops, flags);
-	if (ret)
+	ret = tag_query (ctx, notmuch, query_string, tag_ops, flags, batch,
+			 &pending_changes);
+	if (ret) {
+	    fprintf (stderr, "Error: failed to apply line %d.\n", line_number);
 	    break;
+	}
+
+	if (++pending_lines == transaction_size ||
+	    pending_changes >= TAG_BATCH_MAX_CHANGES) {
+	    pending_lines = 0;
+	    pending_changes = 0;
+	    ret = tag_batch_commit (notmuch, batch, TRUE);
+	    if (ret)
+		break;
+	}
     }
 
+    /* Changes from the lines before a failure are still committed. */
+    if (tag_batch_commit (notmuch, batch, FALSE))
+	ret = 1;
+
     if (line)
 	free (line);
 
@@ -190,6 +500,7 @@ notmuch_tag_command (notmuch_config_t *config, int argc, char *argv[])
     tag_op_flag_t tag_flags = TAG_FLAG_NONE;
     notmuch_bool_t batch = FALSE;
     notmuch_bool_t remove_all = FALSE;
+    int transaction_size = 1000;
     FILE *input = stdin;
     char *input_file_name = NULL;
     int opt_index;
@@ -206,6 +517,7 @@ notmuch_tag_command (notmuch_config_t *config, int argc, char *argv[])
 	{ NOTMUCH_OPT_BOOLEAN, &batch, "batch", 0, 0 },
 	{ NOTMUCH_OPT_STRING, &input_file_name, "input", 'i', 0 },
 	{ NOTMUCH_OPT_BOOLEAN, &remove_all, "remove-all", 0, 0 },
+	{ NOTMUCH_OPT_INT, &transaction_size, "transaction-size", 0, 0 },
 	{ 0, 0, 0, 0, 0 }
     };
 
@@ -232,6 +544,10 @@ notmuch_tag_command (notmuch_config_t *config, int argc, char *argv[])
 	    fprintf (stderr, "Can't specify both --remove-all and --batch\n");
 	    return EXIT_FAILURE;
 	}
+	if (transaction_size < 1) {
+	    fprintf (stderr, "Error: --transaction-size must be at least 1.\n");
+	    return EXIT_FAILURE;
+	}
     } else {
 	tag_ops = tag_op_list_create (config);
 	if (tag_ops == NULL) {
@@ -254,8 +570,8 @@ notmuch_tag_command (notmuch_config_t *config, int argc, char *argv[])
 	}
     }
 
-    if (notmuch_database_open (notmuch_config_get_database_path (config),
-			       NOTMUCH_DATABASE_MODE_READ_WRITE, &notmuch))
+    if (notmuch_client_database_open (config, NOTMUCH_DATABASE_MODE_READ_WRITE,
+				      &notmuch))
 	return EXIT_FAILURE;
 
     if (notmuch_config_get_maildir_synchronize_flags (config))
@@ -265,9 +581,10 @@ notmuch_tag_command (notmuch_config_t *config, int argc, char *argv[])
 	tag_flags |= TAG_FLAG_REMOVE_ALL;
 
     if (batch)
-	ret = tag_file (config, notmuch, tag_flags, input);
+	ret = tag_file (config, notmuch, tag_flags, input, transaction_size);
     else
-	ret = tag_query (config, notmuch, query_string, tag_ops, tag_flags);
+	ret = tag_query (config, notmuch, query_string, tag_ops, tag_flags,
+			 NULL, NULL);
 
     notmuch_database_destroy (notmuch);
 
@@ -72,6 +72,8 @@ static command_t commands[] = {
       "Compact the notmuch database." },
     { "config", notmuch_config_command, FALSE,
       "Get or set settings in the notmuch configuration file." },
+    { "serve", notmuch_serve_command, FALSE,
+      "Keep the database open and run commands sent to a socket." },
     { "help", notmuch_help_command, TRUE, /* create but don't save config */
       "This message, or more detailed help for the named command." }
 };
@@ -276,12 +278,15 @@ notmuch_command (notmuch_config_t *config,
     return EXIT_SUCCESS;
 }
 
+static char stdout_buffer[64 * 1024];
+
 int
 main (int argc, char *argv[])
 {
     void *local;
     char *talloc_report;
     const char *command_name = NULL;
+    const char *serve_socket;
     command_t *command;
     char *config_file_name = NULL;
     notmuch_config_t *config = NULL;
@@ -298,6 +303,11 @@ main (int argc, char *argv[])
 
     talloc_enable_null_tracking ();
 
+    /* Structured output is mostly read by programs through a pipe,
+     * and can run to megabytes; write it out in large blocks. */
+    if (! isatty (STDOUT_FILENO))
+	setvbuf (stdout, stdout_buffer, _IOFBF, sizeof (stdout_buffer));
+
     local = talloc_new (NULL);
 
     g_mime_init (GMIME_ENABLE_RFC2047_WORKAROUNDS);
@@ -344,6 +354,14 @@ main (int argc, char *argv[])
 	goto DONE;
     }
 
+    /* Leave the command to a running "notmuch serve", which has the
+     * configuration and database open already. */
+    serve_socket = getenv ("NOTMUCH_SERVE_SOCKET");
+    if (command_name && serve_socket && *serve_socket && ! config_file_name &&
+	notmuch_serve_forward (serve_socket, argc - opt_index, argv + opt_index,
+			       &ret))
+	goto DONE;
+
     config = notmuch_config_open (local, config_file_name, command->create_config);
     if (!config) {
 	ret = EXIT_FAILURE;
@@ -0,0 +1,13 @@
+#!/bin/bash
+
+test_description='search'
+
+. ./perf-test-lib.sh
+
+memory_start
+
+memory_run 'search *' "notmuch search *"
+memory_run 'search --format=json *' "notmuch search --format=json *"
+memory_run 'search --output=files *' "notmuch search --output=files *"
+
+memory_done
@@ -0,0 +1,14 @@
+#!/bin/bash
+
+test_description='show'
+
+. ./perf-test-lib.sh
+
+memory_start
+
+threads=$(notmuch search --output=threads --sort=oldest-first --limit=200 '*')
+
+memory_run 'show --entire-thread' "notmuch show --entire-thread=true $threads"
+memory_run 'show --format=json' "notmuch show --format=json $threads"
+
+memory_done
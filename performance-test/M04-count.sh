@@ -0,0 +1,16 @@
+#!/bin/bash
+
+test_description='count'
+
+. ./perf-test-lib.sh
+
+memory_start
+
+notmuch search --output=tags '*' | sed 's/.*/tag:"&"/' > count.queries
+notmuch address --output=sender '*' | head -n 500 |
+    sed -e 's/.*<\(.*\)>.*/\1/' -e 's/.*/from:"&"/' >> count.queries
+
+memory_run 'count --batch' "notmuch count --batch --input=count.queries"
+memory_run 'count --batch threads' "notmuch count --batch --output=threads --input=count.queries"
+
+memory_done
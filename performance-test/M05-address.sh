@@ -0,0 +1,12 @@
+#!/bin/bash
+
+test_description='address'
+
+. ./perf-test-lib.sh
+
+memory_start
+
+memory_run 'address (both)' "notmuch address --output=sender --output=recipients *"
+memory_run 'address --output=count' "notmuch address --output=sender --output=count *"
+
+memory_done
@@ -0,0 +1,14 @@
+#!/bin/bash
+
+test_description='reply'
+
+. ./perf-test-lib.sh
+
+memory_start
+
+id=$(notmuch search --output=messages --sort=oldest-first --limit=1 '*')
+
+memory_run 'reply' "notmuch reply $id"
+memory_run 'reply --format=json' "notmuch reply --format=json $id"
+
+memory_done
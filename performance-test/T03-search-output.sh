@@ -0,0 +1,15 @@
+#!/bin/bash
+
+test_description='structured output'
+
+. ./perf-test-lib.sh
+
+time_start
+
+time_run 'search --format=json *' "notmuch search --format=json '*' > search.json"
+time_run 'search --format=sexp *' "notmuch search --format=sexp '*' > search.sexp"
+time_run 'search --format=text *' "notmuch search --format=text '*' > search.text"
+time_run 'show --format=json tag:inbox' "notmuch show --format=json tag:inbox > show.json"
+time_run 'show --format=sexp tag:inbox' "notmuch show --format=sexp tag:inbox > show.sexp"
+
+time_done
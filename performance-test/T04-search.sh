@@ -0,0 +1,18 @@
+#!/bin/bash
+
+test_description='search'
+
+. ./perf-test-lib.sh
+
+time_start
+
+time_run 'search *' "notmuch search '*' > /dev/null"
+time_run 'search --sort=oldest-first *' "notmuch search --sort=oldest-first '*' > /dev/null"
+time_run 'search --limit=100 *' "notmuch search --limit=100 '*' > /dev/null"
+time_run 'search tag:inbox' "notmuch search tag:inbox > /dev/null"
+time_run 'search --output=threads *' "notmuch search --output=threads '*' > /dev/null"
+time_run 'search --output=messages *' "notmuch search --output=messages '*' > /dev/null"
+time_run 'search --output=files *' "notmuch search --output=files '*' > /dev/null"
+time_run 'search --output=tags *' "notmuch search --output=tags '*' > /dev/null"
+
+time_done
@@ -0,0 +1,18 @@
+#!/bin/bash
+
+test_description='show'
+
+. ./perf-test-lib.sh
+
+time_start
+
+# A fixed set of threads, so that each run shows the same messages.
+threads=$(notmuch search --output=threads --sort=oldest-first --limit=200 '*')
+
+time_run 'show --entire-thread' "notmuch show --entire-thread=true $threads > /dev/null"
+time_run 'show --format=json' "notmuch show --format=json $threads > /dev/null"
+time_run 'show --format=sexp' "notmuch show --format=sexp $threads > /dev/null"
+time_run 'show --body=false' "notmuch show --format=json --body=false $threads > /dev/null"
+time_run 'show --entire-thread tag:inbox' "notmuch show --entire-thread=true --format=json --body=false tag:inbox > /dev/null"
+
+time_done
@@ -0,0 +1,19 @@
+#!/bin/bash
+
+test_description='count'
+
+. ./perf-test-lib.sh
+
+time_start
+
+# One query for each tag and for each of the first senders.
+notmuch search --output=tags '*' | sed 's/.*/tag:"&"/' > count.queries
+notmuch address --output=sender '*' | head -n 500 |
+    sed -e 's/.*<\(.*\)>.*/\1/' -e 's/.*/from:"&"/' >> count.queries
+
+time_run 'count *' "notmuch count '*'"
+time_run 'count --output=threads *' "notmuch count --output=threads '*'"
+time_run 'count --batch' "notmuch count --batch --input=count.queries > /dev/null"
+time_run 'count --batch threads' "notmuch count --batch --output=threads --input=count.queries > /dev/null"
+
+time_done
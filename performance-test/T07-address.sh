@@ -0,0 +1,15 @@
+#!/bin/bash
+
+test_description='address'
+
+. ./perf-test-lib.sh
+
+time_start
+
+time_run 'address --output=sender' "notmuch address --output=sender '*' > /dev/null"
+time_run 'address --output=recipients' "notmuch address --output=recipients '*' > /dev/null"
+time_run 'address (both)' "notmuch address --output=sender --output=recipients '*' > /dev/null"
+time_run 'address --output=count' "notmuch address --output=sender --output=count '*' > /dev/null"
+time_run 'address --format=json' "notmuch address --format=json --output=sender '*' > /dev/null"
+
+time_done
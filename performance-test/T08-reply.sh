@@ -0,0 +1,16 @@
+#!/bin/bash
+
+test_description='reply'
+
+. ./perf-test-lib.sh
+
+time_start
+
+# Replying is per message, so time one reply to each of a fixed set.
+notmuch search --output=messages --sort=oldest-first --limit=100 '*' > reply.ids
+
+time_run 'reply x100' "while read -r id; do notmuch reply \"\$id\"; done < reply.ids > /dev/null"
+time_run 'reply --format=json x100' "while read -r id; do notmuch reply --format=json \"\$id\"; done < reply.ids > /dev/null"
+time_run 'reply --reply-to=sender x100' "while read -r id; do notmuch reply --reply-to=sender \"\$id\"; done < reply.ids > /dev/null"
+
+time_done
@@ -0,0 +1,596 @@
+/* microbench - Time the hot paths of libnotmuch one layer at a time
+ *
+ * Copyright © 2026 agent
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ * Author: agent <agent@local>
+ */
+
+/* Each benchmark runs on a synthetic corpus generated from a fixed
+ * seed, so that runs on different commits see the same messages.  The
+ * results are written to stdout as JSON, one entry per benchmark,
+ * with the best time of the repetitions. */
+
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "notmuch-client.h"
+#include "sprinter.h"
+#include "command-line-arguments.h"
+#include "test/random-string.h"
+
+/* Part of the library's internals rather than its API; the static
+ * library still provides it. */
+void
+_notmuch_message_ensure_metadata (notmuch_message_t *message);
+
+typedef struct {
+    const char *name;
+    unsigned int ops;
+    double seconds;
+} bench_result_t;
+
+typedef struct {
+    void *ctx;
+    const char *mail_dir;
+    int num_messages;
+    int repeat;
+
+    /* The tags applied to the corpus.  The first half are plain
+     * words that queries can name, the rest random UTF-8. */
+    char **tags;
+    int num_tags;
+
+    bench_result_t *results;
+    int num_results;
+} bench_t;
+
+#define NUM_AUTHORS 40
+#define NUM_TAGS 24
+
+static const char *words[] = {
+    "notmuch", "mail", "index", "thread", "query", "tag", "search",
+    "xapian", "message", "reply", "patch", "test", "release", "bug",
+    "fix", "performance", "emacs", "database", "header", "address",
+};
+
+#define NUM_WORDS (sizeof (words) / sizeof (words[0]))
+
+static double
+now (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Record one run of a benchmark, keeping the fastest run. */
+static void
+record (bench_t *bench, const char *name, unsigned int ops, double seconds)
+{
+    bench_result_t *result;
+    int i;
+
+    for (i = 0; i < bench->num_results; i++) {
+	result = &bench->results[i];
+	if (strcmp (result->name, name) == 0) {
+	    if (seconds < result->seconds)
+		result->seconds = seconds;
+	    return;
+	}
+    }
+
+    bench->results = talloc_realloc (bench->ctx, bench->results,
+				     bench_result_t, bench->num_results + 1);
+    result = &bench->results[bench->num_results++];
+    result->name = name;
+    result->ops = ops;
+    result->seconds = seconds;
+}
+
+static char *
+random_words (void *ctx, int count)
+{
+    char *str = talloc_strdup (ctx, words[random () % NUM_WORDS]);
+    int i;
+
+    for (i = 1; i < count; i++)
+	str = talloc_asprintf_append (str, " %s", words[random () % NUM_WORDS]);
+
+    return str;
+}
+
+/* Write the messages of the corpus as files in a maildir.  About two
+ * thirds of the messages are replies to an earlier message, so that
+ * the corpus has threads of many shapes and sizes. */
+static char **
+write_corpus (bench_t *bench)
+{
+    char **filenames = talloc_array (bench->ctx, char *, bench->num_messages);
+    char **subjects = talloc_array (bench->ctx, char *, bench->num_messages);
+    char *cur = talloc_asprintf (bench->ctx, "%s/cur", bench->mail_dir);
+    int i, j;
+
+    if (mkdir (cur, 0755) && errno != EEXIST) {
+	fprintf (stderr, "Error: cannot create %s: %s\n", cur, strerror (errno));
+	return NULL;
+    }
+
+    for (i = 0; i < bench->num_messages; i++) {
+	int parent = (i > 0 && random () % 3) ? random () % i : -1;
+	int author = random () % NUM_AUTHORS;
+	time_t date = 1262304000 + i * 3607;
+	char date_str[64];
+	FILE *file;
+
+	if (parent < 0)
+	    subjects[i] = random_words (subjects, 3 + random () % 6);
+	else
+	    subjects[i] = subjects[parent];
+
+	strftime (date_str, sizeof (date_str), "%a, %d %b %Y %H:%M:%S +0000",
+		  gmtime (&date));
+
+	filenames[i] = talloc_asprintf (filenames, "%s/%06d:2,", cur, i);
+	file = fopen (filenames[i], "w");
+	if (file == NULL) {
+	    fprintf (stderr, "Error: cannot write %s: %s\n",
+		     filenames[i], strerror (errno));
+	    return NULL;
+	}
+
+	fprintf (file, "From: Author %d <author%d@example.com>\n", author, author);
+	fprintf (file, "To: Bench List <bench@example.com>\n");
+	if (random () % 4 == 0)
+	    fprintf (file, "Cc: Author %d <author%d@example.com>\n",
+		     (author + 1) % NUM_AUTHORS, (author + 1) % NUM_AUTHORS);
+	fprintf (file, "Subject: %s%s\n", parent < 0 ? "" : "Re: ", subjects[i]);
+	fprintf (file, "Date: %s\n", date_str);
+	fprintf (file, "Message-ID: <bench-%d@example.com>\n", i);
+	if (parent >= 0) {
+	    fprintf (file, "In-Reply-To: <bench-%d@example.com>\n", parent);
+	    fprintf (file, "References: <bench-%d@example.com>\n", parent);
+	}
+	fprintf (file, "\n");
+
+	for (j = 5 + random () % 40; j > 0; j--) {
+	    char *line = random_words (bench->ctx, 4 + random () % 10);
+	    fprintf (file, "%s\n", line);
+	    talloc_free (line);
+	}
+
+	fclose (file);
+    }
+
+    talloc_free (cur);
+    return filenames;
+}
+
+static void
+create_tags (bench_t *bench)
+{
+    int i;
+
+    bench->num_tags = NUM_TAGS;
+    bench->tags = talloc_array (bench->ctx, char *, NUM_TAGS);
+
+    for (i = 0; i < NUM_TAGS / 2; i++)
+	bench->tags[i] = talloc_asprintf (bench->tags, "%s%d",
+					  words[i % NUM_WORDS], i);
+
+    for (; i < NUM_TAGS; i++)
+	bench->tags[i] = random_utf8_string (bench->tags, 1 + random () % 20);
+}
+
+/* Index the corpus into a new database, and give each message a few
+ * tags from the pool. */
+static notmuch_status_t
+bench_add_message (bench_t *bench, char **filenames)
+{
+    notmuch_database_t *notmuch;
+    notmuch_status_t status;
+    double start;
+    int i, j;
+
+    status = notmuch_database_create (bench->mail_dir, &notmuch);
+    if (status)
+	return status;
+
+    start = now ();
+    for (i = 0; i < bench->num_messages; i++) {
+	status = notmuch_database_add_message (notmuch, filenames[i], NULL);
+	if (status && status != NOTMUCH_STATUS_DUPLICATE_MESSAGE_ID)
+	    goto DONE;
+    }
+    record (bench, "add_message", bench->num_messages, now () - start);
+
+    for (i = 0; i < bench->num_messages; i++) {
+	notmuch_message_t *message;
+	char *mid = talloc_asprintf (bench->ctx, "bench-%d@example.com", i);
+
+	status = notmuch_database_find_message (notmuch, mid, &message);
+	talloc_free (mid);
+	if (status)
+	    goto DONE;
+	if (message == NULL)
+	    continue;
+
+	for (j = random () % 5; j > 0; j--)
+	    notmuch_message_add_tag (message, bench->tags[random () % NUM_TAGS]);
+	notmuch_message_destroy (message);
+    }
+
+    status = NOTMUCH_STATUS_SUCCESS;
+
+  DONE:
+    notmuch_database_destroy (notmuch);
+    return status;
+}
+
+/* Add a tag to every message and remove it again, in two ways: one
+ * message at a time within an atomic section, as "notmuch tag" does
+ * when it synchronizes maildir flags, and with
+ * notmuch_query_apply_tag_ops, as it does otherwise. */
+static notmuch_status_t
+bench_tag (bench_t *bench, notmuch_database_t *notmuch)
+{
+    static const notmuch_tag_op_t add_op = { "bench", FALSE };
+    static const notmuch_tag_op_t remove_op = { "bench", TRUE };
+    notmuch_query_t *query = notmuch_query_create (notmuch, "*");
+    notmuch_messages_t *messages;
+    notmuch_message_t **list;
+    notmuch_status_t status = NOTMUCH_STATUS_SUCCESS;
+    unsigned int count = 0, i;
+    double start;
+    int run;
+
+    list = talloc_array (query, notmuch_message_t *, bench->num_messages);
+    for (messages = notmuch_query_search_messages (query);
+	 notmuch_messages_valid (messages) && count < (unsigned) bench->num_messages;
+	 notmuch_messages_move_to_next (messages))
+	list[count++] = notmuch_messages_get (messages);
+
+    for (run = 0; run < bench->repeat; run++) {
+	start = now ();
+	notmuch_database_begin_atomic (notmuch);
+	for (i = 0; i < count; i++) {
+	    notmuch_message_freeze (list[i]);
+	    notmuch_message_add_tag (list[i], "bench");
+	    notmuch_message_thaw (list[i]);
+	}
+	notmuch_database_end_atomic (notmuch);
+	record (bench, "tag_add", count, now () - start);
+
+	start = now ();
+	notmuch_database_begin_atomic (notmuch);
+	for (i = 0; i < count; i++) {
+	    notmuch_message_freeze (list[i]);
+	    notmuch_message_remove_tag (list[i], "bench");
+	    notmuch_message_thaw (list[i]);
+	}
+	notmuch_database_end_atomic (notmuch);
+	record (bench, "tag_remove", count, now () - start);
+
+	start = now ();
+	status = notmuch_query_apply_tag_ops (query, &add_op, 1, NULL,
+					      NULL, NULL);
+	if (status)
+	    break;
+	record (bench, "tag_add_bulk", count, now () - start);
+
+	start = now ();
+	status = notmuch_query_apply_tag_ops (query, &remove_op, 1, NULL,
+					      NULL, NULL);
+	if (status)
+	    break;
+	record (bench, "tag_remove_bulk", count, now () - start);
+    }
+
+    notmuch_query_destroy (query);
+    return status;
+}
+
+/* Read the metadata of every message into message objects that have
+ * not read anything yet, with the database's caches dropped first. */
+static void
+bench_ensure_metadata (bench_t *bench, notmuch_database_t *notmuch)
+{
+    int run;
+
+    for (run = 0; run < bench->repeat; run++) {
+	notmuch_query_t *query;
+	notmuch_messages_t *messages;
+	notmuch_message_t **list;
+	unsigned int count = 0, i;
+	double start;
+
+	notmuch_database_reopen (notmuch);
+
+	query = notmuch_query_create (notmuch, "*");
+	list = talloc_array (query, notmuch_message_t *, bench->num_messages);
+	for (messages = notmuch_query_search_messages (query);
+	     notmuch_messages_valid (messages) && count < (unsigned) bench->num_messages;
+	     notmuch_messages_move_to_next (messages))
+	    list[count++] = notmuch_messages_get (messages);
+
+	start = now ();
+	for (i = 0; i < count; i++)
+	    _notmuch_message_ensure_metadata (list[i]);
+	record (bench, "ensure_metadata", count, now () - start);
+
+	notmuch_query_destroy (query);
+    }
+}
+
+/* Build every thread of the corpus.  Each notmuch_threads_get is one
+ * call to _notmuch_thread_create; finding the matching messages is
+ * not timed. */
+static void
+bench_thread_create (bench_t *bench, notmuch_database_t *notmuch)
+{
+    int run;
+
+    for (run = 0; run < bench->repeat; run++) {
+	notmuch_query_t *query;
+	notmuch_threads_t *threads;
+	unsigned int count = 0;
+	double start;
+
+	notmuch_database_reopen (notmuch);
+
+	query = notmuch_query_create (notmuch, "*");
+	threads = notmuch_query_search_threads (query);
+
+	start = now ();
+	for (; notmuch_threads_valid (threads);
+	     notmuch_threads_move_to_next (threads)) {
+	    notmuch_thread_destroy (notmuch_threads_get (threads));
+	    count++;
+	}
+	record (bench, "thread_create", count, now () - start);
+
+	notmuch_query_destroy (query);
+    }
+}
+
+static void
+bench_count (bench_t *bench, notmuch_database_t *notmuch)
+{
+    const char *queries[] = {
+	"*",
+	"from:author1@example.com",
+	talloc_asprintf (bench->ctx, "tag:%s", bench->tags[0]),
+	talloc_asprintf (bench->ctx, "tag:%s or tag:%s",
+			 bench->tags[1], bench->tags[2]),
+	"subject:notmuch and not subject:xapian",
+    };
+    unsigned int num_queries = sizeof (queries) / sizeof (queries[0]);
+    unsigned int i;
+    int run;
+
+    for (run = 0; run < bench->repeat; run++) {
+	double messages = 0, threads = 0, start;
+
+	notmuch_database_reopen (notmuch);
+
+	for (i = 0; i < num_queries; i++) {
+	    notmuch_query_t *query = notmuch_query_create (notmuch, queries[i]);
+
+	    start = now ();
+	    notmuch_query_count_messages (query);
+	    messages += now () - start;
+
+	    start = now ();
+	    notmuch_query_count_threads (query);
+	    threads += now () - start;
+
+	    notmuch_query_destroy (query);
+	}
+
+	record (bench, "count_messages", num_queries, messages);
+	record (bench, "count_threads", num_queries, threads);
+    }
+}
+
+/* Print something shaped like the output of "notmuch search
+ * --output=summary" for every message, to /dev/null. */
+static notmuch_status_t
+bench_sprinter (bench_t *bench, notmuch_database_t *notmuch)
+{
+    static const struct {
+	const char *name;
+	sprinter_t *(*create) (const void *ctx, FILE *stream);
+    } printers[] = {
+	{ "sprinter_text", sprinter_text_create },
+	{ "sprinter_json", sprinter_json_create },
+	{ "sprinter_sexp", sprinter_sexp_create },
+	{ "sprinter_cbor", sprinter_cbor_create },
+    };
+    notmuch_query_t *query = notmuch_query_create (notmuch, "*");
+    notmuch_messages_t *messages = notmuch_query_search_messages (query);
+    notmuch_message_info_t *info;
+    unsigned int count, i, j, p;
+    notmuch_status_t status;
+    FILE *null;
+    int run;
+
+    info = talloc_array (query, notmuch_message_info_t, bench->num_messages);
+    status = notmuch_messages_get_info (messages, info, bench->num_messages,
+					&count);
+    if (status)
+	goto DONE;
+
+    null = fopen ("/dev/null", "w");
+    if (null == NULL) {
+	status = NOTMUCH_STATUS_FILE_ERROR;
+	goto DONE;
+    }
+
+    for (run = 0; run < bench->repeat; run++) {
+	for (p = 0; p < sizeof (printers) / sizeof (printers[0]); p++) {
+	    sprinter_t *format = printers[p].create (query, null);
+	    double start = now ();
+
+	    format->begin_list (format);
+	    for (i = 0; i < count; i++) {
+		format->begin_map (format);
+		format->map_key (format, "thread");
+		format->string (format, info[i].thread_id);
+		format->map_key (format, "id");
+		format->string (format, info[i].message_id);
+		format->map_key (format, "timestamp");
+		format->integer (format, info[i].date);
+		format->map_key (format, "tags");
+		format->begin_list (format);
+		for (j = 0; j < info[i].num_tags; j++)
+		    format->string (format, info[i].tags[j]);
+		format->end (format);
+		format->end (format);
+		format->separator (format);
+	    }
+	    format->end (format);
+	    fflush (null);
+
+	    record (bench, printers[p].name, count, now () - start);
+	    talloc_free (format);
+	}
+    }
+
+    fclose (null);
+
+  DONE:
+    notmuch_query_destroy (query);
+    return status;
+}
+
+static void
+print_results (bench_t *bench, int seed)
+{
+    sprinter_t *format = sprinter_json_create (bench->ctx, stdout);
+    int i;
+
+    format->begin_map (format);
+    format->map_key (format, "corpus");
+    format->begin_map (format);
+    format->map_key (format, "messages");
+    format->integer (format, bench->num_messages);
+    format->map_key (format, "seed");
+    format->integer (format, seed);
+    format->end (format);
+    format->map_key (format, "repeat");
+    format->integer (format, bench->repeat);
+
+    format->map_key (format, "benchmarks");
+    format->begin_list (format);
+    for (i = 0; i < bench->num_results; i++) {
+	bench_result_t *result = &bench->results[i];
+
+	format->begin_map (format);
+	format->map_key (format, "name");
+	format->string (format, result->name);
+	format->map_key (format, "ops");
+	format->integer (format, result->ops);
+	format->map_key (format, "usec");
+	format->integer (format, result->seconds * 1e6);
+	format->map_key (format, "ns_per_op");
+	format->integer (format, result->ops ?
+			 result->seconds * 1e9 / result->ops : 0);
+	format->end (format);
+    }
+    format->end (format);
+    format->end (format);
+    printf ("\n");
+}
+
+int
+main (int argc, char **argv)
+{
+    bench_t bench;
+    notmuch_database_t *notmuch;
+    notmuch_status_t status;
+    char **filenames;
+    int seed = 734569;
+    int opt_index;
+
+    memset (&bench, 0, sizeof (bench));
+    bench.ctx = talloc_new (NULL);
+    bench.num_messages = 2000;
+    bench.repeat = 5;
+
+    notmuch_opt_desc_t options[] = {
+	{ NOTMUCH_OPT_STRING, &bench.mail_dir, "directory", 'd', 0 },
+	{ NOTMUCH_OPT_INT, &bench.num_messages, "num-messages", 'n', 0 },
+	{ NOTMUCH_OPT_INT, &bench.repeat, "repeat", 'r', 0 },
+	{ NOTMUCH_OPT_INT, &seed, "seed", 's', 0 },
+	{ 0, 0, 0, 0, 0 }
+    };
+
+    opt_index = parse_arguments (argc, argv, options, 1);
+    if (opt_index < 0)
+	return 1;
+
+    if (bench.mail_dir == NULL) {
+	fprintf (stderr, "Error: an empty --directory must be given for the corpus.\n");
+	return 1;
+    }
+
+    if (bench.num_messages < 1 || bench.repeat < 1) {
+	fprintf (stderr, "Error: --num-messages and --repeat must be positive.\n");
+	return 1;
+    }
+
+    srandom (seed);
+
+    create_tags (&bench);
+    filenames = write_corpus (&bench);
+    if (filenames == NULL)
+	return 1;
+
+    status = bench_add_message (&bench, filenames);
+    if (status)
+	goto FAIL;
+
+    status = notmuch_database_open (bench.mail_dir,
+				    NOTMUCH_DATABASE_MODE_READ_WRITE, &notmuch);
+    if (status)
+	goto FAIL;
+    status = bench_tag (&bench, notmuch);
+    notmuch_database_destroy (notmuch);
+    if (status)
+	goto FAIL;
+
+    status = notmuch_database_open (bench.mail_dir,
+				    NOTMUCH_DATABASE_MODE_READ_ONLY, &notmuch);
+    if (status)
+	goto FAIL;
+    bench_ensure_metadata (&bench, notmuch);
+    bench_thread_create (&bench, notmuch);
+    bench_count (&bench, notmuch);
+    status = bench_sprinter (&bench, notmuch);
+    notmuch_database_destroy (notmuch);
+    if (status)
+	goto FAIL;
+
+    print_results (&bench, seed);
+
+    talloc_free (bench.ctx);
+    return 0;
+
+  FAIL:
+    fprintf (stderr, "Error: %s\n", notmuch_status_to_string (status));
+    return 1;
+}
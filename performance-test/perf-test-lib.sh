@@ -21,6 +21,14 @@ do
 		corpus_size=large;
 		shift
 		;;
+	--results=*)
+		results_file=${1#--results=}
+		case "$results_file" in
+		/*) ;;
+		*) results_file="$(pwd)/$results_file" ;;
+		esac
+		shift
+		;;
 	*)
 		echo "error: unknown performance test option '$1'" >&2; exit 1 ;;
 	esac
@@ -149,12 +157,20 @@ memory_run ()
 
     printf "[ %d ]\t%s\n" $test_count "$1"
 
-    NOTMUCH_TALLOC_REPORT="$talloc_log" valgrind --leak-check=full --log-file="$log_file" $2
+    # The command is split into words, but a '*' query is not a glob.
+    set -f
+    NOTMUCH_TALLOC_REPORT="$talloc_log" valgrind --leak-check=full --log-file="$log_file" $2 > $log_dir/$test_count.out
+    set +f
 
     awk '/LEAK SUMMARY/,/suppressed/ { sub(/^==[0-9]*==/," "); print }' "$log_file"
     echo
     sed -n -e 's/.*[(]total *\([^)]*\)[)]/talloced at exit: \1/p' $talloc_log
     echo
+
+    record_result memory "$1" \
+	$(sed -n -e 's/.*total heap usage: \([0-9,]*\) allocs, [0-9,]* frees, \([0-9,]*\) bytes allocated.*/allocs=\1 heap=\2/p' "$log_file" | tr -d ,) \
+	lost=$(sed -n -e 's/.*definitely lost: \([0-9,]*\) bytes.*/\1/p' "$log_file" | tr -d , | grep . || echo 0) \
+	talloc=$(sed -n -e 's/.*[(]total *\([0-9]*\) bytes.*/\1/p' $talloc_log 2>/dev/null | head -n 1 | grep . || echo 0)
 }
 
 memory_done ()
@@ -181,15 +197,38 @@ print_header ()
     printf "\t\t\tWall(s)\tUsr(s)\tSys(s)\tRes(K)\tIn/Out(512B)\n"
 }
 
+# Append one measurement to the file given with --results, as a line
+# of tab separated fields: the kind of test, the script, the corpus
+# size, the name of the measurement and then name=value pairs.
+record_result ()
+{
+    local kind="$1" name="$2"
+    shift 2
+
+    test -n "$results_file" || return 0
+
+    {
+	printf "%s\t%s\t%s\t%s" "$kind" "$(basename "$0" .sh)" "$corpus_size" "$name"
+	printf "\t%s" "$@"
+	printf "\n"
+    } >> "$results_file"
+}
+
 time_run ()
 {
+    local time_file="${TMP_DIRECTORY}/time.output"
+
     printf "  %-22s" "$1"
     test_count=$(($test_count+1))
     if test "$verbose" != "t"; then exec 4>test.output 3>&4; fi
-    if ! eval >&3 "/usr/bin/time -f '%e\t%U\t%S\t%M\t%I/%O' $2" ; then
+    if ! eval >&3 "/usr/bin/time -o '$time_file' -f '%e\t%U\t%S\t%M\t%I/%O' $2" ; then
+	cat "$time_file" >&2
 	test_failure=$(($test_failure + 1))
 	return 1
     fi
+    cat "$time_file"
+    record_result time "$1" \
+	$(awk -F'\t' '{ printf "wall=%s usr=%s sys=%s res=%s", $1, $2, $3, $4 }' "$time_file")
     return 0
 }
 
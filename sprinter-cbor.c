@@ -0,0 +1,201 @@
+/* notmuch - Not much of an email program, (just index and search)
+ *
+ * Copyright © 2026 agent
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ * Author: agent <agent@local>
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <talloc.h>
+#include "sprinter.h"
+
+/* A structure printer emitting CBOR (RFC 7049).  Maps and lists are
+ * written with indefinite length, since their size is not known when
+ * they begin, and each top-level value is a complete CBOR data item,
+ * so the output is a sequence of items in the order JSON output
+ * would have them.  Strings are written with their length up front
+ * and need no escaping.  Those that are not valid UTF-8, such as some
+ * file names, are written as byte strings rather than text strings. */
+
+enum {
+    CBOR_UNSIGNED = 0,
+    CBOR_NEGATIVE = 1,
+    CBOR_BYTES = 2,
+    CBOR_TEXT = 3,
+    CBOR_ARRAY = 4,
+    CBOR_MAP = 5,
+};
+
+#define CBOR_INDEFINITE 31
+#define CBOR_FALSE 0xf4
+#define CBOR_TRUE 0xf5
+#define CBOR_NULL 0xf6
+#define CBOR_BREAK 0xff
+
+struct sprinter_cbor {
+    struct sprinter vtable;
+    FILE *stream;
+};
+
+/* Write the initial byte of a data item of type 'major' with argument
+ * 'value', followed by the bytes of 'value' if it does not fit. */
+static void
+cbor_head (struct sprinter_cbor *spc, int major, uint64_t value)
+{
+    unsigned char buf[9];
+    int len, i;
+
+    if (value < 24) {
+	buf[0] = major << 5 | value;
+	len = 0;
+    } else if (value <= UINT8_MAX) {
+	buf[0] = major << 5 | 24;
+	len = 1;
+    } else if (value <= UINT16_MAX) {
+	buf[0] = major << 5 | 25;
+	len = 2;
+    } else if (value <= UINT32_MAX) {
+	buf[0] = major << 5 | 26;
+	len = 4;
+    } else {
+	buf[0] = major << 5 | 27;
+	len = 8;
+    }
+
+    /* Big-endian. */
+    for (i = len; i > 0; i--) {
+	buf[i] = value & 0xff;
+	value >>= 8;
+    }
+
+    fwrite (buf, 1, len + 1, spc->stream);
+}
+
+static void
+cbor_begin_map (struct sprinter *sp)
+{
+    struct sprinter_cbor *spc = (struct sprinter_cbor *) sp;
+
+    fputc (CBOR_MAP << 5 | CBOR_INDEFINITE, spc->stream);
+}
+
+static void
+cbor_begin_list (struct sprinter *sp)
+{
+    struct sprinter_cbor *spc = (struct sprinter_cbor *) sp;
+
+    fputc (CBOR_ARRAY << 5 | CBOR_INDEFINITE, spc->stream);
+}
+
+static void
+cbor_end (struct sprinter *sp)
+{
+    struct sprinter_cbor *spc = (struct sprinter_cbor *) sp;
+
+    fputc (CBOR_BREAK, spc->stream);
+}
+
+static void
+cbor_string_len (struct sprinter *sp, const char *val, size_t len)
+{
+    struct sprinter_cbor *spc = (struct sprinter_cbor *) sp;
+
+    cbor_head (spc, g_utf8_validate (val, len, NULL) ? CBOR_TEXT : CBOR_BYTES,
+	       len);
+    fwrite (val, 1, len, spc->stream);
+}
+
+static void
+cbor_string (struct sprinter *sp, const char *val)
+{
+    if (val == NULL)
+	val = "";
+    cbor_string_len (sp, val, strlen (val));
+}
+
+static void
+cbor_integer (struct sprinter *sp, int val)
+{
+    struct sprinter_cbor *spc = (struct sprinter_cbor *) sp;
+
+    if (val >= 0)
+	cbor_head (spc, CBOR_UNSIGNED, val);
+    else
+	cbor_head (spc, CBOR_NEGATIVE, -(val + 1));
+}
+
+static void
+cbor_boolean (struct sprinter *sp, notmuch_bool_t val)
+{
+    struct sprinter_cbor *spc = (struct sprinter_cbor *) sp;
+
+    fputc (val ? CBOR_TRUE : CBOR_FALSE, spc->stream);
+}
+
+static void
+cbor_null (struct sprinter *sp)
+{
+    struct sprinter_cbor *spc = (struct sprinter_cbor *) sp;
+
+    fputc (CBOR_NULL, spc->stream);
+}
+
+static void
+cbor_map_key (struct sprinter *sp, const char *key)
+{
+    cbor_string (sp, key);
+}
+
+static void
+cbor_set_prefix (unused (struct sprinter *sp), unused (const char *name))
+{
+}
+
+static void
+cbor_separator (unused (struct sprinter *sp))
+{
+}
+
+struct sprinter *
+sprinter_cbor_create (const void *ctx, FILE *stream)
+{
+    static const struct sprinter_cbor template = {
+	.vtable = {
+	    .begin_map = cbor_begin_map,
+	    .begin_list = cbor_begin_list,
+	    .end = cbor_end,
+	    .string = cbor_string,
+	    .string_len = cbor_string_len,
+	    .integer = cbor_integer,
+	    .boolean = cbor_boolean,
+	    .null = cbor_null,
+	    .map_key = cbor_map_key,
+	    .separator = cbor_separator,
+	    .set_prefix = cbor_set_prefix,
+	    .is_text_printer = FALSE,
+	}
+    };
+    struct sprinter_cbor *res;
+
+    res = talloc (ctx, struct sprinter_cbor);
+    if (! res)
+	return NULL;
+
+    *res = template;
+    res->stream = stream;
+    return &res->vtable;
+}
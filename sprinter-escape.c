@@ -0,0 +1,101 @@
+/* notmuch - Not much of an email program, (just index and search)
+ *
+ * Copyright © 2026 agent
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ * Author: agent <agent@local>
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "sprinter.h"
+
+/* Most of what the structured printers output is message text that
+ * needs no quoting at all.  Rather than writing strings a byte at a
+ * time, find the runs of bytes that can be copied as they are, eight
+ * bytes at a time, and write each run with a single call. */
+
+#define ONES  0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+
+/* Non-zero if any byte of 'word' is a control character, '"' or
+ * '\\'.  The tests are exact: bytes of 0x80 and above (as in UTF-8
+ * sequences) never match. */
+static inline uint64_t
+_word_needs_escape (uint64_t word)
+{
+    uint64_t quote = word ^ (ONES * '"');
+    uint64_t backslash = word ^ (ONES * '\\');
+
+    return ((word - ONES * 0x20) |
+	    (quote - ONES) |
+	    (backslash - ONES)) & ~word & HIGHS;
+}
+
+static inline notmuch_bool_t
+_byte_needs_escape (unsigned char ch)
+{
+    return ch < 0x20 || ch == '"' || ch == '\\';
+}
+
+/* Return the length of the longest prefix of 'val' (of 'len' bytes)
+ * that needs no escaping. */
+static size_t
+_escape_span (const char *val, size_t len)
+{
+    size_t i = 0;
+
+    for (; i + sizeof (uint64_t) <= len; i += sizeof (uint64_t)) {
+	uint64_t word;
+
+	memcpy (&word, val + i, sizeof (word));
+	if (_word_needs_escape (word))
+	    break;
+    }
+
+    while (i < len && ! _byte_needs_escape (val[i]))
+	i++;
+
+    return i;
+}
+
+void
+sprinter_write_escaped (FILE *stream, const char *val, size_t len,
+			const char *const *escapes, size_t num_escapes,
+			const char *control_format)
+{
+    while (len) {
+	size_t span = _escape_span (val, len);
+	unsigned char ch;
+
+	if (span) {
+	    fwrite (val, 1, span, stream);
+	    val += span;
+	    len -= span;
+	    if (! len)
+		break;
+	}
+
+	ch = *val;
+	if (ch < num_escapes && escapes[ch])
+	    fputs (escapes[ch], stream);
+	else if (ch >= 32)
+	    fputc (ch, stream);
+	else
+	    fprintf (stream, control_format, ch);
+	val++;
+	len--;
+    }
+}
@@ -103,15 +103,8 @@ json_string_len (struct sprinter *sp, const char *val, size_t len)
     struct sprinter_json *spj = json_begin_value (sp);
 
     fputc ('"', spj->stream);
-    for (; len; ++val, --len) {
-	unsigned char ch = *val;
-	if (ch < ARRAY_SIZE (escapes) && escapes[ch])
-	    fputs (escapes[ch], spj->stream);
-	else if (ch >= 32)
-	    fputc (ch, spj->stream);
-	else
-	    fprintf (spj->stream, "\\u%04x", ch);
-    }
+    sprinter_write_escaped (spj->stream, val, len,
+			    escapes, ARRAY_SIZE (escapes), "\\u%04x");
     fputc ('"', spj->stream);
 }
 
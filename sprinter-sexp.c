@@ -118,15 +118,8 @@ sexp_string_len (struct sprinter *sp, const char *val, size_t len)
     struct sprinter_sexp *sps = sexp_begin_value (sp);
 
     fputc ('"', sps->stream);
-    for (; len; ++val, --len) {
-	unsigned char ch = *val;
-	if (ch < ARRAY_SIZE (escapes) && escapes[ch])
-	    fputs (escapes[ch], sps->stream);
-	else if (ch >= 32)
-	    fputc (ch, sps->stream);
-	else
-	    fprintf (sps->stream, "\\%03o", ch);
-    }
+    sprinter_write_escaped (sps->stream, val, len,
+			    escapes, ARRAY_SIZE (escapes), "\\%03o");
     fputc ('"', sps->stream);
 }
 
@@ -81,4 +81,18 @@ sprinter_json_create (const void *ctx, FILE *stream);
 struct sprinter *
 sprinter_sexp_create (const void *ctx, FILE *stream);
 
+/* Create a new structure printer that emits CBOR. */
+struct sprinter *
+sprinter_cbor_create (const void *ctx, FILE *stream);
+
+/* Write the 'len' bytes of 'val' to 'stream' for a quoted string.
+ * Each byte ch with escapes[ch] set (for ch < num_escapes) is written
+ * as that escape, and other control characters with
+ * 'control_format'.  Only control characters, '"' and '\\' may have
+ * escapes; all other bytes are copied as they are. */
+void
+sprinter_write_escaped (FILE *stream, const char *val, size_t len,
+			const char *const *escapes, size_t num_escapes,
+			const char *control_format);
+
 #endif // NOTMUCH_SPRINTER_H
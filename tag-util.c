@@ -331,6 +331,48 @@ tag_op_list_apply (notmuch_message_t *message,
 
 }
 
+static notmuch_bool_t
+_flag_is_set (void *closure)
+{
+    return *(volatile sig_atomic_t *) closure != 0;
+}
+
+notmuch_status_t
+tag_op_list_apply_query (notmuch_query_t *query,
+			 tag_op_list_t *list,
+			 unsigned int *changed,
+			 volatile sig_atomic_t *interrupted)
+{
+    notmuch_tag_op_t *ops;
+    notmuch_status_t status;
+    unsigned int query_changed;
+    size_t i;
+
+    ops = talloc_array (list, notmuch_tag_op_t, list->count);
+    if (ops == NULL && list->count) {
+	fprintf (stderr, "Error: Out of memory.\n");
+	return NOTMUCH_STATUS_OUT_OF_MEMORY;
+    }
+
+    for (i = 0; i < list->count; i++) {
+	ops[i].tag = list->ops[i].tag;
+	ops[i].remove = list->ops[i].remove;
+    }
+
+    status = notmuch_query_apply_tag_ops (query, ops, list->count,
+					  &query_changed,
+					  interrupted ? _flag_is_set : NULL,
+					  (void *) interrupted);
+    if (changed)
+	*changed += query_changed;
+    if (status)
+	fprintf (stderr, "Error applying tags to messages matching %s: %s\n",
+		 notmuch_query_get_query_string (query),
+		 notmuch_status_to_string (status));
+
+    talloc_free (ops);
+    return status;
+}
 
 /* Array of tagging operations (add or remove.  Size will be increased
  * as necessary. */
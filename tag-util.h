@@ -131,6 +131,26 @@ tag_op_list_apply (notmuch_message_t *message,
 		   tag_op_list_t *tag_ops,
 		   tag_op_flag_t flags);
 
+/*
+ * Apply a list of tag operations, in order, to every message matching
+ * a query, using notmuch_query_apply_tag_ops.
+ *
+ * This does not support TAG_FLAG_MAILDIR_SYNC or TAG_FLAG_REMOVE_ALL;
+ * callers needing those must use tag_op_list_apply on each message.
+ *
+ * If 'changed' is not NULL, the number of messages whose tags changed
+ * is added to it.
+ *
+ * If 'interrupted' is not NULL, no further message is changed once
+ * it becomes non-zero (typically from a signal handler).
+ */
+
+notmuch_status_t
+tag_op_list_apply_query (notmuch_query_t *query,
+			 tag_op_list_t *tag_ops,
+			 unsigned int *changed,
+			 volatile sig_atomic_t *interrupted);
+
 /*
  * Return the number of operations in a list
  */
@@ -93,5 +93,37 @@ notmuch count --output=messages >>EXPECTED
 notmuch count --output=messages tag:inbox >>EXPECTED
 test_expect_equal_file EXPECTED OUTPUT
 
+notmuch tag +deleted from:cworth and tag:unread
+notmuch config set search.exclude_tags deleted
+
+cat >INPUT <<EOF
+from:cworth
+tag:deleted
+from:cworth
+
+tag:inbox and not tag:deleted
+from:cworth
+EOF
+
+for output in messages threads; do
+    test_begin_subtest "batch $output count with excluded tags"
+    notmuch count --input=INPUT --output=$output >OUTPUT
+    rm -f EXPECTED
+    while read -r query; do
+	notmuch count --output=$output "$query" >>EXPECTED
+    done <INPUT
+    test_expect_equal_file EXPECTED OUTPUT
+
+    test_begin_subtest "batch $output count with --exclude=false"
+    notmuch count --input=INPUT --output=$output --exclude=false >OUTPUT
+    rm -f EXPECTED
+    while read -r query; do
+	notmuch count --output=$output --exclude=false "$query" >>EXPECTED
+    done <INPUT
+    test_expect_equal_file EXPECTED OUTPUT
+done
+
+notmuch config set search.exclude_tags
+notmuch tag -deleted tag:deleted
 
 test_done
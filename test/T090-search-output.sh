@@ -443,4 +443,32 @@ notmuch search --format=json "no-message-matches-this" > OUTPUT
 echo "[]" >EXPECTED
 test_expect_equal_file OUTPUT EXPECTED
 
+test_begin_subtest "--jobs=4 gives the same summaries in the same order"
+notmuch search '*' > EXPECTED
+notmuch search --jobs=4 '*' > OUTPUT
+test_expect_equal_file OUTPUT EXPECTED
+
+test_begin_subtest "--jobs=4 with --format=json"
+notmuch search --format=json --sort=oldest-first 'from:cworth or tag:inbox' > EXPECTED
+notmuch search --format=json --sort=oldest-first --jobs=4 'from:cworth or tag:inbox' > OUTPUT
+test_expect_equal_file OUTPUT EXPECTED
+
+test_begin_subtest "--jobs=3 with --offset and --limit"
+notmuch search --offset=5 --limit=11 '*' > EXPECTED
+notmuch search --jobs=3 --offset=5 --limit=11 '*' > OUTPUT
+test_expect_equal_file OUTPUT EXPECTED
+
+test_expect_code 1 "--jobs=0 is an error" "notmuch search --jobs=0 '*'"
+
+test_begin_subtest "--jobs=2 with excluded messages"
+notmuch tag +deleted from:cworth
+notmuch config set search.exclude_tags deleted
+for x in true flag all; do
+    notmuch search --format=json --exclude=$x 'tag:inbox' >> EXPECTED.excl
+    notmuch search --format=json --exclude=$x --jobs=2 'tag:inbox' >> OUTPUT.excl
+done
+notmuch config set search.exclude_tags
+notmuch tag -deleted from:cworth
+test_expect_equal_file OUTPUT.excl EXPECTED.excl
+
 test_done
@@ -145,4 +145,22 @@ cat <<EOF >EXPECTED
 EOF
 test_expect_equal_file OUTPUT EXPECTED
 
+test_begin_subtest "Group members and mailboxes without a name"
+add_message '[to]="Team: Alice <alice@example.com>, bob@example.com;"' \
+    '[cc]="carol@example.com"' '[subject]="address groups"'
+notmuch address --output=recipients id:${gen_msg_id} >OUTPUT
+cat <<EOF >EXPECTED
+Alice <alice@example.com>
+bob@example.com
+carol@example.com
+EOF
+test_expect_equal_file OUTPUT EXPECTED
+
+test_begin_subtest "Addresses are read from the database, not the message file"
+notmuch address --output=sender --output=recipients --format=json id:${gen_msg_id} >EXPECTED
+mv ${gen_msg_filename} ${TMP_DIRECTORY}/address-groups
+notmuch address --output=sender --output=recipients --format=json id:${gen_msg_id} >OUTPUT
+mv ${TMP_DIRECTORY}/address-groups ${gen_msg_filename}
+test_expect_equal_file OUTPUT EXPECTED
+
 test_done
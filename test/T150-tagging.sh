@@ -62,6 +62,21 @@ test_expect_equal "$output" "\
 thread:XXX   2001-01-05 [1/1] Notmuch Test Suite; One (:\"  inbox tag1 unread)
 thread:XXX   2001-01-05 [1/1] Notmuch Test Suite; Two (inbox tag1 tag4 unread)"
 
+test_begin_subtest "Tagging without maildir synchronization"
+notmuch config set maildir.synchronize_flags false
+notmuch tag +bulk1 +bulk2 -tag1 \*
+notmuch tag -bulk2 +bulk2 -bulk1 One
+output=$(notmuch search \* | notmuch_search_sanitize)
+test_expect_equal "$output" "\
+thread:XXX   2001-01-05 [1/1] Notmuch Test Suite; One (:\"  bulk2 inbox unread)
+thread:XXX   2001-01-05 [1/1] Notmuch Test Suite; Two (bulk1 bulk2 inbox tag4 unread)"
+
+test_begin_subtest "Tagging without maildir synchronization matches tag: search"
+output=$(notmuch count tag:bulk1)
+test_expect_equal "$output" "1"
+notmuch tag -bulk1 -bulk2 +tag1 \*
+notmuch config set maildir.synchronize_flags true
+
 test_begin_subtest "--batch"
 notmuch tag --batch <<EOF
 # %20 is a space in tag
@@ -102,6 +117,38 @@ notmuch search \* | notmuch_search_sanitize > OUTPUT
 notmuch restore --format=batch-tag < backup.tags
 test_expect_equal_file batch.expected OUTPUT
 
+test_begin_subtest "--batch --transaction-size=1"
+notmuch dump --format=batch-tag > backup.tags
+notmuch tag --batch --transaction-size=1 --input=batch.in
+notmuch search \* | notmuch_search_sanitize > OUTPUT
+notmuch restore --format=batch-tag < backup.tags
+test_expect_equal_file batch.expected OUTPUT
+
+test_begin_subtest "--batch: lines see the changes of earlier lines"
+notmuch dump --format=batch-tag > backup.tags
+notmuch tag --batch <<EOF
++chain1 -- One
++chain2 +other -- tag:chain1
+-chain1 -- tag:chain2
++more -- One
+-other -- tag:more
+EOF
+output=$(notmuch search tag:chain1 or tag:chain2 or tag:other or tag:more | notmuch_search_sanitize)
+notmuch restore --format=batch-tag < backup.tags
+test_expect_equal "$output" "thread:XXX   2001-01-05 [1/1] Notmuch Test Suite; One (chain2 inbox more tag5 unread)"
+
+test_begin_subtest "--batch: later lines undo the changes of earlier lines"
+notmuch dump --format=batch-tag > backup.tags
+notmuch tag --batch <<EOF
++undone -inbox -- One
+-undone +inbox -- One
++quoted%20tag -- One
++after -- tag:"quoted tag"
+EOF
+output=$(notmuch search One | notmuch_search_sanitize)
+notmuch restore --format=batch-tag < backup.tags
+test_expect_equal "$output" "thread:XXX   2001-01-05 [1/1] Notmuch Test Suite; One (after inbox quoted tag tag5 unread)"
+
 test_begin_subtest "--batch, blank lines and comments"
 notmuch dump | sort > EXPECTED
 notmuch tag --batch <<EOF
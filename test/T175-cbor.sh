@@ -0,0 +1,108 @@
+#!/usr/bin/env bash
+test_description="--format=cbor output"
+. ./test-lib.sh
+
+add_email_corpus
+
+# Decode a sequence of CBOR items from stdin and print each as
+# normalized JSON, one per line.
+cat <<'EOF' > cbor2json.py
+import json, sys
+
+data = bytearray(getattr(sys.stdin, 'buffer', sys.stdin).read())
+BREAK = object()
+
+def item(pos):
+    byte = data[pos]
+    pos += 1
+    major, info = byte >> 5, byte & 31
+    if byte == 0xff:
+        return BREAK, pos
+    if major == 7:
+        return {20: False, 21: True, 22: None}[info], pos
+    if info == 31:
+        items = []
+        while True:
+            value, pos = item(pos)
+            if value is BREAK:
+                break
+            items.append(value)
+        if major == 5:
+            return dict(zip(items[::2], items[1::2])), pos
+        return items, pos
+    if info < 24:
+        value = info
+    else:
+        size = 1 << (info - 24)
+        value = 0
+        for byte in data[pos:pos + size]:
+            value = value << 8 | byte
+        pos += size
+    if major == 0:
+        return value, pos
+    if major == 1:
+        return -1 - value, pos
+    if major == 2:
+        return data[pos:pos + value].decode('latin-1'), pos + value
+    if major == 3:
+        return data[pos:pos + value].decode('utf-8'), pos + value
+    raise ValueError('unexpected major type %d' % major)
+
+pos = 0
+while pos < len(data):
+    value, pos = item(pos)
+    print(json.dumps(value, sort_keys=True))
+EOF
+
+cat <<'EOF' > normalize.py
+import json, sys
+
+print(json.dumps(json.loads(sys.stdin.read()), sort_keys=True))
+EOF
+
+test_cbor_equals_json () {
+    notmuch "$@" --format=json > json.out
+    notmuch "$@" --format=cbor > cbor.out
+    python normalize.py < json.out > EXPECTED
+    python cbor2json.py < cbor.out > OUTPUT
+    test_expect_equal_file EXPECTED OUTPUT
+}
+
+test_begin_subtest "Encoding of strings, lists and the end of lists"
+notmuch search --format=cbor --output=tags id:877h1wv7mg.fsf@inf-8657.int-evry.fr |
+    od -An -tx1 -v | tr -d '\n' > OUTPUT
+echo >> OUTPUT
+cat <<EOF > EXPECTED
+ 9f 65 69 6e 62 6f 78 66 75 6e 72 65 61 64 ff
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "search summary"
+test_cbor_equals_json search from:cworth
+
+test_begin_subtest "search --output=messages"
+test_cbor_equals_json search --output=messages '*'
+
+test_begin_subtest "search --output=files"
+test_cbor_equals_json search --output=files from:cworth
+
+test_begin_subtest "show"
+test_cbor_equals_json show id:877h1wv7mg.fsf@inf-8657.int-evry.fr
+
+test_begin_subtest "show --body=false"
+test_cbor_equals_json show --body=false from:cworth
+
+test_begin_subtest "reply"
+test_cbor_equals_json reply id:877h1wv7mg.fsf@inf-8657.int-evry.fr
+
+test_begin_subtest "address"
+test_cbor_equals_json address --output=sender --output=recipients '*'
+
+test_begin_subtest "Strings that are not UTF-8 are byte strings"
+add_message "[filename]=$(printf 'latin1-\351')" '[subject]="Latin-1 file name"'
+notmuch search --format=cbor --output=files 'subject:"Latin-1 file name"' |
+    python cbor2json.py > OUTPUT
+echo "[\"${MAIL_DIR}/latin1-\\u00e9\"]" > EXPECTED
+test_expect_equal_file EXPECTED OUTPUT
+
+test_done
@@ -9,4 +9,12 @@ add_message '[subject]="author-naming: Initial thread subject"' \
 output=$(notmuch search --sort=oldest-first author-naming and tag:inbox | notmuch_search_sanitize)
 test_expect_equal "$output" "thread:XXX   2001-01-05 [1/1] address@example.com; author-naming: Initial thread subject (inbox unread)"
 
+test_begin_subtest "Author is taken from the index"
+add_message '[subject]="author-naming: indexed author"' \
+	    '[date]="Sat, 06 Jan 2001 15:43:56 -0000"' \
+	    '[from]="Last, First <first.last@example.com>"'
+sed -i 's/^From: .*/From: Someone Else <someone@example.com>/' $gen_msg_filename
+output=$(notmuch search author-naming and subject:indexed | notmuch_search_sanitize)
+test_expect_equal "$output" "thread:XXX   2001-01-06 [1/1] First Last; author-naming: indexed author (inbox unread)"
+
 test_done
@@ -94,6 +94,17 @@ notmuch restore --input=backup.gz
 notmuch dump --output=dump.actual
 test_expect_equal_file dump.expected dump.actual
 
+test_begin_subtest "restoring concatenated gzip members"
+(head -n 20 dump.expected | gzip; tail -n +21 dump.expected | gzip) > backup.gz
+notmuch tag +new_tag '*'
+notmuch restore --input=backup.gz
+notmuch dump --output=dump.actual
+test_expect_equal_file dump.expected dump.actual
+
+gzip -c dump.expected | head -c 100 > truncated.gz
+test_expect_code 1 "restoring truncated gzip input fails" \
+    "notmuch restore --input=truncated.gz"
+
 # Note, we assume all messages from cworth have a message-id
 # containing cworth.org
 
@@ -111,6 +122,19 @@ test_begin_subtest "dump --output=outfile -- from:cworth"
 notmuch dump --output=dump-outfile-dash-inbox.actual -- from:cworth
 test_expect_equal_file dump-cworth.expected dump-outfile-dash-inbox.actual
 
+test_begin_subtest "dump agrees with the tags of each message"
+for id in $(notmuch search --output=messages from:cworth); do
+    echo $(notmuch search --output=tags $id | sed 's/^/+/') -- $id
+done | sort > EXPECTED
+notmuch dump --format=batch-tag -- from:cworth | sort > OUTPUT
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "dump of a single message"
+id=$(notmuch search --output=messages from:cworth | head -1)
+echo $(notmuch search --output=tags $id | sed 's/^/+/') -- $id > EXPECTED
+notmuch dump --format=batch-tag -- $id > OUTPUT
+test_expect_equal_file EXPECTED OUTPUT
+
 test_begin_subtest "Check for a safe set of message-ids"
 notmuch search --output=messages from:cworth | sed s/^id:// > EXPECTED
 notmuch search --output=messages from:cworth | sed s/^id:// |\
@@ -295,17 +319,30 @@ Warning: no query string after -- [+c +d --]
 Warning: hex decoding of tag %zz failed [+%zz -- id:whatever]
 Warning: cannot parse query: id:" (skipping)
 Warning: not an id query: tag:abc (skipping)
-Warning: cannot apply tags to missing message: missing_message_id
 Warning: cannot parse query: id:some)stuff (skipping)
 Warning: cannot parse query: id:some stuff (skipping)
-Warning: cannot apply tags to missing message: some"stuff
-Warning: cannot apply tags to missing message: a_message_id_with"_a_quote
 Warning: cannot apply tags to missing message: a message id with spaces
+Warning: cannot apply tags to missing message: a_message_id_with"_a_quote
 Warning: cannot apply tags to missing message: an_id_with_leading_and_trailing_ws
+Warning: cannot apply tags to missing message: missing_message_id
+Warning: cannot apply tags to missing message: some"stuff
 EOF
 
 test_expect_equal_file EXPECTED OUTPUT
 
+test_begin_subtest 'restore: later lines for a message win'
+notmuch dump id:20091117232137.GA7669@griffis1.net > BACKUP
+notmuch restore <<EOF
++first -- id:20091117232137.GA7669@griffis1.net
++second -- id:20091117232137.GA7669@griffis1.net
+EOF
+notmuch dump id:20091117232137.GA7669@griffis1.net > OUTPUT
+notmuch restore < BACKUP
+cat <<EOF > EXPECTED
++second -- id:20091117232137.GA7669@griffis1.net
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
 test_begin_subtest 'roundtripping random message-ids and tags'
 
     ${TEST_DIRECTORY}/random-corpus --config-path=${NOTMUCH_CONFIG} \
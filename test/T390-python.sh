@@ -36,4 +36,38 @@ print db.find_message_by_filename("i-dont-exist")
 EOF
 test_expect_equal "$(cat OUTPUT)" "None"
 
+test_begin_subtest "message properties in bulk"
+test_python <<EOF
+import notmuch
+db = notmuch.Database(mode=notmuch.Database.MODE.READ_ONLY)
+def describe(msgs):
+    return [(m.get_message_id(), m.get_thread_id(), m.get_date(),
+             int(m.get_flag(notmuch.Message.FLAG.MATCH)), list(m.get_tags()))
+            for m in msgs]
+expected = describe(notmuch.Query(db, '*').search_messages())
+msgs = notmuch.Query(db, '*').search_messages()
+first = msgs.get_info(7)
+info = first + list(msgs.iter_info(batch=5))
+print len(first), len(info) == len(expected)
+print [(i.message_id, i.thread_id, i.date, i.flags & 1, i.tags)
+       for i in info] == expected
+EOF
+cat <<EOF > EXPECTED
+7 True
+True
+EOF
+test_expect_equal_file OUTPUT EXPECTED
+
+test_begin_subtest "message properties in bulk from a thread"
+test_python <<EOF
+import notmuch
+db = notmuch.Database(mode=notmuch.Database.MODE.READ_ONLY)
+query = 'id:877h1wv7mg.fsf@inf-8657.int-evry.fr'
+thread = next(notmuch.Query(db, query).search_threads())
+ids = [m.get_message_id() for m in thread.get_toplevel_messages()]
+thread = next(notmuch.Query(db, query).search_threads())
+print ids == [i.message_id for i in thread.get_toplevel_messages().get_info()]
+EOF
+test_expect_equal "$(cat OUTPUT)" "True"
+
 test_done
@@ -0,0 +1,122 @@
+#!/usr/bin/env bash
+test_description="doc id sets"
+. ./test-lib.sh
+
+# Tests of the doc id set container independent of any database
+
+doc_id_set ()
+{
+    ${TEST_DIRECTORY}/doc-id-set
+}
+
+test_begin_subtest "Empty set"
+doc_id_set <<EOF >OUTPUT
+count
+list
+contains 0 1 65536
+next 0
+EOF
+cat <<EOF >EXPECTED
+0
+
+0 0 0
+none
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Duplicate doc ids are added once"
+doc_id_set <<EOF >OUTPUT
+add 5 3 5 1 3
+add 3
+count
+list
+EOF
+cat <<EOF >EXPECTED
+3
+1 3 5
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Doc ids added out of order are listed in order"
+doc_id_set <<EOF >OUTPUT
+add 200000 7 65536 65535 131072 0 4294967295
+count
+list
+contains 65535 65537 0 4294967295 4294967294
+EOF
+cat <<EOF >EXPECTED
+7
+0 7 65535 65536 131072 200000 4294967295
+1 0 1 1 0
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Next member across containers"
+doc_id_set <<EOF >OUTPUT
+add 7 65535 131072 200000
+next 0
+next 8
+next 65536
+next 131073
+next 200001
+EOF
+cat <<EOF >EXPECTED
+7
+65535
+131072
+200000
+none
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Remove members"
+doc_id_set <<EOF >OUTPUT
+add 1 2 3 65536 65537
+remove 65536 2 99 65537
+count
+list
+contains 2 65536 65537
+EOF
+cat <<EOF >EXPECTED
+2
+1 3
+0 0 0
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Dense containers"
+doc_id_set <<EOF >OUTPUT
+range 0 20000 2
+range 0 20000 4
+add 20001 3
+count
+contains 19998 19999 20000 20001 3 5
+next 19999
+remove 20000 3
+count
+list
+EOF
+cat <<EOF >EXPECTED
+10003
+1 0 1 1 1 0
+20000
+10001
+$(seq -s ' ' 0 2 19998) 20001
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Intersection"
+doc_id_set <<EOF >OUTPUT
+range 0 20000 2
+add 70000 70001 200000
+intersect 3 4 70000 99999 200000 20000
+count
+list
+EOF
+cat <<EOF >EXPECTED
+4
+4 20000 70000 200000
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_done
@@ -27,6 +27,8 @@ test_expect_equal "$output" ""
 
 test_expect_success 'pre upgrade dump' 'notmuch dump | sort > pre-upgrade-dump'
 
+test_expect_success 'pre upgrade search' 'notmuch search "*" > pre-upgrade-search'
+
 test_begin_subtest "database upgrade from format version 1"
 output=$(notmuch new | sed -e 's/^Backing up tags to .*$/Backing up tags to FILENAME/')
 test_expect_equal "$output" "\
@@ -40,6 +42,10 @@ test_begin_subtest "tag backup matches pre-upgrade dump"
 gunzip -c ${MAIL_DIR}/.notmuch/dump-*.gz | sort > backup-dump
 test_expect_equal_file pre-upgrade-dump backup-dump
 
+test_begin_subtest "thread summaries built by the upgrade match the messages"
+notmuch search "*" > post-upgrade-search
+test_expect_equal_file pre-upgrade-search post-upgrade-search
+
 test_begin_subtest "folder: no longer matches in the middle of path"
 output=$(notmuch search folder:baz)
 test_expect_equal "$output" ""
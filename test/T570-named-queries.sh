@@ -0,0 +1,189 @@
+#!/usr/bin/env bash
+test_description="named queries"
+
+. ./test-lib.sh
+
+add_email_corpus
+
+test_expect_success "building database" "NOTMUCH_NEW"
+
+cat <<'EOF' > c_head
+#include <stdio.h>
+#include <stdlib.h>
+#include <notmuch.h>
+
+int main (int argc, char** argv)
+{
+   notmuch_database_t *db;
+   notmuch_status_t stat;
+
+   stat = notmuch_database_open (argv[1], NOTMUCH_DATABASE_MODE_READ_WRITE, &db);
+   if (stat != NOTMUCH_STATUS_SUCCESS) {
+     fprintf (stderr, "error opening database: %d\n", stat);
+   }
+EOF
+cat <<'EOF' > c_tail
+   if (stat)
+       fprintf (stderr, "%s\n", notmuch_status_to_string (stat));
+   notmuch_database_destroy (db);
+}
+EOF
+
+test_begin_subtest "Store named queries"
+cat c_head - c_tail <<'EOF' | test_C ${MAIL_DIR}
+   stat = notmuch_database_set_named_query (db, "carl", "from:cworth");
+   if (! stat)
+       stat = notmuch_database_set_named_query (db, "carl-inbox", "query:carl and tag:inbox");
+EOF
+cat <<'EOF' >EXPECTED
+== stdout ==
+== stderr ==
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Retrieve a named query"
+cat c_head - c_tail <<'EOF' | test_C ${MAIL_DIR}
+   {
+       char *query_string;
+       stat = notmuch_database_get_named_query (db, "carl-inbox", &query_string);
+       printf ("%s\n", query_string);
+       free (query_string);
+   }
+EOF
+cat <<'EOF' >EXPECTED
+== stdout ==
+query:carl and tag:inbox
+== stderr ==
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Retrieve an unknown named query"
+cat c_head - c_tail <<'EOF' | test_C ${MAIL_DIR}
+   {
+       char *query_string;
+       stat = notmuch_database_get_named_query (db, "nonexistent", &query_string);
+       printf ("%s\n", query_string ? query_string : "(null)");
+   }
+EOF
+cat <<'EOF' >EXPECTED
+== stdout ==
+(null)
+== stderr ==
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Reject an invalid query name"
+cat c_head - c_tail <<'EOF' | test_C ${MAIL_DIR}
+   stat = notmuch_database_set_named_query (db, "two words", "tag:inbox");
+EOF
+cat <<'EOF' >EXPECTED
+== stdout ==
+== stderr ==
+Illegal argument for function
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Search with a named query"
+notmuch search from:cworth > EXPECTED
+notmuch search query:carl > OUTPUT
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Count with a nested named query"
+test_expect_equal "$(notmuch count query:carl-inbox)" \
+    "$(notmuch count from:cworth and tag:inbox)"
+
+test_begin_subtest "Combine a named query with other terms"
+notmuch search --output=messages from:cworth and not tag:inbox > EXPECTED
+notmuch search --output=messages query:carl and not query:carl-inbox > OUTPUT
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Changes are seen by later queries"
+cat c_head - c_tail <<'EOF' | test_C ${MAIL_DIR}
+   {
+       notmuch_query_t *query = notmuch_query_create (db, "query:carl-inbox");
+       notmuch_messages_t *messages;
+       notmuch_message_t *message;
+       unsigned before = notmuch_query_count_messages (query);
+
+       stat = notmuch_query_search_messages_st (query, &messages);
+       message = notmuch_messages_get (messages);
+       notmuch_message_remove_tag (message, "inbox");
+       printf ("%d\n", before - notmuch_query_count_messages (query));
+       notmuch_message_add_tag (message, "inbox");
+       printf ("%d\n", before - notmuch_query_count_messages (query));
+   }
+EOF
+cat <<'EOF' >EXPECTED
+== stdout ==
+1
+0
+== stderr ==
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "query: within a quoted phrase is not expanded"
+test_expect_equal "$(notmuch count '"query:carl"')" \
+    "$(notmuch count '"query carl"')"
+
+test_begin_subtest "A named query that refers to itself is an error"
+cat c_head - c_tail <<'EOF' | test_C ${MAIL_DIR}
+   {
+       notmuch_query_t *query = notmuch_query_create (db, "query:loop");
+       notmuch_messages_t *messages;
+
+       stat = notmuch_database_set_named_query (db, "loop", "tag:inbox or query:loop");
+       if (! stat)
+	   stat = notmuch_query_search_messages_st (query, &messages);
+   }
+EOF
+cat <<'EOF' >EXPECTED
+== stdout ==
+== stderr ==
+A Xapian exception occurred
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "A named query that expands too far is an error"
+cat c_head - c_tail <<'EOF' | test_C ${MAIL_DIR}
+   {
+       notmuch_query_t *query = notmuch_query_create (db, "query:x7");
+       notmuch_messages_t *messages;
+       char name[8], value[64];
+       int i;
+
+       stat = notmuch_database_set_named_query (db, "x0", "tag:inbox");
+       for (i = 1; i < 8 && ! stat; i++) {
+	   snprintf (name, sizeof (name), "x%d", i);
+	   snprintf (value, sizeof (value), "query:x%d or query:x%d or query:x%d or query:x%d",
+		     i - 1, i - 1, i - 1, i - 1);
+	   stat = notmuch_database_set_named_query (db, name, value);
+       }
+       if (! stat)
+	   stat = notmuch_query_search_messages_st (query, &messages);
+   }
+EOF
+cat <<'EOF' >EXPECTED
+== stdout ==
+== stderr ==
+A Xapian exception occurred
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Remove a named query"
+cat c_head - c_tail <<'EOF' | test_C ${MAIL_DIR}
+   {
+       char *query_string;
+       stat = notmuch_database_set_named_query (db, "carl", NULL);
+       if (! stat)
+	   stat = notmuch_database_get_named_query (db, "carl", &query_string);
+       printf ("%s\n", query_string ? query_string : "(null)");
+   }
+EOF
+cat <<'EOF' >EXPECTED
+== stdout ==
+(null)
+== stderr ==
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_done
@@ -0,0 +1,53 @@
+#!/usr/bin/env bash
+test_description="thread summaries kept in the database"
+. ./test-lib.sh
+
+add_message '[subject]="summary: first"' \
+	    '[date]="Fri, 05 Jan 2001 15:43:56 -0000"' \
+	    '[from]="Last, First <first.last@example.com>"'
+first=${gen_msg_id}
+add_message '[subject]="Re: summary: first"' \
+	    '[date]="Sat, 06 Jan 2001 15:43:56 -0000"' \
+	    "[in-reply-to]=\<$first\>"
+second=${gen_msg_filename}
+
+test_begin_subtest "Summary of a new thread"
+output=$(notmuch search summary | notmuch_search_sanitize)
+test_expect_equal "$output" "thread:XXX   2001-01-06 [2/2] First Last, Notmuch Test Suite; summary: first (inbox unread)"
+
+test_begin_subtest "Summary follows tag changes"
+notmuch tag +seen -unread id:$first
+output=$(notmuch search summary | notmuch_search_sanitize)
+test_expect_equal "$output" "thread:XXX   2001-01-06 [2/2] First Last, Notmuch Test Suite; summary: first (inbox seen unread)"
+
+test_begin_subtest "Summary of a partial match"
+output=$(notmuch search summary and tag:seen | notmuch_search_sanitize)
+test_expect_equal "$output" "thread:XXX   2001-01-05 [1/2] First Last| Notmuch Test Suite; summary: first (inbox seen unread)"
+
+test_begin_subtest "Summary follows message removal"
+rm -f $second
+NOTMUCH_NEW > /dev/null
+output=$(notmuch search summary | notmuch_search_sanitize)
+test_expect_equal "$output" "thread:XXX   2001-01-05 [1/1] First Last; summary: first (inbox seen)"
+
+test_begin_subtest "Summary follows thread merges"
+add_message '[subject]="summary: orphan"' \
+	    '[date]="Sun, 07 Jan 2001 15:43:56 -0000"' \
+	    '[id]="orphan@notmuch-test-suite"' \
+	    '[in-reply-to]="<missing@notmuch-test-suite>"'
+add_message '[subject]="summary: missing"' \
+	    '[date]="Mon, 08 Jan 2001 15:43:56 -0000"' \
+	    '[id]="missing@notmuch-test-suite"' \
+	    "[in-reply-to]=\<$first\>"
+output=$(notmuch search summary | notmuch_search_sanitize)
+test_expect_equal "$output" "thread:XXX   2001-01-08 [3/3] First Last, Notmuch Test Suite; summary: missing (inbox seen unread)"
+
+test_begin_subtest "Thread messages are loaded on demand"
+output=$(notmuch show --entire-thread=true summary and tag:seen | grep -c 'message{')
+test_expect_equal "$output" "3"
+
+test_begin_subtest "Loaded thread messages keep their match flags"
+output=$(notmuch show --entire-thread=false summary and tag:seen | grep -c 'message{')
+test_expect_equal "$output" "1"
+
+test_done
@@ -0,0 +1,97 @@
+#!/usr/bin/env bash
+test_description="message metadata shared between queries"
+. ./test-lib.sh
+
+add_email_corpus
+
+cat <<'EOF' > c_head
+#include <stdio.h>
+#include <notmuch.h>
+
+static void
+print_tags (notmuch_database_t *db, const char *query_string)
+{
+    notmuch_query_t *query = notmuch_query_create (db, query_string);
+    notmuch_messages_t *messages = notmuch_query_search_messages (query);
+    notmuch_message_t *message = notmuch_messages_get (messages);
+    notmuch_tags_t *tags;
+
+    printf ("%s", notmuch_message_get_message_id (message));
+    for (tags = notmuch_message_get_tags (message);
+	 notmuch_tags_valid (tags);
+	 notmuch_tags_move_to_next (tags))
+	printf (" %s", notmuch_tags_get (tags));
+    printf ("\n");
+    notmuch_query_destroy (query);
+}
+
+int main (int argc, char** argv)
+{
+   notmuch_database_t *db;
+   notmuch_message_t *message;
+   notmuch_status_t stat;
+
+   stat = notmuch_database_open (argv[1], NOTMUCH_DATABASE_MODE_READ_WRITE, &db);
+   if (stat != NOTMUCH_STATUS_SUCCESS) {
+     fprintf (stderr, "error opening database: %d\n", stat);
+   }
+EOF
+cat <<'EOF' > c_tail
+   if (stat)
+       fprintf (stderr, "%s\n", notmuch_status_to_string (stat));
+   notmuch_database_destroy (db);
+}
+EOF
+
+test_begin_subtest "Repeated queries see the same metadata"
+cat c_head - c_tail <<'EOF' | test_C ${MAIL_DIR}
+   print_tags (db, "id:877h1wv7mg.fsf@inf-8657.int-evry.fr");
+   print_tags (db, "id:877h1wv7mg.fsf@inf-8657.int-evry.fr");
+EOF
+cat <<'EOF' >EXPECTED
+== stdout ==
+877h1wv7mg.fsf@inf-8657.int-evry.fr inbox unread
+877h1wv7mg.fsf@inf-8657.int-evry.fr inbox unread
+== stderr ==
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Later queries see tag changes"
+cat c_head - c_tail <<'EOF' | test_C ${MAIL_DIR}
+   print_tags (db, "id:877h1wv7mg.fsf@inf-8657.int-evry.fr");
+   stat = notmuch_database_find_message (db, "877h1wv7mg.fsf@inf-8657.int-evry.fr", &message);
+   if (! stat)
+       stat = notmuch_message_add_tag (message, "cached");
+   print_tags (db, "id:877h1wv7mg.fsf@inf-8657.int-evry.fr");
+   if (! stat)
+       stat = notmuch_message_remove_tag (message, "cached");
+   print_tags (db, "id:877h1wv7mg.fsf@inf-8657.int-evry.fr");
+EOF
+cat <<'EOF' >EXPECTED
+== stdout ==
+877h1wv7mg.fsf@inf-8657.int-evry.fr inbox unread
+877h1wv7mg.fsf@inf-8657.int-evry.fr cached inbox unread
+877h1wv7mg.fsf@inf-8657.int-evry.fr inbox unread
+== stderr ==
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Uncommitted changes of a frozen message are not shared"
+cat c_head - c_tail <<'EOF' | test_C ${MAIL_DIR}
+   stat = notmuch_database_find_message (db, "877h1wv7mg.fsf@inf-8657.int-evry.fr", &message);
+   if (! stat)
+       stat = notmuch_message_freeze (message);
+   if (! stat)
+       stat = notmuch_message_add_tag (message, "frozen");
+   if (! stat)
+       notmuch_message_get_message_id (message);
+   print_tags (db, "id:877h1wv7mg.fsf@inf-8657.int-evry.fr");
+EOF
+cat <<'EOF' >EXPECTED
+== stdout ==
+877h1wv7mg.fsf@inf-8657.int-evry.fr inbox unread
+== stderr ==
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_done
@@ -0,0 +1,117 @@
+#!/usr/bin/env bash
+test_description="cached MIME structure of shown messages"
+. ./test-lib.sh
+
+cat <<EOF2 > ${MAIL_DIR}/multipart
+From: Carl Worth <cworth@cworth.org>
+To: cworth@cworth.org
+Subject: Cached multipart message
+Date: Fri, 05 Jan 2001 15:43:57 +0000
+Message-ID: <mime-cache@notmuch-test-suite>
+MIME-Version: 1.0
+Content-Type: multipart/mixed; boundary="=-=-="
+
+--=-=-=
+Content-Type: text/plain; charset=utf-8
+
+This is the first part.
+
+--=-=-=
+Content-Type: message/rfc822
+Content-Disposition: inline
+
+From: Carl Worth <cworth@cworth.org>
+To: cworth@cworth.org
+Subject: embedded message
+Date: Fri, 05 Jan 2001 15:42:57 +0000
+Message-ID: <mime-cache-embedded@notmuch-test-suite>
+Content-Type: text/html
+
+<p>This is an embedded message.</p>
+
+--=-=-=
+Content-Type: application/octet-stream
+Content-Disposition: attachment; filename=attachment
+Content-Transfer-Encoding: base64
+
+VGhpcyBpcyBhbiBhdHRhY2htZW50Lgo=
+
+--=-=-=--
+EOF2
+NOTMUCH_NEW > /dev/null
+cache_dir=${MAIL_DIR}/.notmuch/mime-cache
+
+test_begin_subtest "The cache is off by default"
+notmuch show --format=json id:mime-cache@notmuch-test-suite > /dev/null
+test_expect_equal "$(test -d $cache_dir && echo exists)" ""
+
+notmuch config set show.mime_cache true
+
+test_begin_subtest "Showing a message fills the cache"
+notmuch show --format=json id:mime-cache@notmuch-test-suite > first.json
+test_expect_equal "$(ls $cache_dir | wc -l)" "1"
+
+test_begin_subtest "JSON output from the cache"
+notmuch show --format=json id:mime-cache@notmuch-test-suite > OUTPUT
+test_expect_equal_file first.json OUTPUT
+
+test_begin_subtest "S-Expression output from the cache"
+rm -rf $cache_dir
+notmuch show --format=sexp --include-html id:mime-cache@notmuch-test-suite > EXPECTED
+notmuch show --format=sexp --include-html id:mime-cache@notmuch-test-suite > OUTPUT
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Text output from the cache"
+rm -rf $cache_dir
+notmuch show --format=text id:mime-cache@notmuch-test-suite > EXPECTED
+notmuch show --format=text id:mime-cache@notmuch-test-suite > OUTPUT
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Parts from the cache"
+notmuch show --format=json --part=4 id:mime-cache@notmuch-test-suite > EXPECTED
+notmuch show --format=json --part=4 id:mime-cache@notmuch-test-suite > OUTPUT
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "A corrupt cache is ignored"
+for file in $cache_dir/*; do
+    head -c 40 $file > $file.tmp
+    mv $file.tmp $file
+done
+notmuch show --format=json id:mime-cache@notmuch-test-suite > OUTPUT
+test_expect_equal_file first.json OUTPUT
+
+test_begin_subtest "A changed message file is parsed again"
+notmuch show --format=json id:mime-cache@notmuch-test-suite > /dev/null
+sed -i 's/the first part/a later part/' ${MAIL_DIR}/multipart
+touch -d '2001-01-01 00:00' ${MAIL_DIR}/multipart
+output=$(notmuch show --format=text id:mime-cache@notmuch-test-suite | grep 'part\.$')
+test_expect_equal "$output" "This is a later part."
+
+test_begin_subtest "A message file replaced within the same second is parsed again"
+notmuch show --format=json id:mime-cache@notmuch-test-suite > /dev/null
+sed 's/a later part/another part/' ${MAIL_DIR}/multipart > ${MAIL_DIR}/multipart.new
+mv ${MAIL_DIR}/multipart.new ${MAIL_DIR}/multipart
+touch -d '2001-01-01 00:00' ${MAIL_DIR}/multipart
+output=$(notmuch show --format=text id:mime-cache@notmuch-test-suite | grep 'part\.$')
+test_expect_equal "$output" "This is another part."
+
+add_message '[subject]="Another cached message"' \
+	    '[id]="mime-cache-2@notmuch-test-suite"'
+
+test_begin_subtest "The least recently used entries are pruned"
+rm -rf $cache_dir
+notmuch show --format=json id:mime-cache@notmuch-test-suite > /dev/null
+entry=$(ls $cache_dir)
+for i in $(seq 4100); do
+    : > $cache_dir/unused-$i
+done
+touch -d '2001-01-01 00:00' $cache_dir/*
+notmuch show --format=json id:mime-cache@notmuch-test-suite > /dev/null
+# Pruning runs on every 64th store only.
+echo 63 > $cache_dir/.stores
+notmuch show --format=json id:mime-cache-2@notmuch-test-suite > /dev/null
+output="$(ls $cache_dir | wc -l) $(ls $cache_dir | grep -c -v unused-)"
+test -f $cache_dir/$entry && output="$output kept"
+test_expect_equal "$output" "3072 2 kept"
+
+test_done
@@ -0,0 +1,101 @@
+#!/usr/bin/env bash
+test_description="headers stored in the database"
+. ./test-lib.sh
+
+cat <<EOF > ${MAIL_DIR}/headers
+From: Carl Worth <cworth@cworth.org>
+To: =?utf-8?q?Fran=C3=A7ois?= <francois@example.com>,
+	Keith Packard <keithp@keithp.com>
+Cc: Jan Janak <jan@ryngle.com>
+Bcc: Olivier Berger <olivier.berger@it-sudparis.eu>
+Reply-To: notmuch@notmuchmail.org
+Subject: =?utf-8?q?Stored_h=C3=A9aders?=
+Date: Fri, 05 Jan 2001 15:43:57 +0000
+Message-ID: <stored-headers@notmuch-test-suite>
+In-Reply-To: <parent@notmuch-test-suite>
+References: <parent@notmuch-test-suite>
+
+This body is not shown.
+EOF
+notmuch new > /dev/null
+
+notmuch show --format=json --body=false id:stored-headers@notmuch-test-suite > json.expected
+notmuch show --format=sexp --body=false id:stored-headers@notmuch-test-suite > sexp.expected
+
+cat <<'EOF' > c_head
+#include <stdio.h>
+#include <notmuch.h>
+
+int main (int argc, char** argv)
+{
+   notmuch_database_t *db;
+   notmuch_message_t *message = NULL;
+   notmuch_status_t stat;
+   const char *headers[] = { "cc", "bcc", "reply-to", "date",
+			     "in-reply-to" };
+   unsigned int i;
+
+   stat = notmuch_database_open (argv[1], NOTMUCH_DATABASE_MODE_READ_ONLY, &db);
+   if (stat == NOTMUCH_STATUS_SUCCESS)
+       stat = notmuch_database_find_message (db, "stored-headers@notmuch-test-suite", &message);
+   if (message == NULL) {
+       fprintf (stderr, "error finding message: %d\n", stat);
+       return 1;
+   }
+EOF
+cat <<'EOF' > c_tail
+   notmuch_database_destroy (db);
+   return 0;
+}
+EOF
+
+test_begin_subtest "Stored headers"
+cat c_head - c_tail <<'EOF' | test_C ${MAIL_DIR}
+   printf ("%s", notmuch_message_get_stored_headers (message));
+EOF
+cat <<'EOF' > EXPECTED
+== stdout ==
+From: Carl Worth <cworth@cworth.org>
+To: =?utf-8?q?Fran=C3=A7ois?= <francois@example.com>,
+	Keith Packard <keithp@keithp.com>
+Cc: Jan Janak <jan@ryngle.com>
+Bcc: Olivier Berger <olivier.berger@it-sudparis.eu>
+Reply-To: notmuch@notmuchmail.org
+Subject: =?utf-8?q?Stored_h=C3=A9aders?=
+Date: Fri, 05 Jan 2001 15:43:57 +0000
+In-Reply-To: <parent@notmuch-test-suite>
+
+== stderr ==
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+mv ${MAIL_DIR}/headers ${TMP_DIRECTORY}/headers
+
+test_begin_subtest "Headers without the message file"
+cat c_head - c_tail <<'EOF' | test_C ${MAIL_DIR}
+   for (i = 0; i < sizeof (headers) / sizeof (headers[0]); i++)
+       printf ("%s: %s\n", headers[i], notmuch_message_get_header (message, headers[i]));
+EOF
+cat <<'EOF' > EXPECTED
+== stdout ==
+cc: Jan Janak <jan@ryngle.com>
+bcc: Olivier Berger <olivier.berger@it-sudparis.eu>
+reply-to: notmuch@notmuchmail.org
+date: Fri, 05 Jan 2001 15:43:57 +0000
+in-reply-to: <parent@notmuch-test-suite>
+== stderr ==
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "json --body=false without the message file"
+notmuch show --format=json --body=false id:stored-headers@notmuch-test-suite > OUTPUT
+test_expect_equal_file json.expected OUTPUT
+
+test_begin_subtest "sexp --body=false without the message file"
+notmuch show --format=sexp --body=false id:stored-headers@notmuch-test-suite > OUTPUT
+test_expect_equal_file sexp.expected OUTPUT
+
+test_expect_code 1 "The body still needs the message file" \
+    "notmuch show --format=json id:stored-headers@notmuch-test-suite"
+
+test_done
@@ -0,0 +1,81 @@
+#!/usr/bin/env bash
+test_description='"notmuch serve"'
+. ./test-lib.sh
+
+add_email_corpus
+
+notmuch serve --socket=serve.sock 2>serve.err &
+serve_pid=$!
+
+for i in $(seq 50); do
+    test -S serve.sock && break
+    sleep 0.1
+done
+
+served () {
+    NOTMUCH_SERVE_SOCKET=serve.sock notmuch "$@"
+}
+
+test_begin_subtest "Server is listening"
+test_expect_equal "$(test -S serve.sock && echo listening)" "listening"
+
+test_begin_subtest "Commands are run by the server"
+# The invoking process does not read the configuration.
+output=$(NOTMUCH_CONFIG=/nonexistent served count '*')
+test_expect_equal "$output" "$(notmuch count '*')"
+
+test_begin_subtest "search"
+notmuch search --format=json from:cworth > EXPECTED
+served search --format=json from:cworth > OUTPUT
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "show"
+notmuch show --format=sexp id:877h1wv7mg.fsf@inf-8657.int-evry.fr > EXPECTED
+served show --format=sexp id:877h1wv7mg.fsf@inf-8657.int-evry.fr > OUTPUT
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "address"
+notmuch address --output=sender --output=recipients '*' > EXPECTED
+served address --output=sender --output=recipients '*' > OUTPUT
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Standard input of the client"
+printf 'from:cworth\n\ntag:inbox\n' > INPUT
+notmuch count --batch < INPUT > EXPECTED
+served count --batch < INPUT > OUTPUT
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Errors and exit status of the client"
+served show > OUTPUT 2>&1
+echo "exit status: $?" >> OUTPUT
+cat <<EOF > EXPECTED
+Error: notmuch show requires at least one search term.
+exit status: 1
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Tags written through the server"
+served tag +served from:cworth
+test_expect_equal "$(served count tag:served)" "$(notmuch count from:cworth)"
+
+test_begin_subtest "Changes made by other processes"
+notmuch tag +outside from:cworth
+test_expect_equal "$(served count tag:outside)" "$(notmuch count from:cworth)"
+
+test_expect_code 1 "Server refuses to replace a running server" \
+    "notmuch serve --socket=serve.sock 2>/dev/null"
+
+test_begin_subtest "Server stops on SIGTERM"
+kill $serve_pid
+wait $serve_pid
+echo "exit status: $?" > OUTPUT
+test -e serve.sock && echo "socket left behind" >> OUTPUT
+cat serve.err >> OUTPUT
+echo "exit status: 0" > EXPECTED
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Commands run locally without a server"
+output=$(served count '*')
+test_expect_equal "$output" "$(notmuch count '*')"
+
+test_done
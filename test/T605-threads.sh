@@ -0,0 +1,143 @@
+#!/usr/bin/env bash
+test_description="read-only database clones used from several threads"
+. ./test-lib.sh
+
+add_email_corpus
+
+test_begin_subtest "Queries on clones in concurrent threads"
+TEST_CFLAGS="$TEST_CFLAGS -pthread" test_C ${MAIL_DIR} <<'EOF'
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <notmuch.h>
+
+#define NUM_WORKERS 4
+
+static const char *queries[] = { "*", "from:cworth", "tag:inbox", "subject:notmuch" };
+
+struct worker {
+    notmuch_database_t *db;
+    unsigned int messages[4];
+    unsigned int tags;
+};
+
+static void *
+work (void *closure)
+{
+    struct worker *worker = closure;
+    unsigned int i, round;
+
+    for (round = 0; round < 20; round++) {
+	worker->tags = 0;
+	for (i = 0; i < 4; i++) {
+	    notmuch_query_t *query = notmuch_query_create (worker->db, queries[i]);
+	    notmuch_messages_t *messages = notmuch_query_search_messages (query);
+
+	    worker->messages[i] = 0;
+	    for (; notmuch_messages_valid (messages);
+		 notmuch_messages_move_to_next (messages)) {
+		notmuch_message_t *message = notmuch_messages_get (messages);
+		notmuch_tags_t *tags = notmuch_message_get_tags (message);
+
+		for (; notmuch_tags_valid (tags); notmuch_tags_move_to_next (tags))
+		    worker->tags++;
+		notmuch_message_destroy (message);
+		worker->messages[i]++;
+	    }
+	    notmuch_query_destroy (query);
+	}
+    }
+
+    return NULL;
+}
+
+int main (int argc, char** argv)
+{
+    notmuch_database_t *db;
+    struct worker workers[NUM_WORKERS], expected;
+    pthread_t threads[NUM_WORKERS];
+    unsigned int i, j;
+    int same = 1;
+
+    if (notmuch_database_open (argv[1], NOTMUCH_DATABASE_MODE_READ_ONLY, &db))
+	return 1;
+
+    expected.db = db;
+    work (&expected);
+
+    for (i = 0; i < NUM_WORKERS; i++) {
+	if (notmuch_database_clone_reader (db, &workers[i].db))
+	    return 1;
+	pthread_create (&threads[i], NULL, work, &workers[i]);
+    }
+
+    for (i = 0; i < NUM_WORKERS; i++) {
+	pthread_join (threads[i], NULL);
+	for (j = 0; j < 4; j++)
+	    same &= (workers[i].messages[j] == expected.messages[j]);
+	same &= (workers[i].tags == expected.tags);
+	notmuch_database_destroy (workers[i].db);
+    }
+
+    printf ("%u %u %u %u\n", expected.messages[0], expected.messages[1],
+	    expected.messages[2], expected.messages[3]);
+    printf ("workers agree: %d\n", same);
+
+    notmuch_database_destroy (db);
+    return 0;
+}
+EOF
+cat <<EOF > EXPECTED
+== stdout ==
+$(notmuch count '*') $(notmuch count from:cworth) $(notmuch count tag:inbox) $(notmuch count subject:notmuch)
+workers agree: 1
+== stderr ==
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_begin_subtest "Clones see the latest revision"
+test_C ${MAIL_DIR} <<'EOF'
+#include <stdio.h>
+#include <stdlib.h>
+#include <notmuch.h>
+
+static unsigned int
+count (notmuch_database_t *db)
+{
+    notmuch_query_t *query = notmuch_query_create (db, "tag:cloned");
+    unsigned int n = notmuch_query_count_messages (query);
+
+    notmuch_query_destroy (query);
+    return n;
+}
+
+int main (int argc, char** argv)
+{
+    notmuch_database_t *db, *clone;
+
+    if (notmuch_database_open (argv[1], NOTMUCH_DATABASE_MODE_READ_ONLY, &db))
+	return 1;
+
+    if (system ("notmuch tag +cloned from:cworth"))
+	return 1;
+
+    if (notmuch_database_clone_reader (db, &clone))
+	return 1;
+
+    printf ("original: %u\n", count (db));
+    notmuch_database_destroy (db);
+    printf ("clone: %u\n", count (clone));
+    notmuch_database_destroy (clone);
+
+    return 0;
+}
+EOF
+cat <<EOF > EXPECTED
+== stdout ==
+original: 0
+clone: $(notmuch count from:cworth)
+== stderr ==
+EOF
+test_expect_equal_file EXPECTED OUTPUT
+
+test_done
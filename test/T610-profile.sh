@@ -0,0 +1,52 @@
+#!/usr/bin/env bash
+test_description="phase profiling with NOTMUCH_PROFILE"
+. ./test-lib.sh
+
+add_email_corpus
+
+phases () {
+    sed -e 's/.*"phases": {//' -e 's/: {[^}]*}//g' -e 's/}}$//' "$1"
+}
+
+test_begin_subtest "No report without NOTMUCH_PROFILE"
+notmuch search '*' > /dev/null 2> OUTPUT
+test_expect_equal "$(cat OUTPUT)" ""
+
+test_begin_subtest "Report of search written to stderr"
+NOTMUCH_PROFILE=1 notmuch search '*' > /dev/null 2> OUTPUT
+test_expect_equal "$(phases OUTPUT)" \
+    '"directory_scan", "file_open", "mime_parse", "term_generation", "xapian_add", "xapian_replace", "xapian_commit", "thread_build", "header_fallback", "output"'
+
+test_begin_subtest "One thread built and printed per thread"
+threads=$(notmuch count --output=threads '*')
+NOTMUCH_PROFILE=1 notmuch search '*' > /dev/null 2> OUTPUT
+output=$(sed -n -e 's/.*"thread_build": {"count": \([0-9]*\),.*"output": {"count": \([0-9]*\),.*/\1 \2/p' OUTPUT)
+test_expect_equal "$output" "$threads $threads"
+
+test_begin_subtest "Reports appended to a file"
+rm -f profile.json
+NOTMUCH_PROFILE=$PWD/profile.json notmuch count '*' > /dev/null
+NOTMUCH_PROFILE=$PWD/profile.json notmuch count '*' > /dev/null
+test_expect_equal "$(grep -c '^{"pid": ' profile.json)" "2"
+
+test_begin_subtest "Only the server of notmuch serve writes a report"
+rm -f profile.json
+NOTMUCH_PROFILE=$PWD/profile.json notmuch serve --socket=serve.sock 2>/dev/null &
+serve_pid=$!
+for i in $(seq 50); do
+    test -S serve.sock && break
+    sleep 0.1
+done
+NOTMUCH_SERVE_SOCKET=serve.sock notmuch count '*' > /dev/null
+NOTMUCH_SERVE_SOCKET=serve.sock notmuch count '*' > /dev/null
+kill $serve_pid
+wait $serve_pid
+test_expect_equal "$(grep -c '^{"pid": ' profile.json)" "1"
+
+test_begin_subtest "Messages added by notmuch new are profiled"
+generate_message
+NOTMUCH_PROFILE=1 NOTMUCH_NEW 2> OUTPUT > /dev/null
+output=$(sed -n -e 's/.*"xapian_add": {"count": \([0-9]*\),.*/\1/p' OUTPUT)
+test_expect_equal "$(test "$output" -gt 0 && echo added)" "added"
+
+test_done
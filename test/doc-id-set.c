@@ -0,0 +1,120 @@
+/* testbed for ../lib/doc-id-set.c.
+ *
+ * usage:
+ * doc-id-set < commands
+ *
+ * Each line of input is one command applied to a single set:
+ *
+ *   add ID...        add each ID
+ *   remove ID...     remove each ID
+ *   contains ID...   print 1 or 0 for each ID
+ *   count            print the number of members
+ *   list             print the members in ascending order
+ *   next ID          print the first member not less than ID, or "none"
+ *   intersect ID...  keep only the members also in the list of IDs
+ *   range FIRST LAST STEP
+ *                    add FIRST, FIRST+STEP, ... up to LAST
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "notmuch-private.h"
+
+static void
+print_list (notmuch_doc_id_set_t *doc_ids)
+{
+    unsigned int doc_id = 0, next;
+    const char *sep = "";
+
+    while (_notmuch_doc_id_set_next (doc_ids, doc_id, &next)) {
+	printf ("%s%u", sep, next);
+	sep = " ";
+	if (next == UINT_MAX)
+	    break;
+	doc_id = next + 1;
+    }
+    printf ("\n");
+}
+
+int
+main (unused (int argc), unused (char **argv))
+{
+    void *ctx = talloc_new (NULL);
+    notmuch_doc_id_set_t *doc_ids = _notmuch_doc_id_set_create (ctx);
+    char line[4096];
+
+    if (doc_ids == NULL) {
+	fprintf (stderr, "Out of memory\n");
+	return 1;
+    }
+
+    while (fgets (line, sizeof (line), stdin)) {
+	char *command = strtok (line, " \t\n");
+	char *arg;
+
+	if (command == NULL)
+	    continue;
+
+	if (strcmp (command, "add") == 0) {
+	    while ((arg = strtok (NULL, " \t\n")))
+		if (! _notmuch_doc_id_set_add (doc_ids, strtoul (arg, NULL, 10)))
+		    return 1;
+	} else if (strcmp (command, "remove") == 0) {
+	    while ((arg = strtok (NULL, " \t\n")))
+		_notmuch_doc_id_set_remove (doc_ids, strtoul (arg, NULL, 10));
+	} else if (strcmp (command, "contains") == 0) {
+	    const char *sep = "";
+	    while ((arg = strtok (NULL, " \t\n"))) {
+		printf ("%s%d", sep, _notmuch_doc_id_set_contains (
+			    doc_ids, strtoul (arg, NULL, 10)) ? 1 : 0);
+		sep = " ";
+	    }
+	    printf ("\n");
+	} else if (strcmp (command, "count") == 0) {
+	    printf ("%u\n", _notmuch_doc_id_set_count (doc_ids));
+	} else if (strcmp (command, "list") == 0) {
+	    print_list (doc_ids);
+	} else if (strcmp (command, "next") == 0) {
+	    unsigned int next;
+	    arg = strtok (NULL, " \t\n");
+	    if (arg && _notmuch_doc_id_set_next (doc_ids,
+						 strtoul (arg, NULL, 10), &next))
+		printf ("%u\n", next);
+	    else
+		printf ("none\n");
+	} else if (strcmp (command, "intersect") == 0) {
+	    notmuch_doc_id_set_t *other = _notmuch_doc_id_set_create (ctx);
+	    if (other == NULL)
+		return 1;
+	    while ((arg = strtok (NULL, " \t\n")))
+		if (! _notmuch_doc_id_set_add (other, strtoul (arg, NULL, 10)))
+		    return 1;
+	    _notmuch_doc_id_set_intersect (doc_ids, other);
+	    talloc_free (other);
+	} else if (strcmp (command, "range") == 0) {
+	    unsigned long first, last, step, i;
+	    char *a = strtok (NULL, " \t\n");
+	    char *b = strtok (NULL, " \t\n");
+	    char *c = strtok (NULL, " \t\n");
+	    if (a == NULL || b == NULL || c == NULL) {
+		fprintf (stderr, "Usage: range FIRST LAST STEP\n");
+		return 1;
+	    }
+	    first = strtoul (a, NULL, 10);
+	    last = strtoul (b, NULL, 10);
+	    step = strtoul (c, NULL, 10);
+	    for (i = first; step && i <= last; i += step)
+		if (! _notmuch_doc_id_set_add (doc_ids, i))
+		    return 1;
+	} else {
+	    fprintf (stderr, "Unknown command: %s\n", command);
+	    return 1;
+	}
+    }
+
+    talloc_free (ctx);
+    return 0;
+}
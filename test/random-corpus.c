@@ -34,86 +34,7 @@
 #include "notmuch-client.h"
 #include "command-line-arguments.h"
 #include "database-test.h"
-
-/* Current largest Unicode value defined. Note that most of these will
- * be printed as boxes in most fonts.
- */
-
-#define GLYPH_MAX 0x10FFFE
-
-
-typedef struct {
-    int weight;
-    int start;
-    int stop;
-} char_class_t;
-
-/*
- *  Choose about half ascii as test characters, as ascii
- *  punctation and whitespace is the main cause of problems for
- *  the (old) restore parser.
- *
- *  We then favour code points with 2 byte encodings. Note that
- *  code points 0xD800-0xDFFF are forbidden in UTF-8.
- */
-
-static const
-char_class_t char_class[] = { { 0.50 * GLYPH_MAX, 0x0001, 0x007f },
-			      { 0.75 * GLYPH_MAX, 0x0080, 0x07ff },
-			      { 0.88 * GLYPH_MAX, 0x0800, 0xd7ff },
-			      { 0.90 * GLYPH_MAX, 0xE000, 0xffff },
-			      {        GLYPH_MAX, 0x10000, GLYPH_MAX } };
-
-static gunichar
-random_unichar ()
-{
-    int i;
-    int class = random () % GLYPH_MAX;
-    int size;
-
-    for (i = 0; char_class[i].weight < class; i++) /* nothing */;
-
-    size = char_class[i].stop - char_class[i].start + 1;
-
-    return char_class[i].start + (random () % size);
-}
-
-static char *
-random_utf8_string (void *ctx, size_t char_count)
-{
-    size_t offset = 0;
-    size_t i;
-    gchar *buf = NULL;
-    size_t buf_size = 0;
-
-    for (i = 0; i < char_count; i++) {
-	gunichar randomchar;
-	size_t written;
-
-	/* 6 for one glyph, one for null, one for luck */
-	while (buf_size <= offset + 8) {
-	    buf_size = 2 * buf_size + 8;
-	    buf = talloc_realloc (ctx, buf, gchar, buf_size);
-	}
-
-	do {
-	    randomchar = random_unichar ();
-	} while (randomchar == '\n');
-
-	written = g_unichar_to_utf8 (randomchar, buf + offset);
-
-	if (written <= 0) {
-	    fprintf (stderr, "error converting to utf8\n");
-	    exit (1);
-	}
-
-	offset += written;
-
-    }
-    buf[offset] = 0;
-    return buf;
-}
-
+#include "random-string.h"
 
 int
 main (int argc, char **argv)
@@ -0,0 +1,16 @@
+#ifndef _RANDOM_STRING_H
+#define _RANDOM_STRING_H
+
+#include <stddef.h>
+
+/* Return a string of char_count random Unicode characters, encoded
+ * as UTF-8 and allocated with talloc from ctx.  The characters are
+ * chosen with random(), so srandom() makes the result repeatable.
+ *
+ * About half of the characters are ASCII, including punctuation and
+ * whitespace, but there are no newlines.
+ */
+char *
+random_utf8_string (void *ctx, size_t char_count);
+
+#endif
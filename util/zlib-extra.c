@@ -22,6 +22,9 @@
 #include <talloc.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
 
 /* mimic POSIX/glibc getline, but on a zlib gzFile stream, and using talloc */
 util_status_t
@@ -83,3 +86,641 @@ const char *gz_error_string (util_status_t status, gzFile file)
     else
 	return util_error_string (status);
 }
+
+/* Parallel compressed output.
+ *
+ * Output is collected in blocks, and each block is compressed by a
+ * worker thread into a gzip member of its own.  gunzip and gzread
+ * treat concatenated members as a single stream, so the result reads
+ * back exactly like the output of gzwrite. */
+
+#define GZ_WRITER_BLOCK_SIZE (1024 * 1024)
+#define GZ_WRITER_MAX_THREADS 16
+
+typedef struct {
+    char *in;
+    size_t in_len;
+    unsigned char *out;
+    size_t out_len;
+    /* Set by the worker once 'out' is ready; protected by the lock. */
+    int done;
+    int zlib_status;
+} gz_block_t;
+
+typedef struct {
+    gz_writer_t *writer;
+    z_stream stream;
+    pthread_t thread;
+} gz_worker_t;
+
+struct _gz_writer {
+    int fd;
+    int compress;
+
+    /* Blocks are numbered in output order, and block n lives in
+     * blocks[n % num_blocks].  Blocks before 'written' are on disk,
+     * blocks before 'taken' have been picked up by a worker, and
+     * blocks before 'filled' are waiting to be compressed.  Block
+     * 'filled' is the one being filled by the caller. */
+    gz_block_t *blocks;
+    unsigned int num_blocks;
+    unsigned long written, taken, filled;
+    size_t out_size;
+
+    /* Without any threads, the caller compresses each block itself,
+     * using the stream of workers[0]. */
+    gz_worker_t *workers;
+    unsigned int num_streams;
+    unsigned int num_threads;
+    int closing;
+
+    pthread_mutex_t lock;
+    pthread_cond_t queued;
+    pthread_cond_t compressed;
+
+    util_status_t status;
+    int error;
+};
+
+static int
+_write_all (int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+
+    while (len) {
+	ssize_t n = write (fd, p, len);
+
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	p += n;
+	len -= n;
+    }
+
+    return 0;
+}
+
+static int
+_gz_block_compress (gz_block_t *block, z_stream *stream, size_t out_size)
+{
+    int zlib_status;
+
+    zlib_status = deflateReset (stream);
+    if (zlib_status != Z_OK)
+	return zlib_status;
+
+    stream->next_in = (Bytef *) block->in;
+    stream->avail_in = block->in_len;
+    stream->next_out = block->out;
+    stream->avail_out = out_size;
+
+    /* The output buffer holds deflateBound bytes, so this finishes
+     * in one call. */
+    zlib_status = deflate (stream, Z_FINISH);
+    block->out_len = out_size - stream->avail_out;
+
+    if (zlib_status == Z_STREAM_END)
+	return Z_OK;
+
+    return zlib_status == Z_OK ? Z_BUF_ERROR : zlib_status;
+}
+
+static void *
+_gz_writer_worker (void *arg)
+{
+    gz_worker_t *worker = arg;
+    gz_writer_t *writer = worker->writer;
+
+    pthread_mutex_lock (&writer->lock);
+    while (1) {
+	gz_block_t *block;
+	int zlib_status;
+
+	while (writer->taken == writer->filled && ! writer->closing)
+	    pthread_cond_wait (&writer->queued, &writer->lock);
+
+	if (writer->taken == writer->filled)
+	    break;
+
+	block = &writer->blocks[writer->taken++ % writer->num_blocks];
+	pthread_mutex_unlock (&writer->lock);
+
+	zlib_status = _gz_block_compress (block, &worker->stream,
+					  writer->out_size);
+
+	pthread_mutex_lock (&writer->lock);
+	block->zlib_status = zlib_status;
+	block->done = 1;
+	pthread_cond_signal (&writer->compressed);
+    }
+    pthread_mutex_unlock (&writer->lock);
+
+    return NULL;
+}
+
+static util_status_t
+_gz_writer_status (gz_writer_t *writer)
+{
+    if (writer->status == UTIL_ERRNO)
+	errno = writer->error;
+
+    return writer->status;
+}
+
+static void
+_gz_writer_fail (gz_writer_t *writer, util_status_t status)
+{
+    if (writer->status)
+	return;
+
+    writer->status = status;
+    writer->error = errno;
+}
+
+/* Wait for the oldest block to be compressed, and write it out. */
+static void
+_gz_writer_write_oldest (gz_writer_t *writer)
+{
+    gz_block_t *block = &writer->blocks[writer->written % writer->num_blocks];
+
+    pthread_mutex_lock (&writer->lock);
+    while (! block->done)
+	pthread_cond_wait (&writer->compressed, &writer->lock);
+    pthread_mutex_unlock (&writer->lock);
+
+    writer->written++;
+
+    if (writer->status)
+	return;
+
+    if (block->zlib_status != Z_OK)
+	_gz_writer_fail (writer, UTIL_GZERROR);
+    else if (_write_all (writer->fd, block->out, block->out_len))
+	_gz_writer_fail (writer, UTIL_ERRNO);
+}
+
+/* Hand the block being filled over for compression, and start a new
+ * one. */
+static void
+_gz_writer_submit (gz_writer_t *writer)
+{
+    gz_block_t *block = &writer->blocks[writer->filled % writer->num_blocks];
+
+    if (! writer->compress) {
+	if (! writer->status &&
+	    _write_all (writer->fd, block->in, block->in_len))
+	    _gz_writer_fail (writer, UTIL_ERRNO);
+	block->in_len = 0;
+	return;
+    }
+
+    if (writer->num_threads == 0) {
+	block->zlib_status = _gz_block_compress (block,
+						 &writer->workers[0].stream,
+						 writer->out_size);
+	block->done = 1;
+	writer->filled++;
+    } else {
+	pthread_mutex_lock (&writer->lock);
+	block->done = 0;
+	writer->filled++;
+	pthread_cond_signal (&writer->queued);
+	pthread_mutex_unlock (&writer->lock);
+    }
+
+    if (writer->filled - writer->written == writer->num_blocks)
+	_gz_writer_write_oldest (writer);
+
+    writer->blocks[writer->filled % writer->num_blocks].in_len = 0;
+}
+
+static int
+_gz_writer_destructor (gz_writer_t *writer)
+{
+    unsigned int i;
+
+    pthread_mutex_lock (&writer->lock);
+    writer->closing = 1;
+    pthread_cond_broadcast (&writer->queued);
+    pthread_mutex_unlock (&writer->lock);
+
+    for (i = 0; i < writer->num_threads; i++)
+	pthread_join (writer->workers[i].thread, NULL);
+
+    for (i = 0; i < writer->num_streams; i++)
+	deflateEnd (&writer->workers[i].stream);
+
+    pthread_mutex_destroy (&writer->lock);
+    pthread_cond_destroy (&writer->queued);
+    pthread_cond_destroy (&writer->compressed);
+
+    return 0;
+}
+
+gz_writer_t *
+gz_writer_create (void *ctx, int fd, int compress)
+{
+    gz_writer_t *writer;
+    unsigned int num_workers = 0;
+    unsigned int i;
+
+    writer = talloc_zero (ctx, gz_writer_t);
+    if (writer == NULL)
+	return NULL;
+
+    writer->fd = fd;
+    writer->compress = compress;
+
+    pthread_mutex_init (&writer->lock, NULL);
+    pthread_cond_init (&writer->queued, NULL);
+    pthread_cond_init (&writer->compressed, NULL);
+    talloc_set_destructor (writer, _gz_writer_destructor);
+
+    if (compress) {
+	long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+
+	if (cpus < 1)
+	    cpus = 1;
+	if (cpus > GZ_WRITER_MAX_THREADS)
+	    cpus = GZ_WRITER_MAX_THREADS;
+	num_workers = cpus;
+
+	writer->workers = talloc_zero_array (writer, gz_worker_t, num_workers);
+	if (writer->workers == NULL)
+	    goto FAIL;
+
+	for (i = 0; i < num_workers; i++) {
+	    writer->workers[i].writer = writer;
+	    /* 31 window bits ask for a gzip header and trailer. */
+	    if (deflateInit2 (&writer->workers[i].stream, Z_BEST_COMPRESSION,
+			      Z_DEFLATED, 15 + 16, 8,
+			      Z_DEFAULT_STRATEGY) != Z_OK)
+		goto FAIL;
+	    writer->num_streams++;
+	}
+
+	writer->out_size = deflateBound (&writer->workers[0].stream,
+					 GZ_WRITER_BLOCK_SIZE);
+    }
+
+    /* Twice as many blocks as workers keeps every worker busy while
+     * the caller fills the next block. */
+    writer->num_blocks = compress ? 2 * num_workers : 1;
+    writer->blocks = talloc_zero_array (writer, gz_block_t,
+					writer->num_blocks);
+    if (writer->blocks == NULL)
+	goto FAIL;
+
+    for (i = 0; i < writer->num_blocks; i++) {
+	gz_block_t *block = &writer->blocks[i];
+
+	block->in = talloc_array (writer->blocks, char, GZ_WRITER_BLOCK_SIZE);
+	if (block->in == NULL)
+	    goto FAIL;
+	if (compress) {
+	    block->out = talloc_array (writer->blocks, unsigned char,
+				       writer->out_size);
+	    if (block->out == NULL)
+		goto FAIL;
+	}
+    }
+
+    /* If no thread can be started, compress in the calling thread. */
+    for (i = 0; i < num_workers; i++) {
+	if (pthread_create (&writer->workers[i].thread, NULL,
+			    _gz_writer_worker, &writer->workers[i]))
+	    break;
+	writer->num_threads++;
+    }
+
+    return writer;
+
+  FAIL:
+    talloc_free (writer);
+    return NULL;
+}
+
+util_status_t
+gz_writer_write (gz_writer_t *writer, const char *buf, size_t len)
+{
+    while (len && ! writer->status) {
+	gz_block_t *block = &writer->blocks[writer->filled % writer->num_blocks];
+	size_t n = GZ_WRITER_BLOCK_SIZE - block->in_len;
+
+	if (n > len)
+	    n = len;
+
+	memcpy (block->in + block->in_len, buf, n);
+	block->in_len += n;
+	buf += n;
+	len -= n;
+
+	if (block->in_len == GZ_WRITER_BLOCK_SIZE)
+	    _gz_writer_submit (writer);
+    }
+
+    return _gz_writer_status (writer);
+}
+
+util_status_t
+gz_writer_puts (gz_writer_t *writer, const char *str)
+{
+    return gz_writer_write (writer, str, strlen (str));
+}
+
+util_status_t
+gz_writer_finish (gz_writer_t *writer)
+{
+    gz_block_t *block = &writer->blocks[writer->filled % writer->num_blocks];
+
+    /* Even empty output gets a gzip header. */
+    if (block->in_len || (writer->compress && writer->filled == 0))
+	_gz_writer_submit (writer);
+
+    while (writer->written < writer->filled)
+	_gz_writer_write_oldest (writer);
+
+    return _gz_writer_status (writer);
+}
+
+/* Read-ahead input.
+ *
+ * A thread decompresses the input into chunks that end on a line
+ * boundary, a few chunks ahead of the caller, who only has to split
+ * each chunk into lines. */
+
+#define GZ_READER_CHUNK_SIZE (256 * 1024)
+#define GZ_READER_CHUNKS 4
+
+typedef struct {
+    /* malloc'd rather than talloc'd, as the reading thread allocates
+     * them. */
+    char *data;
+    size_t size;
+    size_t len;
+    /* UTIL_SUCCESS if more chunks follow this one. */
+    util_status_t status;
+    int error;
+} gz_chunk_t;
+
+struct _gz_reader {
+    gzFile stream;
+
+    /* Chunks are numbered in input order, and chunk n lives in
+     * chunks[n % GZ_READER_CHUNKS].  Chunks before 'produced' have
+     * been read, and chunks before 'consumed' have been used up by
+     * the caller, who is at 'offset' in chunk 'consumed'. */
+    gz_chunk_t chunks[GZ_READER_CHUNKS];
+    unsigned long produced, consumed;
+    size_t offset;
+
+    /* The partial line at the end of the last chunk read. */
+    char *carry;
+    size_t carry_len;
+    size_t carry_size;
+
+    int has_thread;
+    pthread_t thread;
+    int closing;
+
+    pthread_mutex_t lock;
+    pthread_cond_t space;
+    pthread_cond_t ready;
+};
+
+static int
+_grow (char **buf, size_t *size, size_t needed)
+{
+    char *grown;
+    size_t new_size = *size ? *size : GZ_READER_CHUNK_SIZE;
+
+    if (needed <= *size)
+	return 0;
+
+    while (new_size < needed)
+	new_size *= 2;
+
+    grown = realloc (*buf, new_size);
+    if (grown == NULL)
+	return -1;
+
+    *buf = grown;
+    *size = new_size;
+    return 0;
+}
+
+/* Read the next chunk from the input, stopping after the last
+ * complete line. */
+static void
+_gz_reader_fill (gz_reader_t *reader, gz_chunk_t *chunk)
+{
+    size_t scanned;
+
+    chunk->len = 0;
+    chunk->status = UTIL_SUCCESS;
+
+    if (_grow (&chunk->data, &chunk->size,
+	       reader->carry_len + GZ_READER_CHUNK_SIZE)) {
+	chunk->status = UTIL_OUT_OF_MEMORY;
+	return;
+    }
+
+    memcpy (chunk->data, reader->carry, reader->carry_len);
+    chunk->len = reader->carry_len;
+    scanned = chunk->len;
+    reader->carry_len = 0;
+
+    while (1) {
+	size_t end;
+	int n;
+
+	n = gzread (reader->stream, chunk->data + chunk->len,
+		    chunk->size - chunk->len);
+
+	/* The final line need not end in a newline.  gzread also
+	 * returns 0 on truncated input, leaving an error behind. */
+	if (n <= 0) {
+	    int zlib_status = 0;
+
+	    (void) gzerror (reader->stream, &zlib_status);
+	    switch (zlib_status) {
+	    case Z_OK:
+		chunk->status = UTIL_EOF;
+		break;
+	    case Z_ERRNO:
+		chunk->status = UTIL_ERRNO;
+		chunk->error = errno;
+		break;
+	    default:
+		chunk->status = UTIL_GZERROR;
+	    }
+	    return;
+	}
+
+	chunk->len += n;
+
+	for (end = chunk->len; end > scanned; end--)
+	    if (chunk->data[end - 1] == '\n')
+		break;
+
+	if (end > scanned) {
+	    if (_grow (&reader->carry, &reader->carry_size,
+		       chunk->len - end)) {
+		chunk->status = UTIL_OUT_OF_MEMORY;
+		return;
+	    }
+	    reader->carry_len = chunk->len - end;
+	    memcpy (reader->carry, chunk->data + end, reader->carry_len);
+	    chunk->len = end;
+	    return;
+	}
+
+	/* A line longer than the chunk. */
+	scanned = chunk->len;
+	if (_grow (&chunk->data, &chunk->size, chunk->size * 2)) {
+	    chunk->status = UTIL_OUT_OF_MEMORY;
+	    return;
+	}
+    }
+}
+
+static void *
+_gz_reader_thread (void *arg)
+{
+    gz_reader_t *reader = arg;
+    util_status_t status = UTIL_SUCCESS;
+
+    pthread_mutex_lock (&reader->lock);
+    while (status == UTIL_SUCCESS) {
+	gz_chunk_t *chunk;
+
+	while (reader->produced - reader->consumed == GZ_READER_CHUNKS &&
+	       ! reader->closing)
+	    pthread_cond_wait (&reader->space, &reader->lock);
+
+	if (reader->closing)
+	    break;
+
+	chunk = &reader->chunks[reader->produced % GZ_READER_CHUNKS];
+	pthread_mutex_unlock (&reader->lock);
+
+	_gz_reader_fill (reader, chunk);
+	status = chunk->status;
+
+	pthread_mutex_lock (&reader->lock);
+	reader->produced++;
+	pthread_cond_signal (&reader->ready);
+    }
+    pthread_mutex_unlock (&reader->lock);
+
+    return NULL;
+}
+
+static int
+_gz_reader_destructor (gz_reader_t *reader)
+{
+    unsigned int i;
+
+    if (reader->has_thread) {
+	pthread_mutex_lock (&reader->lock);
+	reader->closing = 1;
+	pthread_cond_signal (&reader->space);
+	pthread_mutex_unlock (&reader->lock);
+
+	pthread_join (reader->thread, NULL);
+    }
+
+    for (i = 0; i < GZ_READER_CHUNKS; i++)
+	free (reader->chunks[i].data);
+    free (reader->carry);
+
+    pthread_mutex_destroy (&reader->lock);
+    pthread_cond_destroy (&reader->space);
+    pthread_cond_destroy (&reader->ready);
+
+    return 0;
+}
+
+gz_reader_t *
+gz_reader_create (void *ctx, gzFile stream)
+{
+    gz_reader_t *reader;
+
+    reader = talloc_zero (ctx, gz_reader_t);
+    if (reader == NULL)
+	return NULL;
+
+    reader->stream = stream;
+
+    pthread_mutex_init (&reader->lock, NULL);
+    pthread_cond_init (&reader->space, NULL);
+    pthread_cond_init (&reader->ready, NULL);
+    talloc_set_destructor (reader, _gz_reader_destructor);
+
+    /* Without a thread, chunks are read on demand. */
+    if (pthread_create (&reader->thread, NULL, _gz_reader_thread, reader) == 0)
+	reader->has_thread = 1;
+
+    return reader;
+}
+
+util_status_t
+gz_reader_getline (void *talloc_ctx, char **bufptr, ssize_t *bytes_read,
+		   gz_reader_t *reader)
+{
+    gz_chunk_t *chunk;
+    char *start, *end;
+    size_t len;
+    char *buf = *bufptr;
+
+    while (1) {
+	chunk = &reader->chunks[reader->consumed % GZ_READER_CHUNKS];
+
+	if (reader->has_thread) {
+	    pthread_mutex_lock (&reader->lock);
+	    while (reader->produced == reader->consumed)
+		pthread_cond_wait (&reader->ready, &reader->lock);
+	    pthread_mutex_unlock (&reader->lock);
+	} else if (reader->produced == reader->consumed) {
+	    _gz_reader_fill (reader, chunk);
+	    reader->produced++;
+	}
+
+	if (reader->offset < chunk->len)
+	    break;
+
+	/* The last chunk stays put, so its status is returned from
+	 * then on. */
+	if (chunk->status != UTIL_SUCCESS) {
+	    if (chunk->status == UTIL_ERRNO)
+		errno = chunk->error;
+	    return chunk->status;
+	}
+
+	pthread_mutex_lock (&reader->lock);
+	reader->consumed++;
+	reader->offset = 0;
+	pthread_cond_signal (&reader->space);
+	pthread_mutex_unlock (&reader->lock);
+    }
+
+    start = chunk->data + reader->offset;
+    end = memchr (start, '\n', chunk->len - reader->offset);
+    len = end ? (size_t) (end - start) + 1 : chunk->len - reader->offset;
+
+    if (buf == NULL || talloc_array_length (buf) < len + 1) {
+	buf = talloc_realloc (talloc_ctx, buf, char, len + 1);
+	if (buf == NULL)
+	    return UTIL_OUT_OF_MEMORY;
+    }
+
+    memcpy (buf, start, len);
+    buf[len] = '\0';
+    reader->offset += len;
+
+    *bufptr = buf;
+    *bytes_read = len;
+    return UTIL_SUCCESS;
+}
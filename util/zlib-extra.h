@@ -3,6 +3,7 @@
 
 #include "util.h"
 #include <zlib.h>
+#include <sys/types.h>
 
 /* Like getline, but read from a gzFile. Allocation is with talloc.
  * Returns:
@@ -22,4 +23,45 @@ gz_getline (void *ctx, char **lineptr, ssize_t *bytes_read, gzFile stream);
 
 const char *
 gz_error_string (util_status_t status, gzFile stream);
+
+/* A writer that compresses its output on several threads.
+ *
+ * The output is a sequence of gzip members, which gunzip and gzread
+ * read back as one stream.  If 'compress' is false, the output is
+ * written as is.  Writing stops at the first error, and later calls
+ * return it; since there is no gzFile, use util_error_string to
+ * describe it.  talloc_free the writer to stop its threads, after
+ * gz_writer_finish if the output is wanted.  The writer does not
+ * close 'fd'.
+ */
+typedef struct _gz_writer gz_writer_t;
+
+gz_writer_t *
+gz_writer_create (void *ctx, int fd, int compress);
+
+util_status_t
+gz_writer_write (gz_writer_t *writer, const char *buf, size_t len);
+
+util_status_t
+gz_writer_puts (gz_writer_t *writer, const char *str);
+
+/* Write out everything written so far. */
+util_status_t
+gz_writer_finish (gz_writer_t *writer);
+
+/* A line reader that decompresses 'stream' on a separate thread,
+ * ahead of the caller.
+ *
+ * gz_reader_getline behaves like gz_getline.  Errors are reported
+ * with gz_error_string on 'stream'.  talloc_free the reader before
+ * closing 'stream'.
+ */
+typedef struct _gz_reader gz_reader_t;
+
+gz_reader_t *
+gz_reader_create (void *ctx, gzFile stream);
+
+util_status_t
+gz_reader_getline (void *ctx, char **lineptr, ssize_t *bytes_read,
+		   gz_reader_t *reader);
 #endif